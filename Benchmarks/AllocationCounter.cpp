@@ -0,0 +1,59 @@
+//
+// AllocationCounter.cpp
+// Count the heap allocations made by the process, to report allocations per frame.
+//
+
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+namespace {
+std::atomic<uint64_t> gAllocations{ 0 };
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+} // extern "C"
+
+#endif
+
+namespace gimkit {
+namespace bench {
+
+bool allocationCountingSupported() {
+#if defined(__GLIBC__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t allocationCount() {
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+} // namespace bench
+} // namespace gimkit
@@ -0,0 +1,25 @@
+//
+// AllocationCounter.hpp
+// Count the heap allocations made by the process, to report allocations per frame.
+//
+#ifndef GIMKIT_ALLOCATIONCOUNTER_HPP
+#define GIMKIT_ALLOCATIONCOUNTER_HPP
+
+#include <cstdint>
+
+namespace gimkit {
+namespace bench {
+
+/**
+ * Whether allocations are counted at all. malloc(), calloc() and realloc() are interposed with glibc
+ * only; operator new ends up in malloc() there. Elsewhere the count stays at 0.
+ */
+bool allocationCountingSupported();
+
+/** Allocations since the start of the process */
+uint64_t allocationCount();
+
+} // namespace bench
+} // namespace gimkit
+
+#endif //GIMKIT_ALLOCATIONCOUNTER_HPP
@@ -0,0 +1,13 @@
+//
+// CoreHeaders.hpp
+// Include the GimKit core C headers from C++.
+//
+#ifndef GIMKIT_COREHEADERS_HPP
+#define GIMKIT_COREHEADERS_HPP
+
+#include "GKCore.hpp"
+#include "GKCapture.h"
+#include "GKLatency.h"
+#include "CountingSink.h"
+
+#endif //GIMKIT_COREHEADERS_HPP
@@ -0,0 +1,355 @@
+//
+// CountingSink.c
+// A GKMethodTable whose callbacks only count what they receive, for replays and benchmarks.
+//
+
+#include "CountingSink.h"
+
+#include "GKMethods.h"
+
+static inline CountingSink *sinkOf(const void *any) {
+    return (CountingSink *) any;
+}
+
+static inline void tally(const void *any, uint64_t *counter) {
+    sinkOf(any)->methods++;
+    (*counter)++;
+}
+
+static void onForwardFrameRequest(const void *any, const uint8_t *frame, size_t count) {
+    (void) frame;
+    (void) count;
+    tally(any, &sinkOf(any)->forwarded);
+}
+
+static void onReceivedMethodCrcError(const void *any, const uint8_t *frame, size_t count, uint16_t crcReceived, uint16_t crcCalculated) {
+    (void) frame;
+    (void) count;
+    (void) crcReceived;
+    (void) crcCalculated;
+    tally(any, &sinkOf(any)->crcErrors);
+}
+
+static void onReceivedMethodProtocolError(const void *any, const uint8_t *frame, size_t count) {
+    (void) frame;
+    (void) count;
+    tally(any, &sinkOf(any)->protocolErrors);
+}
+
+static void onMethodDisconnectBleInvoke(const void *any) {
+    tally(any, &sinkOf(any)->events);
+}
+
+static void onMethodNotifyKeyEventInvoke(const void *any, const KeyEvent * keyEvent, size_t count) {
+    (void) keyEvent;
+    (void) count;
+    tally(any, &sinkOf(any)->events);
+}
+
+static void onMethodNotifyBrakeEventInvoke(const void *any) {
+    tally(any, &sinkOf(any)->events);
+}
+
+static void onMethodNotifyGimKitDataInvoke(const void *any, const GimkitData *data) {
+    sinkOf(any)->checksum += data->power + data->cadence + data->speed;
+    tally(any, &sinkOf(any)->gimkitData);
+}
+
+static void onMethodNotifyKnobRotationInvoke(const void *any, int rotation) {
+    (void) rotation;
+    tally(any, &sinkOf(any)->events);
+}
+
+static void onMethodHandshakeReply(const void *any, const uint8_t *random, size_t count) {
+    (void) random;
+    (void) count;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodHandshakeReplyError(const void *any, int error) {
+    (void) error;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodVerifyMd5Reply(const void *any, uint8_t result) {
+    (void) result;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodVerifyMd5ReplyError(const void *any, int error, const uint8_t md5[16], size_t count) {
+    (void) error;
+    (void) md5;
+    (void) count;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodGetProtocolRevisionReply(const void *any, uint8_t revision) {
+    (void) revision;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodGetProtocolRevisionReplyError(const void *any, int error) {
+    (void) error;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodGetComponentSnReply(const void *any, const DeviceComponentInfo *info, size_t count) {
+    (void) info;
+    (void) count;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodGetComponentSnReplyError(const void *any, int error) {
+    (void) error;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodGetDeviceIdReply(const void *any, uint32_t deviceId) {
+    (void) deviceId;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodGetDeviceIdReplyError(const void *any, int error) {
+    (void) error;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodStatBikeReply(const void *any, uint8_t type, uint8_t voltage, uint8_t temperature, uint8_t powerSource) {
+    (void) type;
+    (void) voltage;
+    (void) temperature;
+    (void) powerSource;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodStatBikeReplyError(const void *any, int error) {
+    (void) error;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSwitchServiceModeReply(const void *any, uint8_t mode) {
+    (void) mode;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSwitchServiceModeReplyError(const void *any, int error, uint8_t mode) {
+    (void) error;
+    (void) mode;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSetConsoleStateReply(const void *any, uint16_t state) {
+    (void) state;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetConsoleStateReplyError(const void *any, int error, uint16_t state) {
+    (void) error;
+    (void) state;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSetRidingParamReply(const void *any, const RidingParams *rp) {
+    (void) rp;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetRidingParamReplyError(const void *any, int error, const RidingParams *rp) {
+    (void) error;
+    (void) rp;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSetTorqueReply(const void *any, uint8_t torque) {
+    (void) torque;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetTorqueReplyError(const void *any, int error, uint8_t torque) {
+    (void) error;
+    (void) torque;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSeizeKnobControlReply(const void *any, uint8_t mode) {
+    (void) mode;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSeizeKnobControlReplyError(const void *any, int error, uint8_t mode) {
+    (void) error;
+    (void) mode;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSetKnobDisplayModeReply(const void *any, uint8_t mode) {
+    (void) mode;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetKnobDisplayModeReplyError(const void *any, int error, uint8_t mode) {
+    (void) error;
+    (void) mode;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodSetErgModeReply(const void *any, uint8_t erg) {
+    (void) erg;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetErgModeReplyError(const void *any, int error, uint8_t erg) {
+    (void) error;
+    (void) erg;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodNotifyStrengthDataInvoke(const void *any, const StrengthData *data) {
+    sinkOf(any)->checksum += data->power;
+    tally(any, &sinkOf(any)->strengthData);
+}
+
+static void onMethodSetStrengthEquipmentModeReply(const void *any, const uint8_t *data, size_t count) {
+    (void) data;
+    (void) count;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetStrengthEquipmentModeReplyError(const void *any, int error, const uint8_t *data, size_t count) {
+    (void) error;
+    (void) data;
+    (void) count;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodNotifyRowermDataInvoke(const void *any, const RowermData *data) {
+    sinkOf(any)->checksum += data->power;
+    tally(any, &sinkOf(any)->rowermData);
+}
+
+static void onMethodSetRowermModeReply(const void *any, const uint8_t *data, size_t count) {
+    (void) data;
+    (void) count;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodSetRowermModeReplyError(const void *any, int error, const uint8_t *data, size_t count) {
+    (void) error;
+    (void) data;
+    (void) count;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodNotifyXbikeDataInvoke(const void *any, const XbikeData *data) {
+    sinkOf(any)->checksum += data->power;
+    tally(any, &sinkOf(any)->xbikeData);
+}
+
+static void onMethodMcFirmwareInfoReply(const void *any, uint8_t result) {
+    (void) result;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodMcFirmwareInfoReplyError(const void *any, int error, uint8_t result) {
+    (void) error;
+    (void) result;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodGetMtuReply(const void *any, uint8_t size) {
+    (void) size;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodGetMtuReplyError(const void *any, int error, uint8_t size) {
+    (void) error;
+    (void) size;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodMcFirmwareContentReply(const void *any, uint8_t result) {
+    (void) result;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodMcFirmwareContentReplyError(const void *any, int error, uint8_t result) {
+    (void) error;
+    (void) result;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodMcFirmwareTransferEndReply(const void *any, uint8_t result) {
+    (void) result;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodMcFirmwareTransferEndReplyError(const void *any, int error, uint8_t result) {
+    (void) error;
+    (void) result;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+static void onMethodMcFirmwareResultReply(const void *any, uint8_t result) {
+    (void) result;
+    tally(any, &sinkOf(any)->replies);
+}
+
+static void onMethodMcFirmwareResultReplyError(const void *any, int error, uint8_t result) {
+    (void) error;
+    (void) result;
+    tally(any, &sinkOf(any)->replyErrors);
+}
+
+void counting_sink_init_table(struct GKMethodTable *table) {
+    table->onForwardFrameRequest = onForwardFrameRequest;
+    table->onReceivedMethodCrcError = onReceivedMethodCrcError;
+    table->onReceivedMethodProtocolError = onReceivedMethodProtocolError;
+    table->onMethodDisconnectBleInvoke = onMethodDisconnectBleInvoke;
+    table->onMethodNotifyKeyEventInvoke = onMethodNotifyKeyEventInvoke;
+    table->onMethodNotifyBrakeEventInvoke = onMethodNotifyBrakeEventInvoke;
+    table->onMethodNotifyGimKitDataInvoke = onMethodNotifyGimKitDataInvoke;
+    table->onMethodNotifyKnobRotationInvoke = onMethodNotifyKnobRotationInvoke;
+    table->onMethodHandshakeReply = onMethodHandshakeReply;
+    table->onMethodHandshakeReplyError = onMethodHandshakeReplyError;
+    table->onMethodVerifyMd5Reply = onMethodVerifyMd5Reply;
+    table->onMethodVerifyMd5ReplyError = onMethodVerifyMd5ReplyError;
+    table->onMethodGetProtocolRevisionReply = onMethodGetProtocolRevisionReply;
+    table->onMethodGetProtocolRevisionReplyError = onMethodGetProtocolRevisionReplyError;
+    table->onMethodGetComponentSnReply = onMethodGetComponentSnReply;
+    table->onMethodGetComponentSnReplyError = onMethodGetComponentSnReplyError;
+    table->onMethodGetDeviceIdReply = onMethodGetDeviceIdReply;
+    table->onMethodGetDeviceIdReplyError = onMethodGetDeviceIdReplyError;
+    table->onMethodStatBikeReply = onMethodStatBikeReply;
+    table->onMethodStatBikeReplyError = onMethodStatBikeReplyError;
+    table->onMethodSwitchServiceModeReply = onMethodSwitchServiceModeReply;
+    table->onMethodSwitchServiceModeReplyError = onMethodSwitchServiceModeReplyError;
+    table->onMethodSetConsoleStateReply = onMethodSetConsoleStateReply;
+    table->onMethodSetConsoleStateReplyError = onMethodSetConsoleStateReplyError;
+    table->onMethodSetRidingParamReply = onMethodSetRidingParamReply;
+    table->onMethodSetRidingParamReplyError = onMethodSetRidingParamReplyError;
+    table->onMethodSetTorqueReply = onMethodSetTorqueReply;
+    table->onMethodSetTorqueReplyError = onMethodSetTorqueReplyError;
+    table->onMethodSeizeKnobControlReply = onMethodSeizeKnobControlReply;
+    table->onMethodSeizeKnobControlReplyError = onMethodSeizeKnobControlReplyError;
+    table->onMethodSetKnobDisplayModeReply = onMethodSetKnobDisplayModeReply;
+    table->onMethodSetKnobDisplayModeReplyError = onMethodSetKnobDisplayModeReplyError;
+    table->onMethodSetErgModeReply = onMethodSetErgModeReply;
+    table->onMethodSetErgModeReplyError = onMethodSetErgModeReplyError;
+    table->onMethodNotifyStrengthDataInvoke = onMethodNotifyStrengthDataInvoke;
+    table->onMethodSetStrengthEquipmentModeReply = onMethodSetStrengthEquipmentModeReply;
+    table->onMethodSetStrengthEquipmentModeReplyError = onMethodSetStrengthEquipmentModeReplyError;
+    table->onMethodNotifyRowermDataInvoke = onMethodNotifyRowermDataInvoke;
+    table->onMethodSetRowermModeReply = onMethodSetRowermModeReply;
+    table->onMethodSetRowermModeReplyError = onMethodSetRowermModeReplyError;
+    table->onMethodNotifyXbikeDataInvoke = onMethodNotifyXbikeDataInvoke;
+    table->onMethodMcFirmwareInfoReply = onMethodMcFirmwareInfoReply;
+    table->onMethodMcFirmwareInfoReplyError = onMethodMcFirmwareInfoReplyError;
+    table->onMethodGetMtuReply = onMethodGetMtuReply;
+    table->onMethodGetMtuReplyError = onMethodGetMtuReplyError;
+    table->onMethodMcFirmwareContentReply = onMethodMcFirmwareContentReply;
+    table->onMethodMcFirmwareContentReplyError = onMethodMcFirmwareContentReplyError;
+    table->onMethodMcFirmwareTransferEndReply = onMethodMcFirmwareTransferEndReply;
+    table->onMethodMcFirmwareTransferEndReplyError = onMethodMcFirmwareTransferEndReplyError;
+    table->onMethodMcFirmwareResultReply = onMethodMcFirmwareResultReply;
+    table->onMethodMcFirmwareResultReplyError = onMethodMcFirmwareResultReplyError;
+}
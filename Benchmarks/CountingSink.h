@@ -0,0 +1,48 @@
+//
+// CountingSink.h
+// A GKMethodTable whose callbacks only count what they receive, for replays and benchmarks.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_COUNTINGSINK_H
+#define GIMKIT_COUNTINGSINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct GKMethodTable;
+
+typedef struct CountingSink {
+    /** Every callback, whatever the method */
+    uint64_t methods;
+    uint64_t gimkitData;
+    uint64_t strengthData;
+    uint64_t rowermData;
+    uint64_t xbikeData;
+    /** Other device invoked methods: key, brake, knob, disconnect */
+    uint64_t events;
+    uint64_t replies;
+    uint64_t replyErrors;
+    uint64_t forwarded;
+    uint64_t crcErrors;
+    uint64_t protocolErrors;
+    /** Sum of a few telemetry values, so the work can't be optimized out and runs can be compared */
+    uint64_t checksum;
+} CountingSink;
+
+/***
+ * Fill every callback of 'table'. The 'any' pointer handed to #disassembleMethod() must be a CountingSink.
+ */
+void counting_sink_init_table(struct GKMethodTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_COUNTINGSINK_H
@@ -0,0 +1,210 @@
+//
+// LoadGenerator.cpp
+// Synthetic notification traffic of many simulated devices, built from recorded captures.
+//
+
+#include "LoadGenerator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+
+#include "CoreHeaders.hpp"
+
+namespace gimkit {
+namespace bench {
+
+namespace {
+
+constexpr size_t kSeedMaxFrameDataSize = 512;
+
+struct SeedContext {
+    GKMethodTable table;
+    CountingSink sink;
+    /** Forwards to 'table', reporting the replies to onSeedReply() */
+    GKLatencyTap tap;
+    /** opid + 1 of the method the frame being decoded replies to, 0 if it is no reply */
+    uint16_t replyOpid;
+    const StreamType *only;
+    std::array<std::vector<std::vector<uint8_t>>, kStreamTypeCount> *frames;
+    std::vector<uint8_t> *replyOpids;
+    long added;
+};
+
+void onSeedReply(const GKLatencyTap *tap, uint8_t opid) {
+    static_cast<SeedContext *>(tap->context)->replyOpid = static_cast<uint16_t>(opid + 1);
+}
+
+bool classify(const CountingSink &before, const CountingSink &after, bool reply, StreamType &type) {
+    if (after.gimkitData != before.gimkitData) {
+        type = StreamType::GimKit;
+    } else if (after.strengthData != before.strengthData) {
+        type = StreamType::Strength;
+    } else if (after.rowermData != before.rowermData) {
+        type = StreamType::Rowerm;
+    } else if (after.xbikeData != before.xbikeData) {
+        type = StreamType::Xbike;
+    } else if (reply) {
+        type = StreamType::Reply;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void onSeedFrame(const struct slip_dev_t *, const uint8_t *buf, size_t length, slip_dev_status_t status,
+                 const void *any) {
+    auto *context = static_cast<SeedContext *>(const_cast<void *>(any));
+    if (status != SDS_OK || !length) {
+        return;
+    }
+    CountingSink before = context->sink;
+    context->replyOpid = 0;
+    disassembleMethod(&context->tap, gk_latency_tap_table(), buf, length);
+    StreamType type;
+    if (!classify(before, context->sink, context->replyOpid != 0, type)) {
+        return;
+    }
+    if (context->only ? *context->only != type : type == StreamType::Reply) {
+        return;
+    }
+    (*context->frames)[static_cast<size_t>(type)].emplace_back(buf, buf + length);
+    if (type == StreamType::Reply) {
+        context->replyOpids->push_back(static_cast<uint8_t>(context->replyOpid - 1));
+    }
+    context->added++;
+}
+
+} // namespace
+
+const char *streamTypeName(StreamType type) {
+    switch (type) {
+        case StreamType::GimKit:
+            return "gimkit";
+        case StreamType::Strength:
+            return "strength";
+        case StreamType::Rowerm:
+            return "rowerm";
+        case StreamType::Xbike:
+            return "xbike";
+        case StreamType::Reply:
+            return "reply";
+    }
+    return "unknown";
+}
+
+bool parseStreamType(const std::string &name, StreamType &type) {
+    for (size_t i = 0; i < kStreamTypeCount; i++) {
+        if (name == streamTypeName(static_cast<StreamType>(i))) {
+            type = static_cast<StreamType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+long SeedPool::addCapture(const std::string &path, const StreamType *only) {
+    struct gk_capture_reader *reader = gk_capture_open_reader(path.c_str());
+    if (!reader) {
+        return -1;
+    }
+    std::vector<uint8_t> memory(sd_get_required_memory_size(kSeedMaxFrameDataSize));
+    auto *sd = reinterpret_cast<struct slip_dev_t *>(memory.data());
+    if (memory.empty() || sd_init_device(sd, kSeedMaxFrameDataSize) != SDS_OK) {
+        gk_capture_close_reader(reader);
+        return -1;
+    }
+
+    SeedContext context = {};
+    counting_sink_init_table(&context.table);
+    context.tap = { &context.table, &context.sink, onSeedReply, &context };
+    context.only = only;
+    context.frames = &frames_;
+    context.replyOpids = &replyOpids_;
+    GKCaptureRecord record;
+    while (gk_capture_next(reader, &record) == GK_CAPTURE_OK) {
+        if (record.direction == GK_CAPTURE_FROM_DEVICE) {
+            sd_decode_frame(sd, record.data, record.length, onSeedFrame, &context);
+        }
+    }
+    sd_deinit_device(sd);
+    gk_capture_close_reader(reader);
+    return context.added;
+}
+
+bool SeedPool::empty() const {
+    return std::all_of(frames_.begin(), frames_.end(), [](const auto &frames) { return frames.empty(); });
+}
+
+LoadGenerator::LoadGenerator(const SeedPool &seeds, const LoadConfig &config) : config_(config) {
+    if (config_.mtu == 0) {
+        config_.mtu = 20;
+    }
+
+    // Lay out every seed frame once, raw and SLIP encoded, grouped by stream type.
+    std::array<uint32_t, kStreamTypeCount> firstFrame = {};
+    std::array<uint32_t, kStreamTypeCount> frameCount = {};
+    std::vector<StreamType> seeded;
+    std::vector<uint8_t> encoded;
+    for (size_t t = 0; t < kStreamTypeCount; t++) {
+        const auto &frames = seeds.frames(static_cast<StreamType>(t));
+        firstFrame[t] = static_cast<uint32_t>(frames_.size());
+        frameCount[t] = static_cast<uint32_t>(frames.size());
+        if (!frames.empty()) {
+            seeded.push_back(static_cast<StreamType>(t));
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            const auto &rawFrame = frames[i];
+            encoded.resize(rawFrame.size() * 2 + 2);
+            size_t wireLength = sd_encode_frame_to_buffer(rawFrame.data(), rawFrame.size(), encoded.data(), encoded.size());
+            Frame frame;
+            frame.rawOffset = static_cast<uint32_t>(raw_.size());
+            frame.rawLength = static_cast<uint32_t>(rawFrame.size());
+            frame.wireOffset = static_cast<uint32_t>(wire_.size());
+            frame.wireLength = static_cast<uint32_t>(wireLength);
+            frame.replyOpid = static_cast<StreamType>(t) == StreamType::Reply ? seeds.replyOpids()[i] : 0;
+            raw_.insert(raw_.end(), rawFrame.begin(), rawFrame.end());
+            wire_.insert(wire_.end(), encoded.begin(), encoded.begin() + static_cast<long>(wireLength));
+            frames_.push_back(frame);
+            maxFrameSize_ = std::max(maxFrameSize_, rawFrame.size());
+        }
+    }
+    if (seeded.empty() || config_.devices == 0) {
+        return;
+    }
+
+    std::mt19937_64 random(config_.seed);
+    std::vector<double> phases(config_.devices);
+    std::vector<uint32_t> cursors(config_.devices);
+    deviceTypes_.resize(config_.devices);
+    for (uint32_t d = 0; d < config_.devices; d++) {
+        StreamType type = seeded[d % seeded.size()];
+        deviceTypes_[d] = type;
+        phases[d] = std::uniform_real_distribution<double>(0, 1)(random);
+        cursors[d] = static_cast<uint32_t>(random() % frameCount[static_cast<size_t>(type)]);
+    }
+
+    // All the devices share one period, so ordering them by phase once orders every tick.
+    std::vector<uint32_t> order(config_.devices);
+    for (uint32_t d = 0; d < config_.devices; d++) {
+        order[d] = d;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return phases[a] < phases[b]; });
+
+    auto ticks = static_cast<uint64_t>(config_.rateHz * config_.seconds);
+    schedule_.reserve(ticks * config_.devices);
+    for (uint64_t tick = 0; tick < ticks; tick++) {
+        for (uint32_t d : order) {
+            auto t = static_cast<size_t>(deviceTypes_[d]);
+            uint32_t index = firstFrame[t] + cursors[d];
+            cursors[d] = (cursors[d] + 1) % frameCount[t];
+            schedule_.push_back({ d, index });
+            uint32_t wireLength = frames_[index].wireLength;
+            wireBytes_ += wireLength;
+            notifications_ += (wireLength + config_.mtu - 1) / config_.mtu;
+        }
+    }
+}
+
+} // namespace bench
+} // namespace gimkit
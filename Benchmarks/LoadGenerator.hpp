@@ -0,0 +1,140 @@
+//
+// LoadGenerator.hpp
+// Synthetic notification traffic of many simulated devices, built from recorded captures.
+//
+#ifndef GIMKIT_LOADGENERATOR_HPP
+#define GIMKIT_LOADGENERATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gimkit {
+namespace bench {
+
+/** The telemetry streams a device can produce, one per data callback of the method table */
+enum class StreamType : uint8_t {
+    GimKit,
+    Strength,
+    Rowerm,
+    Xbike,
+    /** The replies to the host invoked methods, kept from the seeds of this type only */
+    Reply,
+};
+
+constexpr size_t kStreamTypeCount = 5;
+
+const char *streamTypeName(StreamType type);
+
+bool parseStreamType(const std::string &name, StreamType &type);
+
+/**
+ * Decoded method frames taken from captures, classified by the telemetry callback they trigger.
+ * Frames triggering no telemetry callback (key events...) are not kept, nor replies unless asked for.
+ */
+class SeedPool {
+public:
+    /**
+     * Decode the device to host records of a capture and keep its telemetry frames.
+     * If 'only' is not null, frames of other stream types are dropped: the replies are kept if it is
+     * StreamType::Reply.
+     * @return the number of frames added, -1 if the capture can't be read.
+     */
+    long addCapture(const std::string &path, const StreamType *only = nullptr);
+
+    const std::vector<std::vector<uint8_t>> &frames(StreamType type) const {
+        return frames_[static_cast<size_t>(type)];
+    }
+
+    /** The opid of the method each frame of StreamType::Reply replies to */
+    const std::vector<uint8_t> &replyOpids() const { return replyOpids_; }
+
+    bool empty() const;
+
+private:
+    std::array<std::vector<std::vector<uint8_t>>, kStreamTypeCount> frames_;
+    std::vector<uint8_t> replyOpids_;
+};
+
+struct LoadConfig {
+    /** Simulated devices, stream types are assigned round robin among the seeded ones */
+    uint32_t devices = 16;
+    /** Notification rate of every device */
+    double rateHz = 20;
+    /** Simulated duration */
+    double seconds = 10;
+    /** Largest notification payload, longer SLIP frames are split over several notifications */
+    uint32_t mtu = 20;
+    /** Seed of the phase of every device, runs with the same seed produce the same traffic */
+    uint64_t seed = 1;
+};
+
+/**
+ * The traffic of one run, laid out up front so replaying it allocates nothing and costs nothing but
+ * the work under measurement.
+ * <p/>
+ * Every seed frame is SLIP encoded once and split into notifications of at most 'mtu' bytes. The
+ * schedule interleaves the devices in simulated time order: each device starts at a random phase and
+ * then emits its stream's frames in a loop, one every 1 / rateHz seconds.
+ */
+class LoadGenerator {
+public:
+    struct Frame {
+        /** The decoded method frame, as disassembleMethod() expects it */
+        uint32_t rawOffset;
+        uint32_t rawLength;
+        /** The SLIP encoded frame */
+        uint32_t wireOffset;
+        uint32_t wireLength;
+        /** The opid of the method the frame replies to, 0 for telemetry */
+        uint8_t replyOpid;
+    };
+
+    struct Event {
+        uint32_t device;
+        uint32_t frame;
+    };
+
+    LoadGenerator(const SeedPool &seeds, const LoadConfig &config);
+
+    const LoadConfig &config() const { return config_; }
+
+    uint32_t deviceCount() const { return static_cast<uint32_t>(deviceTypes_.size()); }
+
+    StreamType deviceType(uint32_t device) const { return deviceTypes_[device]; }
+
+    const std::vector<Event> &schedule() const { return schedule_; }
+
+    const Frame &frame(uint32_t index) const { return frames_[index]; }
+
+    const uint8_t *raw(const Frame &frame) const { return raw_.data() + frame.rawOffset; }
+
+    const uint8_t *wire(const Frame &frame) const { return wire_.data() + frame.wireOffset; }
+
+    /** Bytes of SLIP encoded traffic in the whole schedule */
+    uint64_t wireBytes() const { return wireBytes_; }
+
+    /** Notifications in the whole schedule */
+    uint64_t notifications() const { return notifications_; }
+
+    /** Largest decoded frame, for sizing the slip devices */
+    size_t maxFrameSize() const { return maxFrameSize_; }
+
+private:
+    LoadConfig config_;
+    std::vector<StreamType> deviceTypes_;
+    std::vector<Frame> frames_;
+    std::vector<uint8_t> raw_;
+    std::vector<uint8_t> wire_;
+    std::vector<Event> schedule_;
+    uint64_t wireBytes_ = 0;
+    uint64_t notifications_ = 0;
+    size_t maxFrameSize_ = 0;
+};
+
+} // namespace bench
+} // namespace gimkit
+
+#endif //GIMKIT_LOADGENERATOR_HPP
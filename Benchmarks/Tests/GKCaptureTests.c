@@ -0,0 +1,257 @@
+//
+// GKCaptureTests.c
+// GKCapture files written and read back: closed, left unclosed, sought, and with a damaged footer.
+//
+
+#include "GKCapture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "GKTestSupport.h"
+
+#define RECORDS (2 * GK_CAPTURE_INDEX_INTERVAL + 500)
+#define FOOTER_SIZE 16
+#define INDEX_ENTRY_SIZE 24
+
+static char sPath[64];
+static char sCopyPath[64];
+
+static uint64_t timestampOf(uint64_t ordinal) {
+    return ordinal * 10 + ordinal % 3;
+}
+
+static size_t lengthOf(uint64_t ordinal) {
+    return (size_t) (ordinal % 7);
+}
+
+static void writeCapture(void) {
+    struct gk_capture_writer *writer = gk_capture_open_writer(sPath);
+    CHECK(writer);
+    uint8_t payload[8];
+    for (uint64_t i = 0; writer && i < RECORDS; i++) {
+        for (size_t j = 0; j < lengthOf(i); j++) {
+            payload[j] = (uint8_t) (i + j);
+        }
+        GKCaptureDirection direction = i % 2 ? GK_CAPTURE_FROM_DEVICE : GK_CAPTURE_TO_DEVICE;
+        CHECK_EQ(GK_CAPTURE_OK, gk_capture_write_at(writer, direction, timestampOf(i), payload, lengthOf(i)));
+    }
+    CHECK_EQ(GK_CAPTURE_OK, gk_capture_close_writer(writer));
+}
+
+/** The file at 'path', to be freed */
+static uint8_t *load(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (size_t) ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*size);
+    if (data && fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static void store(const char *path, const uint8_t *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    CHECK(file && fwrite(data, 1, size, file) == size);
+    if (file) {
+        fclose(file);
+    }
+}
+
+static uint64_t indexOffsetOf(const uint8_t *data, size_t size) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | data[size - 8 + i];
+    return value;
+}
+
+/** Offset of the first index entry of a closed capture */
+static size_t firstEntryOf(const uint8_t *data, size_t size) {
+    size_t position = (size_t) indexOffsetOf(data, size) + 1;
+    for (int varints = 0; varints < 3; position++) {
+        if (!(data[position] & 0x80)) {
+            varints++;
+        }
+    }
+    return position;
+}
+
+/** Read 'reader' to its end from the current record, expected to be 'first' */
+static void checkRecords(struct gk_capture_reader *reader, uint64_t first, uint64_t last) {
+    GKCaptureRecord record;
+    for (uint64_t i = first; i < last; i++) {
+        if (gk_capture_next(reader, &record) != GK_CAPTURE_OK) {
+            CHECK_EQ(i, last);
+            return;
+        }
+        CHECK_EQ(i, record.ordinal);
+        CHECK_EQ(i % 2 ? GK_CAPTURE_FROM_DEVICE : GK_CAPTURE_TO_DEVICE, record.direction);
+        CHECK_EQ(timestampOf(i), record.timestamp);
+        CHECK_EQ(lengthOf(i), record.length);
+        for (size_t j = 0; j < record.length; j++) {
+            CHECK_EQ((uint8_t) (i + j), record.data[j]);
+        }
+    }
+    CHECK_EQ(GK_CAPTURE_END, gk_capture_next(reader, &record));
+}
+
+static void checkSeek(struct gk_capture_reader *reader, uint64_t last) {
+    GKCaptureRecord record;
+    const uint64_t targets[] = { 0, 1, GK_CAPTURE_INDEX_INTERVAL - 1, GK_CAPTURE_INDEX_INTERVAL,
+                                 GK_CAPTURE_INDEX_INTERVAL + 1, 2 * GK_CAPTURE_INDEX_INTERVAL + 7, last - 1 };
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        uint64_t ordinal = targets[i];
+        // On a record, then between it and the one before
+        CHECK_EQ(GK_CAPTURE_OK, gk_capture_seek(reader, timestampOf(ordinal)));
+        CHECK(gk_capture_next(reader, &record) == GK_CAPTURE_OK && record.ordinal == ordinal);
+        CHECK_EQ(timestampOf(ordinal), record.timestamp);
+        if (ordinal) {
+            CHECK_EQ(GK_CAPTURE_OK, gk_capture_seek(reader, timestampOf(ordinal - 1) + 1));
+            CHECK(gk_capture_next(reader, &record) == GK_CAPTURE_OK && record.ordinal == ordinal);
+        }
+    }
+    CHECK_EQ(GK_CAPTURE_OK, gk_capture_seek(reader, timestampOf(last - 5)));
+    checkRecords(reader, last - 5, last);
+    CHECK_EQ(GK_CAPTURE_END, gk_capture_seek(reader, timestampOf(last - 1) + 1));
+    CHECK_EQ(GK_CAPTURE_END, gk_capture_next(reader, &record));
+}
+
+/** A capture whose records are all readable, whatever its trailer */
+static void checkReadable(const char *path, uint64_t last) {
+    struct gk_capture_reader *reader = gk_capture_open_reader(path);
+    CHECK(reader);
+    if (!reader) {
+        return;
+    }
+    CHECK_EQ(last, gk_capture_record_count(reader));
+    CHECK_EQ(timestampOf(last - 1), gk_capture_duration(reader));
+    checkRecords(reader, 0, last);
+    checkSeek(reader, last);
+    gk_capture_close_reader(reader);
+}
+
+static void testRoundTrip(void) {
+    writeCapture();
+    struct gk_capture_reader *reader = gk_capture_open_reader(sPath);
+    CHECK(reader);
+    if (!reader) {
+        return;
+    }
+    CHECK(gk_capture_start_time(reader) > 0);
+    CHECK_EQ(RECORDS, gk_capture_record_count(reader));
+    CHECK_EQ(timestampOf(RECORDS - 1), gk_capture_duration(reader));
+    checkRecords(reader, 0, RECORDS);
+    gk_capture_rewind(reader);
+    checkRecords(reader, 0, RECORDS);
+    gk_capture_close_reader(reader);
+}
+
+static void testSeek(void) {
+    checkReadable(sPath, RECORDS);
+}
+
+static void testUnclosed(void) {
+    size_t size;
+    uint8_t *data = load(sPath, &size);
+    CHECK(data);
+    if (!data) {
+        return;
+    }
+    size_t indexOffset = (size_t) indexOffsetOf(data, size);
+    // Killed before the close: the records only
+    store(sCopyPath, data, indexOffset);
+    checkReadable(sCopyPath, RECORDS);
+    // Killed while writing the last record
+    store(sCopyPath, data, indexOffset - 2);
+    checkReadable(sCopyPath, RECORDS - 1);
+    free(data);
+}
+
+static void testDamagedFooter(void) {
+    size_t size;
+    uint8_t *data = load(sPath, &size);
+    CHECK(data);
+    if (!data) {
+        return;
+    }
+    uint8_t *copy = malloc(size);
+    size_t entry = firstEntryOf(data, size);
+
+    // Truncated in the footer, or in the index
+    store(sCopyPath, data, size - 5);
+    checkReadable(sCopyPath, RECORDS);
+    store(sCopyPath, data, entry + INDEX_ENTRY_SIZE + 3);
+    checkReadable(sCopyPath, RECORDS);
+
+    // The index offset past the end of the file, then on a record
+    memcpy(copy, data, size);
+    copy[size - 1] = 0x7F;
+    store(sCopyPath, copy, size);
+    checkReadable(sCopyPath, RECORDS);
+    memcpy(copy, data, size);
+    memset(copy + size - 8, 0, 8);
+    copy[size - 8] = 20;
+    store(sCopyPath, copy, size);
+    checkReadable(sCopyPath, RECORDS);
+
+    // An index entry out of the records, then out of order
+    memcpy(copy, data, size);
+    memset(copy + entry + INDEX_ENTRY_SIZE, 0xFF, 8);
+    store(sCopyPath, copy, size);
+    checkReadable(sCopyPath, RECORDS);
+    memcpy(copy, data, size);
+    memcpy(copy + entry + INDEX_ENTRY_SIZE, data + entry, INDEX_ENTRY_SIZE);
+    store(sCopyPath, copy, size);
+    checkReadable(sCopyPath, RECORDS);
+
+    // Not a capture
+    memcpy(copy, data, size);
+    copy[0] = 'X';
+    store(sCopyPath, copy, size);
+    CHECK(!gk_capture_open_reader(sCopyPath));
+    store(sCopyPath, data, 10);
+    CHECK(!gk_capture_open_reader(sCopyPath));
+    free(copy);
+    free(data);
+}
+
+static void testBadRecord(void) {
+    size_t size;
+    uint8_t *data = load(sPath, &size);
+    CHECK(data);
+    if (!data) {
+        return;
+    }
+    // The direction of the 4th record: the records before it are 3, 4 and 5 bytes long
+    data[16 + 3 + 4 + 5] = 7;
+    store(sCopyPath, data, size);
+    struct gk_capture_reader *reader = gk_capture_open_reader(sCopyPath);
+    CHECK(reader);
+    GKCaptureRecord record;
+    for (int i = 0; reader && i < 3; i++) {
+        CHECK_EQ(GK_CAPTURE_OK, gk_capture_next(reader, &record));
+    }
+    CHECK_EQ(GK_CAPTURE_BAD_RECORD, gk_capture_next(reader, &record));
+    gk_capture_close_reader(reader);
+    free(data);
+}
+
+int main(void) {
+    snprintf(sPath, sizeof(sPath), "gk_capture_tests_%ld.gkcap", (long) getpid());
+    snprintf(sCopyPath, sizeof(sCopyPath), "gk_capture_tests_%ld_copy.gkcap", (long) getpid());
+    RUN(testRoundTrip);
+    RUN(testSeek);
+    RUN(testUnclosed);
+    RUN(testDamagedFooter);
+    RUN(testBadRecord);
+    remove(sPath);
+    remove(sCopyPath);
+    return TEST_RESULT();
+}
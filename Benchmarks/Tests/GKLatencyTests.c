@@ -0,0 +1,183 @@
+//
+// GKLatencyTests.c
+// The histogram figures of GKLatency: quantiles, clamping, invoke / reply matching and the tap table.
+//
+
+#include "GKLatency.h"
+#include "GKMethods.h"
+#include "GKTestSupport.h"
+
+#define SET_TORQUE 0x44
+#define HANDSHAKE 0xA0
+#define NOTIFY_GIMKIT_DATA 0x50
+
+static void testExactBelowSubBuckets(void) {
+    gk_latency_reset_all();
+    for (uint64_t micros = 1; micros <= 100; micros++) {
+        CHECK(gk_latency_record(SET_TORQUE, micros));
+    }
+    // Values under 2^GK_LATENCY_SUB_BUCKET_BITS have a bucket each.
+    CHECK_EQ(50, gk_latency_quantile(SET_TORQUE, 0.50));
+    CHECK_EQ(10, gk_latency_quantile(SET_TORQUE, 0.10));
+    // 99 shares its bucket with 98, whose upper bound it is.
+    CHECK_EQ(99, gk_latency_quantile(SET_TORQUE, 0.99));
+    // 100 shares its bucket with 101: the quantile is clamped to the largest value recorded.
+    CHECK_EQ(100, gk_latency_quantile(SET_TORQUE, 1.0));
+
+    GKLatencySummary summary;
+    CHECK(gk_latency_get_summary(SET_TORQUE, &summary));
+    CHECK_EQ(100, summary.count);
+    CHECK_EQ(1, summary.min);
+    CHECK_EQ(100, summary.max);
+    CHECK(summary.mean == 50.5);
+    CHECK_EQ(50, summary.p50);
+    CHECK_EQ(99, summary.p99);
+    CHECK(summary.name && summary.name[0] == 'S');
+}
+
+static void testQuantileOutOfRange(void) {
+    gk_latency_reset_all();
+    CHECK_EQ(0, gk_latency_quantile(SET_TORQUE, 0.5));
+    gk_latency_record(SET_TORQUE, 7);
+    gk_latency_record(SET_TORQUE, 3000);
+    CHECK_EQ(7, gk_latency_quantile(SET_TORQUE, -1));
+    CHECK_EQ(7, gk_latency_quantile(SET_TORQUE, 0));
+    CHECK_EQ(3000, gk_latency_quantile(SET_TORQUE, 2));
+}
+
+static void testRelativeError(void) {
+    const uint64_t values[] = { 64, 65, 127, 128, 1000, 4095, 65537, 1000000, 123456789, UINT32_MAX };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        gk_latency_reset_all();
+        // A bigger value makes the max clamp irrelevant, the bucket upper bound is read.
+        gk_latency_record(HANDSHAKE, values[i]);
+        gk_latency_record(HANDSHAKE, UINT32_MAX);
+        uint64_t upper = gk_latency_quantile(HANDSHAKE, 0.5);
+        CHECK(upper >= values[i]);
+        CHECK(upper - values[i] <= values[i] >> (GK_LATENCY_SUB_BUCKET_BITS - 1));
+    }
+}
+
+static void testClampAboveUInt32(void) {
+    gk_latency_reset_all();
+    const uint64_t huge = 5000000000ull;
+    CHECK(gk_latency_record(SET_TORQUE, huge));
+    GKLatencySummary summary;
+    CHECK(gk_latency_get_summary(SET_TORQUE, &summary));
+    // Counted in the last bucket, whose upper bound is UINT32_MAX, but min, max and mean are exact.
+    CHECK_EQ(UINT32_MAX, summary.p50);
+    CHECK_EQ(huge, summary.max);
+    CHECK_EQ(huge, summary.min);
+    CHECK(summary.mean == (double) huge);
+}
+
+static void testInvokeReply(void) {
+    gk_latency_reset_all();
+    CHECK(!gk_latency_mark_reply(SET_TORQUE));
+    CHECK(gk_latency_mark_invoke(SET_TORQUE));
+    CHECK(gk_latency_mark_reply(SET_TORQUE));
+    CHECK(!gk_latency_mark_reply(SET_TORQUE));
+
+    CHECK(gk_latency_mark_invoke(SET_TORQUE));
+    CHECK(gk_latency_mark_invoke(SET_TORQUE));
+    CHECK(gk_latency_mark_reply(SET_TORQUE));
+
+    GKLatencySummary summary;
+    CHECK(gk_latency_get_summary(SET_TORQUE, &summary));
+    CHECK_EQ(2, summary.count);
+    CHECK_EQ(1, summary.overlapped);
+
+    // The device invokes NOTIFY_GIMKIT_DATA, 0x01 is no method.
+    CHECK(!gk_latency_mark_invoke(NOTIFY_GIMKIT_DATA));
+    CHECK(!gk_latency_record(0x01, 10));
+    CHECK(!gk_latency_get_summary(0x01, &summary));
+
+    gk_latency_set_enabled(false);
+    CHECK(!gk_latency_mark_invoke(SET_TORQUE));
+    CHECK(!gk_latency_record(SET_TORQUE, 10));
+    gk_latency_set_enabled(true);
+}
+
+static void testMethodEnumeration(void) {
+    bool torque = false;
+    for (size_t i = 0; i < gk_latency_method_count(); i++) {
+        uint8_t opid = gk_latency_method_opid(i);
+        CHECK(opid != NOTIFY_GIMKIT_DATA);
+        torque = torque || opid == SET_TORQUE;
+    }
+    CHECK(torque);
+}
+
+typedef struct TapSink {
+    int torqueReplies;
+    uint8_t torque;
+    int gimkitData;
+    const void *any;
+} TapSink;
+
+static void onTorqueReply(const void *any, uint8_t torque) {
+    TapSink *sink = (TapSink *) any;
+    sink->torqueReplies++;
+    sink->torque = torque;
+    sink->any = any;
+}
+
+static void onGimKitData(const void *any, const GimkitData *data) {
+    (void) data;
+    ((TapSink *) any)->gimkitData++;
+}
+
+static int sTapReplies;
+static uint8_t sTapOpid;
+
+static void onTapReply(const GKLatencyTap *tap, uint8_t opid) {
+    (void) tap;
+    sTapReplies++;
+    sTapOpid = opid;
+}
+
+static void testTap(void) {
+    GKMethodTable table = { 0 };
+    table.onMethodSetTorqueReply = onTorqueReply;
+    table.onMethodNotifyGimKitDataInvoke = onGimKitData;
+    TapSink sink = { 0 };
+    GKLatencyTap tap = { &table, &sink, onTapReply, NULL };
+    const GKMethodTable *tapped = gk_latency_tap_table();
+
+    GimkitData data = { 0 };
+    tapped->onMethodNotifyGimKitDataInvoke(&tap, &data);
+    CHECK_EQ(1, sink.gimkitData);
+    CHECK_EQ(0, sTapReplies);
+
+    tapped->onMethodSetTorqueReply(&tap, 42);
+    CHECK_EQ(1, sink.torqueReplies);
+    CHECK_EQ(42, sink.torque);
+    CHECK(sink.any == &sink);
+    CHECK_EQ(1, sTapReplies);
+    CHECK_EQ(SET_TORQUE, sTapOpid);
+
+    // Not forwarded, the tapped table leaves it NULL, but still a reply.
+    tapped->onMethodHandshakeReplyError(&tap, 1);
+    CHECK_EQ(2, sTapReplies);
+    CHECK_EQ(HANDSHAKE, sTapOpid);
+
+    // Without onReply, the reply ends the invocation in flight.
+    gk_latency_reset_all();
+    tap.onReply = NULL;
+    gk_latency_mark_invoke(SET_TORQUE);
+    tapped->onMethodSetTorqueReplyError(&tap, 1, 42);
+    GKLatencySummary summary;
+    CHECK(gk_latency_get_summary(SET_TORQUE, &summary));
+    CHECK_EQ(1, summary.count);
+}
+
+int main(void) {
+    RUN(testExactBelowSubBuckets);
+    RUN(testQuantileOutOfRange);
+    RUN(testRelativeError);
+    RUN(testClampAboveUInt32);
+    RUN(testInvokeReply);
+    RUN(testMethodEnumeration);
+    RUN(testTap);
+    return TEST_RESULT();
+}
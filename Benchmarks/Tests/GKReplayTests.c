@@ -0,0 +1,131 @@
+//
+// GKReplayTests.c
+// GKReplay over a capture of SLIP framed methods: the records and frames fed, the replayed window and
+// the passes. Needs the GimKit core, for the SLIP decoder and disassembleMethod().
+//
+
+#include "GKReplay.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "CountingSink.h"
+#include "GKMethods.h"
+#include "slipdev.h"
+
+#include "GKTestSupport.h"
+
+#define FRAMES 100
+
+static char sPath[64];
+
+typedef struct Encoded {
+    uint8_t slip[2 * GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE];
+    size_t length;
+} Encoded;
+
+typedef struct Assembled {
+    uint8_t frame[GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE];
+    size_t length;
+} Assembled;
+
+static void onAssembledFrame(uint8_t *frame, size_t count, const void *any) {
+    Assembled *assembled = (Assembled *) any;
+    assembled->length = count <= sizeof(assembled->frame) ? count : 0;
+    memcpy(assembled->frame, frame, assembled->length);
+}
+
+static void onAssembled(uint8_t *frame, size_t count, const void *any) {
+    Encoded *encoded = (Encoded *) any;
+    encoded->length = sd_encode_frame_to_buffer(frame, count, encoded->slip, sizeof(encoded->slip));
+}
+
+/**
+ * FRAMES host to device frames 100 us apart, every other one split over two records, with a device to
+ * host record between them.
+ */
+static uint64_t writeCapture(void) {
+    struct gk_capture_writer *writer = gk_capture_open_writer(sPath);
+    CHECK(writer);
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; writer && i < FRAMES; i++) {
+        Encoded encoded = { .length = 0 };
+        CHECK(assembleMethodSetTorqueInvoke((double) (i % 50), onAssembled, &encoded));
+        CHECK(encoded.length > 2);
+        uint64_t timestamp = i * 100;
+        if (i % 2) {
+            size_t half = encoded.length / 2;
+            gk_capture_write_at(writer, GK_CAPTURE_TO_DEVICE, timestamp, encoded.slip, half);
+            gk_capture_write_at(writer, GK_CAPTURE_TO_DEVICE, timestamp + 10, encoded.slip + half,
+                                encoded.length - half);
+        } else {
+            gk_capture_write_at(writer, GK_CAPTURE_TO_DEVICE, timestamp, encoded.slip, encoded.length);
+        }
+        bytes += encoded.length;
+        const uint8_t noise[] = { 1, 2, 3 };
+        gk_capture_write_at(writer, GK_CAPTURE_FROM_DEVICE, timestamp + 50, noise, sizeof(noise));
+    }
+    CHECK_EQ(GK_CAPTURE_OK, gk_capture_close_writer(writer));
+    return bytes;
+}
+
+static void testReplay(void) {
+    uint64_t bytes = writeCapture();
+    struct gk_capture_reader *reader = gk_capture_open_reader(sPath);
+    CHECK(reader);
+    GKMethodTable table;
+    counting_sink_init_table(&table);
+    CountingSink sink;
+    memset(&sink, 0, sizeof(sink));
+
+    GKReplayOptions options;
+    gk_replay_default_options(&options);
+    options.toDevice = true;
+    GKReplayStats stats;
+    CHECK(gk_replay_run(reader, &table, &sink, &options, &stats));
+    CHECK_EQ(FRAMES + FRAMES / 2, stats.records);
+    CHECK_EQ(bytes, stats.bytes);
+    CHECK_EQ(FRAMES, stats.frames);
+    CHECK_EQ(0, stats.badFrames);
+
+    // The window [1000, 1950] us holds frames 10 to 19.
+    options.from = 1000;
+    options.to = 1950;
+    CHECK(gk_replay_run(reader, &table, &sink, &options, &stats));
+    CHECK_EQ(10, stats.frames);
+
+    options.from = 0;
+    options.to = 0;
+    options.repeat = 3;
+    CHECK(gk_replay_run(reader, &table, &sink, &options, &stats));
+    CHECK_EQ(3 * FRAMES, stats.frames);
+
+    // The other direction carries no frame.
+    gk_replay_default_options(&options);
+    CHECK(gk_replay_run(reader, &table, &sink, &options, &stats));
+    CHECK_EQ(FRAMES, stats.records);
+    CHECK_EQ(0, stats.frames);
+
+    CHECK(!gk_replay_run(NULL, &table, &sink, NULL, &stats));
+    gk_capture_close_reader(reader);
+}
+
+static void testFrameOpid(void) {
+    Assembled torque = { .length = 0 }, erg = { .length = 0 };
+    CHECK(assembleMethodSetTorqueInvoke(12.5, onAssembledFrame, &torque));
+    CHECK(assembleMethodSetErgModeInvoke(onAssembledFrame, &erg, 1));
+    uint8_t opid = 0;
+    CHECK(gk_replay_frame_opid(torque.frame, torque.length, &opid));
+    CHECK_EQ(0x44, opid);
+    CHECK(gk_replay_frame_opid(erg.frame, erg.length, &opid));
+    CHECK_EQ(0x53, opid);
+    CHECK(!gk_replay_frame_opid(torque.frame, 0, &opid));
+}
+
+int main(void) {
+    snprintf(sPath, sizeof(sPath), "gk_replay_tests_%ld.gkcap", (long) getpid());
+    RUN(testReplay);
+    RUN(testFrameOpid);
+    remove(sPath);
+    return TEST_RESULT();
+}
@@ -0,0 +1,156 @@
+//
+// GKTelemetryTests.c
+// The StrengthData conversion and the GKTelemetryQueue, filled by several producers at once.
+//
+
+#include "GKTelemetry.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slipdev.h"
+#include "GKMethods.h"
+
+#include "GKTestSupport.h"
+
+#define PRODUCERS 4
+#define SAMPLES_PER_PRODUCER 200000
+#define CAPACITY 256
+
+static void testStrength(void) {
+    StrengthData data = { 0 };
+    data.flag = (1u << 0) | (1u << 1) | (1u << 2) | (1u << 5);
+    data.tension = 300;
+    data.speed = (uint16_t) -1500;
+    data.power = 1234;
+    data.position = 700;
+    data.mcTemperature = 455;
+    GKTelemetrySample fromData, fromValues;
+    gk_telemetry_from_strength(&data, &fromData);
+    gk_telemetry_from_strength_values(data.flag, 300, -1.5f, 123.4f, 0.7f, 45.5f, &fromValues);
+
+    CHECK_EQ(GK_TELEMETRY_TENSION | GK_TELEMETRY_SPEED | GK_TELEMETRY_POWER | GK_TELEMETRY_MOTOR_TEMPERATURE,
+             fromData.present);
+    CHECK_EQ(fromData.present, fromValues.present);
+    CHECK(fromData.tension == 300 && fromValues.tension == 300);
+    CHECK(fromData.speed == 1.5f && fromValues.speed == 1.5f);
+    CHECK(fromData.power == fromValues.power);
+    CHECK(fromData.motorTemperature == fromValues.motorTemperature);
+    // Not flagged
+    CHECK(fromData.position == 0 && fromValues.position == 0);
+}
+
+static void testFull(void) {
+    GKTelemetryQueue *queue = gk_telemetry_queue_create(5);
+    CHECK(queue);
+    GKTelemetrySample sample = { 0 };
+    for (size_t i = 1; i <= 8; i++) {
+        sample.cadence = (float) i;
+        CHECK_EQ(i, gk_telemetry_queue_push(queue, &sample));
+    }
+    CHECK_EQ(0, gk_telemetry_queue_push(queue, &sample));
+    CHECK_EQ(1, gk_telemetry_queue_dropped(queue));
+    CHECK_EQ(8, gk_telemetry_queue_count(queue));
+
+    GKTelemetrySample samples[8];
+    CHECK_EQ(3, gk_telemetry_queue_pop(queue, samples, 3));
+    CHECK(samples[0].cadence == 1 && samples[2].cadence == 3);
+    CHECK(samples[0].timeNs > 0);
+    // The freed slots are reused, in order.
+    for (size_t i = 9; i <= 11; i++) {
+        sample.cadence = (float) i;
+        CHECK(gk_telemetry_queue_push(queue, &sample) > 0);
+    }
+    CHECK_EQ(8, gk_telemetry_queue_pop(queue, samples, 8));
+    CHECK(samples[0].cadence == 4 && samples[7].cadence == 11);
+    CHECK_EQ(0, gk_telemetry_queue_pop(queue, samples, 8));
+    gk_telemetry_queue_destroy(queue);
+}
+
+static void testClosed(void) {
+    GKTelemetryQueue *queue = gk_telemetry_queue_create(4);
+    CHECK(queue);
+    GKTelemetrySample sample = { 0 };
+    sample.cadence = 1;
+    CHECK_EQ(1, gk_telemetry_queue_push(queue, &sample));
+    gk_telemetry_queue_close(queue);
+    sample.cadence = 2;
+    CHECK_EQ(0, gk_telemetry_queue_push(queue, &sample));
+    CHECK_EQ(0, gk_telemetry_queue_dropped(queue));
+    // Still drained
+    GKTelemetrySample samples[4];
+    CHECK_EQ(1, gk_telemetry_queue_pop(queue, samples, 4));
+    CHECK(samples[0].cadence == 1);
+    CHECK_EQ(0, gk_telemetry_queue_count(queue));
+    gk_telemetry_queue_destroy(queue);
+}
+
+typedef struct Producer {
+    GKTelemetryQueue *queue;
+    uint32_t id;
+    uint64_t pushed;
+} Producer;
+
+static void *produce(void *arg) {
+    Producer *producer = arg;
+    GKTelemetrySample sample = { 0 };
+    sample.heartRate = (uint8_t) producer->id;
+    for (uint32_t i = 0; i < SAMPLES_PER_PRODUCER; i++) {
+        // Exact in a float up to 2^24
+        sample.power = (float) i;
+        while (gk_telemetry_queue_push(producer->queue, &sample) == 0) {
+            sched_yield();
+        }
+        producer->pushed++;
+    }
+    return NULL;
+}
+
+static void testProducers(void) {
+    GKTelemetryQueue *queue = gk_telemetry_queue_create(CAPACITY);
+    CHECK(queue);
+    Producer producers[PRODUCERS];
+    pthread_t threads[PRODUCERS];
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        producers[i] = (Producer) { queue, i, 0 };
+        CHECK(pthread_create(&threads[i], NULL, produce, &producers[i]) == 0);
+    }
+
+    // Every sample once, in the order of its producer.
+    uint32_t next[PRODUCERS] = { 0 };
+    uint64_t popped = 0, outOfOrder = 0;
+    GKTelemetrySample samples[64];
+    while (popped < (uint64_t) PRODUCERS * SAMPLES_PER_PRODUCER) {
+        size_t count = gk_telemetry_queue_pop(queue, samples, 64);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t id = samples[i].heartRate;
+            if (id >= PRODUCERS || samples[i].power != (float) next[id]) {
+                outOfOrder++;
+                continue;
+            }
+            next[id]++;
+        }
+        popped += count;
+        if (!count) {
+            sched_yield();
+        }
+    }
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK_EQ(SAMPLES_PER_PRODUCER, producers[i].pushed);
+        CHECK_EQ(SAMPLES_PER_PRODUCER, next[i]);
+    }
+    CHECK_EQ(0, outOfOrder);
+    CHECK_EQ(0, gk_telemetry_queue_count(queue));
+    gk_telemetry_queue_destroy(queue);
+}
+
+int main(void) {
+    RUN(testStrength);
+    RUN(testFull);
+    RUN(testClosed);
+    RUN(testProducers);
+    return TEST_RESULT();
+}
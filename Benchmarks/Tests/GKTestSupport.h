@@ -0,0 +1,42 @@
+//
+// GKTestSupport.h
+// The few checks the native tests share: each test program runs its cases and exits with 1 if a
+// check failed.
+//
+#ifndef GIMKIT_GKTESTSUPPORT_H
+#define GIMKIT_GKTESTSUPPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int gk_test_failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            gk_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(expected, actual) \
+    do { \
+        unsigned long long expected_ = (unsigned long long) (expected); \
+        unsigned long long actual_ = (unsigned long long) (actual); \
+        if (expected_ != actual_) { \
+            fprintf(stderr, "%s:%d: %s is %llu, expected %s = %llu\n", __FILE__, __LINE__, #actual, actual_, \
+                    #expected, expected_); \
+            gk_test_failures++; \
+        } \
+    } while (0)
+
+#define RUN(test) \
+    do { \
+        int failures_ = gk_test_failures; \
+        test(); \
+        fprintf(stderr, "%s %s\n", failures_ == gk_test_failures ? "passed" : "FAILED", #test); \
+    } while (0)
+
+#define TEST_RESULT() (gk_test_failures ? 1 : 0)
+
+#endif //GIMKIT_GKTESTSUPPORT_H
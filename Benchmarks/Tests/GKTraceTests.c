@@ -0,0 +1,179 @@
+//
+// GKTraceTests.c
+// The GKTrace ring buffers, their clearing while other threads trace, and the Chrome trace export.
+//
+
+#define _GNU_SOURCE // for pthread_setname_np
+
+#include "GKTrace.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "GKTestSupport.h"
+
+#define CAPACITY 8
+
+static const char *const kNames[] = {
+    "e00", "e01", "e02", "e03", "e04", "e05", "e06", "e07", "e08", "e09",
+    "e10", "e11", "e12", "e13", "e14", "e15", "e16", "e17", "e18", "e19",
+};
+
+static char sPath[64];
+
+/** The exported file, NUL terminated, to be freed */
+static char *exportTrace(long *written) {
+    *written = gk_trace_export_chrome_json(sPath);
+    FILE *file = fopen(sPath, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *json = calloc((size_t) size + 1, 1);
+    if (json && fread(json, 1, (size_t) size, file) != (size_t) size) {
+        json[0] = '\0';
+    }
+    fclose(file);
+    return json;
+}
+
+static void testWrapAround(void) {
+    gk_trace_clear();
+    for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+        gk_trace_instant(kNames[i]);
+    }
+    long written;
+    char *json = exportTrace(&written);
+    CHECK(json);
+    // The ring keeps the last CAPACITY events, the export leaves out the oldest one: it's in the slot
+    // the owner writes next.
+    CHECK_EQ(CAPACITY - 1, written);
+    CHECK(!strstr(json, "\"e12\""));
+    for (size_t i = 13; i < 20; i++) {
+        CHECK(strstr(json, kNames[i]));
+    }
+    // In the order they were recorded.
+    CHECK(strstr(json, "\"e13\"") < strstr(json, "\"e19\""));
+    free(json);
+}
+
+static void testJson(void) {
+    gk_trace_clear();
+    uint64_t begin = gk_trace_begin();
+    CHECK(begin != 0);
+    gk_trace_end("quo\"te\\", begin);
+    gk_trace_instant("instant");
+    long written;
+    char *json = exportTrace(&written);
+    CHECK(json);
+    CHECK_EQ(2, written);
+    CHECK(!strncmp(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39));
+    size_t length = strlen(json);
+    CHECK(length > 4 && !strcmp(json + length - 4, "\n]}\n"));
+    CHECK(strstr(json, "{\"name\":\"quo\\\"te\\\\\",\"cat\":\"gimkit\",\"ph\":\"X\",\"ts\":"));
+    CHECK(strstr(json, "\"dur\":"));
+    CHECK(strstr(json, "{\"name\":\"instant\",\"cat\":\"gimkit\",\"ph\":\"i\",\"ts\":"));
+    CHECK(strstr(json, "\"s\":\"t\""));
+    free(json);
+}
+
+static void *namedThread(void *arg) {
+    (void) arg;
+    pthread_setname_np(pthread_self(), "gk-trace-test");
+    GK_TRACE_SCOPE("worker");
+    return NULL;
+}
+
+static void testThreads(void) {
+    gk_trace_clear();
+    gk_trace_instant("main");
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, namedThread, NULL) == 0);
+    pthread_join(thread, NULL);
+    long written;
+    char *json = exportTrace(&written);
+    CHECK(json);
+    CHECK_EQ(2, written);
+    CHECK(strstr(json, "\"worker\""));
+    CHECK(strstr(json, "{\"name\":\"thread_name\",\"ph\":\"M\""));
+    CHECK(strstr(json, "\"args\":{\"name\":\"gk-trace-test\"}"));
+    free(json);
+}
+
+static void testClear(void) {
+    gk_trace_clear();
+    gk_trace_instant("before");
+    gk_trace_clear();
+    long written;
+    char *json = exportTrace(&written);
+    CHECK_EQ(0, written);
+    free(json);
+
+    gk_trace_instant("after");
+    json = exportTrace(&written);
+    CHECK_EQ(1, written);
+    CHECK(json && strstr(json, "\"after\"") && !strstr(json, "\"before\""));
+    free(json);
+}
+
+typedef struct Writer {
+    volatile bool stop;
+    uint64_t recorded;
+} Writer;
+
+static void *writeUntilStopped(void *arg) {
+    Writer *writer = arg;
+    while (!writer->stop) {
+        gk_trace_instant("spin");
+        writer->recorded++;
+    }
+    return NULL;
+}
+
+static void testClearWhileTracing(void) {
+    Writer writer = { false, 0 };
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, writeUntilStopped, &writer) == 0);
+    long written = 0;
+    for (int i = 0; i < 200; i++) {
+        gk_trace_clear();
+        char *json = exportTrace(&written);
+        // Never more than a ring, never an event of another name.
+        CHECK(written >= 0 && written <= CAPACITY);
+        CHECK(json && !strstr(json, "\"e1"));
+        free(json);
+    }
+    writer.stop = true;
+    pthread_join(thread, NULL);
+    CHECK(writer.recorded > 0);
+}
+
+static void testDisabled(void) {
+    gk_trace_clear();
+    gk_trace_set_enabled(false);
+    CHECK_EQ(0, gk_trace_begin());
+    gk_trace_instant("disabled");
+    gk_trace_set_enabled(true);
+    long written;
+    char *json = exportTrace(&written);
+    CHECK_EQ(0, written);
+    free(json);
+}
+
+int main(void) {
+    snprintf(sPath, sizeof(sPath), "gk_trace_tests_%ld.json", (long) getpid());
+    gk_trace_set_buffer_capacity(CAPACITY - 1);
+    gk_trace_set_enabled(true);
+    RUN(testWrapAround);
+    RUN(testJson);
+    RUN(testThreads);
+    RUN(testClear);
+    RUN(testClearWhileTracing);
+    RUN(testDisabled);
+    remove(sPath);
+    return TEST_RESULT();
+}
@@ -0,0 +1,70 @@
+//
+// MethodBuildersCheck.cpp
+// Compile time checks of GKMethodBuilders.hpp: built as is, every builder is instantiated and must
+// compile; built with one of the GK_BUILDER_MISUSE_* macros, it must not.
+//
+
+#include "GKMethodBuilders.hpp"
+
+namespace gimkit {
+namespace {
+
+template <typename M, typename T, int WireSize>
+bool buildTyped(MethodFrame<M> &frame, detail::ValuePayload<T, WireSize>) {
+    return buildMethod(frame, T{});
+}
+
+template <typename M, typename Payload = typename detail::Assembler<M>::Payload>
+bool buildAny(MethodFrame<M> &frame) {
+    if constexpr (std::is_same<Payload, detail::NoPayload>::value || std::is_same<Payload, detail::CorePayload>::value) {
+        return buildMethod(frame);
+    } else if constexpr (std::is_same<Payload, detail::BytesPayload>::value) {
+        return buildMethod(frame, FixedPayload<M>{});
+    } else if constexpr (std::is_same<Payload, detail::VariablePayload>::value) {
+        uint8_t bytes[4] = {};
+        return buildMethod(frame, span<const uint8_t>(bytes));
+    } else {
+        return buildTyped(frame, Payload{});
+    }
+}
+
+template <typename M>
+bool buildHostMethod() {
+    if constexpr (M::invoker == method::Side::Host) {
+        MethodFrame<M> frame;
+        typename MethodFrame<M>::EncodedBuffer encoded;
+        return buildAny(frame) && frame.encode(encoded) > 0;
+    } else {
+        return true;
+    }
+}
+
+} // namespace
+
+bool buildEveryHostMethod() {
+    bool built = true;
+#define METHOD(opid_, bomi, bomr, invoke, reply, name_, desc) built = buildHostMethod<method::name_>() && built;
+#include "Methods.h"
+#undef METHOD
+    return built;
+}
+
+bool misuse() {
+    MethodFrame<method::SET_ERG_MODE> erg;
+    MethodFrame<method::SET_TORQUE> torque;
+    MethodFrame<method::VERIFY_MD5> md5;
+    bool built = buildMethod(erg, uint8_t{1}) && buildMethod(torque, Torque{ 25 }) && buildMethod(md5, FixedPayload<method::VERIFY_MD5>{});
+#if defined(GK_BUILDER_MISUSE_NARROWING)
+    built = MethodBuilder<method::SET_ERG_MODE>::build(erg, 1000);
+#elif defined(GK_BUILDER_MISUSE_TORQUE_FROM_INT)
+    built = buildMethod(torque, 12);
+#elif defined(GK_BUILDER_MISUSE_DEVICE_METHOD)
+    MethodFrame<method::NOTIFY_GIMKIT_DATA> data;
+    built = MethodBuilder<method::NOTIFY_GIMKIT_DATA>::build(data);
+#elif defined(GK_BUILDER_MISUSE_MD5_SIZE)
+    built = buildMethod(md5, std::array<uint8_t, 15>{});
+#endif
+    return built;
+}
+
+} // namespace gimkit
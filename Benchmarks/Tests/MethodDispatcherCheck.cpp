@@ -0,0 +1,50 @@
+//
+// MethodDispatcherCheck.cpp
+// Compile time checks of GKMethodDispatcher.hpp: built as is, the handler's callbacks are dispatched
+// and it must compile; built with one of the GK_DISPATCHER_MISUSE_* macros, it must not.
+//
+
+#include "GKMethodDispatcher.hpp"
+
+namespace gimkit {
+namespace {
+
+struct Handler {
+    using Callbacks = MethodCallbacks<&GKMethodTable::onMethodNotifyGimKitDataInvoke,
+                                      &GKMethodTable::onMethodSetTorqueReply>;
+
+    void onMethodNotifyGimKitDataInvoke(const GimkitData *data) { power = data->power; }
+#if defined(GK_DISPATCHER_MISUSE_MISSPELLED)
+    void onMethodSetTorqueReplay(uint8_t) { replies++; }
+#elif defined(GK_DISPATCHER_MISUSE_WRONG_TYPE)
+    void onMethodSetTorqueReply(const GimkitData *) { replies++; }
+#else
+    void onMethodSetTorqueReply(uint8_t) { replies++; }
+#endif
+#if defined(GK_DISPATCHER_MISUSE_UNLISTED)
+    void onMethodSetErgModeReply(uint8_t) { replies++; }
+#endif
+
+    int power = 0;
+    int replies = 0;
+};
+
+#if defined(GK_DISPATCHER_MISUSE_NO_CALLBACKS)
+struct Unlisted {
+    void onMethodNotifyGimKitDataInvoke(const GimkitData *) {}
+};
+#else
+struct Unlisted {
+    using Callbacks = MethodCallbacks<>;
+};
+#endif
+
+} // namespace
+
+size_t dispatchChecked(span<const uint8_t> frame) {
+    Handler handler;
+    Unlisted unlisted;
+    return MethodDispatcher<Handler>(handler).dispatch(frame) + MethodDispatcher<Unlisted>(unlisted).dispatch(frame);
+}
+
+} // namespace gimkit
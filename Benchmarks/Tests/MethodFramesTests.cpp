@@ -0,0 +1,63 @@
+//
+// MethodFramesTests.cpp
+// The frames the core assembles for every host invoked method, against the sizes MethodFrame
+// reserves for them: FrameLayout must match the core. Needs the GimKit core.
+//
+
+#include "GKMethodBuilders.hpp"
+
+#include "GKTestSupport.h"
+
+namespace gimkit {
+namespace {
+
+constexpr size_t kVariablePayload = 4;
+
+template <typename M, typename T, int WireSize>
+bool buildValue(MethodFrame<M> &frame, detail::ValuePayload<T, WireSize>) {
+    return buildMethod(frame, T{});
+}
+
+/** Build 'frame' from a payload of zeros, whose size goes to 'payload'. */
+template <typename M, typename Payload = typename detail::Assembler<M>::Payload>
+bool build(MethodFrame<M> &frame, size_t &payload) {
+    payload = M::requestSize >= 0 ? static_cast<size_t>(M::requestSize) : kVariablePayload;
+    if constexpr (std::is_same<Payload, detail::NoPayload>::value || std::is_same<Payload, detail::CorePayload>::value) {
+        return buildMethod(frame);
+    } else if constexpr (std::is_same<Payload, detail::BytesPayload>::value) {
+        return buildMethod(frame, FixedPayload<M>{});
+    } else if constexpr (std::is_same<Payload, detail::VariablePayload>::value) {
+        uint8_t bytes[kVariablePayload] = {};
+        return buildMethod(frame, span<const uint8_t>(bytes));
+    } else {
+        return buildValue(frame, Payload{});
+    }
+}
+
+template <typename M>
+void checkMethod() {
+    if constexpr (M::invoker == method::Side::Host) {
+        MethodFrame<M> frame;
+        size_t payload = 0;
+        bool built = build(frame, payload);
+        if (!built) {
+            fprintf(stderr, "%s not built\n", M::name);
+        }
+        CHECK(built);
+        CHECK_EQ(payload + FrameLayout::kEnvelopeSize, frame.size());
+    }
+}
+
+void testEveryHostMethod() {
+#define METHOD(opid_, bomi, bomr, invoke, reply, name_, desc) checkMethod<method::name_>();
+#include "Methods.h"
+#undef METHOD
+}
+
+} // namespace
+} // namespace gimkit
+
+int main() {
+    RUN(gimkit::testEveryHostMethod);
+    return TEST_RESULT();
+}
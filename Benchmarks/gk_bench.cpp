@@ -0,0 +1,503 @@
+//
+// gk_bench.cpp
+// End to end benchmarks of the notification path, under the synthetic load of many devices.
+//
+// usage: gk_bench [options] --seed [TYPE=]capture.gkc...
+//   --seed [TYPE=]FILE  telemetry frames to replay, from the device to host records of a capture;
+//                       TYPE (gimkit, strength, rowerm, xbike) keeps the frames of one stream only;
+//                       reply keeps the replies to the host invoked methods instead
+//   --devices N         simulated devices, default 16
+//   --rate HZ           notifications per second of every device, default 20
+//   --seconds S         simulated duration of one pass, default 10
+//   --mtu BYTES         largest notification payload, default 20
+//   --random-seed N     seed of the device phases, default 1
+//   --passes N          measured passes of every case, the best one is reported, default 5
+//   --case NAME         run this case only, may be repeated: slip_decode, dispatch, end_to_end,
+//                       dispatch_cpp, end_to_end_cpp, build_cpp
+//   --json FILE         write the results to FILE instead of stdout
+//   --baseline FILE     compare with the results of an earlier run, exit with 3 on a regression
+//   --tolerance F       relative slowdown tolerated by --baseline, default 0.10
+//
+// The cases:
+//   slip_decode   notifications through one slip device per simulated device, frames discarded
+//   dispatch      decoded frames through disassembleMethod() into one CountingSink per device
+//   end_to_end    notifications through the slip devices, disassembleMethod() and the sinks
+//   dispatch_cpp, end_to_end_cpp
+//                 the same through gimkit::SlipDevice and gimkit::MethodDispatcher, with the
+//                 frame handling inlined into the callbacks instead of behind a GKMethodTable
+//   build_cpp     the host answering every notification with a SET_TORQUE, built through
+//                 gimkit::MethodBuilder into a stack frame and SLIP encoded
+//
+// Every case reports frames per second and nanoseconds per frame over the whole schedule, the heap
+// allocations per frame (glibc only, -1 elsewhere), and the p50 / p99 / max latency of a frame, from
+// its first notification to the return of its last one, measured in a separate pass so the clock
+// reads don't weigh on the throughput figures.
+//
+// With reply seeds, the _cpp cases mark the invocation of a reply's method for GKLatency when its
+// first notification arrives, and MethodDispatcher marks the reply: the "method_latency" results
+// are the host side of the round trips, per method, over the last case run.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.hpp"
+#include "CoreHeaders.hpp"
+#include "GKMethodBuilders.hpp"
+#include "GKMethodDispatcher.hpp"
+#include "GKSlipDevice.hpp"
+#include "LoadGenerator.hpp"
+
+using namespace gimkit::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    uint64_t frames = 0;
+    double framesPerSecond = 0;
+    double nsPerFrame = 0;
+    double allocationsPerFrame = -1;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t max = 0;
+};
+
+/** The telemetry figures CountingSink keeps, for the MethodDispatcher cases */
+struct TelemetryHandler {
+    using Callbacks = gimkit::MethodCallbacks<&GKMethodTable::onMethodNotifyGimKitDataInvoke,
+                                              &GKMethodTable::onMethodNotifyStrengthDataInvoke,
+                                              &GKMethodTable::onMethodNotifyRowermDataInvoke,
+                                              &GKMethodTable::onMethodNotifyXbikeDataInvoke>;
+
+    uint64_t frames = 0;
+    uint64_t checksum = 0;
+
+    void onMethodNotifyGimKitDataInvoke(const GimkitData *data) {
+        checksum += data->power + data->cadence + data->speed;
+        frames++;
+    }
+    void onMethodNotifyStrengthDataInvoke(const StrengthData *data) {
+        checksum += data->power;
+        frames++;
+    }
+    void onMethodNotifyRowermDataInvoke(const RowermData *data) {
+        checksum += data->power;
+        frames++;
+    }
+    void onMethodNotifyXbikeDataInvoke(const XbikeData *data) {
+        checksum += data->power;
+        frames++;
+    }
+};
+
+/** The state of one simulated device on the host side */
+struct Device {
+    std::vector<uint8_t> memory;
+    CountingSink sink;
+    gimkit::SlipDevice slip;
+    TelemetryHandler handler;
+};
+
+struct Bench {
+    const LoadGenerator &load;
+    GKMethodTable table;
+    std::vector<Device> devices;
+    uint64_t decodedFrames = 0;
+
+    explicit Bench(const LoadGenerator &load) : load(load), devices(load.deviceCount()) {
+        counting_sink_init_table(&table);
+        size_t maxFrameDataSize = std::max<size_t>(load.maxFrameSize(), 64);
+        for (auto &device : devices) {
+            device.memory.resize(sd_get_required_memory_size(maxFrameDataSize));
+            sd_init_device(slipDevice(device), maxFrameDataSize);
+            device.slip = gimkit::SlipDevice(maxFrameDataSize);
+        }
+    }
+
+    ~Bench() {
+        for (auto &device : devices) {
+            sd_deinit_device(slipDevice(device));
+        }
+    }
+
+    static struct slip_dev_t *slipDevice(Device &device) {
+        return reinterpret_cast<struct slip_dev_t *>(device.memory.data());
+    }
+
+    void reset() {
+        decodedFrames = 0;
+        gk_latency_reset_all();
+        for (auto &device : devices) {
+            device.sink = CountingSink();
+            device.handler = TelemetryHandler();
+        }
+    }
+
+    template <typename Decoded>
+    void feed(Device &device, const LoadGenerator::Frame &frame, Decoded onDecoded) {
+        const uint8_t *wire = load.wire(frame);
+        uint32_t mtu = load.config().mtu;
+        for (uint32_t offset = 0; offset < frame.wireLength; offset += mtu) {
+            uint32_t length = std::min(mtu, frame.wireLength - offset);
+            sd_decode_frame(slipDevice(device), wire + offset, length, onDecoded, this);
+        }
+    }
+
+    static void onFrameDiscarded(const struct slip_dev_t *, const uint8_t *, size_t, slip_dev_status_t status,
+                                 const void *any) {
+        auto *bench = static_cast<Bench *>(const_cast<void *>(any));
+        bench->decodedFrames += status == SDS_OK;
+    }
+
+    // The slip decoder hands no device back but its own, the sink is found through the frame's device.
+    Device *current = nullptr;
+
+    static void onFrameDispatched(const struct slip_dev_t *, const uint8_t *buf, size_t length,
+                                  slip_dev_status_t status, const void *any) {
+        auto *bench = static_cast<Bench *>(const_cast<void *>(any));
+        if (status == SDS_OK) {
+            bench->decodedFrames++;
+            disassembleMethod(&bench->current->sink, &bench->table, buf, length);
+        }
+    }
+
+    void slipDecode(const LoadGenerator::Event &event) {
+        feed(devices[event.device], load.frame(event.frame), onFrameDiscarded);
+    }
+
+    void dispatch(const LoadGenerator::Event &event) {
+        const auto &frame = load.frame(event.frame);
+        disassembleMethod(&devices[event.device].sink, &table, load.raw(frame), frame.rawLength);
+        decodedFrames++;
+    }
+
+    void endToEnd(const LoadGenerator::Event &event) {
+        current = &devices[event.device];
+        feed(*current, load.frame(event.frame), onFrameDispatched);
+    }
+
+    void dispatchCpp(const LoadGenerator::Event &event) {
+        const auto &frame = load.frame(event.frame);
+        if (frame.replyOpid) {
+            gk_latency_mark_invoke(frame.replyOpid);
+        }
+        gimkit::MethodDispatcher<TelemetryHandler> dispatcher(devices[event.device].handler);
+        dispatcher.dispatch({ load.raw(frame), frame.rawLength });
+        decodedFrames++;
+    }
+
+    void endToEndCpp(const LoadGenerator::Event &event) {
+        Device &device = devices[event.device];
+        gimkit::MethodDispatcher<TelemetryHandler> dispatcher(device.handler);
+        const auto &frame = load.frame(event.frame);
+        if (frame.replyOpid) {
+            gk_latency_mark_invoke(frame.replyOpid);
+        }
+        const uint8_t *wire = load.wire(frame);
+        uint32_t mtu = load.config().mtu;
+        for (uint32_t offset = 0; offset < frame.wireLength; offset += mtu) {
+            uint32_t length = std::min(mtu, frame.wireLength - offset);
+            device.slip.decode({ wire + offset, length }, [&](gimkit::span<const uint8_t> decoded) {
+                decodedFrames++;
+                dispatcher.dispatch(decoded);
+            });
+        }
+    }
+
+    void buildCpp(const LoadGenerator::Event &event) {
+        gimkit::MethodFrame<gimkit::method::SET_TORQUE> frame;
+        gimkit::MethodFrame<gimkit::method::SET_TORQUE>::EncodedBuffer encoded;
+        gimkit::Torque torque = { static_cast<uint8_t>(event.frame % 64) };
+        size_t encodedSize = gimkit::buildMethod(frame, torque) ? frame.encode(encoded) : 0;
+        if (encodedSize) {
+            devices[event.device].handler.checksum += encoded[encodedSize / 2];
+            decodedFrames++;
+        }
+    }
+};
+
+using Step = void (Bench::*)(const LoadGenerator::Event &);
+
+uint64_t nanosSince(Clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+Result runCase(const std::string &name, Bench &bench, Step step, unsigned passes) {
+    const auto &schedule = bench.load.schedule();
+    Result result;
+    result.name = name;
+    result.frames = schedule.size();
+
+    // Warm up the caches and the branch predictors, and check the traffic actually decodes.
+    bench.reset();
+    for (const auto &event : schedule) {
+        (bench.*step)(event);
+    }
+    if (bench.decodedFrames != schedule.size()) {
+        fprintf(stderr, "%s: %llu of %zu frames decoded\n", name.c_str(), (unsigned long long) bench.decodedFrames,
+                schedule.size());
+    }
+
+    uint64_t best = UINT64_MAX;
+    uint64_t allocations = UINT64_MAX;
+    for (unsigned pass = 0; pass < passes; pass++) {
+        bench.reset();
+        uint64_t allocationsBefore = allocationCount();
+        auto start = Clock::now();
+        for (const auto &event : schedule) {
+            (bench.*step)(event);
+        }
+        uint64_t elapsed = nanosSince(start);
+        best = std::min(best, elapsed);
+        allocations = std::min(allocations, allocationCount() - allocationsBefore);
+    }
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(schedule.size());
+    bench.reset();
+    for (const auto &event : schedule) {
+        auto start = Clock::now();
+        (bench.*step)(event);
+        latencies.push_back(nanosSince(start));
+    }
+
+    if (!schedule.empty()) {
+        result.nsPerFrame = static_cast<double>(best) / schedule.size();
+        result.framesPerSecond = best ? schedule.size() * 1e9 / best : 0;
+        if (allocationCountingSupported()) {
+            result.allocationsPerFrame = static_cast<double>(allocations) / schedule.size();
+        }
+        auto quantile = [&](double q) {
+            auto nth = latencies.begin() + static_cast<long>(q * (latencies.size() - 1));
+            std::nth_element(latencies.begin(), nth, latencies.end());
+            return *nth;
+        };
+        result.p50 = quantile(0.50);
+        result.p99 = quantile(0.99);
+        result.max = *std::max_element(latencies.begin(), latencies.end());
+    }
+    return result;
+}
+
+std::string toJson(const LoadGenerator &load, const std::vector<Result> &results) {
+    const auto &config = load.config();
+    std::ostringstream out;
+    char line[512];
+    out << "{\n";
+    out << "  \"suite\": \"gk_bench\",\n";
+    snprintf(line, sizeof(line),
+             "  \"config\": {\"devices\": %u, \"rate_hz\": %g, \"seconds\": %g, \"mtu\": %u, \"random_seed\": %llu, "
+             "\"notifications\": %llu, \"wire_bytes\": %llu},\n",
+             config.devices, config.rateHz, config.seconds, config.mtu, (unsigned long long) config.seed,
+             (unsigned long long) load.notifications(), (unsigned long long) load.wireBytes());
+    out << line;
+    out << "  \"results\": [\n";
+    // One result per line, --baseline reads them back line by line.
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        snprintf(line, sizeof(line),
+                 "    {\"name\": \"%s\", \"frames\": %llu, \"frames_per_second\": %.1f, \"ns_per_frame\": %.2f, "
+                 "\"allocations_per_frame\": %.3f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}%s\n",
+                 r.name.c_str(), (unsigned long long) r.frames, r.framesPerSecond, r.nsPerFrame, r.allocationsPerFrame,
+                 (unsigned long long) r.p50, (unsigned long long) r.p99, (unsigned long long) r.max,
+                 i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ],\n";
+    out << "  \"method_latency\": [";
+    const char *separator = "\n";
+    for (size_t i = 0; i < gk_latency_method_count(); i++) {
+        GKLatencySummary summary;
+        if (gk_latency_get_summary(gk_latency_method_opid(i), &summary) && summary.count) {
+            snprintf(line, sizeof(line), "%s    {\"method\": \"%s\", \"count\": %llu, \"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu}",
+                     separator, summary.name, (unsigned long long) summary.count, (unsigned long long) summary.p50,
+                     (unsigned long long) summary.p99, (unsigned long long) summary.max);
+            out << line;
+            separator = ",\n";
+        }
+    }
+    out << (separator[0] == ',' ? "\n  ]\n" : "]\n");
+    out << "}\n";
+    return out.str();
+}
+
+bool findNumber(const std::string &line, const char *key, double &value) {
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos) {
+        return false;
+    }
+    value = strtod(line.c_str() + at + pattern.size(), nullptr);
+    return true;
+}
+
+bool readBaseline(const std::string &path, std::map<std::string, Result> &baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t at = line.find("\"name\": \"");
+        if (at == std::string::npos) {
+            continue;
+        }
+        at += strlen("\"name\": \"");
+        Result r;
+        r.name = line.substr(at, line.find('"', at) - at);
+        double p99 = 0;
+        findNumber(line, "ns_per_frame", r.nsPerFrame);
+        findNumber(line, "allocations_per_frame", r.allocationsPerFrame);
+        findNumber(line, "p99_ns", p99);
+        r.p99 = static_cast<uint64_t>(p99);
+        baseline[r.name] = r;
+    }
+    return true;
+}
+
+/** @return the number of regressions */
+int compare(const std::vector<Result> &results, const std::map<std::string, Result> &baseline, double tolerance) {
+    int regressions = 0;
+    for (const auto &r : results) {
+        auto found = baseline.find(r.name);
+        if (found == baseline.end()) {
+            continue;
+        }
+        const Result &base = found->second;
+        if (base.nsPerFrame > 0 && r.nsPerFrame > base.nsPerFrame * (1 + tolerance)) {
+            fprintf(stderr, "%s: %.2f ns/frame, baseline %.2f\n", r.name.c_str(), r.nsPerFrame, base.nsPerFrame);
+            regressions++;
+        }
+        if (base.p99 > 0 && r.p99 > base.p99 * (1 + tolerance)) {
+            fprintf(stderr, "%s: p99 %llu ns, baseline %llu\n", r.name.c_str(), (unsigned long long) r.p99,
+                    (unsigned long long) base.p99);
+            regressions++;
+        }
+        if (base.allocationsPerFrame >= 0 && r.allocationsPerFrame > base.allocationsPerFrame + 0.001) {
+            fprintf(stderr, "%s: %.3f allocations/frame, baseline %.3f\n", r.name.c_str(), r.allocationsPerFrame,
+                    base.allocationsPerFrame);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s --seed [TYPE=]capture.gkc... [--devices N] [--rate HZ] [--seconds S] [--mtu BYTES]\n"
+            "       [--random-seed N] [--passes N] [--case NAME]... [--json FILE] [--baseline FILE] [--tolerance F]\n",
+            program);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    LoadConfig config;
+    SeedPool seeds;
+    unsigned passes = 5;
+    std::vector<std::string> cases;
+    std::string jsonPath;
+    std::string baselinePath;
+    double tolerance = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--seed" && hasValue) {
+            std::string value = argv[++i];
+            StreamType type;
+            size_t equals = value.find('=');
+            bool typed = equals != std::string::npos && parseStreamType(value.substr(0, equals), type);
+            std::string path = typed ? value.substr(equals + 1) : value;
+            long added = seeds.addCapture(path, typed ? &type : nullptr);
+            if (added < 0) {
+                fprintf(stderr, "%s: not a readable capture file\n", path.c_str());
+                return 1;
+            }
+            if (added == 0) {
+                fprintf(stderr, "%s: no telemetry frame\n", path.c_str());
+            }
+        } else if (arg == "--devices" && hasValue) {
+            config.devices = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rate" && hasValue) {
+            config.rateHz = atof(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            config.seconds = atof(argv[++i]);
+        } else if (arg == "--mtu" && hasValue) {
+            config.mtu = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--random-seed" && hasValue) {
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--passes" && hasValue) {
+            passes = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--case" && hasValue) {
+            cases.emplace_back(argv[++i]);
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            baselinePath = argv[++i];
+        } else if (arg == "--tolerance" && hasValue) {
+            tolerance = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (seeds.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    LoadGenerator load(seeds, config);
+    if (load.schedule().empty()) {
+        fprintf(stderr, "empty schedule, check --devices, --rate and --seconds\n");
+        return 2;
+    }
+    Bench bench(load);
+
+    const std::pair<const char *, Step> allCases[] = {
+        { "slip_decode", &Bench::slipDecode },
+        { "dispatch", &Bench::dispatch },
+        { "end_to_end", &Bench::endToEnd },
+        { "dispatch_cpp", &Bench::dispatchCpp },
+        { "end_to_end_cpp", &Bench::endToEndCpp },
+        { "build_cpp", &Bench::buildCpp },
+    };
+    std::vector<Result> results;
+    for (const auto &c : allCases) {
+        if (cases.empty() || std::find(cases.begin(), cases.end(), c.first) != cases.end()) {
+            results.push_back(runCase(c.first, bench, c.second, passes));
+        }
+    }
+
+    std::string json = toJson(load, results);
+    if (jsonPath.empty()) {
+        fputs(json.c_str(), stdout);
+    } else if (!(std::ofstream(jsonPath) << json)) {
+        fprintf(stderr, "%s: can't write the results\n", jsonPath.c_str());
+        return 1;
+    }
+
+    if (!baselinePath.empty()) {
+        std::map<std::string, Result> baseline;
+        if (!readBaseline(baselinePath, baseline)) {
+            fprintf(stderr, "%s: can't read the baseline\n", baselinePath.c_str());
+            return 1;
+        }
+        if (compare(results, baseline, tolerance) > 0) {
+            return 3;
+        }
+    }
+    return 0;
+}
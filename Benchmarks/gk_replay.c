@@ -0,0 +1,115 @@
+//
+// gk_replay.c
+// Replay a GKCapture file through the GimKit core and report the throughput.
+//
+// usage: gk_replay [options] capture.gkc
+//   --speed S       pace relative to the capture, 1 is wire speed, 0 (default) as fast as possible
+//   --repeat N      number of passes over the capture
+//   --to-device     replay the host to device traffic instead of the notifications
+//   --from US       start of the window, in microseconds since the start of the capture
+//   --to US         end of the window
+//   --trace FILE    record a Chrome trace of the replay into FILE
+//   --latency       report the round trip of the replies, per method, on the capture clock
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GKCapture.h"
+#include "GKLatency.h"
+#include "GKMethods.h"
+#include "GKReplay.h"
+#include "GKTrace.h"
+#include "CountingSink.h"
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--speed S] [--repeat N] [--to-device] [--from US] [--to US] [--trace FILE] [--latency]\n"
+            "       capture.gkc\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    GKReplayOptions options;
+    gk_replay_default_options(&options);
+    const char *tracePath = NULL;
+    const char *capturePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--speed") && hasValue) {
+            options.speed = atof(argv[++i]);
+        } else if (!strcmp(arg, "--repeat") && hasValue) {
+            options.repeat = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "--to-device")) {
+            options.toDevice = true;
+        } else if (!strcmp(arg, "--from") && hasValue) {
+            options.from = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "--to") && hasValue) {
+            options.to = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "--trace") && hasValue) {
+            tracePath = argv[++i];
+        } else if (!strcmp(arg, "--latency")) {
+            options.latency = true;
+        } else if (arg[0] != '-' && !capturePath) {
+            capturePath = arg;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!capturePath) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct gk_capture_reader *reader = gk_capture_open_reader(capturePath);
+    if (!reader) {
+        fprintf(stderr, "%s: not a readable capture file\n", capturePath);
+        return 1;
+    }
+
+    GKMethodTable table;
+    counting_sink_init_table(&table);
+    CountingSink sink = { 0 };
+    GKReplayStats stats;
+
+    gk_trace_set_enabled(tracePath != NULL);
+    gk_latency_reset_all();
+    bool ok = gk_replay_run(reader, &table, &sink, &options, &stats);
+    gk_trace_set_enabled(false);
+    gk_capture_close_reader(reader);
+    if (!ok) {
+        fprintf(stderr, "replay failed\n");
+        return 1;
+    }
+    if (tracePath && gk_trace_export_chrome_json(tracePath) < 0) {
+        fprintf(stderr, "%s: can't write the trace\n", tracePath);
+    }
+
+    double seconds = stats.elapsed / 1e9;
+    printf("records      %llu\n", (unsigned long long) stats.records);
+    printf("bytes        %llu\n", (unsigned long long) stats.bytes);
+    printf("frames       %llu\n", (unsigned long long) stats.frames);
+    printf("bad frames   %llu\n", (unsigned long long) stats.badFrames);
+    printf("methods      %llu (gimkit %llu, strength %llu, rowerm %llu, xbike %llu, replies %llu, errors %llu)\n",
+           (unsigned long long) sink.methods, (unsigned long long) sink.gimkitData,
+           (unsigned long long) sink.strengthData, (unsigned long long) sink.rowermData,
+           (unsigned long long) sink.xbikeData, (unsigned long long) sink.replies,
+           (unsigned long long) (sink.replyErrors + sink.crcErrors + sink.protocolErrors));
+    printf("elapsed      %.3f s\n", seconds);
+    if (stats.frames && seconds > 0) {
+        printf("throughput   %.0f frames/s, %.1f ns/frame, %.2f MB/s\n", stats.frames / seconds,
+               stats.elapsed / (double) stats.frames, stats.bytes / seconds / 1e6);
+    }
+    for (size_t i = 0; options.latency && i < gk_latency_method_count(); i++) {
+        GKLatencySummary summary;
+        if (gk_latency_get_summary(gk_latency_method_opid(i), &summary) && summary.count) {
+            printf("latency      %-28s %6llu replies, p50 %llu us, p99 %llu us, max %llu us\n", summary.name,
+                   (unsigned long long) summary.count, (unsigned long long) summary.p50,
+                   (unsigned long long) summary.p99, (unsigned long long) summary.max);
+        }
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 import XCTest
+import GimKit
 import GimBle
 
 class Tests: XCTestCase {
@@ -26,3 +27,1108 @@ class Tests: XCTestCase {
     }
     
 }
+
+/// The messages of the FIT files the tests write: records one second apart from a fixed start.
+enum FitFixtures {
+
+    static let start = FitDateTime(date: Date(timeIntervalSince1970: 1_600_000_000)).timeStamp
+
+    /// A record at `start + second`.
+    static func record(_ second: Int) -> RecordMesg {
+        let record = RecordMesg()
+        record.setTimestamp(FitDateTime(timeStamp: start + UInt32(second)))
+        return record
+    }
+
+    /// `count` records from `start`, completed by `fill` with the record and its index.
+    static func records(_ count: Int, fill: (RecordMesg, Int) -> Void = { _, _ in }) -> [RecordMesg] {
+        return (0..<count).map { i in
+            let record = FitFixtures.record(i)
+            fill(record, i)
+            return record
+        }
+    }
+
+    /// The file `Encode` writes of the messages `body` writes to it.
+    static func file(_ body: (Encode) -> Void) -> [UInt8] {
+        let encode = Encode(.v20)
+        body(encode)
+        return encode.close().data
+    }
+
+    static func file(_ mesgs: [Mesg]) -> [UInt8] {
+        return file { $0.write(mesgs) }
+    }
+}
+
+/// A `DecodeDelegate` keeping the messages, or handing them to `body` if given.
+final class MesgCollector: DecodeDelegate {
+    private(set) var mesgs = [Mesg]()
+    private let body: ((Mesg) -> Void)?
+
+    init(_ body: ((Mesg) -> Void)? = nil) {
+        self.body = body
+    }
+
+    func didReadMesg(mesg: Mesg) {
+        if let body = body {
+            body(mesg)
+        } else {
+            mesgs.append(mesg)
+        }
+    }
+
+    func didReadMesgDefinition(mesgDef: MesgDefinition) {
+    }
+
+    func didReadDeveloperFieldDescription(fieldDesc: DeveloperFieldDescription) {
+    }
+}
+
+class FitBufferTests: XCTestCase {
+
+    /// About 10 MB of record messages, written once for all the tests.
+    static let activityPath: String = {
+        let bytes = FitFixtures.file { encode in
+            for i in 0..<600_000 {
+                let record = FitFixtures.record(i)
+                record.setHeartRate(UInt8(120 + i % 40))
+                record.setCadence(UInt8(80 + i % 20))
+                record.setPower(UInt16(180 + i % 120))
+                record.setSpeed(Float32(8 + Double(i % 10) / 10))
+                record.setDistance(Float32(i) * 8)
+                record.setAltitude(Float32(100 + i % 50))
+                encode.write(record)
+            }
+        }
+        let path = NSTemporaryDirectory() + "FitBufferTests.fit"
+        FileManager.default.createFile(atPath: path, contents: Data(bytes))
+        return path
+    }()
+
+    /// The messages reported to the delegate given to `read`, counted and their power summed.
+    private func totals(_ read: (DecodeDelegate) -> Bool) -> (mesgs: Int, powerSum: Int) {
+        var mesgs = 0, powerSum = 0
+        let counter = MesgCollector { mesg in
+            mesgs += 1
+            powerSum += Int(RecordMesg(mesg).getPower() ?? 0)
+        }
+        XCTAssertTrue(read(counter))
+        return (mesgs, powerSum)
+    }
+
+    func testBufferDecoderMatchesDecode() {
+        let bytes = [UInt8](FileManager.default.contents(atPath: FitBufferTests.activityPath)!)
+        let expected = totals { delegate in
+            let decode = Decode()
+            decode.delegate = delegate
+            return decode.read(PositionableData(data: bytes))
+        }
+        let actual = totals { delegate in
+            let decoder = FitBufferDecoder()
+            decoder.delegate = delegate
+            return decoder.read(path: FitBufferTests.activityPath)
+        }
+        XCTAssertEqual(actual.mesgs, expected.mesgs)
+        XCTAssertEqual(actual.powerSum, expected.powerSum)
+    }
+
+    func testFitBufferLoads() {
+        withFitBuffer([0x01, 0x02, 0x03, 0x04, 0x00, 0x00, 0x80, 0x3F]) { buffer in
+            XCTAssertEqual(buffer.load(UInt16.self, at: 0), 0x0201)
+            XCTAssertEqual(buffer.load(UInt16.self, at: 0, bigEndian: true), 0x0102)
+            XCTAssertEqual(buffer.load(UInt32.self, at: 0), 0x0403_0201)
+            XCTAssertEqual(buffer.loadFloat32(at: 4), 1.0)
+            XCTAssertEqual(buffer.read(UInt32.self, bigEndian: true), 0x0102_0304)
+            XCTAssertEqual(buffer.position, 4)
+        }
+    }
+
+    func testPerformanceDecode() {
+        let path = FitBufferTests.activityPath
+        measure {
+            let bytes = [UInt8](FileManager.default.contents(atPath: path)!)
+            _ = self.totals { delegate in
+                let decode = Decode()
+                decode.delegate = delegate
+                return decode.read(PositionableData(data: bytes))
+            }
+        }
+    }
+
+    func testPerformanceBufferDecoder() {
+        let path = FitBufferTests.activityPath
+        measure {
+            _ = self.totals { delegate in
+                let decoder = FitBufferDecoder()
+                decoder.delegate = delegate
+                return decoder.read(path: path)
+            }
+        }
+    }
+}
+
+class CRC16Tests: XCTestCase {
+
+    func testCheckValue() {
+        XCTAssertEqual(GimKitCRC16.checksum(Array("123456789".utf8)), 0xBB3D)
+        XCTAssertEqual(GimKitCRC16.checksum([UInt8]()), 0)
+    }
+
+    func testMatchesFitSDK() {
+        var generator = SystemRandomNumberGenerator()
+        let bytes = (0..<4099).map { _ in UInt8.random(in: 0...255, using: &generator) }
+        for count in [0, 1, 7, 8, 9, 15, 16, 17, 1000, 4099] {
+            let slice = Array(bytes[0..<count])
+            XCTAssertEqual(GimKitCRC16.checksum(slice), CRC.calc16(dataBlock: slice, size: count), "\(count) bytes")
+        }
+    }
+
+    func testStreamingUpdate() {
+        let bytes = (0..<1000).map { UInt8(truncatingIfNeeded: $0 * 31) }
+        var crc = GimKitCRC16()
+        for start in stride(from: 0, to: bytes.count, by: 13) {
+            crc.update(Array(bytes[start..<min(start + 13, bytes.count)]))
+        }
+        XCTAssertEqual(crc.value, GimKitCRC16.checksum(bytes))
+    }
+
+    func testPerformanceChecksum() {
+        let bytes = [UInt8](repeating: 0x5A, count: 10 << 20)
+        measure {
+            _ = GimKitCRC16.checksum(bytes)
+        }
+    }
+}
+
+class LazyMesgTests: XCTestCase {
+
+    func testLazyValuesMatchMesg() {
+        var powers = [UInt16]()
+        var timestamps = [UInt32]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { mesg in
+            let record = RecordMesg(mesg)
+            powers.append(record.getPower() ?? 0)
+            timestamps.append(record.getTimestamp()?.timeStamp ?? 0)
+        }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+
+        var index = 0
+        let lazyDecoder = FitBufferDecoder()
+        lazyDecoder.onLazyMesg = { mesg in
+            guard mesg.num == MesgNum.Record else {
+                return
+            }
+            XCTAssertEqual(mesg.getRawValue(fieldNum: RecordMesg.FieldDefNum.Power.rawValue).map { UInt16($0) }, powers[index])
+            XCTAssertEqual(mesg.timestamp, timestamps[index])
+            index += 1
+        }
+        XCTAssertTrue(lazyDecoder.read(path: FitBufferTests.activityPath))
+        XCTAssertEqual(index, powers.count)
+    }
+
+    func testPerformanceLazyDecode() {
+        let path = FitBufferTests.activityPath
+        measure {
+            var sum = 0
+            let decoder = FitBufferDecoder()
+            decoder.onLazyMesg = { mesg in
+                sum += Int(mesg.getRawValue(fieldNum: RecordMesg.FieldDefNum.Power.rawValue) ?? 0)
+            }
+            decoder.read(path: path)
+        }
+    }
+}
+
+class TypedMesgTests: XCTestCase {
+
+    func testTypedValuesMatchMesg() {
+        var mesgs = [TypedMesg]()
+        let decoder = FitBufferDecoder()
+        decoder.expandComponents = false
+        decoder.onMesg = { mesgs.append(TypedMesg($0)) }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+
+        var index = 0
+        let lazyDecoder = FitBufferDecoder()
+        lazyDecoder.onLazyMesg = { mesg in
+            let typed = TypedMesg(mesg)
+            XCTAssertEqual(typed.num, mesgs[index].num)
+            XCTAssertEqual(typed.power, mesgs[index].power)
+            XCTAssertEqual(typed.timestamp, mesgs[index].timestamp)
+            XCTAssertEqual(typed.speed ?? 0, mesgs[index].speed ?? 0, accuracy: 1e-6)
+            index += 1
+        }
+        XCTAssertTrue(lazyDecoder.read(path: FitBufferTests.activityPath))
+        XCTAssertEqual(index, mesgs.count)
+    }
+
+    func testInlineBytes() {
+        let short: [UInt8] = Array("GimKit".utf8)
+        XCTAssertEqual(FitValue(short as Any).byteArray, short)
+        if case .inlineBytes = FitValue(short as Any) {} else { XCTFail("not inline") }
+        let long = [UInt8](repeating: 0x41, count: FitInlineBytes.capacity + 1)
+        XCTAssertEqual(FitValue(long as Any), .bytes(long))
+        XCTAssertEqual(FitValue(UInt16.max as Any, baseType: FitBaseType.Uint16), .invalid)
+    }
+
+    func testPerformanceTypedGetters() {
+        var mesgs = [Mesg]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { mesgs.append($0) }
+        decoder.read(path: FitBufferTests.activityPath)
+        let typed = mesgs.map { TypedMesg($0) }
+        measure {
+            var sum = 0.0
+            for mesg in typed {
+                sum += Double(mesg.power ?? 0) + (mesg.speed ?? 0)
+            }
+            XCTAssertGreaterThan(sum, 0)
+        }
+    }
+}
+
+class MesgFilterTests: XCTestCase {
+
+    static let mixedBytes: [UInt8] = FitFixtures.file { encode in
+        for (i, record) in FitFixtures.records(1_000, fill: { $0.setPower(UInt16($1)) }).enumerated() {
+            encode.write(record)
+            if i % 100 == 99 {
+                let lap = LapMesg()
+                lap.setTimestamp(FitDateTime(timeStamp: FitFixtures.start + UInt32(i)))
+                encode.write(lap)
+            }
+        }
+    }
+
+    func testBufferDecoderFilter() {
+        var nums = [UInt16]()
+        let decoder = FitBufferDecoder()
+        decoder.mesgFilter = [MesgNum.Lap]
+        decoder.onMesg = { nums.append($0.num) }
+        XCTAssertTrue(decoder.read(MesgFilterTests.mixedBytes))
+        XCTAssertEqual(nums, [UInt16](repeating: MesgNum.Lap, count: 10))
+    }
+
+    func testStreamDecoderFilter() {
+        var nums = [UInt16]()
+        let decoder = FitStreamDecoder(source: FitBytesSource(MesgFilterTests.mixedBytes))
+        decoder.mesgFilter = [MesgNum.Lap]
+        decoder.onMesg = { nums.append($0.num) }
+        XCTAssertTrue(decoder.read())
+        XCTAssertEqual(nums, [UInt16](repeating: MesgNum.Lap, count: 10))
+    }
+}
+
+class FitStreamDecoderTests: XCTestCase {
+
+    /// Smaller than a few records: most records straddle two refills of the window.
+    private let windowSize = 64
+
+    /// Number, timestamp and power of every message.
+    private func summary(_ mesgs: [Mesg]) -> [[UInt32]] {
+        return mesgs.map { mesg in
+            let record = RecordMesg(mesg)
+            let power = mesg.num == MesgNum.Record ? UInt32(record.getPower() ?? 0) : 0
+            return [UInt32(mesg.num), record.getTimestamp()?.timeStamp ?? 0, power]
+        }
+    }
+
+    private func decode(_ bytes: [UInt8]) -> [Mesg] {
+        let collector = MesgCollector()
+        let decode = Decode()
+        decode.delegate = collector
+        XCTAssertTrue(decode.read(PositionableData(data: bytes)))
+        return collector.mesgs
+    }
+
+    func testSmallWindowMatchesDecode() {
+        let bytes = MesgFilterTests.mixedBytes
+        let collector = MesgCollector()
+        let decoder = FitStreamDecoder(source: FitBytesSource(bytes), windowSize: windowSize)
+        decoder.delegate = collector
+        XCTAssertTrue(decoder.read())
+        XCTAssertNil(decoder.failure)
+        XCTAssertEqual(decoder.fileCount, 1)
+        let expected = decode(bytes)
+        XCTAssertEqual(decoder.mesgCount, expected.count)
+        XCTAssertEqual(summary(collector.mesgs), summary(expected))
+    }
+
+    func testOneRecordPerRead() {
+        // Every read ends on a record boundary, so the window is empty before each record.
+        let bytes = MesgFilterTests.mixedBytes
+        var cuts = [Int(Fit.headerWithCRCSize)]
+        let scanner = FitBufferDecoder()
+        scanner.onLazyMesg = { cuts.append($0.offset) }
+        XCTAssertTrue(scanner.read(bytes))
+        var position = 0
+        let source = FitClosureSource { buffer, count in
+            let end = min(cuts.first { $0 > position } ?? bytes.count, position + count)
+            bytes.withUnsafeBufferPointer { buffer.assign(from: $0.baseAddress! + position, count: end - position) }
+            defer { position = end }
+            return end - position
+        }
+        let collector = MesgCollector()
+        let decoder = FitStreamDecoder(source: source)
+        decoder.delegate = collector
+        XCTAssertTrue(decoder.read())
+        XCTAssertNil(decoder.failure)
+        XCTAssertEqual(summary(collector.mesgs), summary(decode(bytes)))
+    }
+
+    func testChainedFiles() {
+        let bytes = MesgFilterTests.mixedBytes
+        let collector = MesgCollector()
+        let decoder = FitStreamDecoder(source: FitBytesSource(bytes + bytes), windowSize: windowSize)
+        decoder.delegate = collector
+        XCTAssertTrue(decoder.read())
+        XCTAssertEqual(decoder.fileCount, 2)
+        let expected = summary(decode(bytes))
+        XCTAssertEqual(summary(collector.mesgs), expected + expected)
+    }
+
+    func testFileCRCFailure() {
+        var damaged = MesgFilterTests.mixedBytes
+        damaged[damaged.count - 1] ^= 0xFF
+        // The second file is damaged: the first one is decoded, then the decoder fails.
+        let decoder = FitStreamDecoder(source: FitBytesSource(MesgFilterTests.mixedBytes + damaged),
+                                       windowSize: windowSize)
+        XCTAssertFalse(decoder.read())
+        XCTAssertEqual(decoder.failure, .fileCRC)
+        XCTAssertEqual(decoder.fileCount, 1)
+
+        let unchecked = FitStreamDecoder(source: FitBytesSource(damaged), windowSize: windowSize)
+        unchecked.checkCRC = false
+        XCTAssertTrue(unchecked.read())
+        XCTAssertEqual(unchecked.mesgCount, decode(MesgFilterTests.mixedBytes).count)
+    }
+}
+
+class FitSeekIndexTests: XCTestCase {
+
+    func testRangeMatchesFullDecode() {
+        let path = FitBufferTests.activityPath
+        guard let index = FitSeekIndex(path: path, interval: 5_000) else {
+            return XCTFail("not indexed")
+        }
+        XCTAssertGreaterThan(index.checkpoints.count, 100)
+        XCTAssertEqual(FitSeekIndex(serialized: index.serialized)?.checkpoints, index.checkpoints)
+
+        var timestamps = [UInt32]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { mesg in
+            if let timestamp = mesg.timestamp {
+                timestamps.append(timestamp)
+            }
+        }
+        XCTAssertTrue(decoder.read(path: path))
+        let start = timestamps[123_456], end = timestamps[130_000]
+
+        var ranged = [UInt32]()
+        let rangeDecoder = FitBufferDecoder()
+        rangeDecoder.onLazyMesg = { mesg in
+            ranged.append(mesg.timestamp ?? 0)
+        }
+        XCTAssertTrue(rangeDecoder.read(path: path, index: index, from: start, to: end))
+        XCTAssertEqual(ranged, Array(timestamps[123_456...130_000]))
+    }
+
+    func testSidecar() {
+        let path = FitBufferTests.activityPath
+        try? FileManager.default.removeItem(atPath: FitSeekIndex.sidecarPath(for: path))
+        let built = FitSeekIndex.load(path: path)
+        XCTAssertTrue(FileManager.default.fileExists(atPath: FitSeekIndex.sidecarPath(for: path)))
+        XCTAssertEqual(FitSeekIndex.load(path: path)?.checkpoints, built?.checkpoints)
+    }
+
+    func testDamagedSidecarRejected() {
+        let path = FitBufferTests.activityPath
+        guard let index = FitSeekIndex(path: path, interval: 5_000), index.checkpoints.count > 1 else {
+            return XCTFail("not indexed")
+        }
+        let checkpointSize = 8 * 18 + 4
+        func damaged(at offset: Int, _ value: Int64) -> FitSeekIndex? {
+            var bytes = index.serialized
+            withUnsafeBytes(of: value.littleEndian) { bytes.replaceSubrange(offset..<offset + 8, with: $0) }
+            return FitSeekIndex(serialized: bytes)
+        }
+        let second = 24 + checkpointSize
+        XCTAssertNotNil(damaged(at: second, Int64(index.checkpoints[1].offset)))
+        // An offset past the records, a data end over the file CRC, a definition after the checkpoint
+        XCTAssertNil(damaged(at: second, Int64(index.checkpoints[1].dataEnd + 1)))
+        XCTAssertNil(damaged(at: second + 8, Int64(index.fileSize - 1)))
+        XCTAssertNil(damaged(at: second + 20, Int64(index.checkpoints[1].offset)))
+
+        // A checkpoint read to past the data end of its file
+        let bytes = [UInt8](FileManager.default.contents(atPath: path) ?? Data())
+        let decoder = FitBufferDecoder()
+        let checkpoint = index.checkpoints[1]
+        XCTAssertFalse(withFitBuffer(bytes) { decoder.read($0, from: checkpoint, until: checkpoint.dataEnd + 1) })
+        XCTAssertEqual(decoder.failure, .staleIndex)
+        XCTAssertTrue(withFitBuffer(bytes) { decoder.read($0, from: checkpoint, until: checkpoint.dataEnd) })
+    }
+}
+
+class FitParallelDecoderTests: XCTestCase {
+
+    func testParallelMatchesSequential() {
+        var powers = [UInt16]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { powers.append(RecordMesg($0).getPower() ?? 0) }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+
+        var parallelPowers = [UInt16]()
+        let parallel = FitParallelDecoder()
+        parallel.onMesg = { parallelPowers.append(RecordMesg($0).getPower() ?? 0) }
+        XCTAssertTrue(parallel.read(path: FitBufferTests.activityPath))
+        XCTAssertEqual(parallel.mesgCount, powers.count)
+        XCTAssertEqual(parallelPowers, powers)
+    }
+
+    func testDecodeFiles() {
+        let paths = [String](repeating: FitBufferTests.activityPath, count: 3) + ["/nonexistent.fit"]
+        var counts = [Int: Int]()
+        let finished = expectation(description: "decoded")
+        FitParallelDecoder.decode(paths: paths, maxConcurrentFiles: 2, completion: { i, mesgs in
+            counts[i] = mesgs?.count ?? -1
+        }, done: {
+            finished.fulfill()
+        })
+        wait(for: [finished], timeout: 120)
+        XCTAssertEqual(counts[0], 600_000)
+        XCTAssertEqual(counts[3], -1)
+    }
+
+    func testPerformanceParallelDecode() {
+        let path = FitBufferTests.activityPath
+        measure {
+            let decoder = FitParallelDecoder()
+            decoder.onMesg = { _ in }
+            decoder.read(path: path)
+        }
+    }
+}
+
+class FitColumnsTests: XCTestCase {
+
+    func testColumnsMatchMesgs() {
+        var powers = [UInt16]()
+        var speeds = [Double]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { mesg in
+            let record = RecordMesg(mesg)
+            powers.append(record.getPower() ?? 0)
+            speeds.append(Double(record.getSpeed() ?? 0))
+        }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+
+        guard let records = FitColumns(path: FitBufferTests.activityPath)?[MesgNum.Record] else {
+            return XCTFail("no records")
+        }
+        XCTAssertEqual(records.count, powers.count)
+        XCTAssertEqual(records.timestamps?.validity.validCount, powers.count)
+        XCTAssertEqual(records.column(num: RecordMesg.FieldDefNum.Power.rawValue, as: UInt16.self)?.values, powers)
+        let scaled = records.scaledColumn(num: RecordMesg.FieldDefNum.Speed.rawValue)?.scaledValues() ?? []
+        XCTAssertEqual(scaled.count, speeds.count)
+        XCTAssertEqual(scaled.first ?? 0, speeds.first ?? 0, accuracy: 1e-3)
+    }
+
+    func testValidity() {
+        var validity = FitValidity()
+        for row in 0..<130 {
+            validity.append(row % 3 == 0)
+        }
+        XCTAssertEqual(validity.count, 130)
+        XCTAssertEqual(validity.validCount, 44)
+        XCTAssertTrue(validity[129])
+        XCTAssertFalse(validity[128])
+    }
+
+    func testPerformanceColumns() {
+        let path = FitBufferTests.activityPath
+        measure {
+            _ = FitColumns(path: path, mesgFilter: [MesgNum.Record])
+        }
+    }
+}
+
+class FitStreamEncoderTests: XCTestCase {
+
+    func testMatchesEncode() {
+        let mesgs: [Mesg] = FitFixtures.records(10_000) { record, i in record.setPower(UInt16(i % 400)) }
+        let expected = FitFixtures.file(mesgs)
+
+        let path = NSTemporaryDirectory() + "FitStreamEncoderTests.fit"
+        guard let encoder = FitStreamEncoder(path: path, bufferSize: 1_000) else {
+            return XCTFail("not opened")
+        }
+        encoder.write(mesgs)
+        XCTAssertTrue(encoder.close())
+        XCTAssertEqual(encoder.mesgCount, mesgs.count)
+        XCTAssertEqual([UInt8](FileManager.default.contents(atPath: path)!), expected)
+        XCTAssertTrue(FitBufferDecoder.checkIntegrity(path: path))
+    }
+
+    func testCRCCombine() {
+        let bytes = (0..<5_000).map { UInt8(truncatingIfNeeded: $0 &* 7) }
+        let first = GimKitCRC16.checksum(Array(bytes[0..<14]))
+        let second = GimKitCRC16.checksum(Array(bytes[14...]))
+        XCTAssertEqual(GimKitCRC16.combine(first, second, length2: bytes.count - 14), GimKitCRC16.checksum(bytes))
+    }
+}
+
+class CompressedTimestampTests: XCTestCase {
+
+    private func records(gapAt gap: Int) -> [RecordMesg] {
+        return FitFixtures.records(2_000) { record, i in
+            if i >= gap {
+                record.setTimestamp(FitDateTime(timeStamp: FitFixtures.start + UInt32(i) + 3_600))
+            }
+            record.setHeartRate(UInt8(100 + i % 50))
+            record.setPower(UInt16(i % 500))
+        }
+    }
+
+    private func encode(_ mesgs: [Mesg], compress: Bool) -> (path: String, encoder: FitStreamEncoder) {
+        let path = NSTemporaryDirectory() + "CompressedTimestampTests-\(compress).fit"
+        let encoder = FitStreamEncoder(path: path)!
+        encoder.compressTimestamps = compress
+        encoder.write(mesgs)
+        XCTAssertTrue(encoder.close())
+        return (path, encoder)
+    }
+
+    func testRoundTrip() {
+        let mesgs = records(gapAt: 1_000)
+        let (path, encoder) = encode(mesgs, compress: true)
+        // The first message and the one after the gap keep their timestamp field.
+        XCTAssertEqual(encoder.compressedCount, mesgs.count - 2)
+
+        var decoded = [(UInt32, UInt16)]()
+        let decode = Decode()
+        let bytes = [UInt8](FileManager.default.contents(atPath: path)!)
+        XCTAssertTrue(decode.checkIntegrity(PositionableData(data: bytes)))
+        let listener = MesgCollector()
+        decode.delegate = listener
+        XCTAssertTrue(decode.read(PositionableData(data: bytes)))
+        for mesg in listener.mesgs {
+            let record = RecordMesg(mesg)
+            decoded.append((record.getTimestamp()?.timeStamp ?? 0, record.getPower() ?? 0))
+        }
+        XCTAssertEqual(decoded.map { $0.0 }, mesgs.map { $0.getTimestamp()?.timeStamp ?? 0 })
+        XCTAssertEqual(decoded.map { $0.1 }, mesgs.map { $0.getPower() ?? 0 })
+
+        var lazyTimestamps = [UInt32]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { lazyTimestamps.append($0.timestamp ?? 0) }
+        XCTAssertTrue(decoder.read(path: path))
+        XCTAssertEqual(lazyTimestamps, decoded.map { $0.0 })
+    }
+
+    func testSmallerFile() {
+        let mesgs = records(gapAt: Int.max)
+        let plain = encode(mesgs, compress: false).path
+        let compressed = encode(mesgs, compress: true).path
+        let plainSize = FileManager.default.contents(atPath: plain)!.count
+        let compressedSize = FileManager.default.contents(atPath: compressed)!.count
+        XCTAssertLessThanOrEqual(compressedSize, plainSize - 4 * (mesgs.count - 1) + 16)
+    }
+}
+
+class FitLocalMesgAllocatorTests: XCTestCase {
+
+    private func interleaved() -> [Mesg] {
+        var mesgs = [Mesg]()
+        for (i, record) in FitFixtures.records(3_000, fill: { $0.setPower(UInt16($1 % 300)) }).enumerated() {
+            mesgs.append(record)
+            if i % 2 == 0 {
+                let event = EventMesg()
+                event.setTimestamp(FitDateTime(timeStamp: FitFixtures.start + UInt32(i)))
+                event.setData(UInt32(i))
+                mesgs.append(event)
+            }
+            if i % 3 == 0 {
+                let lap = LapMesg()
+                lap.setTimestamp(FitDateTime(timeStamp: FitFixtures.start + UInt32(i)))
+                mesgs.append(lap)
+            }
+        }
+        return mesgs
+    }
+
+    func testDefinitionsReused() {
+        let mesgs = interleaved()
+        let plainPath = NSTemporaryDirectory() + "FitLocalMesgAllocatorTests-plain.fit"
+        let plain = FitStreamEncoder(path: plainPath)!
+        plain.write(mesgs)
+        XCTAssertTrue(plain.close())
+
+        let path = NSTemporaryDirectory() + "FitLocalMesgAllocatorTests.fit"
+        let encoder = FitStreamEncoder(path: path)!
+        let allocator = FitLocalMesgAllocator()
+        encoder.localMesgAllocator = allocator
+        encoder.write(mesgs)
+        XCTAssertTrue(encoder.close())
+        XCTAssertEqual(allocator.misses, 3)
+        XCTAssertEqual(allocator.hits, mesgs.count - 3)
+        XCTAssertLessThan(encoder.dataSize, plain.dataSize)
+
+        var nums = [UInt16]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { nums.append($0.num) }
+        XCTAssertTrue(decoder.read(path: path))
+        XCTAssertEqual(nums, mesgs.map { $0.num })
+    }
+
+    func testEviction() {
+        let allocator = FitLocalMesgAllocator()
+        let record = RecordMesg(), lap = LapMesg(), event = EventMesg()
+        XCTAssertEqual(allocator.allocate(record, locals: 0...1).localMesgNum, 0)
+        XCTAssertEqual(allocator.allocate(lap, locals: 0...1).localMesgNum, 1)
+        XCTAssertFalse(allocator.allocate(record, locals: 0...1).isNew)
+        // The lap is the least recently used.
+        XCTAssertEqual(allocator.allocate(event, locals: 0...1).localMesgNum, 1)
+        XCTAssertEqual(allocator.evictions, 1)
+    }
+}
+
+class GimKitRecorderTests: XCTestCase {
+
+    func testRecordsQueuedSamples() {
+        let path = NSTemporaryDirectory() + "GimKitRecorderTests.fit"
+        guard let recorder = GimKitRecorder(path: path, batchSize: 8) else {
+            return XCTFail("not created")
+        }
+        for i in 0..<100 {
+            var sample = GKTelemetrySample()
+            sample.present = GK_TELEMETRY_CADENCE.rawValue | GK_TELEMETRY_POWER.rawValue | GK_TELEMETRY_TORQUE.rawValue
+            sample.cadence = 80
+            sample.power = Float(100 + i)
+            sample.torque = 12.5
+            recorder.push(sample)
+        }
+        recorder.onHeartrateMeasured(heartrate: 142)
+
+        let stopped = expectation(description: "stopped")
+        recorder.stop { succeeded in
+            XCTAssertTrue(succeeded)
+            stopped.fulfill()
+        }
+        wait(for: [stopped], timeout: 5)
+        XCTAssertEqual(recorder.droppedCount, 0)
+        XCTAssertGreaterThan(recorder.recordCount, 0)
+
+        var records = [RecordMesg]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { mesg in
+            if mesg.num == MesgNum.Record {
+                records.append(RecordMesg(mesg))
+            }
+        }
+        XCTAssertTrue(decoder.read(path: path))
+        XCTAssertEqual(records.count, recorder.recordCount)
+        XCTAssertEqual(records.last?.getPower(), 199)
+        XCTAssertEqual(records.last?.getHeartRate(), 142)
+        XCTAssertEqual(records.last?.getCadence(), 80)
+    }
+
+    func testRemovesJournalWhenStopped() {
+        let path = NSTemporaryDirectory() + "GimKitRecorderTests-journal.fit"
+        guard let recorder = GimKitRecorder(path: path), let journalPath = recorder.journalPath else {
+            return XCTFail("not created")
+        }
+        XCTAssertTrue(FileManager.default.fileExists(atPath: journalPath))
+        let stopped = expectation(description: "stopped")
+        recorder.stop { _ in stopped.fulfill() }
+        wait(for: [stopped], timeout: 5)
+        XCTAssertFalse(FileManager.default.fileExists(atPath: journalPath))
+    }
+
+    func testRecoversOrphanedJournal() {
+        let directory = NSTemporaryDirectory() + "GimKitRecorderTests-recovery"
+        try? FileManager.default.removeItem(atPath: directory)
+        try? FileManager.default.createDirectory(atPath: directory, withIntermediateDirectories: true)
+        let fitPath = directory + "/ride.fit"
+        let journalPath = fitPath + "." + GimKitRecorder.journalExtension
+
+        // A journal of 10 s of samples at 10 Hz, its last group never committed.
+        let start = Date(timeIntervalSince1970: 1_600_000_000)
+        let journal = gk_journal_open_writer(journalPath, 0, UInt64(start.timeIntervalSince1970 * 1_000_000), 20)
+        var sample = GKTelemetrySample()
+        sample.present = GK_TELEMETRY_POWER.rawValue | GK_TELEMETRY_TENSION.rawValue
+        for i in 0..<110 {
+            sample.timeNs = UInt64(i) * 100_000_000
+            sample.power = Float(i)
+            sample.tension = 30
+            gk_journal_append(journal, &sample, 1)
+        }
+        XCTAssertEqual(gk_journal_committed(journal), 100)
+
+        XCTAssertEqual(GimKitRecorder.recoverJournals(in: directory), [fitPath])
+        XCTAssertFalse(FileManager.default.fileExists(atPath: journalPath))
+        gk_journal_close_writer(journal, false)
+
+        var records = [RecordMesg]()
+        let decoder = FitBufferDecoder()
+        decoder.onMesg = { mesg in
+            if mesg.num == MesgNum.Record {
+                records.append(RecordMesg(mesg))
+            }
+        }
+        XCTAssertTrue(decoder.read(path: fitPath))
+        XCTAssertEqual(records.count, 10)
+        XCTAssertEqual(records.first?.getTimestamp()?.timeStamp, FitDateTime(date: start).timeStamp)
+        XCTAssertEqual(records.last?.getPower(), 99)
+    }
+}
+
+class FitSummaryAggregatorTests: XCTestCase {
+
+    private let start = FitFixtures.start
+
+    func testNormalizedPower() {
+        let powers = (0..<600).map { Double(150 + ($0 / 20 % 2) * 150) }
+        let aggregator = FitSummaryAggregator()
+        for (i, power) in powers.enumerated() {
+            aggregator.add(timestamp: start + UInt32(i), power: power, distance: Double(i) * 8)
+        }
+
+        var fourthPowers = [Double]()
+        for end in 30...powers.count {
+            fourthPowers.append(pow(powers[(end - 30)..<end].reduce(0, +) / 30, 4))
+        }
+        let expected = pow(fourthPowers.reduce(0, +) / Double(fourthPowers.count), 0.25)
+        XCTAssertEqual(aggregator.session.normalizedPower ?? 0, expected, accuracy: 1e-6)
+        XCTAssertEqual(aggregator.session.power.average ?? 0, 225, accuracy: 1e-9)
+        XCTAssertEqual(aggregator.session.power.max, 300)
+        XCTAssertEqual(aggregator.session.distance, 599 * 8, accuracy: 1e-9)
+        XCTAssertEqual(aggregator.session.elapsedTime, 600)
+    }
+
+    func testLaps() {
+        let aggregator = FitSummaryAggregator()
+        for i in 0..<120 {
+            aggregator.add(timestamp: start + UInt32(i), power: i < 60 ? 100 : 300, heartRate: 120)
+            if i == 59 {
+                aggregator.endLap()
+            }
+        }
+        // The session counts the laps ended, the caller ends the last one.
+        XCTAssertEqual(aggregator.sessionMesg().getNumLaps(), 1)
+        aggregator.endLap()
+        let session = aggregator.sessionMesg()
+        XCTAssertEqual(aggregator.laps.count, 2)
+        XCTAssertEqual(session.getNumLaps(), 2)
+        XCTAssertEqual(aggregator.laps[0].getAvgPower(), 100)
+        XCTAssertEqual(aggregator.laps[1].getAvgPower(), 300)
+        XCTAssertEqual(aggregator.laps[1].getTotalTimerTime() ?? 0, 60, accuracy: 1e-3)
+        XCTAssertEqual(session.getAvgPower(), 200)
+        XCTAssertEqual(session.getTotalWork(), 24_000)
+        XCTAssertEqual(session.getAvgHeartRate(), 120)
+    }
+
+    func testPauseExcludedFromTimerTime() {
+        let aggregator = FitSummaryAggregator()
+        aggregator.add(timestamp: start, power: 100)
+        aggregator.add(timestamp: start + 1, power: 100)
+        aggregator.add(timestamp: start + 600, power: 100)
+        XCTAssertEqual(aggregator.session.timerTime, 3)
+        XCTAssertEqual(aggregator.session.elapsedTime, 601)
+    }
+}
+
+class FitAccumulatorTests: XCTestCase {
+
+    func testWraps() {
+        let accumulator = FitAccumulator()
+        var total: Int64 = 0
+        for value: Int64 in [10, 200, 250, 4, 100] {
+            total = accumulator.accumulate(slot: 1, value: value, bits: 8)
+        }
+        XCTAssertEqual(total, 256 + 100)
+        accumulator.set(slot: 1, value: 1_000)
+        XCTAssertEqual(accumulator.accumulate(slot: 1, value: 1_010, bits: 8), 1_010)
+    }
+
+    func testColumnsMatchExpandedComponents() {
+        let bytes = FitFixtures.file(FitFixtures.records(2_000) { record, i in
+            record.setCycles(UInt8(truncatingIfNeeded: i * 3))
+        })
+        let path = NSTemporaryDirectory() + "FitAccumulatorTests.fit"
+        // One file, then two chained: the totals start again from 0 in the second one.
+        for chained in [bytes, bytes + bytes] {
+            XCTAssertTrue(FileManager.default.createFile(atPath: path, contents: Data(chained)))
+
+            var expected = [UInt32]()
+            let decoder = FitBufferDecoder()
+            decoder.onMesg = { expected.append(RecordMesg($0).getTotalCycles() ?? 0) }
+            XCTAssertTrue(decoder.read(path: path))
+
+            let column = FitColumns(path: path)?[MesgNum.Record]?
+                .column(num: RecordMesg.FieldDefNum.TotalCycles.rawValue, as: UInt32.self)
+            XCTAssertEqual(column?.values, expected)
+            XCTAssertEqual(expected.last, 1_999 * 3)
+        }
+    }
+}
+
+class FitProfileTableTests: XCTestCase {
+
+    func testMatchesProfile() {
+        for num in [MesgNum.FileId, MesgNum.Record, MesgNum.Lap, MesgNum.Session] {
+            let mesg = FitProfileTable.mesg(num)
+            XCTAssertTrue(mesg === FitProfileTable.mesg(num))
+            XCTAssertEqual(mesg.name, Profile.getMesg(globalMesgNum: num).name)
+            for fieldNum in mesg.fieldNums {
+                let field = Profile.getField(globalMesgNum: num, fieldNum: fieldNum)
+                XCTAssertEqual(mesg.field(num: fieldNum)?.name, field?.name)
+                XCTAssertEqual(mesg.scale(num: fieldNum), field?.scale)
+                XCTAssertEqual(mesg.fieldNum(name: field?.name ?? ""), fieldNum)
+            }
+        }
+        XCTAssertEqual(FitProfileTable.mesg(MesgNum.Record).fieldNum(name: "power"), RecordMesg.FieldDefNum.Power.rawValue)
+        XCTAssertNil(FitProfileTable.mesg(MesgNum.Record).fieldNum(name: "no_such_field"))
+    }
+
+    func testLazyMesgByName() {
+        var powers = [Double]()
+        var expected = [Double]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { mesg in
+            guard mesg.num == MesgNum.Record else {
+                return
+            }
+            powers.append(mesg.getValue(fieldName: "power") ?? -1)
+            expected.append(mesg.getValue(fieldNum: RecordMesg.FieldDefNum.Power.rawValue) ?? -1)
+        }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+        XCTAssertFalse(powers.isEmpty)
+        XCTAssertEqual(powers, expected)
+    }
+
+    func testPerformanceMaterialize() {
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { _ = $0.materialize() }
+        measure {
+            _ = decoder.read(path: FitBufferTests.activityPath)
+        }
+    }
+}
+
+class FitMesgVisitorTests: XCTestCase {
+
+    /// A file id, 100 records, a timer event, a lap and a session.
+    private static let bytes: [UInt8] = FitFixtures.file { encode in
+        let fileId = FileIdMesg()
+        fileId.setType(.Activity)
+        fileId.setSerialNumber(1234)
+        encode.write(fileId)
+        let aggregator = FitSummaryAggregator()
+        let records = FitFixtures.records(100) { record, i in
+            record.setPower(UInt16(180 + i % 20))
+            record.setSpeed(Float32(8 + Double(i % 10) / 10))
+            record.setAltitude(Float32(100 + i % 50))
+        }
+        for record in records {
+            encode.write(record)
+            aggregator.add(record)
+        }
+        let event = EventMesg()
+        event.setTimestamp(FitDateTime(timeStamp: FitFixtures.start + 99))
+        event.setEvent(.Timer)
+        event.setEventType(.StopAll)
+        encode.write(event)
+        encode.write(aggregator.endLap())
+        encode.write(aggregator.sessionMesg())
+    }
+
+    func testRecordViewsMatchLazyMesgs() {
+        var expected = [[Double]]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { mesg in
+            guard mesg.num == MesgNum.Record else {
+                return
+            }
+            expected.append([Double(mesg.timestamp ?? 0),
+                             mesg.getValue(fieldNum: RecordMesg.FieldDefNum.Power.rawValue) ?? -1,
+                             mesg.getValue(fieldNum: RecordMesg.FieldDefNum.Speed.rawValue) ?? -1,
+                             mesg.getValue(fieldNum: RecordMesg.FieldDefNum.Altitude.rawValue) ?? -1])
+        }
+        XCTAssertTrue(decoder.read(FitMesgVisitorTests.bytes))
+
+        var records = [[Double]]()
+        var sessions = [SessionMesg]()
+        let visitor = FitMesgVisitor()
+        visitor.on(FitRecordView.self) { record in
+            records.append([Double(record.timestamp ?? 0), record.power.map { Double($0) } ?? -1,
+                            record.speed ?? -1, record.altitude ?? -1])
+        }
+        visitor.on(FitSessionView.self) { session in
+            XCTAssertEqual(session.numLaps, 1)
+            XCTAssertEqual(session.avgPower, 190)
+            XCTAssertEqual(session.totalTimerTime, 100)
+            sessions.append(SessionMesg(session.mesg.materialize()))
+        }
+        XCTAssertTrue(visitor.visit(FitMesgVisitorTests.bytes))
+        XCTAssertNil(visitor.failure)
+        XCTAssertEqual(records.count, 100)
+        XCTAssertEqual(records, expected)
+        XCTAssertEqual(sessions.count, 1)
+        XCTAssertEqual(sessions.first?.getAvgPower(), 190)
+        XCTAssertEqual(visitor.mesgCount, 101)
+    }
+
+    func testRecordViewGettersMatchTypedMesg() {
+        var records = 0
+        let visitor = FitMesgVisitor()
+        visitor.on(FitRecordView.self) { record in
+            let typed = TypedMesg(record.mesg)
+            XCTAssertEqual(record.heartRate, typed.heartRate)
+            XCTAssertEqual(record.cadence, typed.cadence)
+            XCTAssertEqual(record.power, typed.power)
+            XCTAssertEqual(record.speed, typed.speed)
+            XCTAssertEqual(record.distance, typed.distance)
+            XCTAssertEqual(record.altitude, typed.altitude)
+            records += 1
+        }
+        XCTAssertTrue(visitor.visit(FitMesgVisitorTests.bytes))
+        XCTAssertEqual(records, 100)
+    }
+
+    func testUnregisteredTypesSkipped() {
+        var fileIds = 0
+        var events = 0
+        let visitor = FitMesgVisitor()
+        visitor.on(FitFileIdView.self) { fileId in
+            XCTAssertEqual(fileId.type, .Activity)
+            XCTAssertEqual(fileId.serialNumber, 1234)
+            fileIds += 1
+        }
+        visitor.on(FitEventView.self) { event in
+            XCTAssertEqual(event.event, .Timer)
+            XCTAssertEqual(event.eventType, .StopAll)
+            events += 1
+        }
+        XCTAssertTrue(visitor.visit(FitMesgVisitorTests.bytes))
+        XCTAssertEqual(fileIds, 1)
+        XCTAssertEqual(events, 1)
+        XCTAssertEqual(visitor.mesgCount, 2)
+
+        visitor.removeHandlers(FitEventView.self)
+        XCTAssertTrue(visitor.visit(FitMesgVisitorTests.bytes))
+        XCTAssertEqual(events, 1)
+        XCTAssertEqual(visitor.mesgCount, 1)
+    }
+
+    func testPerformanceRecordViews() {
+        let visitor = FitMesgVisitor()
+        var sum: Double = 0
+        visitor.on(FitRecordView.self) { sum += $0.altitude ?? 0 }
+        measure {
+            _ = visitor.visit(path: FitBufferTests.activityPath)
+        }
+        XCTAssertGreaterThan(sum, 0)
+    }
+}
+
+class FitScalingTests: XCTestCase {
+
+    func testMatchesScalarWithInvalidValues() {
+        // 21 values: two vectors and a remainder.
+        var raw = (0..<21).map { UInt16(2_500 + $0 * 7) }
+        raw[3] = UInt16.max
+        raw[20] = UInt16.max
+        let scaled = FitScaling.scaled(raw, baseType: FitBaseType.Uint16, scale: 5, offset: 500)
+        let scaledFloat32 = FitScaling.scaledFloat32(raw, baseType: FitBaseType.Uint16, scale: 5, offset: 500)
+        XCTAssertEqual(scaled.count, raw.count)
+        for (i, value) in raw.enumerated() {
+            if value == UInt16.max {
+                XCTAssertTrue(scaled[i].isNaN)
+                XCTAssertTrue(scaledFloat32[i].isNaN)
+            } else {
+                XCTAssertEqual(scaled[i], Double(value) / 5 - 500)
+                XCTAssertEqual(scaledFloat32[i], Float32(Double(value) / 5 - 500))
+            }
+        }
+    }
+
+    func testInvalidValues() {
+        XCTAssertEqual(FitScaling.invalidValue(UInt32.self, baseType: FitBaseType.Uint32z), 0)
+        XCTAssertEqual(FitScaling.invalidValue(Int8.self, baseType: FitBaseType.Sint8), Int8.max)
+        XCTAssertEqual(FitScaling.invalidValue(UInt16.self, baseType: FitBaseType.Uint16), UInt16.max)
+        let scaled = FitScaling.scaled([0, 1, 2, 3, 4, 5, 6, 7, 8] as [UInt32], baseType: FitBaseType.Uint32z, scale: 1,
+                                       offset: 0)
+        XCTAssertTrue(scaled[0].isNaN)
+        XCTAssertEqual(scaled[8], 8)
+        let wide = FitScaling.scaled([UInt64.max - 1, UInt64.max] + [UInt64](repeating: 1, count: 7), baseType: FitBaseType.Uint64,
+                                     scale: 1, offset: 0)
+        XCTAssertFalse(wide[0].isNaN)
+        XCTAssertTrue(wide[1].isNaN)
+    }
+
+    func testBaseTypeInfoAgreesWithFitBaseType() {
+        let integers: [(UInt8, Int)] = [
+            (FitBaseType.Enum, 1), (FitBaseType.Sint8, 1), (FitBaseType.Uint8, 1), (FitBaseType.Uint8z, 1),
+            (FitBaseType.Byte, 1), (FitBaseType.Sint16, 2), (FitBaseType.Uint16, 2), (FitBaseType.Uint16z, 2),
+            (FitBaseType.Sint32, 4), (FitBaseType.Uint32, 4), (FitBaseType.Uint32z, 4), (FitBaseType.Sint64, 8),
+            (FitBaseType.Uint64, 8), (FitBaseType.Uint64z, 8),
+        ]
+        for (baseType, size) in integers {
+            let info = FitBaseTypeInfo.of(baseType)
+            XCTAssertTrue(info.isInteger)
+            XCTAssertEqual(info.size, size)
+            XCTAssertEqual(FitBuffer.elementSize(baseType: baseType), size)
+            XCTAssertTrue(FitBaseType.isNumericInvalid(value: info.invalid, type: baseType), "\(baseType)")
+            XCTAssertFalse(FitBaseType.isNumericInvalid(value: 1, type: baseType), "\(baseType)")
+        }
+        XCTAssertEqual(FitBaseTypeInfo.of(FitBaseType.Float32).kind, .float)
+        XCTAssertEqual(FitBaseTypeInfo.of(FitBaseType.Float64).size, 8)
+        XCTAssertEqual(FitBaseTypeInfo.of(FitBaseType.String).kind, .other)
+        XCTAssertEqual(FitBaseTypeInfo.of(FitBaseType.String).size, 1)
+    }
+
+    func testColumnMatchesLazyMesgs() {
+        var expected = [Double]()
+        let decoder = FitBufferDecoder()
+        decoder.onLazyMesg = { mesg in
+            if mesg.num == MesgNum.Record {
+                expected.append(mesg.getValue(fieldNum: RecordMesg.FieldDefNum.Altitude.rawValue) ?? .nan)
+            }
+        }
+        XCTAssertTrue(decoder.read(path: FitBufferTests.activityPath))
+        let column = FitColumns(path: FitBufferTests.activityPath, mesgFilter: [MesgNum.Record])?[MesgNum.Record]?
+            .scaledColumn(num: RecordMesg.FieldDefNum.Altitude.rawValue)
+        XCTAssertEqual(column?.scaledValues(), expected)
+        XCTAssertEqual(column?.scaledFloat32Values().count, expected.count)
+    }
+
+    func testPerformanceScaledAltitudes() {
+        let raw = (0..<600_000).map { UInt16(2_500 + $0 % 1_000) }
+        measure {
+            _ = FitScaling.scaled(raw, baseType: FitBaseType.Uint16, scale: 5, offset: 500)
+        }
+    }
+}
+
+class GimKitTraceTests: XCTestCase {
+
+    func testCaptureSupersededByALaterOne() {
+        let url = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("capture.json")
+        let first = expectation(description: "first capture")
+        let second = expectation(description: "second capture")
+        GimKitTrace.capture(duration: 0.1, to: url) { written in
+            XCTAssertNil(written)
+            // The timer of the first capture leaves the second one tracing.
+            XCTAssertTrue(GimKitTrace.isEnabled)
+            first.fulfill()
+        }
+        GimKitTrace.capture(duration: 0.3, to: url) { written in
+            XCTAssertNotNil(written)
+            XCTAssertFalse(GimKitTrace.isEnabled)
+            second.fulfill()
+        }
+        wait(for: [first, second], timeout: 5, enforceOrder: true)
+    }
+}
@@ -0,0 +1,162 @@
+//
+//  FitAccumulator.swift
+//  GimBle
+//
+//  Accumulated fields in flat arrays, their slots resolved with the message definitions.
+//
+
+import Foundation
+import GimKit
+
+/// A counterpart of `Accumulator` for the messages read through a `FitBuffer`.
+///
+/// `Accumulator.accumulate(mesgNum:destFieldNum:value:bits:)` looks its `AccumulatedField` up for
+/// every value. Here each accumulated field of `components` has a fixed slot in two arrays: the
+/// slots of a message are resolved once, when its `MesgLayout` is read, into the `accumulations`
+/// of the layout, and accumulating a value is a single slot update.
+///
+/// Only the record fields are supported: distance from compressed_speed_distance, total_cycles and
+/// accumulated_power, one value per message. The other accumulating component of the profile,
+/// hr.event_timestamp_12, packs eight values into the event_timestamp array, which a column of
+/// one value per message can't hold; it is not accumulated here.
+///
+/// `Mesg.expandComponents(accumulator:)` still needs an `Accumulator`, this one serves `LazyMesg`
+/// consumers such as `FitColumns`.
+public final class FitAccumulator {
+
+    /// A component of a field that accumulates into another field of the message.
+    public struct Component {
+        public let globalMesgNum: UInt16
+        public let sourceFieldNum: UInt8
+        /// Bits of the source value, least significant first
+        public let bitOffset: Int
+        public let bits: Int
+        public let destFieldNum: UInt8
+        /// Scale of the component, the destination field has its own
+        public let scale: Double
+    }
+
+    /// One accumulated field of a message layout.
+    public struct Accumulation {
+        /// Slot of the destination field
+        public let slot: Int
+        /// Index of the source field in `MesgLayout.fields`
+        public let fieldIndex: Int
+        public let bitOffset: Int
+        public let bits: Int
+        public let destFieldNum: UInt8
+        /// Destination raw units per accumulated unit
+        public let factor: Double
+        /// The field is the destination itself: its value resets the accumulation
+        public let isReset: Bool
+    }
+
+    /// The supported accumulating components, the slot of a destination field is its index.
+    public static let components: [Component] = [
+        // record.compressed_speed_distance: speed (12 bits), distance (12 bits, 1/16 m)
+        Component(globalMesgNum: MesgNum.Record, sourceFieldNum: 8, bitOffset: 12, bits: 12, destFieldNum: 5, scale: 16),
+        // record.cycles -> total_cycles
+        Component(globalMesgNum: MesgNum.Record, sourceFieldNum: 18, bitOffset: 0, bits: 8, destFieldNum: 19, scale: 1),
+        // record.compressed_accumulated_power -> accumulated_power
+        Component(globalMesgNum: MesgNum.Record, sourceFieldNum: 28, bitOffset: 0, bits: 16, destFieldNum: 29, scale: 1),
+    ]
+
+    private var accumulated = [Int64](repeating: 0, count: FitAccumulator.components.count)
+    private var last = [Int64](repeating: 0, count: FitAccumulator.components.count)
+
+    public init() {
+    }
+
+    /// The accumulations of a message with `fields`, resets first.
+    public static func accumulations(globalMesgNum: UInt16, fields: [MesgLayout.FieldLayout]) -> [Accumulation] {
+        var resets = [Accumulation]()
+        var accumulations = [Accumulation]()
+        for (slot, component) in components.enumerated() where component.globalMesgNum == globalMesgNum {
+            if let index = fields.firstIndex(where: { $0.num == component.destFieldNum }) {
+                resets.append(Accumulation(slot: slot, fieldIndex: index, bitOffset: 0, bits: 64,
+                                           destFieldNum: component.destFieldNum, factor: 1, isReset: true))
+            } else if let index = fields.firstIndex(where: { $0.num == component.sourceFieldNum }) {
+                let destScale = FitProfileTable.mesg(globalMesgNum).scale(num: component.destFieldNum)
+                accumulations.append(Accumulation(slot: slot, fieldIndex: index, bitOffset: component.bitOffset,
+                                                  bits: component.bits, destFieldNum: component.destFieldNum,
+                                                  factor: destScale / component.scale, isReset: false))
+            }
+        }
+        return resets + accumulations
+    }
+
+    /// Add the wrapped `value` of `bits` bits to the slot, and return its accumulated value.
+    @inline(__always)
+    public func accumulate(slot: Int, value: Int64, bits: Int) -> Int64 {
+        let mask: Int64 = bits >= 64 ? -1 : (1 << Int64(bits)) - 1
+        accumulated[slot] += (value - last[slot]) & mask
+        last[slot] = value
+        return accumulated[slot]
+    }
+
+    /// Reset the slot to a full value.
+    @inline(__always)
+    public func set(slot: Int, value: Int64) {
+        accumulated[slot] = value
+        last[slot] = value
+    }
+
+    /// The accumulated values of a message, as destination field numbers and raw values in the
+    /// units of the destination fields. Destination fields present in the message are reported
+    /// as they are.
+    public func accumulate(_ mesg: LazyMesg, _ body: (UInt8, Int64) -> Void) {
+        let layout = mesg.layout
+        for accumulation in layout.accumulations {
+            let field = layout.fields[accumulation.fieldIndex]
+            guard let value = FitAccumulator.bits(of: mesg, field: field, offset: accumulation.bitOffset,
+                                                  count: accumulation.bits) else {
+                continue
+            }
+            if accumulation.isReset {
+                set(slot: accumulation.slot, value: value)
+                body(accumulation.destFieldNum, value)
+            } else {
+                let total = accumulate(slot: accumulation.slot, value: value, bits: accumulation.bits)
+                body(accumulation.destFieldNum, Int64((Double(total) * accumulation.factor).rounded()))
+            }
+        }
+    }
+
+    public func reset() {
+        for slot in 0..<accumulated.count {
+            accumulated[slot] = 0
+            last[slot] = 0
+        }
+    }
+
+    /// `count` bits of a field from bit `offset`, nil if the field is invalid. Byte arrays are read
+    /// as one little endian integer.
+    @inline(__always)
+    private static func bits(of mesg: LazyMesg, field: MesgLayout.FieldLayout, offset: Int, count: Int) -> Int64? {
+        let start = mesg.offset + 1 + field.offset
+        var raw: Int64
+        if Int(field.size) == FitBuffer.elementSize(baseType: field.type) {
+            guard let value = LazyMesg.integer(mesg.buffer, at: start, baseType: field.type,
+                                               bigEndian: mesg.layout.isBigEndian) else {
+                return nil
+            }
+            raw = value
+        } else {
+            let size = min(Int(field.size), 8)
+            raw = 0
+            var invalid = true
+            for i in (0..<size).reversed() {
+                let byte = mesg.buffer[start + i]
+                invalid = invalid && byte == 0xFF
+                raw = raw << 8 | Int64(byte)
+            }
+            if invalid {
+                return nil
+            }
+        }
+        guard count < 64 else {
+            return raw
+        }
+        return (raw >> Int64(offset)) & ((1 << Int64(count)) - 1)
+    }
+}
@@ -0,0 +1,83 @@
+//
+//  FitBaseTypes.swift
+//  GimBle
+//
+//  Size, kind and invalid value of the FIT base types, derived once from the FitBaseType codes.
+//
+
+import Foundation
+import GimKit
+
+/// What the decoders need to know of a base type.
+///
+/// `FitBaseType` gives the codes, and `FitBaseType.isNumericInvalid(value:type:)` tests a value
+/// through a switch on them. The readers of this package look up the element size and the invalid
+/// value of a field for every element, so they look them up here instead: one table indexed by the
+/// base type number, the low five bits of the code, built from the `FitBaseType` codes on first use.
+public struct FitBaseTypeInfo {
+
+    public enum Kind {
+        case unsigned
+        case signed
+        case float
+        /// Strings and the base types this package doesn't know
+        case other
+    }
+
+    public let kind: Kind
+    /// Size of one element, 1 for strings
+    public let size: Int
+    /// The invalid value, as `LazyMesg.getRawValue(fieldNum:index:)` returns the raw values: sign
+    /// extended for the signed types, the bit pattern for the 64 bit unsigned and the float types
+    public let invalid: Int64
+
+    @inline(__always)
+    public var isInteger: Bool {
+        return kind == .unsigned || kind == .signed
+    }
+
+    /// The info of `baseType`, that of a string for an unknown one.
+    @inlinable
+    @inline(__always)
+    public static func of(_ baseType: UInt8) -> FitBaseTypeInfo {
+        return table[Int(baseType & FitBaseTypeInfo.numberMask)]
+    }
+
+    @usableFromInline
+    static let numberMask: UInt8 = 0x1F
+
+    @usableFromInline
+    static let table: [FitBaseTypeInfo] = {
+        var table = [FitBaseTypeInfo](repeating: FitBaseTypeInfo(kind: .other, size: 1, invalid: 0),
+                                      count: Int(numberMask) + 1)
+        func set(_ baseType: UInt8, _ kind: Kind, _ size: Int, zeroInvalid: Bool = false) {
+            let bits = 8 * size
+            let invalid: Int64
+            if zeroInvalid {
+                invalid = 0
+            } else if kind == .signed {
+                invalid = Int64.max >> (64 - bits)
+            } else {
+                invalid = bits == 64 ? -1 : (1 << bits) - 1
+            }
+            table[Int(baseType & numberMask)] = FitBaseTypeInfo(kind: kind, size: size, invalid: invalid)
+        }
+        set(FitBaseType.Enum, .unsigned, 1)
+        set(FitBaseType.Sint8, .signed, 1)
+        set(FitBaseType.Uint8, .unsigned, 1)
+        set(FitBaseType.Sint16, .signed, 2)
+        set(FitBaseType.Uint16, .unsigned, 2)
+        set(FitBaseType.Sint32, .signed, 4)
+        set(FitBaseType.Uint32, .unsigned, 4)
+        set(FitBaseType.Float32, .float, 4)
+        set(FitBaseType.Float64, .float, 8)
+        set(FitBaseType.Uint8z, .unsigned, 1, zeroInvalid: true)
+        set(FitBaseType.Uint16z, .unsigned, 2, zeroInvalid: true)
+        set(FitBaseType.Uint32z, .unsigned, 4, zeroInvalid: true)
+        set(FitBaseType.Byte, .unsigned, 1)
+        set(FitBaseType.Sint64, .signed, 8)
+        set(FitBaseType.Uint64, .unsigned, 8)
+        set(FitBaseType.Uint64z, .unsigned, 8, zeroInvalid: true)
+        return table
+    }()
+}
@@ -0,0 +1,156 @@
+//
+//  FitBuffer.swift
+//  GimBle
+//
+//  Zero-copy reading of FIT data from borrowed or memory mapped bytes.
+//
+
+import Foundation
+import GimKit
+
+/// A `PositionableData` counterpart over bytes it doesn't own.
+///
+/// `PositionableData.read(count:)` returns a new array on every call; the loads of a `FitBuffer`
+/// read straight from the underlying memory, in either byte order, and `read(count:)` returns a
+/// borrowed slice. The bytes must outlive the buffer: use it inside `withFitBuffer(_:)`,
+/// `MappedFitFile.withBuffer(_:)` or `withUnsafeBytes`.
+public struct FitBuffer {
+
+    public let bytes: UnsafeRawBufferPointer
+    public var position: Int
+
+    public init(_ bytes: UnsafeRawBufferPointer, position: Int = 0) {
+        self.bytes = bytes
+        self.position = position
+    }
+
+    @inline(__always)
+    public var count: Int {
+        return bytes.count
+    }
+
+    @inline(__always)
+    public var remaining: Int {
+        return bytes.count - position
+    }
+
+    @inline(__always)
+    public func canRead(_ count: Int) -> Bool {
+        return count <= bytes.count - position
+    }
+
+    // MARK: - Loads at an absolute offset
+
+    @inline(__always)
+    public func load<T: FixedWidthInteger>(_ type: T.Type, at offset: Int, bigEndian: Bool = false) -> T {
+        precondition(offset >= 0 && offset + MemoryLayout<T>.size <= bytes.count, "FitBuffer load out of bounds")
+        var value: T = 0
+        withUnsafeMutableBytes(of: &value) { value in
+            value.copyMemory(from: UnsafeRawBufferPointer(start: bytes.baseAddress! + offset, count: MemoryLayout<T>.size))
+        }
+        return bigEndian ? T(bigEndian: value) : T(littleEndian: value)
+    }
+
+    @inline(__always)
+    public func loadFloat32(at offset: Int, bigEndian: Bool = false) -> Float32 {
+        return Float32(bitPattern: load(UInt32.self, at: offset, bigEndian: bigEndian))
+    }
+
+    @inline(__always)
+    public func loadFloat64(at offset: Int, bigEndian: Bool = false) -> Float64 {
+        return Float64(bitPattern: load(UInt64.self, at: offset, bigEndian: bigEndian))
+    }
+
+    @inline(__always)
+    public subscript(offset: Int) -> UInt8 {
+        return bytes[offset]
+    }
+
+    /// The bytes `offset..<offset + count`, borrowed.
+    @inline(__always)
+    public func slice(at offset: Int, count: Int) -> UnsafeRawBufferPointer {
+        precondition(offset >= 0 && offset + count <= bytes.count, "FitBuffer slice out of bounds")
+        return UnsafeRawBufferPointer(start: bytes.baseAddress.map { $0 + offset }, count: count)
+    }
+
+    // MARK: - Reads at the position, which they advance
+
+    @inline(__always)
+    public mutating func read() -> UInt8 {
+        let byte = bytes[position]
+        position += 1
+        return byte
+    }
+
+    @inline(__always)
+    public mutating func read<T: FixedWidthInteger>(_ type: T.Type, bigEndian: Bool = false) -> T {
+        let value = load(type, at: position, bigEndian: bigEndian)
+        position += MemoryLayout<T>.size
+        return value
+    }
+
+    /// The next `count` bytes, borrowed.
+    @inline(__always)
+    public mutating func read(count: Int) -> UnsafeRawBufferPointer {
+        let slice = self.slice(at: position, count: count)
+        position += count
+        return slice
+    }
+
+    @inline(__always)
+    public mutating func skip(_ count: Int) {
+        position += count
+    }
+}
+
+/// Run `body` with a `FitBuffer` over the bytes of `array`, without copying them.
+public func withFitBuffer<R>(_ array: [UInt8], _ body: (inout FitBuffer) throws -> R) rethrows -> R {
+    return try array.withUnsafeBytes { bytes in
+        var buffer = FitBuffer(bytes)
+        return try body(&buffer)
+    }
+}
+
+/// A file mapped read-only in memory, paged in by the system as it is read.
+public final class MappedFitFile {
+
+    public let count: Int
+    private let base: UnsafeMutableRawPointer?
+
+    public init?(path: String) {
+        let fd = Darwin.open(path, O_RDONLY)
+        guard fd >= 0 else {
+            return nil
+        }
+        defer { Darwin.close(fd) }
+        var info = stat()
+        guard fstat(fd, &info) == 0 else {
+            return nil
+        }
+        count = Int(info.st_size)
+        if count == 0 {
+            base = nil
+            return
+        }
+        guard let mapped = mmap(nil, count, PROT_READ, MAP_PRIVATE, fd, 0), mapped != MAP_FAILED else {
+            return nil
+        }
+        // Decoding reads the file front to back once.
+        madvise(mapped, count, MADV_SEQUENTIAL)
+        base = mapped
+    }
+
+    deinit {
+        if let base = base {
+            munmap(base, count)
+        }
+    }
+
+    /// The mapping is valid as long as the file object, only use the buffer inside `body`.
+    public func withBuffer<R>(_ body: (inout FitBuffer) throws -> R) rethrows -> R {
+        var buffer = FitBuffer(UnsafeRawBufferPointer(start: base, count: count))
+        return try withExtendedLifetime(self) {
+            try body(&buffer)
+        }
+    }
+}
@@ -0,0 +1,318 @@
+//
+//  FitBufferDecoder.swift
+//  GimBle
+//
+//  Decode FIT data in place, from borrowed or memory mapped bytes.
+//
+
+import Foundation
+import GimKit
+
+/// A `Decode` counterpart reading through a `FitBuffer`.
+///
+/// The file is never copied: definitions and data messages are read in place with `MesgLayout` and
+/// `Mesg(buffer:layout:)`, and only the values of the `Mesg` objects handed to the delegate are
+/// allocated, or nothing with `onLazyMesg` alone. Compressed timestamp headers and chained files are supported; developer fields are
+/// skipped, use `Decode` for files that need them. With a `mesgFilter`, the data messages of the
+/// other global message numbers are stepped over by their size, and cost only their timestamp.
+public final class FitBufferDecoder {
+
+    public enum Failure: Error, Equatable {
+        case notFit
+        case headerCRC
+        case fileCRC
+        /// The data ends in the middle of a record
+        case truncated
+        case undefinedLocalMesg(UInt8)
+        /// The seek index was built from other data
+        case staleIndex
+    }
+
+    public weak var delegate: DecodeDelegate?
+    /// Called for every message, after the delegate.
+    public var onMesg: ((Mesg) -> Void)?
+    /// Called for every message, before the delegate, with the message left undecoded. When neither
+    /// the delegate nor `onMesg` is set, no `Mesg` is built at all, and the components are not
+    /// expanded.
+    public var onLazyMesg: ((LazyMesg) -> Void)?
+    /// Called at the header of every file, chained files included, and at a checkpoint resumed from,
+    /// before their messages: the state carried from message to message starts again there.
+    public var onFileStart: (() -> Void)?
+    /// Verify the header and file CRCs.
+    public var checkCRC = true
+    /// Expand the components of the messages, as `Decode` does.
+    public var expandComponents = true
+    /// The global message numbers to decode, nil for all of them.
+    public var mesgFilter: Set<UInt16>?
+
+    public private(set) var failure: Failure?
+    public private(set) var mesgCount = 0
+
+    private var layouts = [MesgLayout?](repeating: nil, count: 16)
+    private var lastTimestamp: UInt32 = 0
+    private var accumulator = Accumulator()
+    /// The timestamps to report, and whether decoding went past them
+    private var range: ClosedRange<UInt32>?
+    private var rangeEnded = false
+
+    public init() {
+    }
+
+    /// Decode a file, mapped in memory rather than read.
+    @discardableResult
+    public func read(path: String) -> Bool {
+        guard let file = MappedFitFile(path: path) else {
+            failure = .notFit
+            return false
+        }
+        return file.withBuffer { read(&$0) }
+    }
+
+    @discardableResult
+    public func read(_ bytes: [UInt8]) -> Bool {
+        return withFitBuffer(bytes) { read(&$0) }
+    }
+
+    /// Decode every file from the buffer position to its end.
+    @discardableResult
+    public func read(_ buffer: inout FitBuffer) -> Bool {
+        failure = nil
+        mesgCount = 0
+        range = nil
+        rangeEnded = false
+        repeat {
+            guard readFile(&buffer) else {
+                return false
+            }
+        } while buffer.remaining > 0
+        return true
+    }
+
+    /// Decode the messages timestamped `start...end` of a mapped file, from the checkpoint of `index`
+    /// before them. Messages without a timestamp are reported if they fall between the checkpoint and
+    /// the end of the range. Accumulated component fields start from 0 at the checkpoint.
+    @discardableResult
+    public func read(path: String, index: FitSeekIndex, from start: UInt32, to end: UInt32) -> Bool {
+        guard let file = MappedFitFile(path: path) else {
+            failure = .notFit
+            return false
+        }
+        return file.withBuffer { read(&$0, index: index, from: start, to: end) }
+    }
+
+    @discardableResult
+    public func read(_ buffer: inout FitBuffer, index: FitSeekIndex, from start: UInt32, to end: UInt32) -> Bool {
+        failure = nil
+        mesgCount = 0
+        range = start...max(start, end)
+        rangeEnded = false
+        guard index.matches(buffer) else {
+            return fail(.staleIndex)
+        }
+        guard let checkpoint = index.checkpoint(before: start) else {
+            return true
+        }
+        guard resume(buffer, from: checkpoint, until: checkpoint.dataEnd) else {
+            return false
+        }
+        buffer.position = checkpoint.dataEnd + 2
+        while !rangeEnded && buffer.remaining > 0 {
+            guard readFile(&buffer) else {
+                return false
+            }
+        }
+        return true
+    }
+
+    /// Decode the records from a checkpoint of a seek index built from `buffer` to offset `end`: a
+    /// later checkpoint of the same file, or its data end. Several decoders can read chunks of the
+    /// same buffer at once, see `FitParallelDecoder`.
+    @discardableResult
+    public func read(_ buffer: FitBuffer, from checkpoint: FitSeekIndex.Checkpoint, until end: Int) -> Bool {
+        failure = nil
+        mesgCount = 0
+        range = nil
+        rangeEnded = false
+        return resume(buffer, from: checkpoint, until: end)
+    }
+
+    private func resume(_ buffer: FitBuffer, from checkpoint: FitSeekIndex.Checkpoint, until end: Int) -> Bool {
+        guard checkpoint.isValid(fileSize: buffer.count), checkpoint.offset <= end, end <= checkpoint.dataEnd else {
+            return fail(.staleIndex)
+        }
+        // The definitions are read before the checkpoint, and must define the local type they are for.
+        let definitions = buffer.slice(at: 0, count: checkpoint.offset)
+        for local in 0..<layouts.count {
+            layouts[local] = nil
+            if checkpoint.definitions[local] >= 0 {
+                var definition = FitBuffer(definitions, position: checkpoint.definitions[local])
+                guard let layout = MesgLayout(buffer: &definition), Int(layout.localMesgNum) == local else {
+                    return fail(.staleIndex)
+                }
+                layouts[local] = layout
+            }
+        }
+        lastTimestamp = checkpoint.timestamp
+        accumulator = Accumulator()
+        onFileStart?()
+
+        var records = FitBuffer(buffer.slice(at: 0, count: end), position: checkpoint.offset)
+        while !rangeEnded && records.position < end {
+            guard decodeRecord(&records) else {
+                return false
+            }
+        }
+        return true
+    }
+
+    private func readFile(_ buffer: inout FitBuffer) -> Bool {
+        let start = buffer.position
+        guard buffer.canRead(Int(Fit.headerWithoutCRCSize)) else {
+            return fail(.notFit)
+        }
+        let headerSize = Int(buffer[start])
+        guard (headerSize == Int(Fit.headerWithCRCSize) || headerSize == Int(Fit.headerWithoutCRCSize)),
+              buffer.canRead(headerSize),
+              buffer[start + 8] == 0x2E, buffer[start + 9] == 0x46, buffer[start + 10] == 0x49, buffer[start + 11] == 0x54 else {
+            return fail(.notFit)
+        }
+        let dataSize = Int(buffer.load(UInt32.self, at: start + 4))
+        guard buffer.canRead(headerSize + dataSize + 2) else {
+            return fail(.truncated)
+        }
+        if checkCRC {
+            if headerSize == Int(Fit.headerWithCRCSize) {
+                let headerCRC = buffer.load(UInt16.self, at: start + 12)
+                if headerCRC != 0 && headerCRC != FitBufferDecoder.crc(buffer.slice(at: start, count: 12)) {
+                    return fail(.headerCRC)
+                }
+            }
+            let fileCRC = buffer.load(UInt16.self, at: start + headerSize + dataSize)
+            if fileCRC != FitBufferDecoder.crc(buffer.slice(at: start, count: headerSize + dataSize)) {
+                return fail(.fileCRC)
+            }
+        }
+
+        for i in 0..<layouts.count {
+            layouts[i] = nil
+        }
+        lastTimestamp = 0
+        accumulator = Accumulator()
+        onFileStart?()
+
+        let end = start + headerSize + dataSize
+        buffer.position = start + headerSize
+        // Decode the records within the data size only.
+        var records = FitBuffer(buffer.slice(at: 0, count: end), position: buffer.position)
+        while !rangeEnded && records.position < end {
+            guard decodeRecord(&records) else {
+                return false
+            }
+        }
+        buffer.position = end + 2
+        return true
+    }
+
+    private func decodeRecord(_ buffer: inout FitBuffer) -> Bool {
+        let recordHeader = buffer[buffer.position]
+        if recordHeader & Fit.compressedHeaderMask == 0 && recordHeader & Fit.mesgDefinitionMask != 0 {
+            let start = buffer.position
+            guard let layout = MesgLayout(buffer: &buffer) else {
+                return fail(.truncated)
+            }
+            layouts[Int(layout.localMesgNum)] = layout
+            delegate?.didReadMesgDefinition(mesgDef: layout.mesgDefinition(in: buffer, at: start))
+            return true
+        }
+
+        let compressed = recordHeader & Fit.compressedHeaderMask != 0
+        let local = compressed ? (recordHeader & Fit.compressedLocalMesgNumMask) >> 5 : recordHeader & Fit.localMesgNumMask
+        guard let layout = layouts[Int(local)] else {
+            return fail(.undefinedLocalMesg(local))
+        }
+        guard buffer.canRead(1 + layout.dataSize) else {
+            return fail(.truncated)
+        }
+        var compressedTimestamp: UInt32?
+        if compressed {
+            let timeOffset = UInt32(recordHeader & Fit.compressedTimeMask)
+            lastTimestamp = lastTimestamp &+ ((timeOffset &- lastTimestamp) & UInt32(Fit.compressedTimeMask))
+            compressedTimestamp = lastTimestamp
+        }
+        if let filter = mesgFilter, !filter.contains(layout.globalMesgNum) {
+            // Skipped, but later compressed timestamps may count from its timestamp.
+            if !compressed, let field = layout.field(num: Fit.fieldNumTimeStamp),
+               let timestamp = LazyMesg.integer(buffer, at: buffer.position + 1 + field.offset, baseType: field.type,
+                                                bigEndian: layout.isBigEndian) {
+                lastTimestamp = UInt32(truncatingIfNeeded: timestamp)
+            }
+            buffer.skip(1 + layout.dataSize)
+            return true
+        }
+        let lazy = LazyMesg(buffer: buffer, offset: buffer.position, layout: layout, compressedTimestamp: compressedTimestamp)
+        if !compressed, let timestamp = lazy.timestamp {
+            lastTimestamp = timestamp
+        }
+        if let range = range, let timestamp = lazy.timestamp, !range.contains(timestamp) {
+            rangeEnded = timestamp > range.upperBound
+            buffer.skip(1 + layout.dataSize)
+            return true
+        }
+        mesgCount += 1
+        onLazyMesg?(lazy)
+
+        if delegate != nil || onMesg != nil {
+            let mesg = lazy.materialize()
+            if expandComponents {
+                mesg.expandComponents(accumulator: accumulator)
+            }
+            delegate?.didReadMesg(mesg: mesg)
+            onMesg?(mesg)
+        }
+        buffer.skip(1 + layout.dataSize)
+        return true
+    }
+
+    /// The FIT CRC-16 of `bytes`.
+    static func crc(_ bytes: UnsafeRawBufferPointer) -> UInt16 {
+        return GimKitCRC16.checksum(bytes)
+    }
+
+    /// A `Decode.checkIntegrity(_:)` counterpart over a mapped file: every file of a chain has a
+    /// valid header and CRC.
+    public static func checkIntegrity(path: String) -> Bool {
+        guard let file = MappedFitFile(path: path) else {
+            return false
+        }
+        return file.withBuffer { checkIntegrity($0) }
+    }
+
+    /// Every file of the buffer, from its position, has a valid header and CRC.
+    public static func checkIntegrity(_ buffer: FitBuffer) -> Bool {
+        var buffer = buffer
+        repeat {
+            let start = buffer.position
+            guard buffer.canRead(Int(Fit.headerWithoutCRCSize)) else {
+                return false
+            }
+            let headerSize = Int(buffer[start])
+            guard headerSize == Int(Fit.headerWithCRCSize) || headerSize == Int(Fit.headerWithoutCRCSize),
+                  buffer.canRead(headerSize) else {
+                return false
+            }
+            let dataSize = Int(buffer.load(UInt32.self, at: start + 4))
+            guard buffer.canRead(headerSize + dataSize + 2),
+                  crc(buffer.slice(at: start, count: headerSize + dataSize + 2)) == 0 else {
+                return false
+            }
+            buffer.position = start + headerSize + dataSize + 2
+        } while buffer.remaining > 0
+        return true
+    }
+
+    @discardableResult
+    private func fail(_ failure: Failure) -> Bool {
+        self.failure = failure
+        return false
+    }
+}
@@ -0,0 +1,89 @@
+//
+//  FitChunkSource.swift
+//  GimBle
+//
+//  Sources of FIT bytes pulled piece by piece by FitStreamDecoder.
+//
+
+import Foundation
+
+public protocol FitChunkSource: AnyObject {
+    /// Copy up to `count` bytes to `buffer`. Returns the number of bytes copied, 0 at the end of
+    /// the data, -1 on failure.
+    func read(into buffer: UnsafeMutablePointer<UInt8>, count: Int) -> Int
+}
+
+/// Reads a file descriptor, without ever holding more than the caller's buffer.
+public final class FitFileSource: FitChunkSource {
+
+    public let fileDescriptor: Int32
+    private let closeOnDeinit: Bool
+
+    public init(fileDescriptor: Int32, closeOnDeinit: Bool = false) {
+        self.fileDescriptor = fileDescriptor
+        self.closeOnDeinit = closeOnDeinit
+    }
+
+    public convenience init?(path: String) {
+        let fd = Darwin.open(path, O_RDONLY)
+        guard fd >= 0 else {
+            return nil
+        }
+        self.init(fileDescriptor: fd, closeOnDeinit: true)
+    }
+
+    public convenience init(fileHandle: FileHandle) {
+        self.init(fileDescriptor: fileHandle.fileDescriptor)
+    }
+
+    deinit {
+        if closeOnDeinit {
+            Darwin.close(fileDescriptor)
+        }
+    }
+
+    public func read(into buffer: UnsafeMutablePointer<UInt8>, count: Int) -> Int {
+        while true {
+            let n = Darwin.read(fileDescriptor, buffer, count)
+            if n >= 0 || errno != EINTR {
+                return n
+            }
+        }
+    }
+}
+
+/// Bytes handed over piece by piece by a closure, e.g. as they arrive from the network.
+public final class FitClosureSource: FitChunkSource {
+
+    private let body: (UnsafeMutablePointer<UInt8>, Int) -> Int
+
+    public init(_ body: @escaping (UnsafeMutablePointer<UInt8>, Int) -> Int) {
+        self.body = body
+    }
+
+    public func read(into buffer: UnsafeMutablePointer<UInt8>, count: Int) -> Int {
+        return body(buffer, count)
+    }
+}
+
+/// Bytes already in memory.
+public final class FitBytesSource: FitChunkSource {
+
+    private let bytes: [UInt8]
+    private var position = 0
+
+    public init(_ bytes: [UInt8]) {
+        self.bytes = bytes
+    }
+
+    public func read(into buffer: UnsafeMutablePointer<UInt8>, count: Int) -> Int {
+        let n = min(count, bytes.count - position)
+        bytes.withUnsafeBufferPointer { source in
+            if n > 0, let base = source.baseAddress {
+                buffer.assign(from: base + position, count: n)
+            }
+        }
+        position += n
+        return n
+    }
+}
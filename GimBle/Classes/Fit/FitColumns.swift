@@ -0,0 +1,393 @@
+//
+//  FitColumns.swift
+//  GimBle
+//
+//  FIT messages decoded into typed columns, one per field.
+//
+
+import Foundation
+import GimKit
+
+/// One bit per row, set when the value is valid.
+public struct FitValidity {
+
+    public private(set) var words: [UInt64] = []
+    public private(set) var count = 0
+
+    @inline(__always)
+    public mutating func append(_ valid: Bool) {
+        if count & 63 == 0 {
+            words.append(0)
+        }
+        if valid {
+            words[count >> 6] |= 1 << UInt64(count & 63)
+        }
+        count += 1
+    }
+
+    @inline(__always)
+    public subscript(row: Int) -> Bool {
+        return words[row >> 6] & (1 << UInt64(row & 63)) != 0
+    }
+
+    public var validCount: Int {
+        return words.reduce(0) { $0 + $1.nonzeroBitCount }
+    }
+}
+
+/// The values of one field, over every message of a type. The rows of the messages without the
+/// field, or with its invalid value, are cleared in `validity`.
+///
+/// Array fields keep their first element. The columns are `FitNumericColumn`s and `FitBytesColumn`s.
+public protocol FitColumn: AnyObject {
+    var num: UInt8 { get }
+    /// The base type of the first definition holding the field
+    var baseType: UInt8 { get }
+    var name: String { get }
+    var scale: Double { get }
+    var offset: Double { get }
+    var validity: FitValidity { get }
+}
+
+extension FitColumn {
+
+    public var count: Int {
+        return validity.count
+    }
+}
+
+/// A column of numbers, which the profile scale and offset apply to.
+public protocol FitScaledColumn: FitColumn {
+    /// The values with the profile scale and offset applied, NaN for the invalid rows.
+    func scaledValues() -> [Double]
+    func scaledFloat32Values() -> [Float32]
+}
+
+/// How `FitMesgColumns` fills its columns.
+protocol FitColumnStorage: FitColumn {
+    /// Append the field of a data message.
+    func append(_ buffer: FitBuffer, at offset: Int, size: Int, baseType: UInt8, bigEndian: Bool)
+    func append(_ value: FitValue)
+    func appendInvalid()
+}
+
+/// The profile name, scale and offset of a column.
+private struct FitColumnProfile {
+
+    let name: String
+    let scale: Double
+    let offset: Double
+
+    init(globalMesgNum: UInt16, num: UInt8) {
+        let profileField = FitProfileTable.field(globalMesgNum: globalMesgNum, fieldNum: num)
+        name = profileField?.name ?? "unknown"
+        scale = profileField?.scale ?? 1
+        offset = profileField?.offset ?? 0
+    }
+}
+
+/// A column of numbers, stored as the base type of the field. The value of the invalid rows is 0.
+public final class FitNumericColumn<T: Numeric>: FitScaledColumn, FitColumnStorage {
+
+    public let num: UInt8
+    public let baseType: UInt8
+    public let name: String
+    public let scale: Double
+    public let offset: Double
+    public private(set) var validity = FitValidity()
+    public private(set) var values: [T] = []
+
+    private let load: (FitBuffer, Int, Bool) -> T?
+    private let convert: (FitValue) -> T?
+    /// `FitScaling.scale(_:scale:offset:into:)` for `T`
+    private let toDoubles: (UnsafeBufferPointer<T>, Double, Double, UnsafeMutableBufferPointer<Double>) -> Void
+    private let toFloat32s: (UnsafeBufferPointer<T>, Double, Double, UnsafeMutableBufferPointer<Float32>) -> Void
+
+    fileprivate init(globalMesgNum: UInt16, num: UInt8, baseType: UInt8, load: @escaping (FitBuffer, Int, Bool) -> T?,
+                     convert: @escaping (FitValue) -> T?,
+                     toDoubles: @escaping (UnsafeBufferPointer<T>, Double, Double, UnsafeMutableBufferPointer<Double>) -> Void,
+                     toFloat32s: @escaping (UnsafeBufferPointer<T>, Double, Double, UnsafeMutableBufferPointer<Float32>) -> Void) {
+        self.num = num
+        self.baseType = baseType
+        let profile = FitColumnProfile(globalMesgNum: globalMesgNum, num: num)
+        name = profile.name
+        scale = profile.scale
+        offset = profile.offset
+        self.load = load
+        self.convert = convert
+        self.toDoubles = toDoubles
+        self.toFloat32s = toFloat32s
+    }
+
+    @inline(__always)
+    private func append(_ value: T?) {
+        values.append(value ?? 0)
+        validity.append(value != nil)
+    }
+
+    func append(_ buffer: FitBuffer, at offset: Int, size: Int, baseType: UInt8, bigEndian: Bool) {
+        guard size >= FitBuffer.elementSize(baseType: baseType) else {
+            return appendInvalid()
+        }
+        if baseType == self.baseType {
+            append(load(buffer, offset, bigEndian))
+        } else {
+            append(TypedMesg.value(buffer, at: offset, baseType: baseType, bigEndian: bigEndian))
+        }
+    }
+
+    func append(_ value: FitValue) {
+        append(convert(value))
+    }
+
+    func appendInvalid() {
+        append(nil as T?)
+    }
+
+    /// Scaled in SIMD vectors by `FitScaling`, then the invalid rows cleared a validity word at a time.
+    public func scaledValues() -> [Double] {
+        return scaled(with: toDoubles)
+    }
+
+    public func scaledFloat32Values() -> [Float32] {
+        return scaled(with: toFloat32s)
+    }
+
+    private func scaled<U: BinaryFloatingPoint>(
+        with kernel: (UnsafeBufferPointer<T>, Double, Double, UnsafeMutableBufferPointer<U>) -> Void) -> [U] {
+        return [U](unsafeUninitializedCapacity: values.count) { output, count in
+            values.withUnsafeBufferPointer { kernel($0, scale, offset, output) }
+            for (word, bits) in validity.words.enumerated() where bits != UInt64.max {
+                let first = word * 64
+                for row in first..<min(first + 64, values.count) where bits & (1 << UInt64(row - first)) == 0 {
+                    output[row] = .nan
+                }
+            }
+            count = values.count
+        }
+    }
+}
+
+/// A column of strings and byte arrays. The value of the invalid rows is empty.
+public final class FitBytesColumn: FitColumn, FitColumnStorage {
+
+    public let num: UInt8
+    public let baseType: UInt8
+    public let name: String
+    public let scale: Double
+    public let offset: Double
+    public private(set) var validity = FitValidity()
+    public private(set) var values: [[UInt8]] = []
+
+    fileprivate init(globalMesgNum: UInt16, num: UInt8, baseType: UInt8) {
+        self.num = num
+        self.baseType = baseType
+        let profile = FitColumnProfile(globalMesgNum: globalMesgNum, num: num)
+        name = profile.name
+        scale = profile.scale
+        offset = profile.offset
+    }
+
+    func append(_ buffer: FitBuffer, at offset: Int, size: Int, baseType: UInt8, bigEndian: Bool) {
+        var bytes = [UInt8](buffer.slice(at: offset, count: size))
+        if baseType == FitBaseType.String, let end = bytes.firstIndex(of: 0) {
+            bytes.removeSubrange(end...)
+        }
+        values.append(bytes)
+        validity.append(!bytes.isEmpty && (baseType == FitBaseType.String || bytes.contains { $0 != 0xFF }))
+    }
+
+    func append(_ value: FitValue) {
+        let bytes = value.byteArray ?? []
+        values.append(bytes)
+        validity.append(!bytes.isEmpty)
+    }
+
+    func appendInvalid() {
+        values.append([])
+        validity.append(false)
+    }
+
+    public func strings() -> [String?] {
+        return values.enumerated().map { row, bytes in
+            validity[row] ? String(decoding: bytes, as: UTF8.self) : nil
+        }
+    }
+}
+
+/// The messages of one global message number, as columns.
+public final class FitMesgColumns {
+
+    public let num: UInt16
+    public let name: String
+    /// Number of messages
+    public private(set) var count = 0
+    /// In the order the fields first appeared
+    public var columns: [FitColumn] {
+        return storages
+    }
+    private var storages: [FitColumnStorage] = []
+    private var slots = [FitColumnStorage?](repeating: nil, count: 256)
+
+    init(num: UInt16) {
+        self.num = num
+        name = FitProfileTable.mesg(num).name
+    }
+
+    public func column(num: UInt8) -> FitColumn? {
+        return slots[Int(num)]
+    }
+
+    /// The column of field `num`, if it holds numbers.
+    public func scaledColumn(num: UInt8) -> FitScaledColumn? {
+        return slots[Int(num)] as? FitScaledColumn
+    }
+
+    /// The column of field `num`, if it holds values of type `type`.
+    public func column<T>(num: UInt8, as type: T.Type) -> FitNumericColumn<T>? {
+        return slots[Int(num)] as? FitNumericColumn<T>
+    }
+
+    public func bytesColumn(num: UInt8) -> FitBytesColumn? {
+        return slots[Int(num)] as? FitBytesColumn
+    }
+
+    public var timestamps: FitNumericColumn<UInt32>? {
+        return column(num: Fit.fieldNumTimeStamp, as: UInt32.self)
+    }
+
+    func append(_ mesg: LazyMesg, accumulator: FitAccumulator) {
+        let layout = mesg.layout
+        let base = mesg.offset + 1
+        for field in layout.fields {
+            column(for: field.num, baseType: field.type, size: Int(field.size))
+                .append(mesg.buffer, at: base + field.offset, size: Int(field.size), baseType: field.type,
+                        bigEndian: layout.isBigEndian)
+        }
+        if let timestamp = mesg.compressedTimestamp {
+            column(for: Fit.fieldNumTimeStamp, baseType: FitBaseType.Uint32, size: 4).append(.integer(Int64(timestamp)))
+        }
+        if !layout.accumulations.isEmpty {
+            accumulator.accumulate(mesg) { fieldNum, value in
+                // The destination fields present in the message have their column already.
+                if layout.field(num: fieldNum) == nil {
+                    column(for: fieldNum, baseType: FitBaseType.Uint32, size: 4).append(.integer(value))
+                }
+            }
+        }
+        count += 1
+        for column in storages where column.count < count {
+            column.appendInvalid()
+        }
+    }
+
+    private func column(for fieldNum: UInt8, baseType: UInt8, size: Int) -> FitColumnStorage {
+        if let column = slots[Int(fieldNum)] {
+            return column
+        }
+        let column = FitMesgColumns.makeColumn(globalMesgNum: num, num: fieldNum, baseType: baseType, size: size)
+        for _ in 0..<count {
+            column.appendInvalid()
+        }
+        slots[Int(fieldNum)] = column
+        storages.append(column)
+        return column
+    }
+
+    private static func makeColumn(globalMesgNum: UInt16, num: UInt8, baseType: UInt8, size: Int) -> FitColumnStorage {
+        let info = FitBaseTypeInfo.of(baseType)
+        switch (info.kind, info.size) {
+        case (.signed, 1): return integerColumn(Int8.self, globalMesgNum, num, baseType)
+        case (.signed, 2): return integerColumn(Int16.self, globalMesgNum, num, baseType)
+        case (.unsigned, 2): return integerColumn(UInt16.self, globalMesgNum, num, baseType)
+        case (.signed, 4): return integerColumn(Int32.self, globalMesgNum, num, baseType)
+        case (.unsigned, 4): return integerColumn(UInt32.self, globalMesgNum, num, baseType)
+        case (.signed, 8): return integerColumn(Int64.self, globalMesgNum, num, baseType)
+        case (.unsigned, 8): return integerColumn(UInt64.self, globalMesgNum, num, baseType)
+        case (.float, 4):
+            return FitNumericColumn<Float32>(globalMesgNum: globalMesgNum, num: num, baseType: baseType, load: { buffer, at, bigEndian in
+                LazyMesg.float(buffer, at: at, baseType: baseType, bigEndian: bigEndian).map { Float32($0) }
+            }, convert: { $0.double.map { Float32($0) } }, toDoubles: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) },
+            toFloat32s: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) })
+        case (.float, 8):
+            return FitNumericColumn<Float64>(globalMesgNum: globalMesgNum, num: num, baseType: baseType, load: { buffer, at, bigEndian in
+                LazyMesg.float(buffer, at: at, baseType: baseType, bigEndian: bigEndian)
+            }, convert: { $0.double }, toDoubles: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) },
+            toFloat32s: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) })
+        default:
+            // enum, uint8, uint8z, byte: strings and byte arrays as bytes.
+            if baseType == FitBaseType.String || baseType == FitBaseType.Byte && size > 1 {
+                return FitBytesColumn(globalMesgNum: globalMesgNum, num: num, baseType: baseType)
+            }
+            return integerColumn(UInt8.self, globalMesgNum, num, baseType)
+        }
+    }
+
+    private static func integerColumn<T: FixedWidthInteger & SIMDScalar>(_ type: T.Type, _ globalMesgNum: UInt16, _ num: UInt8,
+                                                             _ baseType: UInt8) -> FitColumnStorage {
+        return FitNumericColumn<T>(globalMesgNum: globalMesgNum, num: num, baseType: baseType, load: { buffer, at, bigEndian in
+            LazyMesg.integer(buffer, at: at, baseType: baseType, bigEndian: bigEndian).map { T(truncatingIfNeeded: $0) }
+        }, convert: { $0.integer.map { T(truncatingIfNeeded: $0) } },
+        toDoubles: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) },
+        toFloat32s: { FitScaling.scale($0, scale: $1, offset: $2, into: $3) })
+    }
+}
+
+/// FIT files decoded into columns, by global message number.
+///
+/// `GimKitManager.parseFitData(_:)` returns every value boxed in an `Any`, in arrays keyed by
+/// string. The columns hold the values of a field in one array of its base type, `[UInt32]` for
+/// timestamps, `[UInt16]` for power, with a validity bitmap for the messages without a valid
+/// value, ready for statistics and charts. They are filled from `LazyMesg`s, no `Mesg` is built.
+/// Accumulated fields expanded from a component, such as the total cycles of records, get their
+/// column too, see `FitAccumulator`.
+public final class FitColumns {
+
+    public private(set) var mesgs: [UInt16: FitMesgColumns] = [:]
+    private var last: FitMesgColumns?
+    private let accumulator = FitAccumulator()
+
+    public init() {
+    }
+
+    /// Decode a file, mapped in memory. Returns nil if it can't be decoded.
+    public convenience init?(path: String, mesgFilter: Set<UInt16>? = nil) {
+        self.init()
+        let decoder = FitBufferDecoder()
+        decoder.mesgFilter = mesgFilter
+        decoder.onLazyMesg = { [unowned self] in self.append($0) }
+        decoder.onFileStart = { [unowned self] in self.startFile() }
+        guard decoder.read(path: path) else {
+            return nil
+        }
+    }
+
+    public subscript(num: UInt16) -> FitMesgColumns? {
+        return mesgs[num]
+    }
+
+    /// Start the accumulated fields again from 0, as every file does: call it at the header of each
+    /// chained file when appending messages from `FitBufferDecoder.onFileStart`.
+    public func startFile() {
+        accumulator.reset()
+    }
+
+    public func append(_ mesg: LazyMesg) {
+        if let last = last, last.num == mesg.num {
+            return last.append(mesg, accumulator: accumulator)
+        }
+        let columns = mesgs[mesg.num] ?? FitMesgColumns(num: mesg.num)
+        mesgs[mesg.num] = columns
+        last = columns
+        columns.append(mesg, accumulator: accumulator)
+    }
+}
+
+extension GimKitManager {
+
+    /// A columnar counterpart of `parseFitData(_:)`: the messages of the file as typed columns, by
+    /// global message number. Returns nil if the file can't be decoded.
+    public func parseFitColumns(_ fitPath: String, mesgFilter: Set<UInt16>? = nil) -> FitColumns? {
+        return FitColumns(path: fitPath, mesgFilter: mesgFilter)
+    }
+}
@@ -0,0 +1,200 @@
+//
+//  FitLazyMesg.swift
+//  GimBle
+//
+//  A data message whose fields are decoded only when they are read.
+//
+
+import Foundation
+import GimKit
+
+/// A data message left in its record bytes.
+///
+/// A `Mesg` builds a `Field` object and a boxed value for every field of the record as it is
+/// decoded. A `LazyMesg` is a value holding the record position, the layout shared by all the
+/// messages of its definition and the bytes it borrows, so handing it over allocates nothing; a
+/// field is decoded when it is read, and only that one.
+///
+/// The bytes are borrowed: a `LazyMesg` from `FitBufferDecoder.onLazyMesg` must not be used after
+/// the callback returns. Copy the values out, or `materialize()` it.
+public struct LazyMesg {
+
+    public let layout: MesgLayout
+    /// The record, header byte included
+    public let buffer: FitBuffer
+    public let offset: Int
+    /// The timestamp of a compressed timestamp header, which the record bytes don't hold
+    public let compressedTimestamp: UInt32?
+
+    public init(buffer: FitBuffer, offset: Int, layout: MesgLayout, compressedTimestamp: UInt32? = nil) {
+        self.buffer = buffer
+        self.offset = offset
+        self.layout = layout
+        self.compressedTimestamp = compressedTimestamp
+    }
+
+    public var num: UInt16 {
+        return layout.globalMesgNum
+    }
+
+    public var localNum: UInt8 {
+        return layout.localMesgNum
+    }
+
+    public func hasField(fieldNum: UInt8) -> Bool {
+        return (fieldNum == Fit.fieldNumTimeStamp && compressedTimestamp != nil) || layout.field(num: fieldNum) != nil
+    }
+
+    /// Number of elements of an array field, 1 for other fields, 0 if the message doesn't have it.
+    public func getNumFieldValues(fieldNum: UInt8) -> Int {
+        guard let field = layout.field(num: fieldNum) else {
+            return hasField(fieldNum: fieldNum) ? 1 : 0
+        }
+        return Int(field.size) / FitBuffer.elementSize(baseType: field.type)
+    }
+
+    /// The raw integer value of element `index`, nil if the field is missing, invalid or not an integer.
+    public func getRawValue(fieldNum: UInt8, index: Int = 0) -> Int64? {
+        if fieldNum == Fit.fieldNumTimeStamp, let timestamp = compressedTimestamp {
+            return index == 0 ? Int64(timestamp) : nil
+        }
+        guard let field = layout.field(num: fieldNum) else {
+            return nil
+        }
+        let elementSize = FitBuffer.elementSize(baseType: field.type)
+        guard (index + 1) * elementSize <= Int(field.size) else {
+            return nil
+        }
+        return LazyMesg.integer(buffer, at: offset + 1 + field.offset + index * elementSize, baseType: field.type,
+                                bigEndian: layout.isBigEndian)
+    }
+
+    /// The value of element `index` with the profile scale and offset applied, nil if the field is
+    /// missing or invalid.
+    public func getValue(fieldNum: UInt8, index: Int = 0) -> Double? {
+        if fieldNum == Fit.fieldNumTimeStamp, let timestamp = compressedTimestamp {
+            return index == 0 ? Double(timestamp) : nil
+        }
+        guard let field = layout.field(num: fieldNum) else {
+            return nil
+        }
+        let elementSize = FitBuffer.elementSize(baseType: field.type)
+        guard (index + 1) * elementSize <= Int(field.size) else {
+            return nil
+        }
+        let at = offset + 1 + field.offset + index * elementSize
+        let raw: Double
+        if FitBaseTypeInfo.of(field.type).kind == .float {
+            guard let float = LazyMesg.float(buffer, at: at, baseType: field.type, bigEndian: layout.isBigEndian) else {
+                return nil
+            }
+            raw = float
+        } else {
+            guard let integer = LazyMesg.integer(buffer, at: at, baseType: field.type, bigEndian: layout.isBigEndian) else {
+                return nil
+            }
+            raw = Double(integer)
+        }
+        return raw / field.scale - field.valueOffset
+    }
+
+    /// The boxed value, as `Mesg.getFieldValue(fieldNum:)` returns it: scaled if the profile scales
+    /// the field, raw and typed by its base type otherwise, bytes for strings.
+    public func getFieldValue(fieldNum: UInt8, fieldArrayIndex: Int = 0) -> Any? {
+        if fieldNum == Fit.fieldNumTimeStamp, let timestamp = compressedTimestamp {
+            return fieldArrayIndex == 0 ? timestamp : nil
+        }
+        guard let field = layout.field(num: fieldNum) else {
+            return nil
+        }
+        if field.type == FitBaseType.String {
+            let start = offset + 1 + field.offset
+            let bytes = buffer.slice(at: start, count: Int(field.size))
+            let end = bytes.firstIndex(of: 0) ?? bytes.count
+            return fieldArrayIndex == 0 ? [UInt8](bytes[0..<end]) : nil
+        }
+        if field.scale != 1 || field.valueOffset != 0 {
+            return getValue(fieldNum: fieldNum, index: fieldArrayIndex)
+        }
+        let elementSize = FitBuffer.elementSize(baseType: field.type)
+        guard (fieldArrayIndex + 1) * elementSize <= Int(field.size) else {
+            return nil
+        }
+        return buffer.loadValue(baseType: field.type, at: offset + 1 + field.offset + fieldArrayIndex * elementSize,
+                                bigEndian: layout.isBigEndian)
+    }
+
+    /// The field accessors by profile name, resolved through `MesgLayout.profile` with one hash of
+    /// the name, as `Mesg.getFieldValue(name:)` does by walking the fields.
+    public func getRawValue(fieldName: String, index: Int = 0) -> Int64? {
+        return layout.profile.fieldNum(name: fieldName).flatMap { getRawValue(fieldNum: $0, index: index) }
+    }
+
+    public func getValue(fieldName: String, index: Int = 0) -> Double? {
+        return layout.profile.fieldNum(name: fieldName).flatMap { getValue(fieldNum: $0, index: index) }
+    }
+
+    public func getFieldValue(name: String, fieldArrayIndex: Int = 0) -> Any? {
+        return layout.profile.fieldNum(name: name).flatMap { getFieldValue(fieldNum: $0, fieldArrayIndex: fieldArrayIndex) }
+    }
+
+    public var timestamp: UInt32? {
+        return getRawValue(fieldNum: Fit.fieldNumTimeStamp).map { UInt32(truncatingIfNeeded: $0) }
+    }
+
+    /// A full `Mesg` of this message, which no longer depends on the borrowed bytes.
+    public func materialize() -> Mesg {
+        var record = FitBuffer(buffer.bytes, position: offset)
+        let mesg = Mesg(buffer: &record, layout: layout)
+        if let timestamp = compressedTimestamp {
+            var field = Field.make(profile: layout.profile, num: Fit.fieldNumTimeStamp, baseType: FitBaseType.Uint32)
+            field.addValue(value: timestamp)
+            mesg.insertField(index: 0, field: field)
+        }
+        return mesg
+    }
+
+    /// An integer base type value, nil if it is the invalid value of its type or not an integer.
+    @inline(__always)
+    static func integer(_ buffer: FitBuffer, at offset: Int, baseType: UInt8, bigEndian: Bool) -> Int64? {
+        let info = FitBaseTypeInfo.of(baseType)
+        let value: Int64
+        switch (info.kind, info.size) {
+        case (.unsigned, 1):
+            value = Int64(buffer[offset])
+        case (.signed, 1):
+            value = Int64(Int8(bitPattern: buffer[offset]))
+        case (.unsigned, 2):
+            value = Int64(buffer.load(UInt16.self, at: offset, bigEndian: bigEndian))
+        case (.signed, 2):
+            value = Int64(buffer.load(Int16.self, at: offset, bigEndian: bigEndian))
+        case (.unsigned, 4):
+            value = Int64(buffer.load(UInt32.self, at: offset, bigEndian: bigEndian))
+        case (.signed, 4):
+            value = Int64(buffer.load(Int32.self, at: offset, bigEndian: bigEndian))
+        case (.unsigned, 8):
+            value = Int64(bitPattern: buffer.load(UInt64.self, at: offset, bigEndian: bigEndian))
+        case (.signed, 8):
+            value = buffer.load(Int64.self, at: offset, bigEndian: bigEndian)
+        default:
+            return nil
+        }
+        return value == info.invalid ? nil : value
+    }
+
+    /// A float32 or float64 value, nil if it is the invalid value of its type or not a float.
+    @inline(__always)
+    static func float(_ buffer: FitBuffer, at offset: Int, baseType: UInt8, bigEndian: Bool) -> Double? {
+        let info = FitBaseTypeInfo.of(baseType)
+        switch (info.kind, info.size) {
+        case (.float, 4):
+            let bits = buffer.load(UInt32.self, at: offset, bigEndian: bigEndian)
+            return Int64(bits) == info.invalid ? nil : Double(Float32(bitPattern: bits))
+        case (.float, 8):
+            let bits = buffer.load(UInt64.self, at: offset, bigEndian: bigEndian)
+            return Int64(bitPattern: bits) == info.invalid ? nil : Float64(bitPattern: bits)
+        default:
+            return nil
+        }
+    }
+}
@@ -0,0 +1,86 @@
+//
+//  FitLocalMesgAllocator.swift
+//  GimBle
+//
+//  The local message types of an encoder, kept as an LRU cache of definitions.
+//
+
+import Foundation
+import GimKit
+
+/// Chooses the local message type of every message an encoder writes.
+///
+/// `Encode` writes a message with its `localNum`, and a new definition every time the definition of
+/// that local type doesn't support it, so interleaved records, events and laps sharing a local type
+/// redefine it on every switch. The allocator keeps the definitions of the `Fit.maxLocalMesgs` local
+/// types as an LRU cache: a message whose definition is cached reuses its local type, and only a
+/// miss writes a definition, over the least recently used one.
+public final class FitLocalMesgAllocator {
+
+    public struct Allocation {
+        public let localMesgNum: UInt8
+        public let definition: MesgDefinition
+        /// The definition must be written before the message
+        public let isNew: Bool
+    }
+
+    /// Messages whose definition was cached
+    public private(set) var hits = 0
+    /// Messages that needed a new definition
+    public private(set) var misses = 0
+    /// Misses that replaced a cached definition
+    public private(set) var evictions = 0
+
+    private var definitions = [MesgDefinition?](repeating: nil, count: Int(Fit.maxLocalMesgs))
+    private var lastUse = [Int](repeating: 0, count: Int(Fit.maxLocalMesgs))
+    private var clock = 0
+
+    public init() {
+    }
+
+    public var hitRate: Double {
+        return hits + misses == 0 ? 0 : Double(hits) / Double(hits + misses)
+    }
+
+    /// The local message type of `mesg`, among `locals`, with a definition `accept` approves of.
+    public func allocate(_ mesg: Mesg, locals: ClosedRange<Int> = 0...15,
+                         accept: (MesgDefinition) -> Bool = { _ in true }) -> Allocation {
+        clock += 1
+        for local in locals {
+            if let definition = definitions[local], definition.globalMesgNum == mesg.num,
+               definition.supports(mesg: mesg), accept(definition) {
+                hits += 1
+                lastUse[local] = clock
+                return Allocation(localMesgNum: UInt8(local), definition: definition, isNew: false)
+            }
+        }
+
+        misses += 1
+        var victim = locals.lowerBound
+        for local in locals {
+            if definitions[local] == nil {
+                victim = local
+                break
+            }
+            if lastUse[local] < lastUse[victim] {
+                victim = local
+            }
+        }
+        if definitions[victim] != nil {
+            evictions += 1
+        }
+        let definition = MesgDefinition(mesg: mesg)
+        definition.localMesgNum = UInt8(victim)
+        definitions[victim] = definition
+        lastUse[victim] = clock
+        return Allocation(localMesgNum: UInt8(victim), definition: definition, isNew: true)
+    }
+
+    /// Forget every definition, at the start of a new file.
+    public func reset() {
+        for local in 0..<definitions.count {
+            definitions[local] = nil
+            lastUse[local] = 0
+        }
+    }
+}
@@ -0,0 +1,214 @@
+//
+//  FitMesgLayout.swift
+//  GimBle
+//
+//  Message definitions and data messages decoded through a FitBuffer.
+//
+
+import Foundation
+import GimKit
+
+/// The layout of the data messages of one local message type, as given by a definition message.
+/// A `MesgDefinition` counterpart read through a `FitBuffer`.
+public struct MesgLayout {
+
+    public struct FieldLayout {
+        public let num: UInt8
+        public let size: UInt8
+        /// The base type for a field, the developer data index for a developer field
+        public let type: UInt8
+        /// Offset of the field in the data message, past the record header
+        public let offset: Int
+        /// Scale and offset of the profile field, 1 and 0 when the profile doesn't know the field
+        public var scale: Double = 1
+        public var valueOffset: Double = 0
+    }
+
+    public let localMesgNum: UInt8
+    public let globalMesgNum: UInt16
+    public let isBigEndian: Bool
+    public let fields: [FieldLayout]
+    public let developerFields: [FieldLayout]
+    /// Size of a data message, without its record header
+    public let dataSize: Int
+    /// Size of the definition message, record header included
+    public let definitionSize: Int
+    /// The accumulated fields of the messages, resolved once
+    public let accumulations: [FitAccumulator.Accumulation]
+    /// The profile of the messages, resolved once
+    public let profile: FitProfileMesg
+
+    /// Read the definition message at the buffer position, which is left past it.
+    /// Returns nil if the buffer ends before the definition does.
+    public init?(buffer: inout FitBuffer) {
+        let start = buffer.position
+        guard buffer.canRead(6) else {
+            return nil
+        }
+        let recordHeader = buffer.read()
+        buffer.skip(1)
+        let bigEndian = buffer.read() == Fit.bigEndian
+        let global = buffer.read(UInt16.self, bigEndian: bigEndian)
+        let fieldCount = Int(buffer.read())
+        guard buffer.canRead(3 * fieldCount) else {
+            return nil
+        }
+        let profile = FitProfileTable.mesg(global)
+        var offset = 0
+        var fields = [FieldLayout]()
+        fields.reserveCapacity(fieldCount)
+        for _ in 0..<fieldCount {
+            var field = FieldLayout(num: buffer[buffer.position], size: buffer[buffer.position + 1],
+                                    type: buffer[buffer.position + 2], offset: offset)
+            field.scale = profile.scale(num: field.num)
+            field.valueOffset = profile.offset(num: field.num)
+            buffer.skip(3)
+            offset += Int(field.size)
+            fields.append(field)
+        }
+        var developerFields = [FieldLayout]()
+        if recordHeader & Fit.devDataMask != 0 {
+            guard buffer.canRead(1) else {
+                return nil
+            }
+            let developerFieldCount = Int(buffer.read())
+            guard buffer.canRead(3 * developerFieldCount) else {
+                return nil
+            }
+            for _ in 0..<developerFieldCount {
+                let field = FieldLayout(num: buffer[buffer.position], size: buffer[buffer.position + 1],
+                                        type: buffer[buffer.position + 2], offset: offset)
+                buffer.skip(3)
+                offset += Int(field.size)
+                developerFields.append(field)
+            }
+        }
+        localMesgNum = recordHeader & Fit.localMesgNumMask
+        globalMesgNum = global
+        isBigEndian = bigEndian
+        self.fields = fields
+        self.developerFields = developerFields
+        dataSize = offset
+        definitionSize = buffer.position - start
+        self.profile = profile
+        accumulations = FitAccumulator.accumulations(globalMesgNum: global, fields: fields)
+    }
+
+    /// The layout of field `num`, nil if the messages don't have it.
+    @inline(__always)
+    public func field(num: UInt8) -> FieldLayout? {
+        for field in fields where field.num == num {
+            return field
+        }
+        return nil
+    }
+
+    /// The `MesgDefinition` of the SDK for the definition message at `offset`, for `DecodeDelegate`.
+    public func mesgDefinition(in buffer: FitBuffer, at offset: Int) -> MesgDefinition {
+        let bytes = buffer.slice(at: offset, count: definitionSize)
+        return MesgDefinition(fitSource: PositionableData(data: [UInt8](bytes)))
+    }
+}
+
+extension FitBuffer {
+
+    /// The raw value of a field element, typed like `Mesg.read(inData:defnMesg:)` types it.
+    @inline(__always)
+    public func loadValue(baseType: UInt8, at offset: Int, bigEndian: Bool) -> Any {
+        let info = FitBaseTypeInfo.of(baseType)
+        switch (info.kind, info.size) {
+        case (.signed, 1):
+            return Int8(bitPattern: self[offset])
+        case (.signed, 2):
+            return load(Int16.self, at: offset, bigEndian: bigEndian)
+        case (.unsigned, 2):
+            return load(UInt16.self, at: offset, bigEndian: bigEndian)
+        case (.signed, 4):
+            return load(Int32.self, at: offset, bigEndian: bigEndian)
+        case (.unsigned, 4):
+            return load(UInt32.self, at: offset, bigEndian: bigEndian)
+        case (.float, 4):
+            return loadFloat32(at: offset, bigEndian: bigEndian)
+        case (.float, 8):
+            return loadFloat64(at: offset, bigEndian: bigEndian)
+        case (.signed, 8):
+            return load(Int64.self, at: offset, bigEndian: bigEndian)
+        case (.unsigned, 8):
+            return load(UInt64.self, at: offset, bigEndian: bigEndian)
+        default: // enum, uint8, uint8z, byte, string
+            return self[offset]
+        }
+    }
+
+    /// Size of one element of a base type, 1 for strings.
+    @inline(__always)
+    public static func elementSize(baseType: UInt8) -> Int {
+        return FitBaseTypeInfo.of(baseType).size
+    }
+}
+
+extension Field {
+
+    /// The profile field `num` of message `globalMesgNum`, or an unknown field if the profile has none.
+    public static func make(globalMesgNum: UInt16, num: UInt8, baseType: UInt8) -> Field {
+        return make(profile: FitProfileTable.mesg(globalMesgNum), num: num, baseType: baseType)
+    }
+
+    /// The field `num` of a resolved profile message, or an unknown field if it has none.
+    public static func make(profile: FitProfileMesg, num: UInt8, baseType: UInt8) -> Field {
+        if let profileField = profile.field(num: num) {
+            return Field(field: profileField)
+        }
+        let field = Field()
+        field.name = "unknown"
+        field.num = num
+        field.type = baseType
+        field.scale = 1
+        field.offset = 0
+        return field
+    }
+
+    /// Append the elements of a field stored at `offset`: every element of a numeric array, every
+    /// null terminated part of a string as bytes.
+    public func addValues(from buffer: FitBuffer, at offset: Int, size: Int, baseType: UInt8, bigEndian: Bool) {
+        var field = self
+        if baseType == FitBaseType.String {
+            var start = offset
+            for i in offset..<offset + size where buffer[i] == 0 {
+                if i > start {
+                    field.addValue(value: [UInt8](buffer.slice(at: start, count: i - start)))
+                }
+                start = i + 1
+            }
+            if start < offset + size {
+                field.addValue(value: [UInt8](buffer.slice(at: start, count: offset + size - start)))
+            }
+            return
+        }
+        let elementSize = FitBuffer.elementSize(baseType: baseType)
+        var at = offset
+        while at + elementSize <= offset + size {
+            field.addValue(value: buffer.loadValue(baseType: baseType, at: at, bigEndian: bigEndian))
+            at += elementSize
+        }
+    }
+}
+
+extension Mesg {
+
+    /// Read the data message at the buffer position, record header included, which is left past it.
+    /// The counterpart of `Mesg(fitData:defnMesg:)` through a `FitBuffer`. Developer fields are
+    /// skipped, their descriptions are only known to `Decode`.
+    public convenience init(buffer: inout FitBuffer, layout: MesgLayout) {
+        self.init(name: layout.profile.name, num: layout.globalMesgNum)
+        localNum = layout.localMesgNum
+        let base = buffer.position + 1
+        for fieldLayout in layout.fields {
+            let field = Field.make(profile: layout.profile, num: fieldLayout.num, baseType: fieldLayout.type)
+            field.addValues(from: buffer, at: base + fieldLayout.offset, size: Int(fieldLayout.size),
+                            baseType: fieldLayout.type, bigEndian: layout.isBigEndian)
+            setField(field: field)
+        }
+        buffer.position = base + layout.dataSize
+    }
+}
@@ -0,0 +1,285 @@
+//
+//  FitMesgVisitor.swift
+//  GimBle
+//
+//  Typed views of the decoded messages, built only for the message types registered.
+//
+
+import Foundation
+import GimKit
+
+/// A typed view of the messages of one global message number, over a `LazyMesg`.
+///
+/// A view holds the `LazyMesg` and nothing else: its getters read the record bytes when called, so
+/// building one copies nothing. Like the `LazyMesg` it wraps, a view from a `FitMesgVisitor` handler
+/// must not be kept after the handler returns.
+public protocol FitMesgView {
+    static var globalMesgNum: UInt16 { get }
+    init(_ mesg: LazyMesg)
+    var mesg: LazyMesg { get }
+}
+
+/// Hands the messages of a file to handlers taking their typed view.
+///
+/// `MesgConverters` builds a typed `Mesg` subclass, all its fields copied, for every message, and
+/// hands it to one of its delegate methods. Here a handler is registered for the view type it takes;
+/// the closure stored for it builds that very view, so a message reaches its handler with no cast and
+/// no allocation. The decoder is given the registered message numbers as its `mesgFilter`: the other
+/// messages are stepped over by their size.
+///
+///     let visitor = FitMesgVisitor()
+///     visitor.on(FitRecordView.self) { record in
+///         altitudes.append(record.altitude ?? .nan)
+///     }
+///     visitor.visit(path: path)
+public final class FitMesgVisitor {
+
+    public private(set) var failure: FitBufferDecoder.Failure?
+    /// The messages handed to the handlers by the last visit
+    public private(set) var mesgCount = 0
+
+    private var handlers = [UInt16: [(LazyMesg) -> Void]]()
+    private let decoder = FitBufferDecoder()
+
+    public init() {
+        decoder.mesgFilter = []
+        decoder.onLazyMesg = { [unowned self] mesg in
+            guard let handlers = self.handlers[mesg.num] else {
+                return
+            }
+            self.mesgCount += 1
+            for handler in handlers {
+                handler(mesg)
+            }
+        }
+    }
+
+    /// Verify the header and file CRCs.
+    public var checkCRC: Bool {
+        get { return decoder.checkCRC }
+        set { decoder.checkCRC = newValue }
+    }
+
+    /// Call `handler` with the view of every message of `V.globalMesgNum`, after the handlers
+    /// registered before it.
+    public func on<V: FitMesgView>(_ type: V.Type, _ handler: @escaping (V) -> Void) {
+        handlers[V.globalMesgNum, default: []].append { handler(V($0)) }
+        decoder.mesgFilter = Set(handlers.keys)
+    }
+
+    /// Forget the handlers of `V.globalMesgNum`.
+    public func removeHandlers<V: FitMesgView>(_ type: V.Type) {
+        handlers[V.globalMesgNum] = nil
+        decoder.mesgFilter = Set(handlers.keys)
+    }
+
+    /// Visit a file, mapped in memory rather than read.
+    @discardableResult
+    public func visit(path: String) -> Bool {
+        return visit { $0.read(path: path) }
+    }
+
+    @discardableResult
+    public func visit(_ bytes: [UInt8]) -> Bool {
+        return visit { $0.read(bytes) }
+    }
+
+    @discardableResult
+    public func visit(_ buffer: inout FitBuffer) -> Bool {
+        return visit { $0.read(&buffer) }
+    }
+
+    private func visit(_ read: (FitBufferDecoder) -> Bool) -> Bool {
+        mesgCount = 0
+        let result = read(decoder)
+        failure = decoder.failure
+        return result
+    }
+}
+
+public struct FitFileIdView: FitMesgView {
+
+    public static var globalMesgNum: UInt16 { return MesgNum.FileId }
+    public let mesg: LazyMesg
+
+    public init(_ mesg: LazyMesg) {
+        self.mesg = mesg
+    }
+
+    public var type: FitFileType? {
+        return mesg.getRawValue(fieldNum: FileIdMesg.FieldDefNum.`Type`.rawValue)
+            .flatMap { FitFileType(rawValue: UInt8(truncatingIfNeeded: $0)) }
+    }
+
+    public var manufacturer: UInt16? {
+        return mesg.getRawValue(fieldNum: FileIdMesg.FieldDefNum.Manufacturer.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var product: UInt16? {
+        return mesg.getRawValue(fieldNum: FileIdMesg.FieldDefNum.Product.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var serialNumber: UInt32? {
+        return mesg.getRawValue(fieldNum: FileIdMesg.FieldDefNum.SerialNumber.rawValue).map { UInt32(truncatingIfNeeded: $0) }
+    }
+
+    /// s since the FIT epoch
+    public var timeCreated: UInt32? {
+        return mesg.getRawValue(fieldNum: FileIdMesg.FieldDefNum.TimeCreated.rawValue).map { UInt32(truncatingIfNeeded: $0) }
+    }
+}
+
+/// The record getters, `heartRate`, `power`, `altitude` and the others, are those of `FitRecordFields`.
+public struct FitRecordView: FitMesgView, FitRecordFields {
+
+    public static var globalMesgNum: UInt16 { return MesgNum.Record }
+    public let mesg: LazyMesg
+
+    public init(_ mesg: LazyMesg) {
+        self.mesg = mesg
+    }
+
+    /// s since the FIT epoch, from a compressed timestamp header too
+    public var timestamp: UInt32? {
+        return mesg.timestamp
+    }
+
+    public func int64(fieldNum: UInt8, index: Int = 0) -> Int64? {
+        return mesg.getRawValue(fieldNum: fieldNum, index: index)
+    }
+
+    public func double(fieldNum: UInt8, index: Int = 0) -> Double? {
+        return mesg.getValue(fieldNum: fieldNum, index: index)
+    }
+}
+
+public struct FitEventView: FitMesgView {
+
+    public static var globalMesgNum: UInt16 { return MesgNum.Event }
+    public let mesg: LazyMesg
+
+    public init(_ mesg: LazyMesg) {
+        self.mesg = mesg
+    }
+
+    public var timestamp: UInt32? {
+        return mesg.timestamp
+    }
+
+    public var event: FitEvent? {
+        return mesg.getRawValue(fieldNum: EventMesg.FieldDefNum.Event.rawValue)
+            .flatMap { FitEvent(rawValue: UInt8(truncatingIfNeeded: $0)) }
+    }
+
+    public var eventType: EventType? {
+        return mesg.getRawValue(fieldNum: EventMesg.FieldDefNum.EventType.rawValue)
+            .flatMap { EventType(rawValue: UInt8(truncatingIfNeeded: $0)) }
+    }
+
+    public var data: UInt32? {
+        return mesg.getRawValue(fieldNum: EventMesg.FieldDefNum.Data.rawValue).map { UInt32(truncatingIfNeeded: $0) }
+    }
+}
+
+public struct FitLapView: FitMesgView {
+
+    public static var globalMesgNum: UInt16 { return MesgNum.Lap }
+    public let mesg: LazyMesg
+
+    public init(_ mesg: LazyMesg) {
+        self.mesg = mesg
+    }
+
+    public var timestamp: UInt32? {
+        return mesg.timestamp
+    }
+
+    public var startTime: UInt32? {
+        return mesg.getRawValue(fieldNum: LapMesg.FieldDefNum.StartTime.rawValue).map { UInt32(truncatingIfNeeded: $0) }
+    }
+
+    /// s
+    public var totalElapsedTime: Double? {
+        return mesg.getValue(fieldNum: LapMesg.FieldDefNum.TotalElapsedTime.rawValue)
+    }
+
+    /// s
+    public var totalTimerTime: Double? {
+        return mesg.getValue(fieldNum: LapMesg.FieldDefNum.TotalTimerTime.rawValue)
+    }
+
+    /// m
+    public var totalDistance: Double? {
+        return mesg.getValue(fieldNum: LapMesg.FieldDefNum.TotalDistance.rawValue)
+    }
+
+    public var avgPower: UInt16? {
+        return mesg.getRawValue(fieldNum: LapMesg.FieldDefNum.AvgPower.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var maxPower: UInt16? {
+        return mesg.getRawValue(fieldNum: LapMesg.FieldDefNum.MaxPower.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var avgHeartRate: UInt8? {
+        return mesg.getRawValue(fieldNum: LapMesg.FieldDefNum.AvgHeartRate.rawValue).map { UInt8(truncatingIfNeeded: $0) }
+    }
+
+    public var maxHeartRate: UInt8? {
+        return mesg.getRawValue(fieldNum: LapMesg.FieldDefNum.MaxHeartRate.rawValue).map { UInt8(truncatingIfNeeded: $0) }
+    }
+}
+
+public struct FitSessionView: FitMesgView {
+
+    public static var globalMesgNum: UInt16 { return MesgNum.Session }
+    public let mesg: LazyMesg
+
+    public init(_ mesg: LazyMesg) {
+        self.mesg = mesg
+    }
+
+    public var timestamp: UInt32? {
+        return mesg.timestamp
+    }
+
+    public var startTime: UInt32? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.StartTime.rawValue).map { UInt32(truncatingIfNeeded: $0) }
+    }
+
+    public var sport: Sport? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.Sport.rawValue)
+            .flatMap { Sport(rawValue: UInt8(truncatingIfNeeded: $0)) }
+    }
+
+    /// s
+    public var totalElapsedTime: Double? {
+        return mesg.getValue(fieldNum: SessionMesg.FieldDefNum.TotalElapsedTime.rawValue)
+    }
+
+    /// s
+    public var totalTimerTime: Double? {
+        return mesg.getValue(fieldNum: SessionMesg.FieldDefNum.TotalTimerTime.rawValue)
+    }
+
+    /// m
+    public var totalDistance: Double? {
+        return mesg.getValue(fieldNum: SessionMesg.FieldDefNum.TotalDistance.rawValue)
+    }
+
+    public var numLaps: UInt16? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.NumLaps.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var avgPower: UInt16? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.AvgPower.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var normalizedPower: UInt16? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.NormalizedPower.rawValue).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    public var avgHeartRate: UInt8? {
+        return mesg.getRawValue(fieldNum: SessionMesg.FieldDefNum.AvgHeartRate.rawValue).map { UInt8(truncatingIfNeeded: $0) }
+    }
+}
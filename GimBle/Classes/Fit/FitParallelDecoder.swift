@@ -0,0 +1,163 @@
+//
+//  FitParallelDecoder.swift
+//  GimBle
+//
+//  Decode FIT files on every core: the chunks of a big file, or many files at once.
+//
+
+import Foundation
+import GimKit
+
+/// Decode a FIT file in two phases.
+///
+/// A sequential scan, `FitSeekIndex`, steps over the records by their size and keeps a checkpoint
+/// every `chunkMesgCount` data messages: the offset and the definitions in effect there. The chunks
+/// between checkpoints are then decoded at once, each by its own `FitBufferDecoder` into its own
+/// message array, and the arrays are reported in file order. Components are expanded while
+/// reporting, with one `Accumulator` for the file, since accumulated fields depend on every message
+/// before them.
+///
+/// Developer fields are skipped, as with `FitBufferDecoder`.
+public final class FitParallelDecoder {
+
+    public typealias Failure = FitBufferDecoder.Failure
+
+    public weak var delegate: DecodeDelegate?
+    /// Called for every message, after the delegate.
+    public var onMesg: ((Mesg) -> Void)?
+    /// Verify the header and file CRCs.
+    public var checkCRC = true
+    /// Expand the components of the messages, as `Decode` does.
+    public var expandComponents = true
+    /// The global message numbers to decode, nil for all of them.
+    public var mesgFilter: Set<UInt16>?
+    /// Data messages per chunk, the unit of work of a thread.
+    public var chunkMesgCount = 4_096
+
+    public private(set) var failure: Failure?
+    public private(set) var mesgCount = 0
+
+    public init() {
+    }
+
+    @discardableResult
+    public func read(path: String) -> Bool {
+        guard let file = MappedFitFile(path: path) else {
+            failure = .notFit
+            return false
+        }
+        return file.withBuffer { read($0) }
+    }
+
+    @discardableResult
+    public func read(_ bytes: [UInt8]) -> Bool {
+        return withFitBuffer(bytes) { read($0) }
+    }
+
+    /// Decode every file of the buffer, from its position.
+    @discardableResult
+    public func read(_ buffer: FitBuffer) -> Bool {
+        failure = nil
+        mesgCount = 0
+        if checkCRC && !FitBufferDecoder.checkIntegrity(buffer) {
+            failure = .fileCRC
+            return false
+        }
+        guard let index = FitSeekIndex(buffer: buffer, interval: chunkMesgCount) else {
+            failure = .notFit
+            return false
+        }
+        guard let chunks = decodeChunks(buffer, index: index) else {
+            return false
+        }
+
+        var accumulator = Accumulator()
+        for (i, mesgs) in chunks.enumerated() {
+            if i > 0 && index.checkpoints[i].dataEnd != index.checkpoints[i - 1].dataEnd {
+                // The next file of a chain.
+                accumulator = Accumulator()
+            }
+            for mesg in mesgs {
+                if expandComponents {
+                    mesg.expandComponents(accumulator: accumulator)
+                }
+                delegate?.didReadMesg(mesg: mesg)
+                onMesg?(mesg)
+            }
+            mesgCount += mesgs.count
+        }
+        return true
+    }
+
+    /// The messages of every chunk, in file order, nil on failure.
+    private func decodeChunks(_ buffer: FitBuffer, index: FitSeekIndex) -> [[Mesg]]? {
+        let checkpoints = index.checkpoints
+        var chunks = [[Mesg]](repeating: [], count: checkpoints.count)
+        var failures = [Failure?](repeating: nil, count: checkpoints.count)
+        let filter = mesgFilter
+        chunks.withUnsafeMutableBufferPointer { chunks in
+            failures.withUnsafeMutableBufferPointer { failures in
+                // Each iteration writes its own elements only.
+                DispatchQueue.concurrentPerform(iterations: checkpoints.count) { i in
+                    let checkpoint = checkpoints[i]
+                    let end = i + 1 < checkpoints.count && checkpoints[i + 1].dataEnd == checkpoint.dataEnd
+                        ? checkpoints[i + 1].offset : checkpoint.dataEnd
+                    var mesgs = [Mesg]()
+                    mesgs.reserveCapacity(index.interval)
+                    let decoder = FitBufferDecoder()
+                    decoder.expandComponents = false
+                    decoder.mesgFilter = filter
+                    decoder.onMesg = { mesgs.append($0) }
+                    if !decoder.read(buffer, from: checkpoint, until: end) {
+                        failures[i] = decoder.failure
+                    }
+                    chunks[i] = mesgs
+                }
+            }
+        }
+        if let failure = failures.lazy.compactMap({ $0 }).first {
+            self.failure = failure
+            return nil
+        }
+        return chunks
+    }
+
+    // MARK: - Many files
+
+    /// Decode files on `maxConcurrentFiles` threads at most, each file sequentially, the messages of
+    /// a file kept until `completion` gets them. `completion` is called on a serial queue as the
+    /// files complete, in any order, with the index of the file in `paths` and its messages, nil if
+    /// it failed; then `done` on the main queue.
+    public static func decode(paths: [String],
+                              maxConcurrentFiles: Int = ProcessInfo.processInfo.activeProcessorCount,
+                              configure: ((FitBufferDecoder) -> Void)? = nil,
+                              completion: @escaping (Int, [Mesg]?) -> Void,
+                              done: (() -> Void)? = nil) {
+        let work = DispatchQueue(label: "gimkit.fit.decode", attributes: .concurrent)
+        let results = DispatchQueue(label: "gimkit.fit.decode.results")
+        let slots = DispatchSemaphore(value: max(maxConcurrentFiles, 1))
+        let group = DispatchGroup()
+        // Submitting blocks on the semaphore, so that at most `maxConcurrentFiles` files are queued.
+        DispatchQueue.global(qos: .userInitiated).async {
+            for (i, path) in paths.enumerated() {
+                slots.wait()
+                group.enter()
+                work.async {
+                    var mesgs = [Mesg]()
+                    let decoder = FitBufferDecoder()
+                    configure?(decoder)
+                    decoder.onMesg = { mesgs.append($0) }
+                    let ok = decoder.read(path: path)
+                    results.async {
+                        completion(i, ok ? mesgs : nil)
+                        slots.signal()
+                        group.leave()
+                    }
+                }
+            }
+            group.notify(queue: .main) {
+                done?()
+            }
+        }
+    }
+}
@@ -0,0 +1,104 @@
+//
+//  FitProfileTable.swift
+//  GimBle
+//
+//  The FIT profile resolved once per message, fields indexed by number.
+//
+
+import Foundation
+import GimKit
+
+/// The profile of one message: its fields in a table indexed by field number, their names
+/// interned in a table of field numbers.
+///
+/// `Profile.getMesg(globalMesgNum:)` builds a `Mesg` and `Profile.getField(globalMesgNum:fieldNum:)`
+/// walks the fields of the message for every call. A `FitProfileMesg` makes those calls once for
+/// all the fields of the message, then a field is one array access, and a name one hash of the
+/// name with no walk of the fields.
+public final class FitProfileMesg {
+
+    public let num: UInt16
+    public let name: String
+    /// The field numbers of the profile, in increasing order
+    public let fieldNums: [UInt8]
+
+    private let fields: [Field?]
+    private let scales: [Double]
+    private let offsets: [Double]
+    private let numsByName: [String: UInt8]
+
+    fileprivate init(num: UInt16) {
+        self.num = num
+        name = Profile.getMesg(globalMesgNum: num).name
+        var fields = [Field?](repeating: nil, count: 256)
+        var scales = [Double](repeating: 1, count: 256)
+        var offsets = [Double](repeating: 0, count: 256)
+        var fieldNums = [UInt8]()
+        var numsByName = [String: UInt8]()
+        for fieldNum in 0...255 {
+            guard let field = Profile.getField(globalMesgNum: num, fieldNum: UInt8(fieldNum)) else {
+                continue
+            }
+            fields[fieldNum] = field
+            scales[fieldNum] = field.scale
+            offsets[fieldNum] = field.offset
+            fieldNums.append(UInt8(fieldNum))
+            if let name = field.name {
+                numsByName[name] = UInt8(fieldNum)
+            }
+        }
+        self.fields = fields
+        self.scales = scales
+        self.offsets = offsets
+        self.fieldNums = fieldNums
+        self.numsByName = numsByName
+    }
+
+    /// The profile field `num`, not to be modified: copy it with `Field(field:)`.
+    @inline(__always)
+    public func field(num: UInt8) -> Field? {
+        return fields[Int(num)]
+    }
+
+    @inline(__always)
+    public func fieldNum(name: String) -> UInt8? {
+        return numsByName[name]
+    }
+
+    /// Scale and offset of field `num`, 1 and 0 when the profile doesn't know it.
+    @inline(__always)
+    public func scale(num: UInt8) -> Double {
+        return scales[Int(num)]
+    }
+
+    @inline(__always)
+    public func offset(num: UInt8) -> Double {
+        return offsets[Int(num)]
+    }
+}
+
+/// The `FitProfileMesg`s, built the first time a message is met and kept.
+///
+/// Looking a message up takes a lock, so it is done once per definition message, see
+/// `MesgLayout.profile`; the field lookups through the result take none.
+public enum FitProfileTable {
+
+    private static var mesgs = [UInt16: FitProfileMesg]()
+    private static let lock = NSLock()
+
+    public static func mesg(_ globalMesgNum: UInt16) -> FitProfileMesg {
+        lock.lock()
+        defer { lock.unlock() }
+        if let mesg = mesgs[globalMesgNum] {
+            return mesg
+        }
+        let mesg = FitProfileMesg(num: globalMesgNum)
+        mesgs[globalMesgNum] = mesg
+        return mesg
+    }
+
+    @inline(__always)
+    public static func field(globalMesgNum: UInt16, fieldNum: UInt8) -> Field? {
+        return mesg(globalMesgNum).field(num: fieldNum)
+    }
+}
@@ -0,0 +1,126 @@
+//
+//  FitScaling.swift
+//  GimBle
+//
+//  The profile scale and offset applied to whole columns of raw values, eight at a time.
+//
+
+import Foundation
+
+/// Scale and offset of a series of raw values, as `value / scale - offset`.
+///
+/// The getters of the generated messages, `RecordMesg.getAltitude()` and the like, scale one boxed
+/// value per call. These functions take the raw values of a field over a whole file, as a
+/// `FitNumericColumn` or any array of the base type holds them, and scale them in SIMD vectors of
+/// eight lanes into `Float64` or `Float32` values: the invalid values of the base type become NaN
+/// in the same pass. The functions are `@inlinable`, so they are specialized for the value types of
+/// the caller.
+public enum FitScaling {
+
+    /// The invalid value of an integer base type, from `FitBaseTypeInfo`: 0 for the z types, the
+    /// largest value otherwise.
+    @inlinable
+    public static func invalidValue<T: FixedWidthInteger>(_ type: T.Type, baseType: UInt8) -> T {
+        return T(truncatingIfNeeded: FitBaseTypeInfo.of(baseType).invalid)
+    }
+
+    /// Scale the raw integers of a field of `baseType` into `output`, NaN for its invalid value.
+    /// `output` must be as large as `raw`.
+    @inlinable
+    public static func scale<T: FixedWidthInteger & SIMDScalar, U: BinaryFloatingPoint & SIMDScalar>(
+        _ raw: UnsafeBufferPointer<T>, baseType: UInt8, scale: Double, offset: Double,
+        into output: UnsafeMutableBufferPointer<U>) {
+        precondition(output.count >= raw.count, "output smaller than raw")
+        guard let values = raw.baseAddress, let results = output.baseAddress else {
+            return
+        }
+        let invalid = invalidValue(T.self, baseType: baseType)
+        // Integers wider than the significand of a Double are compared exactly, after the fact.
+        let exact = T.bitWidth <= 32
+        apply(values, count: raw.count, invalid: exact ? Double(invalid) : nil, scale: scale, offset: offset,
+              into: results, vector: { SIMD8<Double>($0) }, scalar: { Double($0) })
+        if !exact {
+            for i in 0..<raw.count where values[i] == invalid {
+                results[i] = .nan
+            }
+        }
+    }
+
+    /// Scale raw integers whose validity is known otherwise, such as the values of a
+    /// `FitNumericColumn`, without checking for an invalid value.
+    @inlinable
+    public static func scale<T: FixedWidthInteger & SIMDScalar, U: BinaryFloatingPoint & SIMDScalar>(
+        _ raw: UnsafeBufferPointer<T>, scale: Double, offset: Double, into output: UnsafeMutableBufferPointer<U>) {
+        precondition(output.count >= raw.count, "output smaller than raw")
+        guard let values = raw.baseAddress, let results = output.baseAddress else {
+            return
+        }
+        apply(values, count: raw.count, invalid: nil, scale: scale, offset: offset, into: results,
+              vector: { SIMD8<Double>($0) }, scalar: { Double($0) })
+    }
+
+    /// Scale the values of a float32 or float64 field.
+    @inlinable
+    public static func scale<T: BinaryFloatingPoint & SIMDScalar, U: BinaryFloatingPoint & SIMDScalar>(
+        _ raw: UnsafeBufferPointer<T>, scale: Double, offset: Double, into output: UnsafeMutableBufferPointer<U>) {
+        precondition(output.count >= raw.count, "output smaller than raw")
+        guard let values = raw.baseAddress, let results = output.baseAddress else {
+            return
+        }
+        apply(values, count: raw.count, invalid: nil, scale: scale, offset: offset, into: results,
+              vector: { SIMD8<Double>($0) }, scalar: { Double($0) })
+    }
+
+    /// The raw integers of a field of `baseType`, scaled, NaN for its invalid value.
+    @inlinable
+    public static func scaled<T: FixedWidthInteger & SIMDScalar>(_ raw: [T], baseType: UInt8, scale: Double,
+                                                                 offset: Double) -> [Double] {
+        return [Double](unsafeUninitializedCapacity: raw.count) { output, count in
+            raw.withUnsafeBufferPointer {
+                FitScaling.scale($0, baseType: baseType, scale: scale, offset: offset, into: output)
+            }
+            count = raw.count
+        }
+    }
+
+    @inlinable
+    public static func scaledFloat32<T: FixedWidthInteger & SIMDScalar>(_ raw: [T], baseType: UInt8, scale: Double,
+                                                                        offset: Double) -> [Float32] {
+        return [Float32](unsafeUninitializedCapacity: raw.count) { output, count in
+            raw.withUnsafeBufferPointer {
+                FitScaling.scale($0, baseType: baseType, scale: scale, offset: offset, into: output)
+            }
+            count = raw.count
+        }
+    }
+
+    /// The loop of all the functions above: eight values per iteration, widened to `Double` by
+    /// `vector` and computed as `LazyMesg.getValue(fieldNum:index:)` computes one, then narrowed to
+    /// `U`; the remainder one at a time.
+    @inlinable
+    @inline(__always)
+    static func apply<T: SIMDScalar, U: BinaryFloatingPoint & SIMDScalar>(
+        _ raw: UnsafePointer<T>, count: Int, invalid: Double?, scale: Double, offset: Double,
+        into output: UnsafeMutablePointer<U>, vector: (SIMD8<T>) -> SIMD8<Double>, scalar: (T) -> Double) {
+        let scales = SIMD8<Double>(repeating: scale)
+        let offsets = SIMD8<Double>(repeating: offset)
+        let invalids = SIMD8<Double>(repeating: invalid ?? 0)
+        let nans = SIMD8<Double>(repeating: .nan)
+        var i = 0
+        while i + 8 <= count {
+            let p = raw + i
+            var values = vector(SIMD8<T>(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7]))
+            if invalid != nil {
+                values.replace(with: nans, where: values .== invalids)
+            }
+            var results = SIMD8<U>(values / scales - offsets)
+            UnsafeMutableRawPointer(output + i).copyMemory(from: &results, byteCount: MemoryLayout<SIMD8<U>>.size)
+            i += 8
+        }
+        while i < count {
+            let value = scalar(raw[i])
+            output[i] = value == invalid ? .nan : U(value / scale - offset)
+            i += 1
+        }
+    }
+}
@@ -0,0 +1,253 @@
+//
+//  FitSeekIndex.swift
+//  GimBle
+//
+//  Checkpoints of the decoding state of a FIT file, for random access by timestamp.
+//
+
+import Foundation
+import GimKit
+
+/// Where decoding can resume in a FIT file.
+///
+/// Data messages only make sense with the definitions read before them, and compressed timestamps
+/// with the last timestamp. A checkpoint keeps both every `interval` data messages: the offsets of
+/// the active definition messages and the last timestamp. `FitBufferDecoder.read(path:index:from:to:)`
+/// resumes from the checkpoint before a time range instead of the start of the file.
+///
+/// The index is built in one pass and kept in a sidecar file next to the FIT file, see `sidecarPath(for:)`.
+public struct FitSeekIndex {
+
+    public struct Checkpoint: Equatable {
+        /// Offset of the next record
+        public let offset: Int
+        /// End of the records of the file the checkpoint is in, where its CRC starts
+        public let dataEnd: Int
+        /// The last timestamp read before the checkpoint, 0 at the start of a file
+        public let timestamp: UInt32
+        /// Offsets of the definition messages of the 16 local message types, -1 if undefined
+        public let definitions: [Int]
+
+        /// Decoding can resume from the checkpoint in a file of `fileSize` bytes: it is within the
+        /// records of its file, the CRC of the file follows them, and its definitions come before it.
+        public func isValid(fileSize: Int) -> Bool {
+            return offset >= 0 && offset <= dataEnd && dataEnd <= fileSize - 2 && definitions.count == 16
+                && definitions.allSatisfy { $0 == -1 || (0..<offset).contains($0) }
+        }
+    }
+
+    public static let defaultInterval = 1_000
+
+    public let interval: Int
+    public private(set) var checkpoints: [Checkpoint] = []
+    /// Size and file CRC of the indexed file, to tell a stale index
+    public let fileSize: Int
+    public let fileCRC: UInt16
+
+    /// Index every file of the buffer, from its position. Returns nil if it doesn't hold FIT files.
+    public init?(buffer: FitBuffer, interval: Int = FitSeekIndex.defaultInterval) {
+        guard buffer.count >= 2 else {
+            return nil
+        }
+        self.interval = max(interval, 1)
+        fileSize = buffer.count
+        fileCRC = buffer.load(UInt16.self, at: buffer.count - 2)
+
+        var buffer = buffer
+        repeat {
+            guard buffer.canRead(Int(Fit.headerWithoutCRCSize)) else {
+                return nil
+            }
+            let start = buffer.position
+            let headerSize = Int(buffer[start])
+            guard headerSize == Int(Fit.headerWithCRCSize) || headerSize == Int(Fit.headerWithoutCRCSize),
+                  buffer.canRead(headerSize) else {
+                return nil
+            }
+            let dataEnd = start + headerSize + Int(buffer.load(UInt32.self, at: start + 4))
+            guard dataEnd + 2 <= buffer.count else {
+                return nil
+            }
+            buffer.position = start + headerSize
+            guard indexRecords(&buffer, dataEnd: dataEnd) else {
+                return nil
+            }
+            buffer.position = dataEnd + 2
+        } while buffer.remaining > 0
+    }
+
+    private mutating func indexRecords(_ buffer: inout FitBuffer, dataEnd: Int) -> Bool {
+        var records = FitBuffer(buffer.slice(at: 0, count: dataEnd), position: buffer.position)
+        var layouts = [MesgLayout?](repeating: nil, count: 16)
+        var definitions = [Int](repeating: -1, count: 16)
+        var lastTimestamp: UInt32 = 0
+        var count = 0
+        checkpoints.append(Checkpoint(offset: records.position, dataEnd: dataEnd, timestamp: 0, definitions: definitions))
+
+        while records.position < dataEnd {
+            let recordHeader = records[records.position]
+            if recordHeader & Fit.compressedHeaderMask == 0 && recordHeader & Fit.mesgDefinitionMask != 0 {
+                let start = records.position
+                guard let layout = MesgLayout(buffer: &records) else {
+                    return false
+                }
+                layouts[Int(layout.localMesgNum)] = layout
+                definitions[Int(layout.localMesgNum)] = start
+                continue
+            }
+            let compressed = recordHeader & Fit.compressedHeaderMask != 0
+            let local = compressed ? (recordHeader & Fit.compressedLocalMesgNumMask) >> 5 : recordHeader & Fit.localMesgNumMask
+            guard let layout = layouts[Int(local)], records.canRead(1 + layout.dataSize) else {
+                return false
+            }
+            if compressed {
+                let timeOffset = UInt32(recordHeader & Fit.compressedTimeMask)
+                lastTimestamp = lastTimestamp &+ ((timeOffset &- lastTimestamp) & UInt32(Fit.compressedTimeMask))
+            } else if let field = layout.field(num: Fit.fieldNumTimeStamp),
+                      let timestamp = LazyMesg.integer(records, at: records.position + 1 + field.offset, baseType: field.type,
+                                                       bigEndian: layout.isBigEndian) {
+                lastTimestamp = UInt32(truncatingIfNeeded: timestamp)
+            }
+            records.skip(1 + layout.dataSize)
+            count += 1
+            if count % interval == 0 && records.position < dataEnd {
+                checkpoints.append(Checkpoint(offset: records.position, dataEnd: dataEnd, timestamp: lastTimestamp,
+                                              definitions: definitions))
+            }
+        }
+        return true
+    }
+
+    /// Index a file, mapped in memory.
+    public init?(path: String, interval: Int = FitSeekIndex.defaultInterval) {
+        guard let file = MappedFitFile(path: path),
+              let index = file.withBuffer({ FitSeekIndex(buffer: $0, interval: interval) }) else {
+            return nil
+        }
+        self = index
+    }
+
+    /// The index was built from this data.
+    public func matches(_ buffer: FitBuffer) -> Bool {
+        return buffer.count == fileSize && buffer.count >= 2 && buffer.load(UInt16.self, at: buffer.count - 2) == fileCRC
+    }
+
+    /// The last checkpoint before the messages of timestamp `timestamp`: the first one of its file if
+    /// they are in the first interval, the first one of the index if no checkpoint comes before them.
+    public func checkpoint(before timestamp: UInt32) -> Checkpoint? {
+        // Timestamps only grow along a recording: the first checkpoint of a chained file, at 0,
+        // stands at the last timestamp of the file before it.
+        var found = checkpoints.first
+        var last: UInt32 = 0
+        for checkpoint in checkpoints {
+            last = max(last, checkpoint.timestamp)
+            guard last < timestamp else {
+                break
+            }
+            found = checkpoint
+        }
+        return found
+    }
+
+    // MARK: - Sidecar
+
+    private static let magic: [UInt8] = Array("GKSI".utf8)
+    private static let version: UInt16 = 1
+
+    public static func sidecarPath(for path: String) -> String {
+        return path + ".gksi"
+    }
+
+    /// The index of the file at `path` from its sidecar, built and written if it is missing or stale.
+    public static func load(path: String, interval: Int = FitSeekIndex.defaultInterval) -> FitSeekIndex? {
+        guard let file = MappedFitFile(path: path) else {
+            return nil
+        }
+        let sidecar = sidecarPath(for: path)
+        if let index = FitSeekIndex(contentsOf: sidecar), file.withBuffer({ index.matches($0) }) {
+            return index
+        }
+        guard let index = file.withBuffer({ FitSeekIndex(buffer: $0, interval: interval) }) else {
+            return nil
+        }
+        _ = index.write(to: sidecar)
+        return index
+    }
+
+    /// Little endian: magic, version, interval, file size, file CRC, checkpoint count, then for
+    /// every checkpoint its offset, data end, timestamp and 16 definition offsets, all 8 bytes but
+    /// the timestamp.
+    public var serialized: [UInt8] {
+        var bytes = FitSeekIndex.magic
+        bytes.reserveCapacity(32 + checkpoints.count * (8 * 18 + 4))
+        func append<T: FixedWidthInteger>(_ value: T) {
+            withUnsafeBytes(of: value.littleEndian) { bytes.append(contentsOf: $0) }
+        }
+        append(FitSeekIndex.version)
+        append(UInt32(interval))
+        append(UInt64(fileSize))
+        append(fileCRC)
+        append(UInt32(checkpoints.count))
+        for checkpoint in checkpoints {
+            append(UInt64(checkpoint.offset))
+            append(UInt64(checkpoint.dataEnd))
+            append(checkpoint.timestamp)
+            for definition in checkpoint.definitions {
+                append(Int64(definition))
+            }
+        }
+        return bytes
+    }
+
+    public init?(serialized bytes: [UInt8]) {
+        guard let index = withFitBuffer(bytes, { (buffer: inout FitBuffer) -> FitSeekIndex? in
+            guard buffer.canRead(24), [UInt8](buffer.read(count: 4)) == FitSeekIndex.magic,
+                  buffer.read(UInt16.self) == FitSeekIndex.version else {
+                return nil
+            }
+            let interval = Int(buffer.read(UInt32.self))
+            let fileSize = Int(buffer.read(UInt64.self))
+            let fileCRC = buffer.read(UInt16.self)
+            let count = Int(buffer.read(UInt32.self))
+            guard interval > 0, buffer.remaining == count * (8 * 18 + 4) else {
+                return nil
+            }
+            var checkpoints = [Checkpoint]()
+            checkpoints.reserveCapacity(count)
+            for _ in 0..<count {
+                let offset = Int(buffer.read(UInt64.self))
+                let dataEnd = Int(buffer.read(UInt64.self))
+                let timestamp = buffer.read(UInt32.self)
+                let definitions = (0..<16).map { _ in Int(buffer.read(Int64.self)) }
+                let checkpoint = Checkpoint(offset: offset, dataEnd: dataEnd, timestamp: timestamp, definitions: definitions)
+                guard checkpoint.isValid(fileSize: fileSize) else {
+                    return nil
+                }
+                checkpoints.append(checkpoint)
+            }
+            return FitSeekIndex(interval: interval, checkpoints: checkpoints, fileSize: fileSize, fileCRC: fileCRC)
+        }) else {
+            return nil
+        }
+        self = index
+    }
+
+    public init?(contentsOf path: String) {
+        guard let data = FileManager.default.contents(atPath: path) else {
+            return nil
+        }
+        self.init(serialized: [UInt8](data))
+    }
+
+    @discardableResult
+    public func write(to path: String) -> Bool {
+        return FileManager.default.createFile(atPath: path, contents: Data(serialized))
+    }
+
+    private init(interval: Int, checkpoints: [Checkpoint], fileSize: Int, fileCRC: UInt16) {
+        self.interval = interval
+        self.checkpoints = checkpoints
+        self.fileSize = fileSize
+        self.fileCRC = fileCRC
+    }
+}
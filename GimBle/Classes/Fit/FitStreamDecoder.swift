@@ -0,0 +1,375 @@
+//
+//  FitStreamDecoder.swift
+//  GimBle
+//
+//  Decode a FIT file of any size through a fixed window, emitting the messages as they complete.
+//
+
+import Foundation
+import GimKit
+
+/// A streaming counterpart of `Decode`.
+///
+/// `Decode.read(_:)` needs the whole file in a `PositionableData`. This decoder pulls the bytes from
+/// a `FitChunkSource` into a window allocated once, cuts them into records, and hands each record to
+/// `Decode.decodeNextMessage(_:)`, which keeps the active message definitions, the compressed
+/// timestamps and the developer field descriptions, and reports to the delegate as usual. `Decode`
+/// reads the records from one copy of the window per refill, positioned on each record in turn.
+/// Peak memory is twice the window, whatever the size of the file.
+///
+/// Chained FIT files are decoded one after the other, and the header and file CRCs are verified on
+/// the fly.
+///
+/// With a `mesgFilter`, the data messages of the other global message numbers are skipped by their
+/// size alone and never reach `Decode`.
+public final class FitStreamDecoder {
+
+    public enum Failure: Error, Equatable {
+        /// The source failed
+        case source
+        /// Not a FIT header
+        case notFit
+        case headerCRC
+        case fileCRC
+        /// The data ended in the middle of a file
+        case truncated
+        /// A record bigger than the window, see `minimumWindowSize`
+        case recordTooLarge(Int)
+        /// A data message of a local message type with no definition
+        case undefinedLocalMesg(UInt8)
+        /// A record running past the data size of the header
+        case dataSize
+    }
+
+    /// The biggest record a FIT file can hold: a header byte, then 255 fields and 255 developer
+    /// fields of 255 bytes each. A window of this size decodes any file.
+    public static let minimumWindowSize = 1 + 255 * 255 * 2
+    public static let defaultWindowSize = 128 * 1024
+
+    public weak var delegate: DecodeDelegate?
+    /// Called for every message, after the delegate.
+    public var onMesg: ((Mesg) -> Void)?
+    /// Verify the header and file CRCs.
+    public var checkCRC = true
+    /// The global message numbers to decode, nil for all of them. Field descriptions and developer
+    /// data ids are always decoded, the developer fields of the other messages depend on them.
+    public var mesgFilter: Set<UInt16>?
+
+    public private(set) var failure: Failure?
+    public private(set) var mesgCount = 0
+    public private(set) var fileCount = 0
+
+    public let windowSize: Int
+    private let source: FitChunkSource
+    private let window: UnsafeMutablePointer<UInt8>
+    private var head = 0
+    private var tail = 0
+    private var sourceEnded = false
+
+    private var crc: UInt16 = 0
+    /// Size of the data records of every local message type, header byte included, 0 if undefined.
+    private var recordSizes = [Int](repeating: 0, count: 16)
+    /// Global message number and offset of the timestamp field in the data records, -1 if they
+    /// have none, of every local message type.
+    private var recordGlobals = [UInt16](repeating: 0, count: 16)
+    private var timestampOffsets = [Int](repeating: -1, count: 16)
+    private var bigEndian = [Bool](repeating: false, count: 16)
+    /// `Decode` misses the timestamps of the skipped messages, the decoder keeps the last one itself
+    /// and sets it on the messages with a compressed timestamp header.
+    private var lastTimestamp: UInt32 = 0
+    private var compressedTimestamp: UInt32?
+    private var decode = Decode()
+    /// The bytes of the window from `chunkStart` as `Decode` reads them, nil once the window moved.
+    private var chunk: PositionableData?
+    private var chunkStart = 0
+    private lazy var forwarder = Forwarder(self)
+
+    public init(source: FitChunkSource, windowSize: Int = FitStreamDecoder.defaultWindowSize) {
+        self.source = source
+        self.windowSize = max(windowSize, Int(Fit.headerWithCRCSize))
+        window = UnsafeMutablePointer<UInt8>.allocate(capacity: self.windowSize)
+    }
+
+    public convenience init?(path: String, windowSize: Int = FitStreamDecoder.defaultWindowSize) {
+        guard let source = FitFileSource(path: path) else {
+            return nil
+        }
+        self.init(source: source, windowSize: windowSize)
+    }
+
+    deinit {
+        window.deallocate()
+    }
+
+    /// Decode every file of the source. Returns false on failure, see `failure`; the messages
+    /// decoded before the failure have been reported.
+    @discardableResult
+    public func read() -> Bool {
+        failure = nil
+        while true {
+            if !ensure(1) {
+                // A clean end between two files.
+                return failure == nil && fileCount > 0 ? true : fail(failure ?? .notFit)
+            }
+            guard readFile() else {
+                return false
+            }
+            fileCount += 1
+        }
+    }
+
+    private func readFile() -> Bool {
+        let headerSize = Int(window[head])
+        guard headerSize == Int(Fit.headerWithCRCSize) || headerSize == Int(Fit.headerWithoutCRCSize) else {
+            return fail(.notFit)
+        }
+        guard ensure(headerSize) else {
+            return fail(failure ?? .truncated)
+        }
+        let header = window + head
+        guard header[8] == 0x2E, header[9] == 0x46, header[10] == 0x49, header[11] == 0x54 else {
+            return fail(.notFit)
+        }
+        var remaining = Int(UInt32(header[4]) | UInt32(header[5]) << 8 | UInt32(header[6]) << 16 | UInt32(header[7]) << 24)
+        crc = 0
+        if checkCRC && headerSize == Int(Fit.headerWithCRCSize) {
+            let headerCRC = UInt16(header[12]) | UInt16(header[13]) << 8
+            let computed = updateCRC(0, header, 12)
+            if headerCRC != 0 && headerCRC != computed {
+                return fail(.headerCRC)
+            }
+        }
+        consume(headerSize)
+
+        decode = Decode()
+        decode.delegate = forwarder
+        for i in 0..<recordSizes.count {
+            recordSizes[i] = 0
+            timestampOffsets[i] = -1
+        }
+        lastTimestamp = 0
+
+        while remaining > 0 {
+            guard let size = nextRecordSize() else {
+                return false
+            }
+            guard size <= remaining else {
+                return fail(.dataSize)
+            }
+            guard ensure(size) else {
+                return fail(failure ?? .truncated)
+            }
+            let record = window + head
+            if record[0] & Fit.compressedHeaderMask == 0 && record[0] & Fit.mesgDefinitionMask != 0 {
+                define(record)
+                decodeRecord(size: size)
+            } else if let filter = mesgFilter {
+                let compressed = record[0] & Fit.compressedHeaderMask != 0
+                let local = Int(compressed ? (record[0] & Fit.compressedLocalMesgNumMask) >> 5 : record[0] & Fit.localMesgNumMask)
+                if compressed {
+                    let timeOffset = UInt32(record[0] & Fit.compressedTimeMask)
+                    lastTimestamp = lastTimestamp &+ ((timeOffset &- lastTimestamp) & UInt32(Fit.compressedTimeMask))
+                } else if timestampOffsets[local] >= 0 {
+                    let at = record + timestampOffsets[local]
+                    let timestamp = UInt32(at[0]) | UInt32(at[1]) << 8 | UInt32(at[2]) << 16 | UInt32(at[3]) << 24
+                    lastTimestamp = bigEndian[local] ? timestamp.byteSwapped : timestamp
+                }
+                let global = recordGlobals[local]
+                if filter.contains(global) || global == MesgNum.FieldDescription || global == MesgNum.DeveloperDataId {
+                    compressedTimestamp = compressed ? lastTimestamp : nil
+                    decodeRecord(size: size)
+                    compressedTimestamp = nil
+                }
+            } else {
+                decodeRecord(size: size)
+            }
+            consume(size)
+            remaining -= size
+        }
+
+        guard ensure(2) else {
+            return fail(failure ?? .truncated)
+        }
+        let fileCRC = UInt16(window[head]) | UInt16(window[head + 1]) << 8
+        let computed = crc
+        consume(2)
+        if checkCRC && fileCRC != computed {
+            return fail(.fileCRC)
+        }
+        return true
+    }
+
+    /// Hand the record of `size` bytes at the window head to `Decode`, from the current chunk if it
+    /// holds the record, else from a new one holding the window up to its tail.
+    private func decodeRecord(size: Int) {
+        let chunk: PositionableData
+        if let current = self.chunk, head >= chunkStart, head + size <= chunkStart + current.count {
+            chunk = current
+        } else {
+            chunk = PositionableData(data: Array(UnsafeBufferPointer(start: window + head, count: tail - head)))
+            chunkStart = head
+            self.chunk = chunk
+        }
+        chunk.position = head - chunkStart
+        decode.decodeNextMessage(chunk)
+    }
+
+    /// Size of the record starting at the window head, reading as much of it as needed to know.
+    private func nextRecordSize() -> Int? {
+        // The window may have been emptied by the last record.
+        guard ensure(1) else {
+            fail(failure ?? .truncated)
+            return nil
+        }
+        let recordHeader = window[head]
+        if recordHeader & Fit.compressedHeaderMask != 0 {
+            let local = (recordHeader & Fit.compressedLocalMesgNumMask) >> 5
+            return definedSize(local)
+        }
+        if recordHeader & Fit.mesgDefinitionMask == 0 {
+            return definedSize(recordHeader & Fit.localMesgNumMask)
+        }
+        // Header, reserved, architecture, global message number, number of fields.
+        guard ensure(6) else {
+            fail(failure ?? .truncated)
+            return nil
+        }
+        var size = 6 + 3 * Int(window[head + 5])
+        if recordHeader & Fit.devDataMask != 0 {
+            guard ensure(size + 1) else {
+                fail(failure ?? .truncated)
+                return nil
+            }
+            size += 1 + 3 * Int(window[head + size])
+        }
+        return size
+    }
+
+    private func definedSize(_ local: UInt8) -> Int? {
+        let size = recordSizes[Int(local)]
+        if size == 0 {
+            fail(.undefinedLocalMesg(local))
+            return nil
+        }
+        return size
+    }
+
+    /// Keep the size, global message number and timestamp offset of the data records of a definition.
+    private func define(_ definition: UnsafeMutablePointer<UInt8>) {
+        let local = Int(definition[0] & Fit.localMesgNumMask)
+        let isBigEndian = definition[2] == Fit.bigEndian
+        let global = UInt16(definition[3]) | UInt16(definition[4]) << 8
+        recordGlobals[local] = isBigEndian ? global.byteSwapped : global
+        bigEndian[local] = isBigEndian
+        timestampOffsets[local] = -1
+        var offset = 1
+        for i in 0..<Int(definition[5]) {
+            let field = definition + 6 + 3 * i
+            if field[0] == Fit.fieldNumTimeStamp && field[1] == 4 {
+                timestampOffsets[local] = offset
+            }
+            offset += Int(field[1])
+        }
+        recordSizes[local] = dataRecordSize(definition: definition)
+    }
+
+    private func dataRecordSize(definition: UnsafeMutablePointer<UInt8>) -> Int {
+        let fields = Int(definition[5])
+        var size = 1
+        for i in 0..<fields {
+            size += Int(definition[6 + 3 * i + 1])
+        }
+        if definition[0] & Fit.devDataMask != 0 {
+            let devFieldsAt = 6 + 3 * fields
+            for i in 0..<Int(definition[devFieldsAt]) {
+                size += Int(definition[devFieldsAt + 1 + 3 * i + 1])
+            }
+        }
+        return size
+    }
+
+    /// Make sure the window holds `count` bytes from its head.
+    private func ensure(_ count: Int) -> Bool {
+        if tail - head >= count {
+            return true
+        }
+        if count > windowSize {
+            fail(.recordTooLarge(count))
+            return false
+        }
+        if head + count > windowSize {
+            window.assign(from: window + head, count: tail - head)
+            tail -= head
+            head = 0
+            chunk = nil
+        }
+        while tail - head < count {
+            if sourceEnded {
+                return false
+            }
+            let n = source.read(into: window + tail, count: windowSize - tail)
+            if n < 0 {
+                fail(.source)
+                return false
+            }
+            if n == 0 {
+                sourceEnded = true
+                return false
+            }
+            tail += n
+        }
+        return true
+    }
+
+    private func consume(_ count: Int) {
+        crc = updateCRC(crc, window + head, count)
+        head += count
+        if head == tail {
+            head = 0
+            tail = 0
+            chunk = nil
+        }
+    }
+
+    private func updateCRC(_ crc: UInt16, _ bytes: UnsafePointer<UInt8>, _ count: Int) -> UInt16 {
+        guard checkCRC else {
+            return crc
+        }
+        return gk_crc16_update(crc, bytes, count)
+    }
+
+    @discardableResult
+    private func fail(_ failure: Failure) -> Bool {
+        if self.failure == nil {
+            self.failure = failure
+        }
+        return false
+    }
+
+    /// `Decode.delegate` is weak, the decoder keeps this one alive.
+    private final class Forwarder: DecodeDelegate {
+
+        unowned let owner: FitStreamDecoder
+
+        init(_ owner: FitStreamDecoder) {
+            self.owner = owner
+        }
+
+        func didReadMesg(mesg: Mesg) {
+            if let timestamp = owner.compressedTimestamp {
+                mesg.setFieldValue(fieldNum: Fit.fieldNumTimeStamp, value: timestamp)
+            }
+            owner.mesgCount += 1
+            owner.delegate?.didReadMesg(mesg: mesg)
+            owner.onMesg?(mesg)
+        }
+
+        func didReadMesgDefinition(mesgDef: MesgDefinition) {
+            owner.delegate?.didReadMesgDefinition(mesgDef: mesgDef)
+        }
+
+        func didReadDeveloperFieldDescription(fieldDesc: DeveloperFieldDescription) {
+            owner.delegate?.didReadDeveloperFieldDescription(fieldDesc: fieldDesc)
+        }
+    }
+}
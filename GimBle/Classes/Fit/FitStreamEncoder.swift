@@ -0,0 +1,248 @@
+//
+//  FitStreamEncoder.swift
+//  GimBle
+//
+//  Encode a FIT file straight to disk, through a fixed-size buffer.
+//
+
+import Foundation
+import GimKit
+
+/// A streaming counterpart of `Encode`.
+///
+/// `Encode` keeps the whole file in memory until `close()`. This encoder writes the header with a
+/// data size of 0 when it opens the file, then the records through a buffer allocated once, keeping
+/// the CRC of the data as it goes. `close()` flushes the buffer, patches the data size and the
+/// header CRC in place and appends the file CRC, combining the CRC of the final header with the one
+/// of the data instead of reading the file back. Memory stays flat whatever the length of the
+/// recording.
+///
+/// Definitions are written as `Encode` writes them: when a message doesn't fit the definition of
+/// its local message type.
+///
+/// With `compressTimestamps`, a message of local message type 0 to 3 coming less than 32 s after
+/// the previous timestamp gets a compressed timestamp header, holding the low 5 bits of its
+/// timestamp, instead of a 4-byte timestamp field; its definition is written without the field.
+/// Other messages fall back to a normal header.
+///
+/// With a `localMesgAllocator`, the local message types are chosen by the allocator rather than
+/// taken from `Mesg.localNum`, and definitions are only written when it misses.
+public final class FitStreamEncoder {
+
+    public enum Failure: Error, Equatable {
+        /// The file couldn't be opened
+        case open
+        /// A write failed, with its errno
+        case write(Int32)
+        /// The encoder is closed
+        case closed
+    }
+
+    public static let defaultBufferSize = 64 * 1024
+
+    public private(set) var failure: Failure?
+    /// Bytes of records written so far, the data size of the header
+    public private(set) var dataSize = 0
+    public private(set) var mesgCount = 0
+    /// Write compressed timestamp headers when the timestamps allow it.
+    public var compressTimestamps = false
+    /// Messages written with a compressed timestamp header
+    public private(set) var compressedCount = 0
+    /// Chooses the local message types, and with them when to write a definition. Don't write
+    /// definitions directly when it is set.
+    public var localMesgAllocator: FitLocalMesgAllocator?
+
+    private let fd: Int32
+    private let ownsDescriptor: Bool
+    private let version: ProtocolVersion
+    private let headerSize: Int
+    private let buffer: UnsafeMutablePointer<UInt8>
+    private let bufferSize: Int
+    private var buffered = 0
+    private var dataCRC = GimKitCRC16()
+    private var definitions = [MesgDefinition?](repeating: nil, count: Int(Fit.maxLocalMesgs))
+    private var closed = false
+    private var lastTimestamp: UInt32?
+
+    /// Create or truncate the file at `path`.
+    public convenience init?(path: String, version: ProtocolVersion = .v20,
+                             bufferSize: Int = FitStreamEncoder.defaultBufferSize) {
+        let fd = Darwin.open(path, O_WRONLY | O_CREAT | O_TRUNC, 0o644)
+        guard fd >= 0 else {
+            return nil
+        }
+        self.init(fileDescriptor: fd, ownsDescriptor: true, version: version, bufferSize: bufferSize)
+    }
+
+    /// Write to a seekable descriptor, from its current offset, which must be its start.
+    public init(fileDescriptor: Int32, ownsDescriptor: Bool = false, version: ProtocolVersion = .v20,
+                bufferSize: Int = FitStreamEncoder.defaultBufferSize) {
+        fd = fileDescriptor
+        self.ownsDescriptor = ownsDescriptor
+        self.version = version
+        let header = FitStreamEncoder.header(version: version, dataSize: 0)
+        headerSize = header.count
+        self.bufferSize = max(bufferSize, 256)
+        buffer = UnsafeMutablePointer<UInt8>.allocate(capacity: self.bufferSize)
+        header.withUnsafeBytes { append($0, data: false) }
+    }
+
+    deinit {
+        if !closed {
+            close()
+        }
+        buffer.deallocate()
+    }
+
+    public func write(_ mesgDefinition: MesgDefinition) {
+        let fitDest = PositionableData()
+        mesgDefinition.write(fitDest: fitDest)
+        write(record: fitDest.data)
+        definitions[Int(mesgDefinition.localMesgNum & Fit.localMesgNumMask)] = mesgDefinition
+    }
+
+    public func write(_ mesg: Mesg) {
+        let timestamp = mesg.getFieldValue(fieldNum: Fit.fieldNumTimeStamp)
+            .flatMap { FitValue($0).integer }.map { UInt32(truncatingIfNeeded: $0) }
+        if compressTimestamps, let timestamp = timestamp, let last = lastTimestamp,
+           timestamp >= last, timestamp - last <= UInt32(Fit.compressedTimeMask),
+           localMesgAllocator != nil || mesg.localNum & Fit.localMesgNumMask <= 3 {
+            writeCompressed(mesg, timestamp: timestamp)
+        } else {
+            let local = self.local(for: mesg, locals: 0...15) { _ in true }
+            let outData = PositionableData()
+            mesg.write(outData: outData, mesgDef: definitions[local])
+            var record = outData.data
+            record[0] = UInt8(local)
+            write(record: record)
+        }
+        if let timestamp = timestamp {
+            lastTimestamp = timestamp
+        }
+        mesgCount += 1
+    }
+
+    private func writeCompressed(_ mesg: Mesg, timestamp: UInt32) {
+        let stripped = Mesg(mesg: mesg)
+        if let field = stripped.getField(fieldNum: Fit.fieldNumTimeStamp) {
+            stripped.removeField(field: field)
+        }
+        // A definition with the timestamp field would have the decoder read it from the data.
+        let local = self.local(for: stripped, locals: 0...3) { $0.getField(num: Fit.fieldNumTimeStamp) == nil }
+        let outData = PositionableData()
+        stripped.write(outData: outData, mesgDef: definitions[local])
+        var record = outData.data
+        record[0] = Fit.compressedHeaderMask | UInt8(local) << 5 | UInt8(timestamp & UInt32(Fit.compressedTimeMask))
+        write(record: record)
+        compressedCount += 1
+    }
+
+    /// The local message type of `mesg`, its definition written first if needed.
+    private func local(for mesg: Mesg, locals: ClosedRange<Int>, accept: (MesgDefinition) -> Bool) -> Int {
+        if let allocator = localMesgAllocator {
+            let allocation = allocator.allocate(mesg, locals: locals, accept: accept)
+            if allocation.isNew {
+                write(allocation.definition)
+            }
+            return Int(allocation.localMesgNum)
+        }
+        let local = Int(mesg.localNum & Fit.localMesgNumMask)
+        if let definition = definitions[local], definition.supports(mesg: mesg), accept(definition) {
+            return local
+        }
+        write(MesgDefinition(mesg: mesg))
+        return local
+    }
+
+    public func write(_ mesgs: [Mesg]) {
+        for mesg in mesgs {
+            write(mesg)
+        }
+    }
+
+    /// Append encoded records as they are.
+    public func write(record: [UInt8]) {
+        record.withUnsafeBytes { append($0, data: true) }
+    }
+
+    /// Flush the buffer, finish the header and append the file CRC. Returns false if a write failed.
+    @discardableResult
+    public func close() -> Bool {
+        guard !closed else {
+            return fail(.closed)
+        }
+        closed = true
+        defer {
+            if ownsDescriptor {
+                Darwin.close(fd)
+            }
+        }
+        flush()
+        let header = FitStreamEncoder.header(version: version, dataSize: dataSize)
+        let crc = GimKitCRC16.combine(GimKitCRC16.checksum(header), dataCRC.value, length2: dataSize)
+        let written = header.withUnsafeBytes { pwrite(fd, $0.baseAddress, $0.count, 0) }
+        if written != header.count {
+            fail(.write(errno))
+        }
+        var trailer = crc.littleEndian
+        withUnsafeBytes(of: &trailer) { append($0, data: false) }
+        flush()
+        return failure == nil
+    }
+
+    /// Write the buffered bytes to the file.
+    public func flush() {
+        var offset = 0
+        while offset < buffered {
+            let n = Darwin.write(fd, buffer + offset, buffered - offset)
+            if n < 0 {
+                if errno == EINTR {
+                    continue
+                }
+                fail(.write(errno))
+                break
+            }
+            offset += n
+        }
+        buffered = 0
+    }
+
+    private func append(_ bytes: UnsafeRawBufferPointer, data: Bool) {
+        guard !closed || !data else {
+            fail(.closed)
+            return
+        }
+        if data {
+            dataCRC.update(bytes)
+            dataSize += bytes.count
+        }
+        var offset = 0
+        while offset < bytes.count {
+            if buffered == bufferSize {
+                flush()
+            }
+            let count = min(bufferSize - buffered, bytes.count - offset)
+            (buffer + buffered).assign(from: bytes.baseAddress!.advanced(by: offset).assumingMemoryBound(to: UInt8.self),
+                                       count: count)
+            buffered += count
+            offset += count
+        }
+    }
+
+    private static func header(version: ProtocolVersion, dataSize: Int) -> [UInt8] {
+        let header = Header(version: version)
+        header.dataSize = UInt32(dataSize)
+        header.updateCRC()
+        let fitData = PositionableData()
+        header.write(fitData: fitData)
+        return fitData.data
+    }
+
+    @discardableResult
+    private func fail(_ failure: Failure) -> Bool {
+        if self.failure == nil {
+            self.failure = failure
+        }
+        return false
+    }
+}
@@ -0,0 +1,273 @@
+//
+//  FitSummaryAggregator.swift
+//  GimBle
+//
+//  Lap and session summaries, computed record by record while recording.
+//
+
+import Foundation
+import GimKit
+
+/// Count, sum and maximum of one value.
+public struct FitRunningStat {
+
+    public private(set) var count = 0
+    public private(set) var sum: Double = 0
+    public private(set) var max: Double = 0
+
+    @inline(__always)
+    public mutating func add(_ value: Double) {
+        count += 1
+        sum += value
+        if count == 1 || value > max {
+            max = value
+        }
+    }
+
+    public var average: Double? {
+        return count == 0 ? nil : sum / Double(count)
+    }
+}
+
+/// The running statistics of a lap or a session.
+public struct FitSummary {
+
+    public fileprivate(set) var startTime: UInt32?
+    public fileprivate(set) var timestamp: UInt32 = 0
+    /// Seconds covered by the records, pauses longer than `FitSummaryAggregator.maxGap` excluded
+    public fileprivate(set) var timerTime: Double = 0
+    public fileprivate(set) var power = FitRunningStat()
+    public fileprivate(set) var heartRate = FitRunningStat()
+    public fileprivate(set) var cadence = FitRunningStat()
+    public fileprivate(set) var speed = FitRunningStat()
+    /// J
+    public fileprivate(set) var work: Double = 0
+    /// m and kcal, from the accumulated values
+    public fileprivate(set) var distance: Double = 0
+    public fileprivate(set) var calories: Double = 0
+    fileprivate var fourthPowerSum: Double = 0
+    fileprivate var fourthPowerCount = 0
+
+    public var elapsedTime: Double {
+        return startTime.map { Double(timestamp &- $0) } ?? 0
+    }
+
+    /// The fourth root of the mean fourth power of the 30 s rolling average power, once 30 s of
+    /// power were recorded.
+    public var normalizedPower: Double? {
+        return fourthPowerCount == 0 ? nil : pow(fourthPowerSum / Double(fourthPowerCount), 0.25)
+    }
+}
+
+/// Computes the `LapMesg`s and the `SessionMesg` of an activity as its records are written.
+///
+/// Every record updates the current lap and the session in constant time: counts, sums and maxima,
+/// the work, and for the normalized power a 30 s ring of the power values with its running sum, the
+/// fourth power of whose average is summed. Records are expected at 1 Hz, one per second as
+/// `GimKitRecorder` writes them. Laps and session are ready when the last record is added, without
+/// decoding the file again.
+public final class FitSummaryAggregator {
+
+    public static let normalizedPowerWindow = 30
+
+    public var sport: Sport = .Generic
+    /// Records further apart, in s, are a pause: they count for 1 s of timer time and work.
+    public var maxGap: UInt32 = 5
+    public private(set) var lap = FitSummary()
+    public private(set) var session = FitSummary()
+    /// The laps ended so far
+    public private(set) var laps: [LapMesg] = []
+
+    private var window = [Double](repeating: 0, count: FitSummaryAggregator.normalizedPowerWindow)
+    private var windowSum: Double = 0
+    private var windowCount = 0
+    private var lastDistance: Double?
+    private var lastCalories: Double?
+
+    public init() {
+    }
+
+    /// Add a record, the values it doesn't have being nil.
+    public func add(timestamp: UInt32, power: Double? = nil, heartRate: Double? = nil, cadence: Double? = nil,
+                    speed: Double? = nil, distance: Double? = nil, calories: Double? = nil) {
+        let gap = session.startTime == nil ? 1 : timestamp &- session.timestamp
+        let seconds = gap <= maxGap ? Double(gap) : 1
+        var fourthPower: Double?
+        if let power = power {
+            let slot = windowCount % window.count
+            windowSum += power - window[slot]
+            window[slot] = power
+            windowCount += 1
+            if windowCount >= window.count {
+                fourthPower = pow(windowSum / Double(window.count), 4)
+            }
+        }
+        // Accumulated values: the first one seen is the baseline.
+        let distanceDelta = distance.map { $0 - (lastDistance ?? $0) }
+        let caloriesDelta = calories.map { $0 - (lastCalories ?? $0) }
+        lastDistance = distance ?? lastDistance
+        lastCalories = calories ?? lastCalories
+
+        lap.add(timestamp: timestamp, seconds: seconds, power: power, fourthPower: fourthPower, heartRate: heartRate,
+                cadence: cadence, speed: speed, distance: distanceDelta, calories: caloriesDelta)
+        session.add(timestamp: timestamp, seconds: seconds, power: power, fourthPower: fourthPower, heartRate: heartRate,
+                    cadence: cadence, speed: speed, distance: distanceDelta, calories: caloriesDelta)
+    }
+
+    /// Add the values of a telemetry sample.
+    public func add(timestamp: UInt32, sample: GKTelemetrySample) {
+        let present = sample.present
+        func value(_ field: GKTelemetryField, _ value: Float) -> Double? {
+            return present & field.rawValue != 0 ? Double(value) : nil
+        }
+        add(timestamp: timestamp, power: value(GK_TELEMETRY_POWER, sample.power),
+            heartRate: value(GK_TELEMETRY_HEART_RATE, Float(sample.heartRate)),
+            cadence: value(GK_TELEMETRY_CADENCE, sample.cadence), speed: value(GK_TELEMETRY_SPEED, sample.speed),
+            distance: value(GK_TELEMETRY_DISTANCE, sample.distance),
+            calories: value(GK_TELEMETRY_CALORIES, sample.calories))
+    }
+
+    /// Add the values of a record.
+    public func add(_ record: RecordMesg) {
+        guard let timestamp = record.getTimestamp()?.timeStamp else {
+            return
+        }
+        add(timestamp: timestamp, power: record.getPower().map { Double($0) },
+            heartRate: record.getHeartRate().map { Double($0) }, cadence: record.getCadence().map { Double($0) },
+            speed: record.getSpeed().map { Double($0) }, distance: record.getDistance().map { Double($0) },
+            calories: record.getCalories().map { Double($0) })
+    }
+
+    /// End the current lap, at `timestamp` or its last record, and start the next one.
+    @discardableResult
+    public func endLap(at timestamp: UInt32? = nil) -> LapMesg {
+        let lapMesg = LapMesg()
+        lapMesg.setMessageIndex(UInt16(laps.count))
+        lapMesg.setTimestamp(FitDateTime(timeStamp: timestamp ?? lap.timestamp))
+        lapMesg.setEvent(.Lap)
+        lapMesg.setEventType(.Stop)
+        lapMesg.setSport(sport)
+        lapMesg.setStartTime(FitDateTime(timeStamp: lap.startTime ?? timestamp ?? lap.timestamp))
+        lapMesg.setTotalElapsedTime(Float32(lap.elapsedTime))
+        lapMesg.setTotalTimerTime(Float32(lap.timerTime))
+        lapMesg.setTotalDistance(Float32(lap.distance))
+        lapMesg.setTotalCalories(FitSummaryAggregator.clamp(lap.calories))
+        lapMesg.setTotalWork(FitSummaryAggregator.clamp(lap.work))
+        if let power = lap.power.average {
+            lapMesg.setAvgPower(FitSummaryAggregator.clamp(power))
+            lapMesg.setMaxPower(FitSummaryAggregator.clamp(lap.power.max))
+        }
+        if let normalizedPower = lap.normalizedPower {
+            lapMesg.setNormalizedPower(FitSummaryAggregator.clamp(normalizedPower))
+        }
+        if let heartRate = lap.heartRate.average {
+            lapMesg.setAvgHeartRate(FitSummaryAggregator.clamp(heartRate))
+            lapMesg.setMaxHeartRate(FitSummaryAggregator.clamp(lap.heartRate.max))
+        }
+        if let cadence = lap.cadence.average {
+            lapMesg.setAvgCadence(FitSummaryAggregator.clamp(cadence))
+            lapMesg.setMaxCadence(FitSummaryAggregator.clamp(lap.cadence.max))
+        }
+        if let speed = lap.speed.average {
+            lapMesg.setAvgSpeed(Float32(speed))
+            lapMesg.setMaxSpeed(Float32(lap.speed.max))
+        }
+        laps.append(lapMesg)
+        lap = FitSummary()
+        return lapMesg
+    }
+
+    /// The session, of the laps ended so far: end the last one with `endLap(at:)` first.
+    public func sessionMesg() -> SessionMesg {
+        let mesg = SessionMesg()
+        mesg.setMessageIndex(0)
+        mesg.setTimestamp(FitDateTime(timeStamp: session.timestamp))
+        mesg.setEvent(.Session)
+        mesg.setEventType(.Stop)
+        mesg.setSport(sport)
+        mesg.setStartTime(FitDateTime(timeStamp: session.startTime ?? session.timestamp))
+        mesg.setTotalElapsedTime(Float32(session.elapsedTime))
+        mesg.setTotalTimerTime(Float32(session.timerTime))
+        mesg.setTotalDistance(Float32(session.distance))
+        mesg.setTotalCalories(FitSummaryAggregator.clamp(session.calories))
+        mesg.setTotalWork(FitSummaryAggregator.clamp(session.work))
+        mesg.setFirstLapIndex(0)
+        mesg.setNumLaps(UInt16(laps.count))
+        if let power = session.power.average {
+            mesg.setAvgPower(FitSummaryAggregator.clamp(power))
+            mesg.setMaxPower(FitSummaryAggregator.clamp(session.power.max))
+        }
+        if let normalizedPower = session.normalizedPower {
+            mesg.setNormalizedPower(FitSummaryAggregator.clamp(normalizedPower))
+        }
+        if let heartRate = session.heartRate.average {
+            mesg.setAvgHeartRate(FitSummaryAggregator.clamp(heartRate))
+            mesg.setMaxHeartRate(FitSummaryAggregator.clamp(session.heartRate.max))
+        }
+        if let cadence = session.cadence.average {
+            mesg.setAvgCadence(FitSummaryAggregator.clamp(cadence))
+            mesg.setMaxCadence(FitSummaryAggregator.clamp(session.cadence.max))
+        }
+        if let speed = session.speed.average {
+            mesg.setAvgSpeed(Float32(speed))
+            mesg.setMaxSpeed(Float32(session.speed.max))
+        }
+        return mesg
+    }
+
+    /// The activity of the session.
+    public func activityMesg() -> ActivityMesg {
+        let mesg = ActivityMesg()
+        mesg.setTimestamp(FitDateTime(timeStamp: session.timestamp))
+        mesg.setTotalTimerTime(FitSummaryAggregator.clamp(session.timerTime))
+        mesg.setNumSessions(1)
+        mesg.setType(.Manual)
+        mesg.setEvent(.Activity)
+        mesg.setEventType(.Stop)
+        return mesg
+    }
+
+    /// `value` rounded into `T`, short of its invalid value. Shared with `TelemetryRecordWriter`.
+    static func clamp<T: FixedWidthInteger, V: BinaryFloatingPoint>(_ value: V) -> T {
+        let lower = V(T.min), upper = V(T.max - 1)
+        return value.isNaN ? T.max : T(Swift.min(Swift.max(value.rounded(), lower), upper))
+    }
+}
+
+extension FitSummary {
+
+    @inline(__always)
+    fileprivate mutating func add(timestamp: UInt32, seconds: Double, power: Double?, fourthPower: Double?,
+                                  heartRate: Double?, cadence: Double?, speed: Double?, distance: Double?,
+                                  calories: Double?) {
+        // A record covers the seconds since the previous one.
+        if startTime == nil {
+            startTime = timestamp &- UInt32(seconds)
+        }
+        self.timestamp = timestamp
+        timerTime += seconds
+        if let power = power {
+            self.power.add(power)
+            work += power * seconds
+        }
+        if let fourthPower = fourthPower {
+            fourthPowerSum += fourthPower
+            fourthPowerCount += 1
+        }
+        if let heartRate = heartRate {
+            self.heartRate.add(heartRate)
+        }
+        if let cadence = cadence {
+            self.cadence.add(cadence)
+        }
+        if let speed = speed {
+            self.speed.add(speed)
+        }
+        if let distance = distance {
+            self.distance += distance
+        }
+        if let calories = calories {
+            self.calories += calories
+        }
+    }
+}
@@ -0,0 +1,282 @@
+//
+//  FitTypedMesg.swift
+//  GimBle
+//
+//  Field values stored unboxed, in a tagged union, with typed getters.
+//
+
+import Foundation
+import GimKit
+
+/// Up to 15 bytes stored inline, for the short strings and byte arrays of FIT messages.
+public struct FitInlineBytes: Equatable {
+
+    public static let capacity = 15
+
+    private var storage: (UInt64, UInt64) = (0, 0)
+    public private(set) var count: UInt8 = 0
+
+    public init?(_ bytes: UnsafeRawBufferPointer) {
+        guard bytes.count <= FitInlineBytes.capacity else {
+            return nil
+        }
+        count = UInt8(bytes.count)
+        withUnsafeMutableBytes(of: &storage) { $0.copyMemory(from: bytes) }
+    }
+
+    public func withUnsafeBytes<R>(_ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R {
+        var storage = self.storage
+        return try Swift.withUnsafeBytes(of: &storage) { try body(UnsafeRawBufferPointer(rebasing: $0[0..<Int(count)])) }
+    }
+
+    public var array: [UInt8] {
+        return withUnsafeBytes { [UInt8]($0) }
+    }
+
+    public static func == (lhs: FitInlineBytes, rhs: FitInlineBytes) -> Bool {
+        return lhs.count == rhs.count && lhs.storage == rhs.storage
+    }
+}
+
+/// One raw field element, unboxed.
+public enum FitValue: Equatable {
+    /// Every integer base type and enum
+    case integer(Int64)
+    case float(Double)
+    case inlineBytes(FitInlineBytes)
+    case bytes([UInt8])
+    /// The invalid value of the base type
+    case invalid
+
+    public init(bytes: UnsafeRawBufferPointer) {
+        if let inline = FitInlineBytes(bytes) {
+            self = .inlineBytes(inline)
+        } else {
+            self = .bytes([UInt8](bytes))
+        }
+    }
+
+    /// A value of `Field.values`, as the SDK boxes it.
+    public init(_ value: Any) {
+        switch value {
+        case let v as UInt8: self = .integer(Int64(v))
+        case let v as Int8: self = .integer(Int64(v))
+        case let v as UInt16: self = .integer(Int64(v))
+        case let v as Int16: self = .integer(Int64(v))
+        case let v as UInt32: self = .integer(Int64(v))
+        case let v as Int32: self = .integer(Int64(v))
+        case let v as UInt64: self = .integer(Int64(bitPattern: v))
+        case let v as Int64: self = .integer(v)
+        case let v as Float32: self = .float(Double(v))
+        case let v as Float64: self = .float(v)
+        case let v as [UInt8]: self = v.withUnsafeBytes { FitValue(bytes: $0) }
+        case let v as String: self = Array(v.utf8).withUnsafeBytes { FitValue(bytes: $0) }
+        default: self = .invalid
+        }
+    }
+
+    /// A value of `Field.values`, `.invalid` if it is the invalid value of `baseType`.
+    public init(_ value: Any, baseType: UInt8) {
+        self.init(value)
+        if case .integer(let integer) = self, FitValue.isInvalid(integer, baseType: baseType) {
+            self = .invalid
+        } else if case .float(let float) = self, float.isNaN {
+            self = .invalid
+        }
+    }
+
+    static func isInvalid(_ value: Int64, baseType: UInt8) -> Bool {
+        let info = FitBaseTypeInfo.of(baseType)
+        return info.isInteger && value == info.invalid
+    }
+
+    @inline(__always)
+    public var integer: Int64? {
+        switch self {
+        case .integer(let value): return value
+        case .float(let value): return Int64(exactly: value.rounded(.towardZero))
+        default: return nil
+        }
+    }
+
+    @inline(__always)
+    public var double: Double? {
+        switch self {
+        case .integer(let value): return Double(value)
+        case .float(let value): return value
+        default: return nil
+        }
+    }
+
+    public var byteArray: [UInt8]? {
+        switch self {
+        case .inlineBytes(let bytes): return bytes.array
+        case .bytes(let bytes): return bytes
+        default: return nil
+        }
+    }
+}
+
+/// A data message with its values in one flat, unboxed array.
+///
+/// `Mesg` keeps every value as `Any` in a `Field` object, so each typed getter unwraps a box and
+/// casts it. A `TypedMesg` keeps the values of all its fields as `FitValue`s in one array, with one
+/// small header per field: reading a field is an index lookup and a switch on the tag.
+public struct TypedMesg {
+
+    public struct FieldSlot {
+        public let num: UInt8
+        public let baseType: UInt8
+        public let scale: Double
+        public let offset: Double
+        /// Range of the field elements in `values`
+        public let start: Int32
+        public let count: Int32
+    }
+
+    public let num: UInt16
+    public private(set) var fields: [FieldSlot] = []
+    public private(set) var values: [FitValue] = []
+
+    /// Decode every field of a lazy message.
+    public init(_ mesg: LazyMesg) {
+        num = mesg.num
+        let layout = mesg.layout
+        fields.reserveCapacity(layout.fields.count + (mesg.compressedTimestamp != nil ? 1 : 0))
+        values.reserveCapacity(layout.fields.count)
+        if let timestamp = mesg.compressedTimestamp {
+            append(num: Fit.fieldNumTimeStamp, baseType: FitBaseType.Uint32, scale: 1, offset: 0, [.integer(Int64(timestamp))])
+        }
+        let base = mesg.offset + 1
+        for field in layout.fields {
+            let start = values.count
+            if field.type == FitBaseType.String || field.type == FitBaseType.Byte && field.size > 1 {
+                values.append(FitValue(bytes: mesg.buffer.slice(at: base + field.offset, count: Int(field.size))))
+            } else {
+                let elementSize = FitBuffer.elementSize(baseType: field.type)
+                var at = base + field.offset
+                for _ in 0..<Int(field.size) / elementSize {
+                    values.append(TypedMesg.value(mesg.buffer, at: at, baseType: field.type, bigEndian: layout.isBigEndian))
+                    at += elementSize
+                }
+            }
+            fields.append(FieldSlot(num: field.num, baseType: field.type, scale: field.scale, offset: field.valueOffset,
+                                    start: Int32(start), count: Int32(values.count - start)))
+        }
+    }
+
+    /// Convert the boxed values of a `Mesg`.
+    public init(_ mesg: Mesg) {
+        num = mesg.num
+        for field in mesg.fields {
+            append(num: field.num, baseType: field.type, scale: field.scale, offset: field.offset,
+                   field.values.map { FitValue($0, baseType: field.type) })
+        }
+    }
+
+    private mutating func append(num: UInt8, baseType: UInt8, scale: Double, offset: Double, _ elements: [FitValue]) {
+        fields.append(FieldSlot(num: num, baseType: baseType, scale: scale, offset: offset,
+                                start: Int32(values.count), count: Int32(elements.count)))
+        values.append(contentsOf: elements)
+    }
+
+    @inline(__always)
+    public func slot(fieldNum: UInt8) -> FieldSlot? {
+        for slot in fields where slot.num == fieldNum {
+            return slot
+        }
+        return nil
+    }
+
+    public func hasField(fieldNum: UInt8) -> Bool {
+        return slot(fieldNum: fieldNum) != nil
+    }
+
+    @inline(__always)
+    public func value(fieldNum: UInt8, index: Int = 0) -> FitValue? {
+        guard let slot = slot(fieldNum: fieldNum), index < Int(slot.count) else {
+            return nil
+        }
+        return values[Int(slot.start) + index]
+    }
+
+    /// The raw integer value, nil if missing or invalid.
+    @inline(__always)
+    public func int64(fieldNum: UInt8, index: Int = 0) -> Int64? {
+        return value(fieldNum: fieldNum, index: index)?.integer
+    }
+
+    /// The value with the profile scale and offset applied, nil if missing or invalid.
+    @inline(__always)
+    public func double(fieldNum: UInt8, index: Int = 0) -> Double? {
+        guard let slot = slot(fieldNum: fieldNum), index < Int(slot.count),
+              let raw = values[Int(slot.start) + index].double else {
+            return nil
+        }
+        return raw / slot.scale - slot.offset
+    }
+
+    public func bytes(fieldNum: UInt8) -> [UInt8]? {
+        return value(fieldNum: fieldNum)?.byteArray
+    }
+
+    public func string(fieldNum: UInt8) -> String? {
+        guard let bytes = bytes(fieldNum: fieldNum) else {
+            return nil
+        }
+        return String(decoding: bytes.prefix { $0 != 0 }, as: UTF8.self)
+    }
+
+    public var timestamp: UInt32? {
+        return int64(fieldNum: Fit.fieldNumTimeStamp).map { UInt32(truncatingIfNeeded: $0) }
+    }
+
+    @inline(__always)
+    static func value(_ buffer: FitBuffer, at offset: Int, baseType: UInt8, bigEndian: Bool) -> FitValue {
+        if FitBaseTypeInfo.of(baseType).kind == .float {
+            return LazyMesg.float(buffer, at: offset, baseType: baseType, bigEndian: bigEndian).map { .float($0) } ?? .invalid
+        }
+        return LazyMesg.integer(buffer, at: offset, baseType: baseType, bigEndian: bigEndian).map { .integer($0) } ?? .invalid
+    }
+}
+
+/// The fields of the record messages, read from a `TypedMesg` or a `FitRecordView` by the same getters.
+public protocol FitRecordFields {
+    /// The raw integer value, nil if missing or invalid.
+    func int64(fieldNum: UInt8, index: Int) -> Int64?
+    /// The value with the profile scale and offset applied, nil if missing or invalid.
+    func double(fieldNum: UInt8, index: Int) -> Double?
+}
+
+/// Typed getters of the usual record fields.
+extension FitRecordFields {
+
+    public var heartRate: UInt8? {
+        return int64(fieldNum: RecordMesg.FieldDefNum.HeartRate.rawValue, index: 0).map { UInt8(truncatingIfNeeded: $0) }
+    }
+
+    public var cadence: UInt8? {
+        return int64(fieldNum: RecordMesg.FieldDefNum.Cadence.rawValue, index: 0).map { UInt8(truncatingIfNeeded: $0) }
+    }
+
+    public var power: UInt16? {
+        return int64(fieldNum: RecordMesg.FieldDefNum.Power.rawValue, index: 0).map { UInt16(truncatingIfNeeded: $0) }
+    }
+
+    /// m/s
+    public var speed: Double? {
+        return double(fieldNum: RecordMesg.FieldDefNum.Speed.rawValue, index: 0)
+    }
+
+    /// m
+    public var distance: Double? {
+        return double(fieldNum: RecordMesg.FieldDefNum.Distance.rawValue, index: 0)
+    }
+
+    /// m
+    public var altitude: Double? {
+        return double(fieldNum: RecordMesg.FieldDefNum.Altitude.rawValue, index: 0)
+    }
+}
+
+extension TypedMesg: FitRecordFields {}
@@ -0,0 +1,44 @@
+//
+//  GimKitCRC16.swift
+//  GimBle
+//
+//  Swift access to the GKCRC16 kernel, the CRC-16 of FIT files.
+//
+
+import Foundation
+
+/// A running CRC-16, identical to chaining `CRC.get16(crc:data:)` over the same bytes, eight bytes
+/// per step instead of one.
+public struct GimKitCRC16 {
+
+    public private(set) var value: UInt16
+
+    public init(seed: UInt16 = 0) {
+        value = seed
+    }
+
+    public mutating func update(_ bytes: UnsafeRawBufferPointer) {
+        value = gk_crc16_update(value, bytes.baseAddress, bytes.count)
+    }
+
+    public mutating func update(_ bytes: [UInt8]) {
+        bytes.withUnsafeBytes { update($0) }
+    }
+
+    public mutating func update(_ data: Data) {
+        data.withUnsafeBytes { update($0) }
+    }
+
+    public static func checksum(_ bytes: UnsafeRawBufferPointer) -> UInt16 {
+        return gk_crc16(bytes.baseAddress, bytes.count)
+    }
+
+    public static func checksum(_ bytes: [UInt8]) -> UInt16 {
+        return bytes.withUnsafeBytes { checksum($0) }
+    }
+
+    /// The CRC of two blocks end to end, from the CRC of each and the length of the second.
+    public static func combine(_ crc1: UInt16, _ crc2: UInt16, length2: Int) -> UInt16 {
+        return gk_crc16_combine(crc1, crc2, length2)
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  GimKitMethodLatency.swift
+//  GimBle
+//
+//  Swift access to the method round-trip histograms recorded by GKLatency.
+//
+
+import Foundation
+
+public class GimKitMethodLatency {
+
+    public struct Summary {
+        public let opid: UInt8
+        public let name: String
+        public let count: UInt64
+        /// Latencies, in microseconds
+        public let min: UInt64
+        public let max: UInt64
+        public let mean: Double
+        public let p50: UInt64
+        public let p90: UInt64
+        public let p99: UInt64
+        /// Invocations replaced by a newer one of the same method before their reply
+        public let overlapped: UInt64
+    }
+
+    /// Collection is lock-free and enabled by default.
+    public static var isEnabled: Bool {
+        get { return gk_latency_is_enabled() }
+        set { gk_latency_set_enabled(newValue) }
+    }
+
+    @discardableResult
+    public static func markInvoke(opid: UInt8) -> Bool {
+        return gk_latency_mark_invoke(opid)
+    }
+
+    @discardableResult
+    public static func markReply(opid: UInt8) -> Bool {
+        return gk_latency_mark_reply(opid)
+    }
+
+    /// Value at `quantile` (0...1) of the method histogram, in microseconds.
+    public static func quantile(opid: UInt8, _ quantile: Double) -> UInt64 {
+        return gk_latency_quantile(opid, quantile)
+    }
+
+    public static func summary(opid: UInt8) -> Summary? {
+        var s = GKLatencySummary()
+        guard gk_latency_get_summary(opid, &s) else {
+            return nil
+        }
+        return Summary(opid: s.opid, name: s.name.map { String(cString: $0) } ?? "",
+                       count: s.count, min: s.min, max: s.max, mean: s.mean,
+                       p50: s.p50, p90: s.p90, p99: s.p99, overlapped: s.overlapped)
+    }
+
+    /// Summaries of every host invoked method that has at least one sample.
+    public static func summaries() -> [Summary] {
+        return (0..<gk_latency_method_count())
+            .compactMap { summary(opid: gk_latency_method_opid($0)) }
+            .filter { $0.count > 0 }
+    }
+
+    public static func reset() {
+        gk_latency_reset_all()
+    }
+}
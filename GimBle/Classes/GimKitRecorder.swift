@@ -0,0 +1,481 @@
+//
+//  GimKitRecorder.swift
+//  GimBle
+//
+//  Record the telemetry of a device to a FIT file, encoded on a background thread.
+//
+
+import Foundation
+import GimKit
+
+/// Records the telemetry of a `GimKitDevice` as an activity FIT file.
+///
+/// The observer callbacks only convert their arguments to a `GKTelemetrySample` and push it to a
+/// lock-free queue, see GKTelemetry.h: no `Mesg` is built and no lock is taken on the BLE or UI
+/// thread. A background thread wakes up when `batchSize` samples are queued, or every
+/// `flushInterval`, pops them in batches and encodes them with a `FitStreamEncoder`.
+///
+/// Samples are folded into one `RecordMesg` per second, holding the latest value of every field.
+/// Values the FIT profile has no record field for (torque, tension, position, force, drawstring
+/// distance, motor temperature) are written as developer fields. The laps ended by `markLap()` and
+/// the session are summarized as the records are written, see `FitSummaryAggregator`, and are
+/// written as soon as the recorder stops.
+///
+/// The FIT file is only valid once the recorder is stopped. Until then the samples are also
+/// appended to a journal next to it, see GKJournal.h, committed to disk by the background thread
+/// every `flushInterval` or every `journalGroupSamples` samples. If the app is killed, call
+/// `recoverJournals(in:)` on the next launch, before recording again, to rebuild the FIT files of
+/// the journals left behind; at most the last `flushInterval` of samples is lost.
+///
+/// `GimKitRowermData` and `GimKitXbikeData` don't expose their values to Swift: to record a rower or
+/// an X-bike, set `gk_telemetry_queue_push_rowerm` or `gk_telemetry_queue_push_xbike` as the notify
+/// callback of the method table with `telemetryQueue` as its context, and the payloads go from the
+/// method decoder straight to the queue. `stop()` closes the queue, the pushes after it are ignored,
+/// but the queue is destroyed with the recorder: unset those callbacks before releasing it.
+///
+/// Samples can be pushed from any number of threads at once: the observer callbacks, the native
+/// notify callbacks and `push(_:)` may run on different ones.
+public final class GimKitRecorder: GimKitDeviceObserver {
+
+    public static let defaultBatchSize = 64
+    public static let defaultCapacity = 4096
+    public static let defaultJournalGroupSamples = 1024
+    /// Appended to the path of the FIT file to name its journal
+    public static let journalExtension = "gkjournal"
+
+    public let path: String
+    /// nil when recording without a journal
+    public let journalPath: String?
+    public let batchSize: Int
+    public let flushInterval: TimeInterval
+    /// The queue the samples go through, the context of the native push entry points
+    public let telemetryQueue: OpaquePointer
+    public private(set) var device: GimKitDevice?
+
+    /// Samples dropped because the encoder thread fell behind
+    public var droppedCount: UInt64 {
+        return gk_telemetry_queue_dropped(telemetryQueue)
+    }
+
+    /// Records written so far, read it once the recorder is stopped.
+    public var recordCount: Int {
+        return writer.recordCount
+    }
+
+    public var failure: FitStreamEncoder.Failure? {
+        return writer.encoder.failure
+    }
+
+    /// The laps and session of the recording, complete once the recorder is stopped.
+    public var summary: FitSummaryAggregator {
+        return writer.summary
+    }
+
+    private let writer: TelemetryRecordWriter
+    private let journal: OpaquePointer?
+    private let wakeup = DispatchSemaphore(value: 0)
+    private let lock = NSLock()
+    private var stopping = false
+    private var completion: ((Bool) -> Void)?
+    private var lapMarks: [UInt64] = []
+
+    /// Create the file at `path` and start the encoder thread. Returns nil if the file, or its
+    /// journal, can't be created.
+    public init?(path: String, batchSize: Int = GimKitRecorder.defaultBatchSize, flushInterval: TimeInterval = 1,
+                 capacity: Int = GimKitRecorder.defaultCapacity, journal: Bool = true,
+                 journalGroupSamples: Int = GimKitRecorder.defaultJournalGroupSamples) {
+        let startDate = Date()
+        let startNs = gk_trace_now_ns()
+        let journalPath = journal ? path + "." + GimKitRecorder.journalExtension : nil
+        var journalWriter: OpaquePointer?
+        if let journalPath = journalPath {
+            let startTime = UInt64(startDate.timeIntervalSince1970 * 1_000_000)
+            journalWriter = gk_journal_open_writer(journalPath, startNs, startTime, max(journalGroupSamples, 1))
+            guard journalWriter != nil else {
+                return nil
+            }
+        }
+        guard let writer = TelemetryRecordWriter(path: path, startNs: startNs, startDate: startDate),
+              let queue = gk_telemetry_queue_create(max(capacity, batchSize)) else {
+            gk_journal_close_writer(journalWriter, true)
+            return nil
+        }
+        self.path = path
+        self.journalPath = journalPath
+        self.batchSize = max(batchSize, 1)
+        self.flushInterval = flushInterval
+        self.writer = writer
+        self.journal = journalWriter
+        telemetryQueue = queue
+
+        // The thread keeps the recorder until it is stopped.
+        let thread = Thread { self.run() }
+        thread.name = "GimKitRecorder"
+        thread.qualityOfService = .utility
+        thread.start()
+    }
+
+    deinit {
+        gk_telemetry_queue_destroy(telemetryQueue)
+    }
+
+    /// Record the telemetry of `device`, until `detach()`.
+    public func attach(to device: GimKitDevice) {
+        detach()
+        self.device = device
+        GimKitManager.shared.register(device: device, observer: self)
+    }
+
+    public func detach() {
+        if let device = device {
+            GimKitManager.shared.unregister(device: device, observer: self)
+            self.device = nil
+        }
+    }
+
+    /// Detach, encode the queued samples and finish the file. The completion runs on the encoder
+    /// thread, with false if a write failed; the journal is then kept for recovery.
+    public func stop(completion: ((Bool) -> Void)? = nil) {
+        detach()
+        gk_telemetry_queue_close(telemetryQueue)
+        lock.lock()
+        let wasStopping = stopping
+        stopping = true
+        self.completion = completion
+        lock.unlock()
+        if !wasStopping {
+            wakeup.signal()
+        }
+    }
+
+    /// End the current lap now.
+    public func markLap() {
+        let now = gk_trace_now_ns()
+        lock.lock()
+        lapMarks.append(now)
+        lock.unlock()
+    }
+
+    /// Push a sample, as the observer callbacks do.
+    @inline(__always)
+    public func push(_ sample: GKTelemetrySample) {
+        var sample = sample
+        if gk_telemetry_queue_push(telemetryQueue, &sample) == batchSize {
+            wakeup.signal()
+        }
+    }
+
+    // MARK: - Encoder thread
+
+    private func run() {
+        let batch = UnsafeMutablePointer<GKTelemetrySample>.allocate(capacity: batchSize)
+        defer { batch.deallocate() }
+        var nextCommit = DispatchTime.now() + flushInterval
+        while true {
+            _ = wakeup.wait(timeout: .now() + flushInterval)
+            lock.lock()
+            let stop = stopping
+            let marks = lapMarks
+            lapMarks.removeAll()
+            lock.unlock()
+
+            var count = 0
+            repeat {
+                count = gk_telemetry_queue_pop(telemetryQueue, batch, batchSize)
+                if let journal = journal {
+                    gk_journal_append(journal, batch, count)
+                }
+                for i in 0..<count {
+                    writer.fold(batch[i])
+                }
+            } while count == batchSize
+            for mark in marks {
+                var sample = GKTelemetrySample()
+                sample.timeNs = mark
+                sample.present = GK_TELEMETRY_LAP.rawValue
+                if let journal = journal {
+                    gk_journal_append(journal, &sample, 1)
+                }
+                writer.fold(sample)
+            }
+            writer.encoder.flush()
+            if let journal = journal, DispatchTime.now() >= nextCommit {
+                gk_journal_commit(journal)
+                nextCommit = DispatchTime.now() + flushInterval
+            }
+
+            if stop {
+                return finish()
+            }
+        }
+    }
+
+    private func finish() {
+        let succeeded = writer.finish()
+        if let journal = journal {
+            gk_journal_close_writer(journal, succeeded)
+        }
+        lock.lock()
+        let completion = self.completion
+        self.completion = nil
+        lock.unlock()
+        completion?(succeeded)
+    }
+
+    // MARK: - Recovery
+
+    /// Rebuild the FIT file of a journal left by a recorder that wasn't stopped, at `fitPath`, by
+    /// default the path the recorder was writing. The journal is removed once the file is written.
+    @discardableResult
+    public static func recover(journalPath: String, to fitPath: String? = nil) -> Bool {
+        let suffix = "." + journalExtension
+        guard let fitPath = fitPath ?? (journalPath.hasSuffix(suffix) ? String(journalPath.dropLast(suffix.count)) : nil) else {
+            return false
+        }
+        var info = GKJournalInfo()
+        guard gk_journal_read(journalPath, &info, nil, nil) == GK_JOURNAL_OK else {
+            return false
+        }
+        let startDate = Date(timeIntervalSince1970: TimeInterval(info.startTime) / 1_000_000)
+        guard let writer = TelemetryRecordWriter(path: fitPath, startNs: info.startNs, startDate: startDate) else {
+            return false
+        }
+        let context = Unmanaged.passUnretained(writer).toOpaque()
+        gk_journal_read(journalPath, nil, { context, samples, count in
+            let writer = Unmanaged<TelemetryRecordWriter>.fromOpaque(context!).takeUnretainedValue()
+            for i in 0..<count {
+                writer.fold(samples![i])
+            }
+        }, context)
+        guard writer.finish() else {
+            return false
+        }
+        unlink(journalPath)
+        return true
+    }
+
+    /// Recover every journal of `directory`, see `recover(journalPath:to:)`. Returns the paths of
+    /// the FIT files rebuilt.
+    public static func recoverJournals(in directory: String) -> [String] {
+        let suffix = "." + journalExtension
+        let names = (try? FileManager.default.contentsOfDirectory(atPath: directory)) ?? []
+        return names.filter { $0.hasSuffix(suffix) }.sorted().compactMap { name in
+            let journalPath = (directory as NSString).appendingPathComponent(name)
+            return recover(journalPath: journalPath) ? String(journalPath.dropLast(suffix.count)) : nil
+        }
+    }
+
+    // MARK: - GimKitDeviceObserver
+
+    public func onInstantDataReceived(device: GimKitDevice, cadence: Int, power: Double, torque: Double) {
+        var sample = GKTelemetrySample()
+        sample.present = GK_TELEMETRY_CADENCE.rawValue | GK_TELEMETRY_POWER.rawValue | GK_TELEMETRY_TORQUE.rawValue
+        sample.cadence = Float(cadence)
+        sample.power = Float(power)
+        sample.torque = Float(torque)
+        push(sample)
+    }
+
+    public func onStrengthDataReceived(device: GimKitDevice, flag: Int, tension: Int, speed: Double, power: Double,
+                                       position: Double, mcStatus: Int, mcTemperature: Double) {
+        var sample = GKTelemetrySample()
+        gk_telemetry_from_strength_values(UInt32(truncatingIfNeeded: flag), Float(tension), Float(speed), Float(power),
+                                          Float(position), Float(mcTemperature), &sample)
+        push(sample)
+    }
+
+    public func onHeartrateMeasured(heartrate: Int) {
+        guard heartrate > 0 else {
+            return
+        }
+        var sample = GKTelemetrySample()
+        sample.present = GK_TELEMETRY_HEART_RATE.rawValue
+        sample.heartRate = UInt8(min(heartrate, 254))
+        push(sample)
+    }
+
+    public func onRowermDataReceived(device: GimKitDevice, grd: GimKitRowermData) {
+        // Native only, see gk_telemetry_queue_push_rowerm.
+    }
+
+    public func onXbikeDataReceived(device: GimKitDevice, gxd: GimKitXbikeData) {
+        // Native only, see gk_telemetry_queue_push_xbike.
+    }
+
+    public func onConnectionChanged(device: GimKitDevice, status: Int, errorCause: Int) {
+    }
+
+    public func onKeyEvent(device: GimKitDevice, code: Int, state: Int) {
+    }
+
+    public func onKnobRotation(device: GimKitDevice, rotation: Int) {
+    }
+
+    public func onDeviceID(device: GimKitDevice, deviceID: Int) {
+    }
+
+    public func onBrakeEvent(device: GimKitDevice) {
+    }
+
+    public func onDeviceModel(device: GimKitDevice, deviceModel: String) {
+    }
+
+    public func onDeviceInfo(device: GimKitDevice, deviceInfo: GimKitDeviceInfo?) {
+    }
+
+    public func onDevicePid(device: GimKitDevice, devicePid: String?) {
+    }
+}
+
+/// Folds telemetry samples into one `RecordMesg` per second and encodes them, for a recorder or
+/// the recovery of its journal. Laps are written as they end, the session and activity when the
+/// file is finished.
+final class TelemetryRecordWriter {
+
+    let encoder: FitStreamEncoder
+    let summary = FitSummaryAggregator()
+    private(set) var recordCount = 0
+
+    private let startNs: UInt64
+    private let startTimestamp: UInt32
+    private var developerFields: [DeveloperField] = []
+    // The values held from sample to sample, and the second they are written at.
+    private var held = GKTelemetrySample()
+    private var heldSecond: UInt32?
+    // The seconds of the lap marks not passed yet, in order.
+    private var lapMarks: [UInt32] = []
+
+    private static let developerFieldNames: [(field: GKTelemetryField, name: String, units: String)] = [
+        (GK_TELEMETRY_TORQUE, "torque", "N-m"),
+        (GK_TELEMETRY_TENSION, "tension", "N"),
+        (GK_TELEMETRY_POSITION, "position", "m"),
+        (GK_TELEMETRY_FORCE, "force", "kg"),
+        (GK_TELEMETRY_DRAWSTRING_DISTANCE, "drawstring_distance", "m"),
+        (GK_TELEMETRY_MOTOR_TEMPERATURE, "motor_temperature", "C"),
+    ]
+
+    /// Create the file at `path`, for samples timed from `startNs`, the `gk_trace_now_ns()` at
+    /// `startDate`.
+    init?(path: String, startNs: UInt64, startDate: Date) {
+        guard let encoder = FitStreamEncoder(path: path) else {
+            return nil
+        }
+        self.encoder = encoder
+        self.startNs = startNs
+        startTimestamp = FitDateTime(date: startDate).timeStamp
+        encoder.compressTimestamps = true
+        encoder.localMesgAllocator = FitLocalMesgAllocator()
+        writeHeaderMesgs(startDate: startDate)
+    }
+
+    func fold(_ sample: GKTelemetrySample) {
+        let elapsed = sample.timeNs > startNs ? (sample.timeNs - startNs) / 1_000_000_000 : 0
+        let second = startTimestamp &+ UInt32(truncatingIfNeeded: elapsed)
+        if sample.present & GK_TELEMETRY_LAP.rawValue != 0 {
+            let index = lapMarks.firstIndex { $0 > second } ?? lapMarks.count
+            lapMarks.insert(second, at: index)
+            return
+        }
+        // A lap ends with the records of its second, once a later record comes.
+        while let mark = lapMarks.first, mark < second {
+            lapMarks.removeFirst()
+            if let heldSecond = heldSecond, heldSecond <= mark {
+                writeRecord(at: heldSecond)
+                self.heldSecond = nil
+            }
+            encoder.write(summary.endLap(at: mark))
+        }
+        if let heldSecond = heldSecond, heldSecond != second {
+            writeRecord(at: heldSecond)
+        }
+        heldSecond = second
+
+        let present = sample.present
+        held.present |= present
+        if present & GK_TELEMETRY_CADENCE.rawValue != 0 { held.cadence = sample.cadence }
+        if present & GK_TELEMETRY_POWER.rawValue != 0 { held.power = sample.power }
+        if present & GK_TELEMETRY_SPEED.rawValue != 0 { held.speed = sample.speed }
+        if present & GK_TELEMETRY_DISTANCE.rawValue != 0 { held.distance = sample.distance }
+        if present & GK_TELEMETRY_CALORIES.rawValue != 0 { held.calories = sample.calories }
+        if present & GK_TELEMETRY_HEART_RATE.rawValue != 0 { held.heartRate = sample.heartRate }
+        if present & GK_TELEMETRY_TEMPERATURE.rawValue != 0 { held.temperature = sample.temperature }
+        if present & GK_TELEMETRY_TORQUE.rawValue != 0 { held.torque = sample.torque }
+        if present & GK_TELEMETRY_TENSION.rawValue != 0 { held.tension = sample.tension }
+        if present & GK_TELEMETRY_POSITION.rawValue != 0 { held.position = sample.position }
+        if present & GK_TELEMETRY_FORCE.rawValue != 0 { held.force = sample.force }
+        if present & GK_TELEMETRY_DRAWSTRING_DISTANCE.rawValue != 0 { held.drawstringDistance = sample.drawstringDistance }
+        if present & GK_TELEMETRY_MOTOR_TEMPERATURE.rawValue != 0 { held.motorTemperature = sample.motorTemperature }
+    }
+
+    /// Write the last record, lap, the session and the activity, and close the file. Returns false
+    /// if a write failed.
+    func finish() -> Bool {
+        if let heldSecond = heldSecond {
+            writeRecord(at: heldSecond)
+            self.heldSecond = nil
+        }
+        if summary.lap.startTime != nil || summary.laps.isEmpty {
+            encoder.write(summary.endLap())
+        }
+        encoder.write(summary.sessionMesg())
+        encoder.write(summary.activityMesg())
+        return encoder.close()
+    }
+
+    private func writeRecord(at timestamp: UInt32) {
+        encoder.write(TelemetryRecordWriter.record(held, timestamp: timestamp, developerFields: developerFields))
+        summary.add(timestamp: timestamp, sample: held)
+        recordCount += 1
+    }
+
+    private func writeHeaderMesgs(startDate: Date) {
+        let fileId = FileIdMesg()
+        fileId.setType(.Activity)
+        fileId.setManufacturer(255) // development
+        fileId.setTimeCreated(FitDateTime(date: startDate))
+        encoder.write(fileId)
+
+        let developerDataId = DeveloperDataIdMesg()
+        developerDataId.setDeveloperDataIndex(0)
+        for (index, byte) in "GimBle.Recorder!".utf8.enumerated() {
+            developerDataId.setApplicationId(index, byte)
+        }
+        developerDataId.setApplicationVersion(1)
+        encoder.write(developerDataId)
+
+        for (num, entry) in TelemetryRecordWriter.developerFieldNames.enumerated() {
+            let description = FieldDescriptionMesg()
+            description.setDeveloperDataIndex(0)
+            description.setFieldDefinitionNumber(UInt8(num))
+            description.setFitBaseTypeId(FitBaseType.Float32)
+            description.setFieldName(0, entry.name)
+            description.setUnits(0, entry.units)
+            encoder.write(description)
+            developerFields.append(DeveloperField(description: description, developerDataIdMesg: developerDataId))
+        }
+    }
+
+    /// The record of the values of `sample`.
+    static func record(_ sample: GKTelemetrySample, timestamp: UInt32, developerFields: [DeveloperField]) -> RecordMesg {
+        let record = RecordMesg()
+        record.setTimestamp(FitDateTime(timeStamp: timestamp))
+        let present = sample.present
+        if present & GK_TELEMETRY_CADENCE.rawValue != 0 { record.setCadence(FitSummaryAggregator.clamp(sample.cadence)) }
+        if present & GK_TELEMETRY_POWER.rawValue != 0 { record.setPower(FitSummaryAggregator.clamp(sample.power)) }
+        if present & GK_TELEMETRY_SPEED.rawValue != 0 { record.setSpeed(sample.speed) }
+        if present & GK_TELEMETRY_DISTANCE.rawValue != 0 { record.setDistance(sample.distance) }
+        if present & GK_TELEMETRY_CALORIES.rawValue != 0 { record.setCalories(FitSummaryAggregator.clamp(sample.calories)) }
+        if present & GK_TELEMETRY_HEART_RATE.rawValue != 0 { record.setHeartRate(sample.heartRate) }
+        if present & GK_TELEMETRY_TEMPERATURE.rawValue != 0 { record.setTemperature(FitSummaryAggregator.clamp(sample.temperature)) }
+
+        let values = [sample.torque, sample.tension, sample.position, sample.force, sample.drawstringDistance,
+                      sample.motorTemperature]
+        for (index, entry) in developerFieldNames.enumerated()
+            where present & entry.field.rawValue != 0 && index < developerFields.count {
+            var field = DeveloperField(field: developerFields[index])
+            field.addValue(value: values[index])
+            record.setDeveloperField(field: field)
+        }
+        return record
+    }
+}
@@ -0,0 +1,109 @@
+//
+//  GimKitTrace.swift
+//  GimBle
+//
+//  Swift access to the GKTrace scoped events and Chrome trace export.
+//
+
+import Foundation
+
+public class GimKitTrace {
+
+    /// Stage names shared with the native trace points, see GKTrace.h.
+    public static let transport: StaticString = "transport"
+    public static let slipDecode: StaticString = "sd_decode_frame"
+    public static let disassemble: StaticString = "disassembleMethod"
+    public static let bridge: StaticString = "GimKitMethodDecodedListener"
+    public static let observer: StaticString = "GimKitDeviceObserver"
+
+    private static let captureQueue = DispatchQueue(label: "GimKitTrace.capture")
+    /// Bumped by every capture: a capture whose generation is no longer the current one was
+    /// superseded. Guarded by `captureQueue`.
+    private static var captureGeneration = 0
+
+    /// Tracing is off by default and can be switched at any time.
+    public static var isEnabled: Bool {
+        get { return gk_trace_is_enabled() }
+        set { gk_trace_set_enabled(newValue) }
+    }
+
+    /// Events kept per thread for buffers allocated from now on.
+    public static func setBufferCapacity(_ events: Int) {
+        gk_trace_set_buffer_capacity(events)
+    }
+
+    /// Open a scope, pass the result to `end(_:_:)`.
+    @inline(__always)
+    public static func begin() -> UInt64 {
+        return gk_trace_begin()
+    }
+
+    @inline(__always)
+    public static func end(_ name: StaticString, _ begin: UInt64) {
+        guard begin != 0, let name = cString(name) else {
+            return
+        }
+        gk_trace_end(name, begin)
+    }
+
+    /// Trace `body` as one complete event named `name`.
+    @inline(__always)
+    public static func scope<R>(_ name: StaticString, _ body: () throws -> R) rethrows -> R {
+        let begin = gk_trace_begin()
+        defer { end(name, begin) }
+        return try body()
+    }
+
+    public static func instant(_ name: StaticString) {
+        guard gk_trace_is_enabled(), let name = cString(name) else {
+            return
+        }
+        gk_trace_instant(name)
+    }
+
+    /// The native side keeps the name pointer until export, which only literals with a pointer
+    /// representation guarantee (they are static and null terminated).
+    @inline(__always)
+    private static func cString(_ name: StaticString) -> UnsafePointer<CChar>? {
+        guard name.hasPointerRepresentation else {
+            return nil
+        }
+        return UnsafeRawPointer(name.utf8Start).assumingMemoryBound(to: CChar.self)
+    }
+
+    /// Write the recorded events as Chrome trace JSON, returns the number of events or nil on failure.
+    @discardableResult
+    public static func export(to url: URL) -> Int? {
+        let written = url.path.withCString { gk_trace_export_chrome_json($0) }
+        return written < 0 ? nil : written
+    }
+
+    public static func clear() {
+        gk_trace_clear()
+    }
+
+    /**
+     * Capture a trace of the next `duration` seconds of the running session.
+     *
+     * Tracing is enabled from a clean state, disabled again after `duration`, and the events are written
+     * to `url`. The completion runs on a private queue with the number of exported events, or nil.
+     * A capture started while another one runs supersedes it: when its time is up, the earlier one
+     * completes with nil, leaving tracing on for the new capture, which exports a trace of its own.
+     */
+    public static func capture(duration: TimeInterval = 30, to url: URL, completion: ((Int?) -> Void)? = nil) {
+        let generation: Int = captureQueue.sync {
+            captureGeneration += 1
+            gk_trace_clear()
+            gk_trace_set_enabled(true)
+            return captureGeneration
+        }
+        captureQueue.asyncAfter(deadline: .now() + duration) {
+            guard generation == captureGeneration else {
+                completion?(nil)
+                return
+            }
+            gk_trace_set_enabled(false)
+            completion?(export(to: url))
+        }
+    }
+}
@@ -0,0 +1,98 @@
+//
+// GKCRC16.c
+// Table driven (slicing-by-8) CRC-16, as used by FIT files.
+//
+
+#include "GKCRC16.h"
+
+#include <pthread.h>
+
+#define CRC16_POLYNOMIAL 0xA001u
+
+// kTables[0] is the classic byte table; kTables[k][b] is the CRC of byte b followed by k zero bytes.
+static uint16_t kTables[8][256];
+static pthread_once_t kTablesOnce = PTHREAD_ONCE_INIT;
+
+static void buildTables(void) {
+    for (unsigned b = 0; b < 256; b++) {
+        uint16_t crc = (uint16_t) b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (uint16_t) ((crc >> 1) ^ CRC16_POLYNOMIAL) : (uint16_t) (crc >> 1);
+        }
+        kTables[0][b] = crc;
+    }
+    for (unsigned b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            uint16_t previous = kTables[k - 1][b];
+            kTables[k][b] = (uint16_t) ((previous >> 8) ^ kTables[0][previous & 0xFFu]);
+        }
+    }
+}
+
+uint16_t gk_crc16_update(uint16_t crc, const void *data, size_t length) {
+    pthread_once(&kTablesOnce, buildTables);
+    const uint8_t *p = data;
+
+    while (length >= 8) {
+        // The CRC register overlaps the first two bytes of the block.
+        uint32_t lo = ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24) ^ crc;
+        crc = (uint16_t) (kTables[7][lo & 0xFFu] ^ kTables[6][(lo >> 8) & 0xFFu] ^
+                          kTables[5][(lo >> 16) & 0xFFu] ^ kTables[4][lo >> 24] ^
+                          kTables[3][p[4]] ^ kTables[2][p[5]] ^ kTables[1][p[6]] ^ kTables[0][p[7]]);
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (uint16_t) ((crc >> 8) ^ kTables[0][(crc ^ *p++) & 0xFFu]);
+    }
+    return crc;
+}
+
+uint16_t gk_crc16(const void *data, size_t length) {
+    return gk_crc16_update(GK_CRC16_INIT, data, length);
+}
+
+// A 16x16 matrix over GF(2) is 16 columns; column i is the image of bit i.
+static uint16_t gf2MatrixTimes(const uint16_t *matrix, uint16_t vector) {
+    uint16_t sum = 0;
+    for (; vector; vector >>= 1, matrix++) {
+        if (vector & 1u) {
+            sum ^= *matrix;
+        }
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(uint16_t *square, const uint16_t *matrix) {
+    for (int n = 0; n < 16; n++) {
+        square[n] = gf2MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+uint16_t gk_crc16_combine(uint16_t crc1, uint16_t crc2, size_t length2) {
+    if (length2 == 0) {
+        return crc1 ^ crc2;
+    }
+    pthread_once(&kTablesOnce, buildTables);
+
+    // The operator carrying a CRC over one zero byte, squared for 2, 4, 8... bytes.
+    uint16_t shift[16], square[16];
+    for (int n = 0; n < 16; n++) {
+        uint16_t bit = (uint16_t) (1u << n);
+        shift[n] = (uint16_t) ((bit >> 8) ^ kTables[0][bit & 0xFFu]);
+    }
+    for (;;) {
+        if (length2 & 1u) {
+            crc1 = gf2MatrixTimes(shift, crc1);
+        }
+        length2 >>= 1;
+        if (length2 == 0) {
+            break;
+        }
+        gf2MatrixSquare(square, shift);
+        for (int n = 0; n < 16; n++) {
+            shift[n] = square[n];
+        }
+    }
+    return crc1 ^ crc2;
+}
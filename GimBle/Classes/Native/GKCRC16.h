@@ -0,0 +1,62 @@
+//
+// GKCRC16.h
+// Table driven (slicing-by-8) CRC-16, as used by FIT files.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKCRC16_H
+#define GIMKIT_GKCRC16_H
+
+#include <stdint.h> // for uint16_t, etc
+#include <stddef.h> // for size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The CRC of no data, the seed of a new computation.
+ */
+#define GK_CRC16_INIT 0x0000u
+
+/***
+ * Continue a CRC-16 computation over 'length' bytes.
+ * <p/>
+ * The CRC is the reflected polynomial 0x8005 (0xA001) without final xor, also known as
+ * CRC-16/ARC, which is what #CRC.get16() of the FIT SDK computes one byte at a time. Eight bytes are
+ * folded per step with eight lookup tables; the tables are built once, on first use, and the
+ * function is safe to call from any thread.
+ *
+ * @param crc The CRC of the preceding bytes, #GK_CRC16_INIT to start.
+ * @param data The bytes, may be NULL if 'length' is 0.
+ * @param length Number of bytes.
+ * @return The CRC of the preceding bytes followed by 'data'.
+ */
+uint16_t gk_crc16_update(uint16_t crc, const void *data, size_t length);
+
+/***
+ * The CRC-16 of 'length' bytes, see #gk_crc16_update().
+ */
+uint16_t gk_crc16(const void *data, size_t length);
+
+/***
+ * The CRC of two blocks of data end to end, from the CRC of each.
+ * <p/>
+ * The CRC is linear, so the CRC of the first block only has to be carried over the length of the
+ * second, which takes O(log 'length2') steps rather than a pass over its bytes. It lets a writer
+ * keep the CRC of the data it streams and prepend a header known only at the end.
+ *
+ * @param crc1 The CRC of the first block.
+ * @param crc2 The CRC of the second block, computed from #GK_CRC16_INIT.
+ * @param length2 Number of bytes of the second block.
+ * @return The CRC of the first block followed by the second.
+ */
+uint16_t gk_crc16_combine(uint16_t crc1, uint16_t crc2, size_t length2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKCRC16_H
@@ -0,0 +1,426 @@
+//
+// GKCapture.c
+// Compact append-only capture files of the raw characteristic traffic.
+//
+
+#include "GKCapture.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define HEADER_SIZE 16
+#define FOOTER_SIZE 16
+#define INDEX_TAG 0xFFu
+#define INDEX_ENTRY_SIZE 24
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+static const uint8_t kHeaderMagic[4] = { 'G', 'K', 'C', 'P' };
+static const uint8_t kFooterMagic[4] = { 'G', 'K', 'C', 'I' };
+
+typedef struct IndexEntry {
+    uint64_t offset;
+    /** Absolute timestamp of the record before 'offset', the base of its delta */
+    uint64_t timestamp;
+    uint64_t ordinal;
+} IndexEntry;
+
+typedef struct IndexEntries {
+    IndexEntry *items;
+    size_t count;
+    size_t capacity;
+} IndexEntries;
+
+struct gk_capture_writer {
+    FILE *file;
+    pthread_mutex_t lock;
+    uint64_t started;
+    uint64_t offset;
+    uint64_t timestamp;
+    uint64_t ordinal;
+    bool failed;
+    IndexEntries index;
+};
+
+struct gk_capture_reader {
+    uint8_t *data;
+    size_t size;
+    /** End of the records, i.e. start of the index */
+    size_t end;
+    size_t position;
+    uint64_t timestamp;
+    uint64_t ordinal;
+    uint64_t startTime;
+    uint64_t count;
+    uint64_t duration;
+    IndexEntries index;
+};
+
+static uint64_t monotonicMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+static uint64_t wallClockMicros(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000u + (uint64_t) tv.tv_usec;
+}
+
+static bool appendEntry(IndexEntries *index, uint64_t offset, uint64_t timestamp, uint64_t ordinal) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 64;
+        IndexEntry *items = realloc(index->items, capacity * sizeof(IndexEntry));
+        if (!items) {
+            return false;
+        }
+        index->items = items;
+        index->capacity = capacity;
+    }
+    index->items[index->count++] = (IndexEntry) { offset, timestamp, ordinal };
+    return true;
+}
+
+static size_t putVarint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t) value;
+    return n;
+}
+
+static bool getVarint(const uint8_t *data, size_t end, size_t *position, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *position < end; shift += 7) {
+        uint8_t byte = data[(*position)++];
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void putU64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t getU64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | in[i];
+    return value;
+}
+
+static bool writeBytes(struct gk_capture_writer *writer, const uint8_t *buf, size_t length) {
+    if (length && fwrite(buf, 1, length, writer->file) != length) {
+        writer->failed = true;
+        return false;
+    }
+    writer->offset += length;
+    return true;
+}
+
+struct gk_capture_writer *gk_capture_open_writer(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+    struct gk_capture_writer *writer = calloc(1, sizeof(struct gk_capture_writer));
+    if (!writer) {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        free(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+    pthread_mutex_init(&writer->lock, NULL);
+    writer->started = monotonicMicros();
+
+    uint8_t header[HEADER_SIZE] = { 0 };
+    memcpy(header, kHeaderMagic, sizeof(kHeaderMagic));
+    header[4] = GK_CAPTURE_VERSION & 0xFF;
+    header[5] = GK_CAPTURE_VERSION >> 8;
+    putU64(header + 8, wallClockMicros());
+    if (!writeBytes(writer, header, sizeof(header))) {
+        fclose(writer->file);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+static GKCaptureStatus writeRecord(struct gk_capture_writer *writer, GKCaptureDirection direction,
+                                   uint64_t timestamp, const uint8_t *buf, size_t length) {
+    if (writer->failed) {
+        return GK_CAPTURE_ERROR;
+    }
+    if (timestamp < writer->timestamp) {
+        timestamp = writer->timestamp;
+    }
+    if (writer->ordinal % GK_CAPTURE_INDEX_INTERVAL == 0
+        && !appendEntry(&writer->index, writer->offset, writer->timestamp, writer->ordinal)) {
+        return GK_CAPTURE_ERROR;
+    }
+
+    uint8_t prefix[1 + 10 + 10];
+    size_t n = 0;
+    prefix[n++] = (uint8_t) direction;
+    n += putVarint(prefix + n, timestamp - writer->timestamp);
+    n += putVarint(prefix + n, length);
+    if (!writeBytes(writer, prefix, n) || !writeBytes(writer, buf, length)) {
+        return GK_CAPTURE_ERROR;
+    }
+    writer->timestamp = timestamp;
+    writer->ordinal++;
+    return GK_CAPTURE_OK;
+}
+
+GKCaptureStatus gk_capture_write(struct gk_capture_writer *writer, GKCaptureDirection direction,
+                                 const uint8_t *buf, size_t length) {
+    if (!writer || (!buf && length)) {
+        return GK_CAPTURE_ERROR;
+    }
+    pthread_mutex_lock(&writer->lock);
+    GKCaptureStatus status = writeRecord(writer, direction, monotonicMicros() - writer->started, buf, length);
+    pthread_mutex_unlock(&writer->lock);
+    return status;
+}
+
+GKCaptureStatus gk_capture_write_at(struct gk_capture_writer *writer, GKCaptureDirection direction,
+                                    uint64_t timestamp, const uint8_t *buf, size_t length) {
+    if (!writer || (!buf && length)) {
+        return GK_CAPTURE_ERROR;
+    }
+    pthread_mutex_lock(&writer->lock);
+    GKCaptureStatus status = writeRecord(writer, direction, timestamp, buf, length);
+    pthread_mutex_unlock(&writer->lock);
+    return status;
+}
+
+GKCaptureStatus gk_capture_close_writer(struct gk_capture_writer *writer) {
+    if (!writer) {
+        return GK_CAPTURE_ERROR;
+    }
+    uint64_t indexOffset = writer->offset;
+    uint8_t prefix[1 + 3 * 10];
+    size_t n = 0;
+    prefix[n++] = INDEX_TAG;
+    n += putVarint(prefix + n, writer->ordinal);
+    n += putVarint(prefix + n, writer->timestamp);
+    n += putVarint(prefix + n, writer->index.count);
+    bool ok = writeBytes(writer, prefix, n);
+    for (size_t i = 0; ok && i < writer->index.count; i++) {
+        uint8_t entry[INDEX_ENTRY_SIZE];
+        putU64(entry, writer->index.items[i].offset);
+        putU64(entry + 8, writer->index.items[i].timestamp);
+        putU64(entry + 16, writer->index.items[i].ordinal);
+        ok = writeBytes(writer, entry, sizeof(entry));
+    }
+    uint8_t footer[FOOTER_SIZE] = { 0 };
+    memcpy(footer, kFooterMagic, sizeof(kFooterMagic));
+    putU64(footer + 8, indexOffset);
+    ok = ok && writeBytes(writer, footer, sizeof(footer));
+
+    ok = (fclose(writer->file) == 0) && ok && !writer->failed;
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->index.items);
+    free(writer);
+    return ok ? GK_CAPTURE_OK : GK_CAPTURE_ERROR;
+}
+
+/**
+ * Parse the record at 'position', without consuming it.
+ */
+static GKCaptureStatus parseRecord(const struct gk_capture_reader *reader, size_t position, uint64_t base,
+                                   GKCaptureRecord *record, size_t *next) {
+    if (position >= reader->end) {
+        return GK_CAPTURE_END;
+    }
+    uint8_t direction = reader->data[position++];
+    uint64_t delta, length;
+    if (direction > GK_CAPTURE_FROM_DEVICE
+        || !getVarint(reader->data, reader->end, &position, &delta)
+        || !getVarint(reader->data, reader->end, &position, &length)
+        || length > reader->end - position) {
+        return GK_CAPTURE_BAD_RECORD;
+    }
+    record->direction = (GKCaptureDirection) direction;
+    record->timestamp = base + delta;
+    record->data = reader->data + position;
+    record->length = (size_t) length;
+    *next = position + (size_t) length;
+    return GK_CAPTURE_OK;
+}
+
+static bool readTrailer(struct gk_capture_reader *reader) {
+    if (reader->size < HEADER_SIZE + FOOTER_SIZE
+        || memcmp(reader->data + reader->size - FOOTER_SIZE, kFooterMagic, sizeof(kFooterMagic)) != 0) {
+        return false;
+    }
+    uint64_t indexOffset = getU64(reader->data + reader->size - FOOTER_SIZE + 8);
+    size_t trailerEnd = reader->size - FOOTER_SIZE;
+    if (indexOffset < HEADER_SIZE || indexOffset >= trailerEnd || reader->data[indexOffset] != INDEX_TAG) {
+        return false;
+    }
+    size_t position = (size_t) indexOffset + 1;
+    uint64_t entries;
+    if (!getVarint(reader->data, trailerEnd, &position, &reader->count)
+        || !getVarint(reader->data, trailerEnd, &position, &reader->duration)
+        || !getVarint(reader->data, trailerEnd, &position, &entries)
+        || entries != (trailerEnd - position) / INDEX_ENTRY_SIZE
+        || (trailerEnd - position) % INDEX_ENTRY_SIZE != 0) {
+        return false;
+    }
+    // Checkpoints in file order, each one on a record: a seek never starts outside the records.
+    uint64_t offset = 0, timestamp = 0, ordinal = 0;
+    for (uint64_t i = 0; i < entries; i++, position += INDEX_ENTRY_SIZE) {
+        const uint8_t *entry = reader->data + position;
+        uint64_t next = getU64(entry), base = getU64(entry + 8), at = getU64(entry + 16);
+        if (next < HEADER_SIZE || next >= indexOffset || (i && (next <= offset || base < timestamp || at <= ordinal))
+            || at >= reader->count || !appendEntry(&reader->index, next, base, at)) {
+            return false;
+        }
+        offset = next;
+        timestamp = base;
+        ordinal = at;
+    }
+    reader->end = (size_t) indexOffset;
+    return true;
+}
+
+/**
+ * Rebuild the index of a capture which was not closed, up to the last complete record.
+ */
+static void rebuildIndex(struct gk_capture_reader *reader) {
+    reader->index.count = 0;
+    reader->end = reader->size;
+    size_t position = HEADER_SIZE;
+    uint64_t timestamp = 0, ordinal = 0;
+    GKCaptureRecord record;
+    size_t next;
+    while (position < reader->size && reader->data[position] != INDEX_TAG
+           && parseRecord(reader, position, timestamp, &record, &next) == GK_CAPTURE_OK) {
+        if (ordinal % GK_CAPTURE_INDEX_INTERVAL == 0) {
+            appendEntry(&reader->index, position, timestamp, ordinal);
+        }
+        timestamp = record.timestamp;
+        ordinal++;
+        position = next;
+    }
+    reader->end = position;
+    reader->count = ordinal;
+    reader->duration = timestamp;
+}
+
+struct gk_capture_reader *gk_capture_open_reader(const char *path) {
+    FILE *file = path ? fopen(path, "rb") : NULL;
+    if (!file) {
+        return NULL;
+    }
+    struct gk_capture_reader *reader = calloc(1, sizeof(struct gk_capture_reader));
+    long size = -1;
+    if (reader && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= HEADER_SIZE && fseek(file, 0, SEEK_SET) == 0) {
+        reader->size = (size_t) size;
+        reader->data = malloc(reader->size);
+    }
+    bool ok = reader && reader->data && fread(reader->data, 1, reader->size, file) == reader->size
+              && memcmp(reader->data, kHeaderMagic, sizeof(kHeaderMagic)) == 0
+              && (reader->data[4] | reader->data[5] << 8) <= GK_CAPTURE_VERSION;
+    fclose(file);
+    if (!ok) {
+        gk_capture_close_reader(reader);
+        return NULL;
+    }
+
+    reader->startTime = getU64(reader->data + 8);
+    if (!readTrailer(reader)) {
+        rebuildIndex(reader);
+    }
+    gk_capture_rewind(reader);
+    return reader;
+}
+
+GKCaptureStatus gk_capture_next(struct gk_capture_reader *reader, GKCaptureRecord *record) {
+    if (!reader || !record) {
+        return GK_CAPTURE_ERROR;
+    }
+    size_t next;
+    GKCaptureStatus status = parseRecord(reader, reader->position, reader->timestamp, record, &next);
+    if (status == GK_CAPTURE_OK) {
+        record->ordinal = reader->ordinal++;
+        reader->timestamp = record->timestamp;
+        reader->position = next;
+    }
+    return status;
+}
+
+GKCaptureStatus gk_capture_seek(struct gk_capture_reader *reader, uint64_t timestamp) {
+    if (!reader) {
+        return GK_CAPTURE_ERROR;
+    }
+    gk_capture_rewind(reader);
+    // last checkpoint whose base timestamp is before the target: the record before a checkpoint may
+    // itself be at the target
+    size_t low = 0, high = reader->index.count;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (reader->index.items[middle].timestamp < timestamp) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    if (reader->index.count && (low == 0 || reader->index.items[low].timestamp < timestamp)) {
+        reader->position = (size_t) reader->index.items[low].offset;
+        reader->timestamp = reader->index.items[low].timestamp;
+        reader->ordinal = reader->index.items[low].ordinal;
+    }
+
+    GKCaptureRecord record;
+    size_t next;
+    GKCaptureStatus status;
+    while ((status = parseRecord(reader, reader->position, reader->timestamp, &record, &next)) == GK_CAPTURE_OK
+           && record.timestamp < timestamp) {
+        reader->timestamp = record.timestamp;
+        reader->position = next;
+        reader->ordinal++;
+    }
+    return status;
+}
+
+void gk_capture_rewind(struct gk_capture_reader *reader) {
+    if (reader) {
+        reader->position = HEADER_SIZE;
+        reader->timestamp = 0;
+        reader->ordinal = 0;
+    }
+}
+
+uint64_t gk_capture_record_count(const struct gk_capture_reader *reader) {
+    return reader ? reader->count : 0;
+}
+
+uint64_t gk_capture_start_time(const struct gk_capture_reader *reader) {
+    return reader ? reader->startTime : 0;
+}
+
+uint64_t gk_capture_duration(const struct gk_capture_reader *reader) {
+    return reader ? reader->duration : 0;
+}
+
+void gk_capture_close_reader(struct gk_capture_reader *reader) {
+    if (reader) {
+        free(reader->data);
+        free(reader->index.items);
+        free(reader);
+    }
+}
@@ -0,0 +1,152 @@
+//
+// GKCapture.h
+// Compact append-only capture files of the raw characteristic traffic.
+//
+// Layout, all integers little endian:
+//
+//   header   "GKCP" | u16 version | u16 reserved | u64 wall clock start, in us since the Unix epoch
+//   record   u8 direction | varint timestamp delta, in us | varint length | payload
+//   ...
+//   index    u8 0xFF | varint records | varint duration | varint entries
+//            | entries x (u64 offset | u64 timestamp | u64 ordinal)
+//   footer   "GKCI" | u32 reserved | u64 index offset
+//
+// Record timestamps are relative to the previous record (the first one to the header), so a record
+// takes 3 bytes plus its payload in the common case. An index entry is written every
+// GK_CAPTURE_INDEX_INTERVAL records, it holds the absolute timestamp of the record before it so
+// decoding can start there. The index and footer are written on close; a file without them (the app
+// was killed) is still readable, the reader rebuilds the index by scanning the records. So does a
+// file whose footer or index is truncated or inconsistent.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKCAPTURE_H
+#define GIMKIT_GKCAPTURE_H
+
+#include <stdint.h> // for uint64_t, uint8_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GK_CAPTURE_VERSION 1
+
+#define GK_CAPTURE_INDEX_INTERVAL 1024
+
+typedef enum GKCaptureDirection {
+    /** Written by the host to the device characteristic */
+    GK_CAPTURE_TO_DEVICE = 0,
+    /** Notified by the device to the host */
+    GK_CAPTURE_FROM_DEVICE = 1
+} GKCaptureDirection;
+
+typedef enum GKCaptureStatus {
+    GK_CAPTURE_OK = 0,
+    /** No more record */
+    GK_CAPTURE_END,
+    /** The file is truncated or corrupted at the current record */
+    GK_CAPTURE_BAD_RECORD,
+    /** General failure, null pointer, I/O error, etc */
+    GK_CAPTURE_ERROR
+} GKCaptureStatus;
+
+typedef struct GKCaptureRecord {
+    GKCaptureDirection direction;
+    /** Microseconds since the start of the capture */
+    uint64_t timestamp;
+    /** Zero based position of the record in the capture */
+    uint64_t ordinal;
+    /** Points into the reader memory, valid until #gk_capture_close_reader() */
+    const uint8_t *data;
+    size_t length;
+} GKCaptureRecord;
+
+/***
+ * Opaque writer state
+ */
+struct gk_capture_writer;
+
+/***
+ * Opaque reader state
+ */
+struct gk_capture_reader;
+
+/***
+ * Create a capture file, an existing file is overwritten.
+ *
+ * @param path Destination file.
+ * @return The writer, or NULL if the file can't be created.
+ */
+struct gk_capture_writer *gk_capture_open_writer(const char *path);
+
+/***
+ * Append a record.
+ * <p/>
+ * It is safe to call from the threads of both directions. Timestamps are taken from the monotonic
+ * clock at the time of the call.
+ *
+ * @return GK_CAPTURE_OK, or GK_CAPTURE_ERROR if the record can't be written.
+ */
+GKCaptureStatus gk_capture_write(struct gk_capture_writer *writer, GKCaptureDirection direction,
+                                 const uint8_t *buf, size_t length);
+
+/***
+ * Same as #gk_capture_write(), with an explicit timestamp in microseconds since the capture started.
+ * Timestamps going backward are clamped to the previous one.
+ */
+GKCaptureStatus gk_capture_write_at(struct gk_capture_writer *writer, GKCaptureDirection direction,
+                                    uint64_t timestamp, const uint8_t *buf, size_t length);
+
+/***
+ * Write the index and footer, then close the file and release the writer.
+ */
+GKCaptureStatus gk_capture_close_writer(struct gk_capture_writer *writer);
+
+/***
+ * Load a capture file.
+ *
+ * @return The reader positioned before the first record, or NULL if the file can't be read or is not a capture.
+ */
+struct gk_capture_reader *gk_capture_open_reader(const char *path);
+
+/***
+ * Read the next record.
+ *
+ * @return GK_CAPTURE_OK if 'record' is filled, GK_CAPTURE_END after the last record, GK_CAPTURE_BAD_RECORD
+ *         if the rest of the file is unreadable.
+ */
+GKCaptureStatus gk_capture_next(struct gk_capture_reader *reader, GKCaptureRecord *record);
+
+/***
+ * Position the reader so the next record is the first one at or after 'timestamp', using the index.
+ */
+GKCaptureStatus gk_capture_seek(struct gk_capture_reader *reader, uint64_t timestamp);
+
+/***
+ * Position the reader before the first record.
+ */
+void gk_capture_rewind(struct gk_capture_reader *reader);
+
+/***
+ * Number of records, and wall clock start of the capture in microseconds since the Unix epoch.
+ */
+uint64_t gk_capture_record_count(const struct gk_capture_reader *reader);
+
+uint64_t gk_capture_start_time(const struct gk_capture_reader *reader);
+
+/***
+ * Timestamp of the last record, in microseconds since the start of the capture.
+ */
+uint64_t gk_capture_duration(const struct gk_capture_reader *reader);
+
+void gk_capture_close_reader(struct gk_capture_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKCAPTURE_H
@@ -0,0 +1,97 @@
+//
+// GKCore.hpp
+// Include the GimKit core C headers from C++, and the few helpers the C++ layer shares.
+//
+#ifndef GIMKIT_GKCORE_HPP
+#define GIMKIT_GKCORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+// The core headers refuse any compiler which doesn't announce C99, which a C++ compiler never does:
+// announce it for these two includes only, and restore whatever the translation unit had after them.
+#pragma push_macro("__STDC_VERSION__")
+#ifndef __STDC_VERSION__
+#define __STDC_VERSION__ 199901L
+#endif
+
+extern "C" {
+#include "slipdev.h"
+#include "GKMethods.h"
+}
+
+#pragma pop_macro("__STDC_VERSION__")
+
+namespace gimkit {
+
+/**
+ * One type per METHOD entry of Methods.h, carrying its figures.
+ */
+namespace method {
+
+enum class Side : char {
+    Host = 'H',
+    Device = 'D',
+};
+
+#define METHOD(opid_, bomi, bomr, invoke, reply, name_, desc) \
+    struct name_ { \
+        static constexpr uint8_t opid = (opid_); \
+        /** Payload size of the invocation, -1 for variable, -2 if there is no such method */ \
+        static constexpr int requestSize = (bomi); \
+        /** Payload size of the reply, -1 for variable, -2 if there is none */ \
+        static constexpr int replySize = (bomr); \
+        static constexpr Side invoker = static_cast<Side>(invoke); \
+        static constexpr const char *name = #name_; \
+    };
+#include "Methods.h"
+#undef METHOD
+
+} // namespace method
+
+#if defined(__cpp_lib_span)
+
+template <typename T>
+using span = std::span<T>;
+
+#else
+
+/**
+ * The subset of C++20 std::span the C++ layer uses, for C++17 builds.
+ */
+template <typename T>
+class span {
+public:
+    constexpr span() noexcept = default;
+    constexpr span(T *data, size_t size) noexcept : data_(data), size_(size) {}
+    template <size_t N>
+    constexpr span(T (&array)[N]) noexcept : data_(array), size_(N) {}
+    template <typename Container, typename = decltype(std::declval<Container &>().data())>
+    constexpr span(Container &container) noexcept : data_(container.data()), size_(container.size()) {}
+    template <typename U, typename = std::enable_if_t<std::is_convertible<U (*)[], T (*)[]>::value>>
+    constexpr span(const span<U> &other) noexcept : data_(other.data()), size_(other.size()) {}
+
+    constexpr T *data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T *begin() const noexcept { return data_; }
+    constexpr T *end() const noexcept { return data_ + size_; }
+    constexpr T &operator[](size_t index) const noexcept { return data_[index]; }
+    constexpr span subspan(size_t offset, size_t count) const noexcept { return span(data_ + offset, count); }
+
+private:
+    T *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif
+
+} // namespace gimkit
+
+#endif //GIMKIT_GKCORE_HPP
@@ -0,0 +1,243 @@
+//
+// GKJournal.c
+// Crash-safe append-only journal of telemetry samples, replayed into a FIT file after a crash.
+//
+
+#include "GKJournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "GKCRC16.h"
+
+#define HEADER_SIZE 24
+#define BLOCK_HEADER_SIZE 8
+// Larger counts are garbage from a torn block header.
+#define MAX_BLOCK_SAMPLES (1u << 20)
+
+static const uint8_t kHeaderMagic[4] = { 'G', 'K', 'J', 'L' };
+
+struct gk_journal_writer {
+    int fd;
+    char *path;
+    /** Block header followed by room for 'groupSamples' samples */
+    uint8_t *block;
+    size_t groupSamples;
+    size_t buffered;
+    uint64_t committed;
+    bool failed;
+};
+
+static void putU16(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t getU16(const uint8_t *in) {
+    return (uint16_t) (in[0] | in[1] << 8);
+}
+
+static void putU32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t *in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | in[i];
+    return value;
+}
+
+static void putU64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t getU64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | in[i];
+    return value;
+}
+
+static bool writeAll(int fd, const uint8_t *buf, size_t length) {
+    while (length) {
+        ssize_t n = write(fd, buf, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        length -= (size_t) n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, uint8_t *buf, size_t length) {
+    while (length) {
+        ssize_t n = read(fd, buf, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        length -= (size_t) n;
+    }
+    return true;
+}
+
+struct gk_journal_writer *gk_journal_open_writer(const char *path, uint64_t startNs, uint64_t startTime,
+                                                 size_t groupSamples) {
+    if (!path || groupSamples == 0) {
+        return NULL;
+    }
+    struct gk_journal_writer *writer = calloc(1, sizeof(struct gk_journal_writer));
+    if (!writer) {
+        return NULL;
+    }
+    writer->groupSamples = groupSamples;
+    writer->block = malloc(BLOCK_HEADER_SIZE + groupSamples * sizeof(GKTelemetrySample));
+    writer->path = strdup(path);
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!writer->block || !writer->path || writer->fd < 0) {
+        if (writer->fd >= 0) {
+            close(writer->fd);
+        }
+        free(writer->block);
+        free(writer->path);
+        free(writer);
+        return NULL;
+    }
+
+    uint8_t header[HEADER_SIZE] = { 0 };
+    memcpy(header, kHeaderMagic, sizeof(kHeaderMagic));
+    putU16(header + 4, GK_JOURNAL_VERSION);
+    putU16(header + 6, (uint16_t) sizeof(GKTelemetrySample));
+    putU64(header + 8, startNs);
+    putU64(header + 16, startTime);
+    if (!writeAll(writer->fd, header, sizeof(header)) || fsync(writer->fd) != 0) {
+        gk_journal_close_writer(writer, true);
+        return NULL;
+    }
+    return writer;
+}
+
+GKJournalStatus gk_journal_commit(struct gk_journal_writer *writer) {
+    if (!writer || writer->failed) {
+        return GK_JOURNAL_ERROR;
+    }
+    if (writer->buffered == 0) {
+        return GK_JOURNAL_OK;
+    }
+    size_t size = writer->buffered * sizeof(GKTelemetrySample);
+    uint8_t *block = writer->block;
+    putU32(block, (uint32_t) writer->buffered);
+    putU16(block + 4, gk_crc16(block + BLOCK_HEADER_SIZE, size));
+    putU16(block + 6, 0);
+    // One write per block: a crash leaves at most the last block torn, which its CRC reveals.
+    if (!writeAll(writer->fd, block, BLOCK_HEADER_SIZE + size) || fsync(writer->fd) != 0) {
+        writer->failed = true;
+        return GK_JOURNAL_ERROR;
+    }
+    writer->committed += writer->buffered;
+    writer->buffered = 0;
+    return GK_JOURNAL_OK;
+}
+
+GKJournalStatus gk_journal_append(struct gk_journal_writer *writer, const GKTelemetrySample *samples,
+                                  size_t count) {
+    if (!writer || (!samples && count)) {
+        return GK_JOURNAL_ERROR;
+    }
+    GKTelemetrySample *buffer = (GKTelemetrySample *) (writer->block + BLOCK_HEADER_SIZE);
+    while (count) {
+        size_t n = writer->groupSamples - writer->buffered;
+        if (n > count) {
+            n = count;
+        }
+        memcpy(buffer + writer->buffered, samples, n * sizeof(GKTelemetrySample));
+        writer->buffered += n;
+        samples += n;
+        count -= n;
+        if (writer->buffered == writer->groupSamples && gk_journal_commit(writer) != GK_JOURNAL_OK) {
+            return GK_JOURNAL_ERROR;
+        }
+    }
+    return writer->failed ? GK_JOURNAL_ERROR : GK_JOURNAL_OK;
+}
+
+uint64_t gk_journal_committed(const struct gk_journal_writer *writer) {
+    return writer ? writer->committed : 0;
+}
+
+GKJournalStatus gk_journal_close_writer(struct gk_journal_writer *writer, bool remove) {
+    if (!writer) {
+        return GK_JOURNAL_ERROR;
+    }
+    GKJournalStatus status = remove ? GK_JOURNAL_OK : gk_journal_commit(writer);
+    if (close(writer->fd) != 0 && status == GK_JOURNAL_OK) {
+        status = GK_JOURNAL_ERROR;
+    }
+    if (remove) {
+        unlink(writer->path);
+    }
+    free(writer->block);
+    free(writer->path);
+    free(writer);
+    return status;
+}
+
+GKJournalStatus gk_journal_read(const char *path, GKJournalInfo *info, GKJournalBlockCallback callback,
+                                void *context) {
+    if (!path) {
+        return GK_JOURNAL_ERROR;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return GK_JOURNAL_ERROR;
+    }
+    uint8_t header[HEADER_SIZE];
+    if (!readAll(fd, header, sizeof(header)) || memcmp(header, kHeaderMagic, sizeof(kHeaderMagic)) != 0
+        || getU16(header + 4) != GK_JOURNAL_VERSION || getU16(header + 6) != sizeof(GKTelemetrySample)) {
+        close(fd);
+        return GK_JOURNAL_BAD_FILE;
+    }
+    GKJournalInfo result = { getU64(header + 8), getU64(header + 16), 0, HEADER_SIZE };
+
+    GKTelemetrySample *samples = NULL;
+    size_t capacity = 0;
+    uint8_t blockHeader[BLOCK_HEADER_SIZE];
+    while (readAll(fd, blockHeader, sizeof(blockHeader))) {
+        size_t count = getU32(blockHeader);
+        if (count == 0 || count > MAX_BLOCK_SAMPLES) {
+            break;
+        }
+        if (count > capacity) {
+            GKTelemetrySample *grown = realloc(samples, count * sizeof(GKTelemetrySample));
+            if (!grown) {
+                break;
+            }
+            samples = grown;
+            capacity = count;
+        }
+        size_t size = count * sizeof(GKTelemetrySample);
+        if (!readAll(fd, (uint8_t *) samples, size) || gk_crc16(samples, size) != getU16(blockHeader + 4)) {
+            break;
+        }
+        if (callback) {
+            callback(context, samples, count);
+        }
+        result.sampleCount += count;
+        result.validSize += BLOCK_HEADER_SIZE + size;
+    }
+    free(samples);
+    close(fd);
+    if (info) {
+        *info = result;
+    }
+    return GK_JOURNAL_OK;
+}
@@ -0,0 +1,119 @@
+//
+// GKJournal.h
+// Crash-safe append-only journal of telemetry samples, replayed into a FIT file after a crash.
+//
+// Layout, all integers little endian:
+//
+//   header   "GKJL" | u16 version | u16 sample size | u64 monotonic start, in ns | u64 wall clock
+//            start, in us since the Unix epoch
+//   block    u32 samples | u16 CRC-16 of the samples | u16 reserved | samples x GKTelemetrySample
+//   ...
+//
+// Samples are appended to a buffer and committed as one block with one write() and one fsync():
+// when 'groupSamples' samples are buffered, or when #gk_journal_commit() is called, typically every
+// second from the thread already encoding the samples. The thread receiving the telemetry never
+// waits on the disk. Should the app be killed or the system crash, the samples of the blocks
+// written entirely survive; a torn last block fails its CRC and is ignored.
+//
+// Samples are stored in their in-memory layout: a journal is replayed by the device that wrote it.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKJOURNAL_H
+#define GIMKIT_GKJOURNAL_H
+
+#include <stdint.h> // for uint64_t, uint8_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#include "GKTelemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GK_JOURNAL_VERSION 1
+
+typedef enum GKJournalStatus {
+    GK_JOURNAL_OK = 0,
+    /** Not a journal, or one written with another sample layout */
+    GK_JOURNAL_BAD_FILE,
+    /** General failure, null pointer, I/O error, etc */
+    GK_JOURNAL_ERROR
+} GKJournalStatus;
+
+typedef struct GKJournalInfo {
+    /** #gk_trace_now_ns() when the journal was opened, the clock of the sample timestamps */
+    uint64_t startNs;
+    /** Wall clock at the same time, in us since the Unix epoch */
+    uint64_t startTime;
+    /** Samples in the valid blocks */
+    uint64_t sampleCount;
+    /** Bytes up to the end of the last valid block */
+    uint64_t validSize;
+} GKJournalInfo;
+
+/***
+ * Opaque writer state
+ */
+struct gk_journal_writer;
+
+/***
+ * Create a journal, an existing file is overwritten.
+ *
+ * @param path Destination file.
+ * @param startNs The #gk_trace_now_ns() the sample timestamps are relative to.
+ * @param startTime The wall clock at 'startNs', in us since the Unix epoch.
+ * @param groupSamples Samples buffered before a block is committed.
+ * @return The writer, or NULL if the file can't be created.
+ */
+struct gk_journal_writer *gk_journal_open_writer(const char *path, uint64_t startNs, uint64_t startTime,
+                                                 size_t groupSamples);
+
+/***
+ * Append samples, committing a block each time 'groupSamples' samples are buffered.
+ * <p/>
+ * Only one thread may write to a journal.
+ *
+ * @return GK_JOURNAL_OK, or GK_JOURNAL_ERROR if a block can't be written.
+ */
+GKJournalStatus gk_journal_append(struct gk_journal_writer *writer, const GKTelemetrySample *samples,
+                                  size_t count);
+
+/***
+ * Write the buffered samples as a block and sync the file.
+ */
+GKJournalStatus gk_journal_commit(struct gk_journal_writer *writer);
+
+/***
+ * Samples committed so far.
+ */
+uint64_t gk_journal_committed(const struct gk_journal_writer *writer);
+
+/***
+ * Commit, close the file and release the writer.
+ *
+ * @param remove Delete the file, once its samples are safely stored elsewhere.
+ */
+GKJournalStatus gk_journal_close_writer(struct gk_journal_writer *writer, bool remove);
+
+typedef void (*GKJournalBlockCallback)(void *context, const GKTelemetrySample *samples, size_t count);
+
+/***
+ * Read the valid blocks of a journal, oldest first.
+ *
+ * @param info Filled with the header and the extent of the valid blocks, may be NULL.
+ * @param callback Called with the samples of each block, may be NULL to only fill 'info'.
+ * @return GK_JOURNAL_OK, GK_JOURNAL_BAD_FILE if the header doesn't match, GK_JOURNAL_ERROR if the
+ *         file can't be read.
+ */
+GKJournalStatus gk_journal_read(const char *path, GKJournalInfo *info, GKJournalBlockCallback callback,
+                                void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKJOURNAL_H
@@ -0,0 +1,352 @@
+//
+// GKLatency.c
+// Round-trip latency histograms for the GimKit method protocol.
+//
+
+#include "GKLatency.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+#include "GKMethods.h"
+
+// One slot per METHOD entry, the slot index is the position of the entry in Methods.h.
+enum {
+#define METHOD(opid, bomi, bomr, invoke, reply, name, desc) LATENCY_SLOT_##name,
+#include "Methods.h"
+#undef METHOD
+    LATENCY_SLOT_COUNT
+};
+
+typedef struct LatencyMethod {
+    uint8_t opid;
+    char invoke;
+    const char *name;
+} LatencyMethod;
+
+static const LatencyMethod kMethods[LATENCY_SLOT_COUNT] = {
+#define METHOD(opid, bomi, bomr, invoke, reply, name, desc) { (opid), (invoke), #name },
+#include "Methods.h"
+#undef METHOD
+};
+
+// slot + 1 for each opid listed in Methods.h, 0 for the others
+static const uint8_t kSlotOfOpid[256] = {
+#define METHOD(opid, bomi, bomr, invoke, reply, name, desc) [(opid)] = LATENCY_SLOT_##name + 1,
+#include "Methods.h"
+#undef METHOD
+};
+
+enum {
+#define METHOD(opid, bomi, bomr, invoke, reply, name, desc) LATENCY_OPID_##name = (opid),
+#include "Methods.h"
+#undef METHOD
+};
+
+typedef struct LatencyHistogram {
+    /** Invocation timestamp + 1 of the call in flight, 0 if none */
+    _Atomic uint64_t inflight;
+    _Atomic uint64_t overlapped;
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    /** UINT64_MAX - min, so that a zeroed histogram reads as 'no minimum yet' */
+    _Atomic uint64_t minComplement;
+    _Atomic uint64_t max;
+    _Atomic uint32_t buckets[GK_LATENCY_BUCKET_COUNT];
+} LatencyHistogram;
+
+static LatencyHistogram sHistograms[LATENCY_SLOT_COUNT];
+static atomic_bool sEnabled = true;
+
+#define SUB_BUCKET_COUNT (1u << GK_LATENCY_SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF (1u << (GK_LATENCY_SUB_BUCKET_BITS - 1))
+
+static inline int highestBit(uint32_t value) {
+    int bit = 31;
+    while (!(value & (1u << bit))) bit--;
+    return bit;
+}
+
+static inline uint32_t bucketIndexOf(uint64_t micros) {
+    uint32_t value = micros > UINT32_MAX ? UINT32_MAX : (uint32_t) micros;
+    if (value < SUB_BUCKET_COUNT) {
+        return value;
+    }
+    // 'top' keeps the GK_LATENCY_SUB_BUCKET_BITS most significant bits of the value
+    uint32_t shift = (uint32_t) highestBit(value) - (GK_LATENCY_SUB_BUCKET_BITS - 1);
+    uint32_t top = value >> shift;
+    return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF + (top - SUB_BUCKET_HALF);
+}
+
+static inline uint64_t bucketUpperBoundOf(uint32_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    uint32_t offset = index - SUB_BUCKET_COUNT;
+    uint32_t shift = offset / SUB_BUCKET_HALF + 1;
+    uint64_t top = offset % SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+    return ((top + 1) << shift) - 1;
+}
+
+static inline void storeMax(_Atomic uint64_t *target, uint64_t value) {
+    uint64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current
+           && !atomic_compare_exchange_weak_explicit(target, &current, value,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static inline LatencyHistogram *histogramOf(uint8_t opid) {
+    uint8_t slot = kSlotOfOpid[opid];
+    return slot ? &sHistograms[slot - 1] : NULL;
+}
+
+void gk_latency_set_enabled(bool enabled) {
+    atomic_store_explicit(&sEnabled, enabled, memory_order_relaxed);
+}
+
+bool gk_latency_is_enabled(void) {
+    return atomic_load_explicit(&sEnabled, memory_order_relaxed);
+}
+
+uint64_t gk_latency_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+bool gk_latency_mark_invoke(uint8_t opid) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h || kMethods[kSlotOfOpid[opid] - 1].invoke != 'H' || !gk_latency_is_enabled()) {
+        return false;
+    }
+    uint64_t previous = atomic_exchange_explicit(&h->inflight, gk_latency_now_us() + 1, memory_order_relaxed);
+    if (previous) {
+        atomic_fetch_add_explicit(&h->overlapped, 1, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool gk_latency_mark_reply(uint8_t opid) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h) {
+        return false;
+    }
+    uint64_t started = atomic_exchange_explicit(&h->inflight, 0, memory_order_relaxed);
+    if (!started) {
+        return false;
+    }
+    uint64_t now = gk_latency_now_us();
+    return gk_latency_record(opid, now + 1 > started ? now + 1 - started : 0);
+}
+
+bool gk_latency_record(uint8_t opid, uint64_t micros) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h || !gk_latency_is_enabled()) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucketIndexOf(micros)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, micros, memory_order_relaxed);
+    storeMax(&h->max, micros);
+    storeMax(&h->minComplement, UINT64_MAX - micros);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_release);
+    return true;
+}
+
+static uint64_t quantileOf(LatencyHistogram *h, double quantile, uint64_t total, uint64_t max) {
+    if (!total) {
+        return 0;
+    }
+    if (quantile < 0) quantile = 0;
+    if (quantile > 1) quantile = 1;
+    uint64_t rank = (uint64_t) (quantile * (double) total + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < GK_LATENCY_BUCKET_COUNT; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = bucketUpperBoundOf(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+static uint64_t bucketTotalOf(LatencyHistogram *h) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < GK_LATENCY_BUCKET_COUNT; i++) {
+        total += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t gk_latency_quantile(uint8_t opid, double quantile) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h) {
+        return 0;
+    }
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    return quantileOf(h, quantile, bucketTotalOf(h), max);
+}
+
+uint64_t gk_latency_max(uint8_t opid) {
+    LatencyHistogram *h = histogramOf(opid);
+    return h ? atomic_load_explicit(&h->max, memory_order_relaxed) : 0;
+}
+
+bool gk_latency_get_summary(uint8_t opid, GKLatencySummary *summary) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h || !summary) {
+        return false;
+    }
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_acquire);
+    uint64_t total = bucketTotalOf(h);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    summary->opid = opid;
+    summary->name = kMethods[kSlotOfOpid[opid] - 1].name;
+    summary->count = count;
+    summary->min = count ? UINT64_MAX - atomic_load_explicit(&h->minComplement, memory_order_relaxed) : 0;
+    summary->max = max;
+    summary->mean = count ? (double) atomic_load_explicit(&h->sum, memory_order_relaxed) / (double) count : 0;
+    summary->p50 = quantileOf(h, 0.50, total, max);
+    summary->p90 = quantileOf(h, 0.90, total, max);
+    summary->p99 = quantileOf(h, 0.99, total, max);
+    summary->overlapped = atomic_load_explicit(&h->overlapped, memory_order_relaxed);
+    return true;
+}
+
+size_t gk_latency_method_count(void) {
+    size_t count = 0;
+    for (size_t i = 0; i < LATENCY_SLOT_COUNT; i++) {
+        if (kMethods[i].invoke == 'H') count++;
+    }
+    return count;
+}
+
+uint8_t gk_latency_method_opid(size_t index) {
+    for (size_t i = 0; i < LATENCY_SLOT_COUNT; i++) {
+        if (kMethods[i].invoke == 'H' && index-- == 0) {
+            return kMethods[i].opid;
+        }
+    }
+    return 0;
+}
+
+void gk_latency_reset(uint8_t opid) {
+    LatencyHistogram *h = histogramOf(opid);
+    if (!h) {
+        return;
+    }
+    atomic_store_explicit(&h->inflight, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->overlapped, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->minComplement, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+    for (uint32_t i = 0; i < GK_LATENCY_BUCKET_COUNT; i++) {
+        atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->count, 0, memory_order_release);
+}
+
+void gk_latency_reset_all(void) {
+    for (size_t i = 0; i < LATENCY_SLOT_COUNT; i++) {
+        gk_latency_reset(kMethods[i].opid);
+    }
+}
+
+// Every callback of GKMethodTable: X(callback, (parameters), (arguments forwarded to the tapped table)).
+#define TAP_CALLBACKS(X) \
+    X(onForwardFrameRequest, (const void *any, const uint8_t *frame, size_t count), (tap->any, frame, count)) \
+    X(onReceivedMethodCrcError, (const void *any, const uint8_t *frame, size_t count, uint16_t crcReceived, uint16_t crcCalculated), (tap->any, frame, count, crcReceived, crcCalculated)) \
+    X(onReceivedMethodProtocolError, (const void *any, const uint8_t *frame, size_t count), (tap->any, frame, count)) \
+    X(onMethodDisconnectBleInvoke, (const void *any), (tap->any)) \
+    X(onMethodNotifyKeyEventInvoke, (const void *any, const KeyEvent *keyEvent, size_t count), (tap->any, keyEvent, count)) \
+    X(onMethodNotifyBrakeEventInvoke, (const void *any), (tap->any)) \
+    X(onMethodNotifyGimKitDataInvoke, (const void *any, const GimkitData *data), (tap->any, data)) \
+    X(onMethodNotifyKnobRotationInvoke, (const void *any, int rotation), (tap->any, rotation)) \
+    X(onMethodHandshakeReply, (const void *any, const uint8_t *random, size_t count), (tap->any, random, count)) \
+    X(onMethodHandshakeReplyError, (const void *any, int error), (tap->any, error)) \
+    X(onMethodVerifyMd5Reply, (const void *any, uint8_t result), (tap->any, result)) \
+    X(onMethodVerifyMd5ReplyError, (const void *any, int error, const uint8_t md5[16], size_t count), (tap->any, error, md5, count)) \
+    X(onMethodGetProtocolRevisionReply, (const void *any, uint8_t revision), (tap->any, revision)) \
+    X(onMethodGetProtocolRevisionReplyError, (const void *any, int error), (tap->any, error)) \
+    X(onMethodGetComponentSnReply, (const void *any, const DeviceComponentInfo *info, size_t count), (tap->any, info, count)) \
+    X(onMethodGetComponentSnReplyError, (const void *any, int error), (tap->any, error)) \
+    X(onMethodGetDeviceIdReply, (const void *any, uint32_t deviceId), (tap->any, deviceId)) \
+    X(onMethodGetDeviceIdReplyError, (const void *any, int error), (tap->any, error)) \
+    X(onMethodStatBikeReply, (const void *any, uint8_t type, uint8_t voltage, uint8_t temperature, uint8_t powerSource), (tap->any, type, voltage, temperature, powerSource)) \
+    X(onMethodStatBikeReplyError, (const void *any, int error), (tap->any, error)) \
+    X(onMethodSwitchServiceModeReply, (const void *any, uint8_t mode), (tap->any, mode)) \
+    X(onMethodSwitchServiceModeReplyError, (const void *any, int error, uint8_t mode), (tap->any, error, mode)) \
+    X(onMethodSetConsoleStateReply, (const void *any, uint16_t state), (tap->any, state)) \
+    X(onMethodSetConsoleStateReplyError, (const void *any, int error, uint16_t state), (tap->any, error, state)) \
+    X(onMethodSetRidingParamReply, (const void *any, const RidingParams *rp), (tap->any, rp)) \
+    X(onMethodSetRidingParamReplyError, (const void *any, int error, const RidingParams *rp), (tap->any, error, rp)) \
+    X(onMethodSetTorqueReply, (const void *any, uint8_t torque), (tap->any, torque)) \
+    X(onMethodSetTorqueReplyError, (const void *any, int error, uint8_t torque), (tap->any, error, torque)) \
+    X(onMethodSeizeKnobControlReply, (const void *any, uint8_t mode), (tap->any, mode)) \
+    X(onMethodSeizeKnobControlReplyError, (const void *any, int error, uint8_t mode), (tap->any, error, mode)) \
+    X(onMethodSetKnobDisplayModeReply, (const void *any, uint8_t mode), (tap->any, mode)) \
+    X(onMethodSetKnobDisplayModeReplyError, (const void *any, int error, uint8_t mode), (tap->any, error, mode)) \
+    X(onMethodSetErgModeReply, (const void *any, uint8_t erg), (tap->any, erg)) \
+    X(onMethodSetErgModeReplyError, (const void *any, int error, uint8_t erg), (tap->any, error, erg)) \
+    X(onMethodNotifyStrengthDataInvoke, (const void *any, const StrengthData *data), (tap->any, data)) \
+    X(onMethodSetStrengthEquipmentModeReply, (const void *any, const uint8_t *data, size_t count), (tap->any, data, count)) \
+    X(onMethodSetStrengthEquipmentModeReplyError, (const void *any, int error, const uint8_t *data, size_t count), (tap->any, error, data, count)) \
+    X(onMethodNotifyRowermDataInvoke, (const void *any, const RowermData *data), (tap->any, data)) \
+    X(onMethodSetRowermModeReply, (const void *any, const uint8_t *data, size_t count), (tap->any, data, count)) \
+    X(onMethodSetRowermModeReplyError, (const void *any, int error, const uint8_t *data, size_t count), (tap->any, error, data, count)) \
+    X(onMethodNotifyXbikeDataInvoke, (const void *any, const XbikeData *data), (tap->any, data)) \
+    X(onMethodMcFirmwareInfoReply, (const void *any, uint8_t result), (tap->any, result)) \
+    X(onMethodMcFirmwareInfoReplyError, (const void *any, int error, uint8_t result), (tap->any, error, result)) \
+    X(onMethodGetMtuReply, (const void *any, uint8_t size), (tap->any, size)) \
+    X(onMethodGetMtuReplyError, (const void *any, int error, uint8_t size), (tap->any, error, size)) \
+    X(onMethodMcFirmwareContentReply, (const void *any, uint8_t result), (tap->any, result)) \
+    X(onMethodMcFirmwareContentReplyError, (const void *any, int error, uint8_t result), (tap->any, error, result)) \
+    X(onMethodMcFirmwareTransferEndReply, (const void *any, uint8_t result), (tap->any, result)) \
+    X(onMethodMcFirmwareTransferEndReplyError, (const void *any, int error, uint8_t result), (tap->any, error, result)) \
+    X(onMethodMcFirmwareResultReply, (const void *any, uint8_t result), (tap->any, result)) \
+    X(onMethodMcFirmwareResultReplyError, (const void *any, int error, uint8_t result), (tap->any, error, result))
+
+#define TAP_SLOT(callback) (offsetof(GKMethodTable, callback) / sizeof(void (*)(void)))
+
+// opid + 1 of the method each reply callback ends, by callback, 0 for the other callbacks
+static const uint16_t kReplyOpidOf[sizeof(GKMethodTable) / sizeof(void (*)(void))] = {
+#define TAP_REPLY(callback, method) [TAP_SLOT(callback)] = LATENCY_OPID_##method + 1,
+    GK_LATENCY_REPLY_CALLBACKS(TAP_REPLY)
+#undef TAP_REPLY
+};
+
+static inline void tapReply(const GKLatencyTap *tap, uint16_t opid) {
+    if (!opid) {
+        return;
+    }
+    if (tap->onReply) {
+        tap->onReply(tap, (uint8_t) (opid - 1));
+    } else {
+        gk_latency_mark_reply((uint8_t) (opid - 1));
+    }
+}
+
+#define TAP_FUNCTION(callback, params, args) \
+    static void tap_##callback params { \
+        const GKLatencyTap *tap = any; \
+        tapReply(tap, kReplyOpidOf[TAP_SLOT(callback)]); \
+        if (tap->mtab->callback) { \
+            tap->mtab->callback args; \
+        } \
+    }
+TAP_CALLBACKS(TAP_FUNCTION)
+#undef TAP_FUNCTION
+
+static const GKMethodTable kTapTable = {
+#define TAP_ENTRY(callback, params, args) .callback = tap_##callback,
+    TAP_CALLBACKS(TAP_ENTRY)
+#undef TAP_ENTRY
+};
+
+const struct GKMethodTable *gk_latency_tap_table(void) {
+    return &kTapTable;
+}
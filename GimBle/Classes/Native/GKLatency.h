@@ -0,0 +1,226 @@
+//
+// GKLatency.h
+// Round-trip latency histograms for the GimKit method protocol.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKLATENCY_H
+#define GIMKIT_GKLATENCY_H
+
+#include <stdint.h> // for uint64_t, uint8_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of linear sub-buckets per power of two is 2^GK_LATENCY_SUB_BUCKET_BITS.
+ * 6 bits keeps the relative error of any recorded value under 1/32 (~3%).
+ */
+#define GK_LATENCY_SUB_BUCKET_BITS 6
+
+/**
+ * Buckets needed to cover every 32 bit value (in microseconds, ~71 minutes) with the precision above.
+ */
+#define GK_LATENCY_BUCKET_COUNT \
+    ((1u << GK_LATENCY_SUB_BUCKET_BITS) + (32u - GK_LATENCY_SUB_BUCKET_BITS) * (1u << (GK_LATENCY_SUB_BUCKET_BITS - 1)))
+
+/**
+ * A point-in-time view of one method's histogram. All durations are in microseconds.
+ */
+typedef struct GKLatencySummary {
+    uint8_t opid;
+    /**
+     * Name of the method as listed in Methods.h, e.g. "SET_TORQUE".
+     */
+    const char *name;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    /**
+     * Invocations that were overwritten by a newer invocation of the same method before
+     * their reply arrived. Their latency is not recorded.
+     */
+    uint64_t overlapped;
+} GKLatencySummary;
+
+/***
+ * Enable or disable latency collection globally.
+ * <p/>
+ * Collection is enabled by default. Every entry point is lock-free and safe to call from any
+ * thread, so it can stay enabled in production builds.
+ */
+void gk_latency_set_enabled(bool enabled);
+
+bool gk_latency_is_enabled(void);
+
+/***
+ * Monotonic clock used for every timestamp in this module, in microseconds.
+ */
+uint64_t gk_latency_now_us(void);
+
+/***
+ * Record that a method invocation has just been assembled and is about to be sent.
+ * <p/>
+ * Call it from the same place the frame is handed to the #MethodAssembledCallback. Only one
+ * invocation per opid can be in flight; a second invocation before the reply replaces the first
+ * one, which is counted in #GKLatencySummary.overlapped.
+ *
+ * @param opid The opid of the method, see Methods.h.
+ * @return false if the opid is not a host invoked method or collection is disabled.
+ */
+bool gk_latency_mark_invoke(uint8_t opid);
+
+/***
+ * Record that the reply (or reply error) of a method has been decoded.
+ * <p/>
+ * Call it from the matching '...Reply' / '...ReplyError' callback of the #GKMethodTable. The
+ * elapsed time since the matching #gk_latency_mark_invoke() is added to the method histogram.
+ *
+ * @param opid The opid of the method, see Methods.h.
+ * @return true if a latency sample was recorded, false if there was no invocation in flight.
+ */
+bool gk_latency_mark_reply(uint8_t opid);
+
+/**
+ * The reply callbacks of GKMethodTable, each with the Methods.h name of the method it replies to:
+ * X(callback, METHOD). Both the reply and the reply error end an invocation.
+ */
+#define GK_LATENCY_REPLY_CALLBACKS(X) \
+    X(onMethodHandshakeReply, HANDSHAKE) \
+    X(onMethodHandshakeReplyError, HANDSHAKE) \
+    X(onMethodVerifyMd5Reply, VERIFY_MD5) \
+    X(onMethodVerifyMd5ReplyError, VERIFY_MD5) \
+    X(onMethodGetProtocolRevisionReply, GET_PROTO_REVISION) \
+    X(onMethodGetProtocolRevisionReplyError, GET_PROTO_REVISION) \
+    X(onMethodGetComponentSnReply, GET_COMPONENT_SN) \
+    X(onMethodGetComponentSnReplyError, GET_COMPONENT_SN) \
+    X(onMethodGetDeviceIdReply, GET_DEVICE_ID) \
+    X(onMethodGetDeviceIdReplyError, GET_DEVICE_ID) \
+    X(onMethodStatBikeReply, STAT_BIKE) \
+    X(onMethodStatBikeReplyError, STAT_BIKE) \
+    X(onMethodSwitchServiceModeReply, SWITCH_SERVICE_MODE) \
+    X(onMethodSwitchServiceModeReplyError, SWITCH_SERVICE_MODE) \
+    X(onMethodSetConsoleStateReply, SET_CONSOLE_STATE) \
+    X(onMethodSetConsoleStateReplyError, SET_CONSOLE_STATE) \
+    X(onMethodSetRidingParamReply, SET_RIDING_PARAM) \
+    X(onMethodSetRidingParamReplyError, SET_RIDING_PARAM) \
+    X(onMethodSetTorqueReply, SET_TORQUE) \
+    X(onMethodSetTorqueReplyError, SET_TORQUE) \
+    X(onMethodSeizeKnobControlReply, SEIZE_KNOB_CONTROL) \
+    X(onMethodSeizeKnobControlReplyError, SEIZE_KNOB_CONTROL) \
+    X(onMethodSetKnobDisplayModeReply, SET_KNOB_DISPLAY_MODE) \
+    X(onMethodSetKnobDisplayModeReplyError, SET_KNOB_DISPLAY_MODE) \
+    X(onMethodSetErgModeReply, SET_ERG_MODE) \
+    X(onMethodSetErgModeReplyError, SET_ERG_MODE) \
+    X(onMethodSetStrengthEquipmentModeReply, SET_STRENGTH_EQUIPMENT_MODE) \
+    X(onMethodSetStrengthEquipmentModeReplyError, SET_STRENGTH_EQUIPMENT_MODE) \
+    X(onMethodSetRowermModeReply, SET_ROWERM_MODE) \
+    X(onMethodSetRowermModeReplyError, SET_ROWERM_MODE) \
+    X(onMethodMcFirmwareInfoReply, MC_FIRMWARE_INFO) \
+    X(onMethodMcFirmwareInfoReplyError, MC_FIRMWARE_INFO) \
+    X(onMethodGetMtuReply, GET_BLE_MTU) \
+    X(onMethodGetMtuReplyError, GET_BLE_MTU) \
+    X(onMethodMcFirmwareContentReply, MC_FIRMWARE_CONTENT) \
+    X(onMethodMcFirmwareContentReplyError, MC_FIRMWARE_CONTENT) \
+    X(onMethodMcFirmwareTransferEndReply, MC_FIRMWARE_TRANSFER_END) \
+    X(onMethodMcFirmwareTransferEndReplyError, MC_FIRMWARE_TRANSFER_END) \
+    X(onMethodMcFirmwareResultReply, MC_FIRMWARE_RESULT) \
+    X(onMethodMcFirmwareResultReplyError, MC_FIRMWARE_RESULT)
+
+/** See GKMethods.h */
+struct GKMethodTable;
+
+/**
+ * The 'any' of #gk_latency_tap_table(): the method table and 'any' every callback is forwarded to.
+ */
+typedef struct GKLatencyTap {
+    const struct GKMethodTable *mtab;
+    const void *any;
+    /**
+     * Called with the opid of every reply and reply error, before it is forwarded. NULL to call
+     * #gk_latency_mark_reply().
+     */
+    void (*onReply)(const struct GKLatencyTap *tap, uint8_t opid);
+    /** Free for 'onReply' */
+    void *context;
+} GKLatencyTap;
+
+/***
+ * A method table marking the end of the invocations for a table which doesn't: every callback is
+ * forwarded to 'tap->mtab', after the reply ones have marked their method, see #GKLatencyTap.
+ *
+ *     GKLatencyTap tap = { &table, sink, NULL, NULL };
+ *     disassembleMethod(&tap, gk_latency_tap_table(), frame, count);
+ *
+ * The callbacks 'tap->mtab' leaves NULL are not forwarded.
+ */
+const struct GKMethodTable *gk_latency_tap_table(void);
+
+/***
+ * Add a latency sample directly, bypassing invoke/reply matching.
+ *
+ * @param opid The opid of the method, see Methods.h.
+ * @param micros Latency in microseconds.
+ * @return false if the opid is unknown or collection is disabled.
+ */
+bool gk_latency_record(uint8_t opid, uint64_t micros);
+
+/***
+ * Get the value at the given quantile of a method histogram.
+ *
+ * @param opid The opid of the method.
+ * @param quantile In [0, 1], e.g. 0.5 for the median, 0.99 for p99.
+ * @return The highest value equivalent to the bucket holding the quantile, in microseconds, or 0
+ *         if there is no sample.
+ */
+uint64_t gk_latency_quantile(uint8_t opid, double quantile);
+
+/***
+ * Get the largest recorded latency of a method, in microseconds, or 0 if there is no sample.
+ */
+uint64_t gk_latency_max(uint8_t opid);
+
+/***
+ * Fill a summary of a method histogram.
+ * <p/>
+ * The histogram keeps being updated while it is read, so the figures are consistent to within the
+ * samples recorded during the call.
+ *
+ * @return false if the opid is unknown, the summary is untouched.
+ */
+bool gk_latency_get_summary(uint8_t opid, GKLatencySummary *summary);
+
+/***
+ * Number of methods tracked, i.e. the host invoked methods of Methods.h.
+ */
+size_t gk_latency_method_count(void);
+
+/***
+ * Opid of the index-th tracked method, to enumerate with #gk_latency_method_count().
+ */
+uint8_t gk_latency_method_opid(size_t index);
+
+/***
+ * Clear the histogram and in-flight state of one method.
+ */
+void gk_latency_reset(uint8_t opid);
+
+/***
+ * Clear every method histogram.
+ */
+void gk_latency_reset_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKLATENCY_H
@@ -0,0 +1,329 @@
+//
+// GKMethodBuilders.hpp
+// Compile time checked builders of the host invoked methods, generated from Methods.h.
+//
+#ifndef GIMKIT_GKMETHODBUILDERS_HPP
+#define GIMKIT_GKMETHODBUILDERS_HPP
+
+#include <array>
+#include <cstring>
+#include <tuple>
+
+#include "GKCore.hpp"
+#include "GKLatency.h"
+#include "GKSlipDevice.hpp"
+
+/**
+ * Largest payload of the variable length methods (bomi -1 in Methods.h).
+ */
+#ifndef GK_METHOD_MAX_VARIABLE_PAYLOAD
+#define GK_METHOD_MAX_VARIABLE_PAYLOAD 512
+#endif
+
+namespace gimkit {
+
+namespace detail {
+
+template <typename M>
+constexpr size_t payloadCapacity() {
+    return M::requestSize >= 0 ? static_cast<size_t>(M::requestSize) : GK_METHOD_MAX_VARIABLE_PAYLOAD;
+}
+
+template <typename... Fields>
+constexpr size_t wireSize(const Fields &...fields) {
+    return (sizeof(fields) + ... + 0);
+}
+
+/**
+ * Argument 'I' of the GKMethodTable callback type 'Callback'.
+ */
+template <typename Callback, size_t I>
+struct CallbackArgument;
+
+template <typename R, typename... Args, size_t I>
+struct CallbackArgument<R (*)(Args...), I> {
+    using type = std::tuple_element_t<I, std::tuple<Args...>>;
+};
+
+template <typename M, typename Payload>
+struct Builder;
+
+} // namespace detail
+
+/**
+ * The frame the core assembles around a method payload, before SLIP encoding: besides the payload it
+ * holds the opid of Methods.h, the payload length and the CRC16 that
+ * GKMethodTable::onReceivedMethodCrcError reports. The sizes come from those types, and
+ * Benchmarks/Tests/MethodFramesTests.cpp checks them against the frames the core assembles.
+ */
+struct FrameLayout {
+    static constexpr size_t kOpidSize = sizeof(method::HANDSHAKE::opid);
+    static constexpr size_t kLengthSize = sizeof(uint16_t);
+    static constexpr size_t kCrcSize =
+        sizeof(detail::CallbackArgument<decltype(GKMethodTable::onReceivedMethodCrcError), 3>::type);
+    /** The bytes a frame holds besides its payload */
+    static constexpr size_t kEnvelopeSize = kOpidSize + kLengthSize + kCrcSize;
+
+    static_assert(GK_METHOD_MAX_VARIABLE_PAYLOAD < (size_t{1} << (8 * kLengthSize)),
+                  "the variable payloads don't fit the length field");
+};
+
+/**
+ * The SET_TORQUE payload, in the one byte unit the device uses for it, see GimkitData::torque.
+ */
+struct Torque {
+    /** The torque in steps of 0.5 N·m */
+    uint8_t halfNewtonMetres;
+
+    constexpr double newtonMetres() const noexcept { return halfNewtonMetres * 0.5; }
+};
+
+static_assert(sizeof(Torque{}.halfNewtonMetres) == sizeof(GimkitData{}.torque), "GimkitData::torque changed unit");
+
+/**
+ * The payload of a fixed size method as raw bytes. Passing an array of any other size is a compile error.
+ */
+template <typename M>
+using FixedPayload = std::enable_if_t<(M::requestSize >= 0), std::array<uint8_t, (M::requestSize >= 0 ? M::requestSize : 0)>>;
+
+/**
+ * An assembled method frame of 'M', on the stack: its capacity is known at compile time from Methods.h.
+ */
+template <typename M>
+class MethodFrame {
+public:
+    static constexpr size_t kCapacity = detail::payloadCapacity<M>() + FrameLayout::kEnvelopeSize;
+    static constexpr size_t kEncodedCapacity = SlipDevice::maxEncodedSize(kCapacity);
+
+    using Buffer = std::array<uint8_t, kCapacity>;
+    using EncodedBuffer = std::array<uint8_t, kEncodedCapacity>;
+
+    span<const uint8_t> bytes() const noexcept { return { buffer_.data(), size_ }; }
+
+    size_t size() const noexcept { return size_; }
+
+    /**
+     * SLIP encode the frame into 'out', see #sd_encode_frame_to_buffer().
+     * @return the encoded size.
+     */
+    size_t encode(EncodedBuffer &out) const noexcept {
+        return SlipDevice::encodeTo(bytes(), { out.data(), out.size() });
+    }
+
+private:
+    template <typename, typename>
+    friend struct detail::Builder;
+
+    static void onAssembled(uint8_t *frame, size_t count, const void *any) {
+        auto *self = static_cast<MethodFrame *>(const_cast<void *>(any));
+        if (count <= kCapacity) {
+            std::memcpy(self->buffer_.data(), frame, count);
+            self->size_ = count;
+        } else {
+            self->size_ = 0;
+        }
+    }
+
+    template <typename Assemble>
+    bool assemble(Assemble &&assemble) {
+        size_ = 0;
+        if (!assemble(&MethodFrame::onAssembled, static_cast<const void *>(this)) || size_ == 0) {
+            return false;
+        }
+        gk_latency_mark_invoke(M::opid);
+        return true;
+    }
+
+    Buffer buffer_;
+    size_t size_ = 0;
+};
+
+namespace detail {
+
+/**
+ * What the assembler of a host invoked method takes besides its callback, see GK_METHOD_ASSEMBLER.
+ */
+struct NoPayload {};
+/** Nothing either, though Methods.h gives the method a payload: the core fills it itself. */
+struct CorePayload {};
+/** The payload as raw bytes, a FixedPayload<M>. */
+struct BytesPayload {};
+/** A payload of any size up to GK_METHOD_MAX_VARIABLE_PAYLOAD, for the bomi -1 methods. */
+struct VariablePayload {};
+/** One value of type T, 'WireSize' bytes on the wire. */
+template <typename T, int WireSize>
+struct ValuePayload {};
+
+/**
+ * The core assembler of method 'M'. The primary template stands for a method with no assembler.
+ */
+template <typename M>
+struct Assembler {
+    using Payload = void;
+};
+
+/**
+ * Declare the assembler of method 'name_': 'call' assembles it from 'cb', 'any' and the payload
+ * 'value', the kind of which is the last argument.
+ */
+#define GK_METHOD_ASSEMBLER(name_, call, ...) \
+    template <> \
+    struct Assembler<method::name_> { \
+        using Payload = __VA_ARGS__; \
+        template <typename Value> \
+        static bool assemble(MethodAssembledCallback cb, const void *any, [[maybe_unused]] Value &value) { \
+            return call; \
+        } \
+    };
+
+// Methods.h has no assembler names, they are listed here. A host method missing from this list is a
+// compile error, see checkBuilder().
+GK_METHOD_ASSEMBLER(HANDSHAKE, assembleMethodHandshakeInvoke(cb, any), NoPayload)
+GK_METHOD_ASSEMBLER(VERIFY_MD5, assembleMethodVerifyMd5Invoke(cb, any, value.data()), BytesPayload)
+GK_METHOD_ASSEMBLER(GET_PROTO_REVISION, assembleMethodGetProtocolRevisionInvoke(cb, any), NoPayload)
+GK_METHOD_ASSEMBLER(GET_COMPONENT_SN, assembleMethodGetComponentSnInvoke(cb, any), NoPayload)
+GK_METHOD_ASSEMBLER(GET_DEVICE_ID, assembleMethodGetDeviceIdInvoke(cb, any), NoPayload)
+GK_METHOD_ASSEMBLER(STAT_BIKE, assembleMethodStatBikeRequestInvoke(cb, any), NoPayload)
+GK_METHOD_ASSEMBLER(SWITCH_SERVICE_MODE, assembleMethodSwitchServiceModeInvoke(cb, any), CorePayload)
+GK_METHOD_ASSEMBLER(SET_CONSOLE_STATE, assembleMethodSetConsoleStateInvoke(cb, any, value), ValuePayload<uint16_t, 2>)
+GK_METHOD_ASSEMBLER(SET_RIDING_PARAM, assembleMethodSetRidingParamsInvoke(cb, any, &value),
+                    ValuePayload<RidingParams, wireSize(RidingParams{}.mass, RidingParams{}.wheel_diameter,
+                                                        RidingParams{}.wind_resistance_coefficient,
+                                                        RidingParams{}.rolling_friction_coefficient,
+                                                        RidingParams{}.angle, RidingParams{}.efficiency,
+                                                        RidingParams{}.chain_wheel, RidingParams{}.rear_wheel,
+                                                        RidingParams{}.gear)>)
+GK_METHOD_ASSEMBLER(SET_TORQUE, assembleMethodSetTorqueInvoke(value.newtonMetres(), cb, any),
+                    ValuePayload<Torque, wireSize(Torque{}.halfNewtonMetres)>)
+GK_METHOD_ASSEMBLER(SEIZE_KNOB_CONTROL, assembleMethodSeizeKnobControlInvoke(cb, any, value), ValuePayload<uint8_t, 1>)
+GK_METHOD_ASSEMBLER(SET_KNOB_DISPLAY_MODE, assembleMethodSetKnobDisplayModeInvoke(cb, any, value), ValuePayload<uint8_t, 1>)
+GK_METHOD_ASSEMBLER(SET_ERG_MODE, assembleMethodSetErgModeInvoke(cb, any, value), ValuePayload<uint8_t, 1>)
+GK_METHOD_ASSEMBLER(SET_STRENGTH_EQUIPMENT_MODE,
+                    assembleMethodSetStrengthEquipmentModeInvoke(cb, any, value.data(), value.size()), VariablePayload)
+GK_METHOD_ASSEMBLER(SET_ROWERM_MODE, assembleMethodSetRowermModeInvoke(cb, any, value.data(), value.size()), VariablePayload)
+GK_METHOD_ASSEMBLER(MC_FIRMWARE_INFO, assembleMethodMcFirmwareInfoInvoke(cb, any, value.data(), value.size()), VariablePayload)
+GK_METHOD_ASSEMBLER(GET_BLE_MTU, assembleMethodGetMtuInvoke(cb, any), CorePayload)
+GK_METHOD_ASSEMBLER(MC_FIRMWARE_CONTENT, assembleMethodMcFirmwareContentInvoke(cb, any, value.data(), value.size()), VariablePayload)
+GK_METHOD_ASSEMBLER(MC_FIRMWARE_TRANSFER_END, assembleMethodMcFirmwareTransferEndInvoke(cb, any), CorePayload)
+GK_METHOD_ASSEMBLER(MC_FIRMWARE_RESULT, assembleMethodMcFirmwareResultInvoke(cb, any), CorePayload)
+GK_METHOD_ASSEMBLER(DB_REBOOT, assembleMethodDbRebootInvoke(cb, any), NoPayload)
+
+#undef GK_METHOD_ASSEMBLER
+
+/**
+ * The build() of method 'M' for its payload kind, checked against the sizes of Methods.h.
+ */
+template <typename M, typename Payload = typename Assembler<M>::Payload>
+struct Builder {};
+
+template <typename M>
+struct Builder<M, NoPayload> {
+    static_assert(M::requestSize == 0, "Methods.h gives this method a payload, its assembler takes none");
+
+    static bool build(MethodFrame<M> &frame) {
+        NoPayload none;
+        return frame.assemble([&](MethodAssembledCallback cb, const void *any) { return Assembler<M>::assemble(cb, any, none); });
+    }
+};
+
+template <typename M>
+struct Builder<M, CorePayload> {
+    static_assert(M::requestSize > 0, "Methods.h gives this method no fixed payload for the core to fill");
+
+    static bool build(MethodFrame<M> &frame) {
+        CorePayload none;
+        return frame.assemble([&](MethodAssembledCallback cb, const void *any) { return Assembler<M>::assemble(cb, any, none); });
+    }
+};
+
+template <typename M>
+struct Builder<M, BytesPayload> {
+    static bool build(MethodFrame<M> &frame, const FixedPayload<M> &bytes) {
+        FixedPayload<M> copy = bytes;
+        return frame.assemble([&](MethodAssembledCallback cb, const void *any) { return Assembler<M>::assemble(cb, any, copy); });
+    }
+};
+
+template <typename M>
+struct Builder<M, VariablePayload> {
+    static_assert(M::requestSize == -1, "Methods.h gives this method a fixed payload");
+
+    static bool build(MethodFrame<M> &frame, span<const uint8_t> payload) {
+        std::array<uint8_t, GK_METHOD_MAX_VARIABLE_PAYLOAD> copy;
+        if (payload.size() > copy.size()) {
+            return false;
+        }
+        std::memcpy(copy.data(), payload.data(), payload.size());
+        span<uint8_t> bytes(copy.data(), payload.size());
+        return frame.assemble([&](MethodAssembledCallback cb, const void *any) { return Assembler<M>::assemble(cb, any, bytes); });
+    }
+};
+
+template <typename M, typename T, int WireSize>
+struct Builder<M, ValuePayload<T, WireSize>> {
+    static_assert(M::requestSize == WireSize, "Methods.h disagrees with the payload of the assembler");
+
+    static bool build(MethodFrame<M> &frame, const T &value) {
+        T copy = value;
+        return frame.assemble([&](MethodAssembledCallback cb, const void *any) { return Assembler<M>::assemble(cb, any, copy); });
+    }
+
+    /** Only T itself: an int would be narrowed to the payload silently. */
+    template <typename U>
+    static bool build(MethodFrame<M> &frame, const U &value) = delete;
+};
+
+/**
+ * Whether method 'M' has a well formed builder, or needs none.
+ */
+template <typename M>
+constexpr bool checkBuilder() {
+    if constexpr (M::invoker != method::Side::Host) {
+        return true;
+    } else if constexpr (std::is_void<typename Assembler<M>::Payload>::value) {
+        return false;
+    } else {
+        return sizeof(Builder<M>) > 0;
+    }
+}
+
+} // namespace detail
+
+/**
+ * The builder of one host invoked method: MethodBuilder<method::SET_TORQUE>::build(frame, Torque{ 25 }).
+ * <p/>
+ * Its arguments are the method payload, typed, and exactly of the payload type: build(frame, 1000)
+ * doesn't compile for a one byte payload. Their wire size is checked against Methods.h at compile
+ * time, for every method of Methods.h below. Methods the device invokes have no builder. Every
+ * build() returns false if the core refuses the arguments, or assembles a frame bigger than
+ * MethodFrame<M>::kCapacity, which would mean FrameLayout no longer matches the core. A frame built marks the invocation of M for GKLatency, see
+ * #gk_latency_mark_invoke(): build it when it is about to be sent.
+ */
+template <typename M>
+struct MethodBuilder : detail::Builder<M> {
+    static_assert(M::invoker == method::Side::Host, "this method is invoked by the device, the host can't build it");
+};
+
+#define METHOD(opid_, bomi, bomr, invoke, reply, name_, desc) \
+    static_assert(detail::checkBuilder<method::name_>(), "no valid builder of " #name_);
+#include "Methods.h"
+#undef METHOD
+
+/**
+ * Build the frame of method 'M' from its typed payload, see MethodBuilder.
+ */
+template <typename M, typename... Args>
+bool buildMethod(MethodFrame<M> &frame, Args &&...args) {
+    return MethodBuilder<M>::build(frame, std::forward<Args>(args)...);
+}
+
+// The telemetry the device notifies must match the sizes in Methods.h as well.
+static_assert(method::NOTIFY_GIMKIT_DATA::requestSize ==
+                  detail::wireSize(GimkitData{}.distance, GimkitData{}.calorie, GimkitData{}.cadence,
+                                   GimkitData{}.speed, GimkitData{}.power, GimkitData{}.state, GimkitData{}.motor,
+                                   GimkitData{}.temperature, GimkitData{}.bpm, GimkitData{}.gear, GimkitData{}.torque),
+              "Methods.h disagrees with GimkitData");
+
+} // namespace gimkit
+
+#endif //GIMKIT_GKMETHODBUILDERS_HPP
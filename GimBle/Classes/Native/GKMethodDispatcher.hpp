@@ -0,0 +1,211 @@
+//
+// GKMethodDispatcher.hpp
+// Header only, statically typed replacement of a hand filled GKMethodTable.
+//
+#ifndef GIMKIT_GKMETHODDISPATCHER_HPP
+#define GIMKIT_GKMETHODDISPATCHER_HPP
+
+#include <type_traits>
+#include <utility>
+
+#include "GKCore.hpp"
+#include "GKLatency.h"
+#include "GKSlipDevice.hpp"
+
+/**
+ * Every callback of GKMethodTable, in declaration order.
+ */
+#define GK_METHOD_TABLE_CALLBACKS(X) \
+    X(onForwardFrameRequest) \
+    X(onReceivedMethodCrcError) \
+    X(onReceivedMethodProtocolError) \
+    X(onMethodDisconnectBleInvoke) \
+    X(onMethodNotifyKeyEventInvoke) \
+    X(onMethodNotifyBrakeEventInvoke) \
+    X(onMethodNotifyGimKitDataInvoke) \
+    X(onMethodNotifyKnobRotationInvoke) \
+    X(onMethodHandshakeReply) \
+    X(onMethodHandshakeReplyError) \
+    X(onMethodVerifyMd5Reply) \
+    X(onMethodVerifyMd5ReplyError) \
+    X(onMethodGetProtocolRevisionReply) \
+    X(onMethodGetProtocolRevisionReplyError) \
+    X(onMethodGetComponentSnReply) \
+    X(onMethodGetComponentSnReplyError) \
+    X(onMethodGetDeviceIdReply) \
+    X(onMethodGetDeviceIdReplyError) \
+    X(onMethodStatBikeReply) \
+    X(onMethodStatBikeReplyError) \
+    X(onMethodSwitchServiceModeReply) \
+    X(onMethodSwitchServiceModeReplyError) \
+    X(onMethodSetConsoleStateReply) \
+    X(onMethodSetConsoleStateReplyError) \
+    X(onMethodSetRidingParamReply) \
+    X(onMethodSetRidingParamReplyError) \
+    X(onMethodSetTorqueReply) \
+    X(onMethodSetTorqueReplyError) \
+    X(onMethodSeizeKnobControlReply) \
+    X(onMethodSeizeKnobControlReplyError) \
+    X(onMethodSetKnobDisplayModeReply) \
+    X(onMethodSetKnobDisplayModeReplyError) \
+    X(onMethodSetErgModeReply) \
+    X(onMethodSetErgModeReplyError) \
+    X(onMethodNotifyStrengthDataInvoke) \
+    X(onMethodSetStrengthEquipmentModeReply) \
+    X(onMethodSetStrengthEquipmentModeReplyError) \
+    X(onMethodNotifyRowermDataInvoke) \
+    X(onMethodSetRowermModeReply) \
+    X(onMethodSetRowermModeReplyError) \
+    X(onMethodNotifyXbikeDataInvoke) \
+    X(onMethodMcFirmwareInfoReply) \
+    X(onMethodMcFirmwareInfoReplyError) \
+    X(onMethodGetMtuReply) \
+    X(onMethodGetMtuReplyError) \
+    X(onMethodMcFirmwareContentReply) \
+    X(onMethodMcFirmwareContentReplyError) \
+    X(onMethodMcFirmwareTransferEndReply) \
+    X(onMethodMcFirmwareTransferEndReplyError) \
+    X(onMethodMcFirmwareResultReply) \
+    X(onMethodMcFirmwareResultReplyError)
+
+namespace gimkit {
+
+/**
+ * The callbacks a MethodDispatcher handler handles, as pointers to the GKMethodTable fields, see
+ * MethodDispatcher.
+ */
+template <auto... Callbacks>
+struct MethodCallbacks;
+
+namespace detail {
+
+template <auto A, auto B>
+struct SameCallback : std::false_type {};
+template <auto A>
+struct SameCallback<A, A> : std::true_type {};
+
+template <typename Handler, typename = void>
+struct HasCallbacks : std::false_type {};
+template <typename Handler>
+struct HasCallbacks<Handler, std::void_t<typename Handler::Callbacks>> : std::true_type {};
+
+// One caller per callback: calls Handler::name() when Handler lists the callback, does nothing
+// otherwise. A listed callback without a member function taking its arguments, a misspelled or
+// wrongly typed one, and a member function of a callback not listed, don't compile.
+#define GK_METHOD_CALLER(name) \
+    struct name##Caller { \
+        template <typename H, typename... Args> \
+        static auto callable(int) -> decltype(std::declval<H &>().name(std::declval<Args>()...), std::true_type()); \
+        template <typename H, typename... Args> \
+        static std::false_type callable(long); \
+        template <typename H> \
+        static auto declared(int) -> decltype(&H::name, std::true_type()); \
+        template <typename H> \
+        static std::false_type declared(long); \
+        template <typename H, typename... Args> \
+        static void call(H &handler, Args... args) { \
+            constexpr bool isCallable = decltype(callable<H, Args...>(0))::value; \
+            if constexpr (H::Callbacks::template contains<&GKMethodTable::name>) { \
+                static_assert(isCallable, "the handler lists " #name " but has no member function " #name \
+                                          " taking its arguments"); \
+                if constexpr (isCallable) { \
+                    handler.name(args...); \
+                } \
+            } else { \
+                static_assert(!isCallable && !decltype(declared<H>(0))::value, \
+                              "the handler declares " #name " but doesn't list it in its Callbacks"); \
+            } \
+        } \
+    };
+GK_METHOD_TABLE_CALLBACKS(GK_METHOD_CALLER)
+#undef GK_METHOD_CALLER
+
+// The opid of the method each reply callback ends, -1 for the other callbacks.
+template <auto Callback>
+struct ReplyOf {
+    static constexpr int opid = -1;
+};
+#define GK_METHOD_REPLY_OF(callback, method_) \
+    template <> \
+    struct ReplyOf<&GKMethodTable::callback> { \
+        static constexpr int opid = method::method_::opid; \
+    };
+GK_LATENCY_REPLY_CALLBACKS(GK_METHOD_REPLY_OF)
+#undef GK_METHOD_REPLY_OF
+
+template <typename Handler>
+constexpr GKMethodTable makeMethodTable() {
+    GKMethodTable table{};
+#define GK_METHOD_THUNK(name) \
+    table.name = [](const void *any, auto... args) { \
+        if constexpr (ReplyOf<&GKMethodTable::name>::opid >= 0) { \
+            gk_latency_mark_reply(static_cast<uint8_t>(ReplyOf<&GKMethodTable::name>::opid)); \
+        } \
+        name##Caller::call(*static_cast<Handler *>(const_cast<void *>(any)), args...); \
+    };
+    GK_METHOD_TABLE_CALLBACKS(GK_METHOD_THUNK)
+#undef GK_METHOD_THUNK
+    return table;
+}
+
+} // namespace detail
+
+template <auto... Callbacks>
+struct MethodCallbacks {
+    template <auto Callback>
+    static constexpr bool contains = (detail::SameCallback<Callback, Callbacks>::value || ...);
+};
+
+/**
+ * Dispatch the methods disassembled by the core straight to the member functions of 'Handler'.
+ * <p/>
+ * Handler lists the callbacks it wants in its 'Callbacks' type, and declares a member function for each,
+ * named after the GKMethodTable field and taking the same parameters minus 'any', e.g.
+ *
+ *     struct Telemetry {
+ *         using Callbacks = gimkit::MethodCallbacks<&GKMethodTable::onMethodNotifyGimKitDataInvoke>;
+ *         void onMethodNotifyGimKitDataInvoke(const GimkitData *data) { power = data->power; }
+ *         int power = 0;
+ *     };
+ *
+ * The callbacks it doesn't list are ignored. A listed callback it has no matching member function for,
+ * and a member function named after a callback it doesn't list, are compile errors, so a misspelled or
+ * wrongly typed member function isn't silently left uncalled. The method table is built at compile time, one thunk
+ * per callback instantiated for Handler, so each handler member function is inlined into the thunk
+ * the core calls instead of being reached through a second indirect call. The reply thunks end the
+ * invocation of their method for GKLatency, see #gk_latency_mark_reply(), whether Handler declares
+ * them or not.
+ */
+template <typename Handler>
+class MethodDispatcher {
+    static_assert(detail::HasCallbacks<Handler>::value,
+                  "the handler lists the callbacks it handles in a gimkit::MethodCallbacks named Callbacks");
+
+public:
+    static constexpr GKMethodTable kTable = detail::makeMethodTable<Handler>();
+
+    explicit MethodDispatcher(Handler &handler) noexcept : handler_(handler) {}
+
+    Handler &handler() const noexcept { return handler_; }
+
+    /**
+     * Disassemble one decoded frame, see #disassembleMethod().
+     */
+    size_t dispatch(span<const uint8_t> frame) const {
+        return disassembleMethod(&handler_, &kTable, frame.data(), frame.size());
+    }
+
+    /**
+     * Feed a piece of SLIP encoded data to 'device' and dispatch every frame it completes.
+     */
+    slip_dev_status_t decode(SlipDevice &device, span<const uint8_t> chunk) const {
+        return device.decode(chunk, [this](span<const uint8_t> frame) { dispatch(frame); });
+    }
+
+private:
+    Handler &handler_;
+};
+
+} // namespace gimkit
+
+#endif //GIMKIT_GKMETHODDISPATCHER_HPP
@@ -0,0 +1,225 @@
+//
+// GKReplay.c
+// Feed a GKCapture file back through sd_decode_frame() and disassembleMethod().
+//
+
+#include "GKReplay.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "slipdev.h"
+#include "GKLatency.h"
+#include "GKMethods.h"
+#include "GKTrace.h"
+
+enum {
+#define METHOD(opid, bomi, bomr, invoke, reply, name, desc) REPLAY_OPID_##name = (opid),
+#include "Methods.h"
+#undef METHOD
+};
+
+typedef struct ReplayContext {
+    const GKMethodTable *mtab;
+    const void *any;
+    GKReplayStats *stats;
+    /** Forwards to 'mtab' when the latency is recorded */
+    GKLatencyTap tap;
+    /** Timestamp of the record being decoded */
+    uint64_t timestamp;
+    /**
+     * Per opid, timestamp + 1 of the host to device record that ended its last invocation no reply
+     * has answered yet, 0 if none
+     */
+    uint64_t invoked[256];
+} ReplayContext;
+
+typedef struct AssembledFrame {
+    uint8_t bytes[64];
+    size_t length;
+} AssembledFrame;
+
+static void onAssembled(uint8_t *frame, size_t count, const void *any) {
+    AssembledFrame *assembled = (AssembledFrame *) any;
+    assembled->length = count <= sizeof(assembled->bytes) ? count : 0;
+    if (assembled->length) {
+        memcpy(assembled->bytes, frame, count);
+    }
+}
+
+/**
+ * Offset of the opid in the frames the core assembles, -1 if it can't be told. Found once, from two
+ * frames of the same size told apart by their opid only.
+ */
+static int opidOffset(void) {
+    static _Atomic int learned = -2;
+    int offset = atomic_load_explicit(&learned, memory_order_relaxed);
+    if (offset != -2) {
+        return offset;
+    }
+    offset = -1;
+    AssembledFrame handshake = { .length = 0 }, revision = { .length = 0 };
+    if (assembleMethodHandshakeInvoke(onAssembled, &handshake) &&
+        assembleMethodGetProtocolRevisionInvoke(onAssembled, &revision) && handshake.length &&
+        handshake.length == revision.length) {
+        for (size_t i = 0; i < handshake.length; i++) {
+            if (handshake.bytes[i] == REPLAY_OPID_HANDSHAKE && revision.bytes[i] == REPLAY_OPID_GET_PROTO_REVISION) {
+                offset = (int) i;
+                break;
+            }
+        }
+    }
+    atomic_store_explicit(&learned, offset, memory_order_relaxed);
+    return offset;
+}
+
+bool gk_replay_frame_opid(const uint8_t *frame, size_t length, uint8_t *opid) {
+    int offset = opidOffset();
+    if (!frame || offset < 0 || (size_t) offset >= length) {
+        return false;
+    }
+    if (opid) {
+        *opid = frame[offset];
+    }
+    return true;
+}
+
+static uint64_t monotonicNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t deadline) {
+    uint64_t now = monotonicNanos();
+    if (deadline > now) {
+        uint64_t delay = deadline - now;
+        struct timespec ts = { (time_t) (delay / 1000000000u), (long) (delay % 1000000000u) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void onFrameDecoded(const struct slip_dev_t *sd, const uint8_t *buf, size_t length,
+                           slip_dev_status_t status, const void *any) {
+    (void) sd;
+    const ReplayContext *context = any;
+    if (status != SDS_OK) {
+        context->stats->badFrames++;
+        return;
+    }
+    context->stats->frames++;
+    GK_TRACE_SCOPE(GK_TRACE_DISASSEMBLE);
+    if (context->tap.mtab) {
+        disassembleMethod(&context->tap, gk_latency_tap_table(), buf, length);
+    } else {
+        disassembleMethod(context->any, context->mtab, buf, length);
+    }
+}
+
+static void onHostFrameDecoded(const struct slip_dev_t *sd, const uint8_t *buf, size_t length,
+                               slip_dev_status_t status, const void *any) {
+    (void) sd;
+    ReplayContext *context = (ReplayContext *) any;
+    uint8_t opid;
+    if (status == SDS_OK && gk_replay_frame_opid(buf, length, &opid)) {
+        context->invoked[opid] = context->timestamp + 1;
+    }
+}
+
+static void onReplyDecoded(const GKLatencyTap *tap, uint8_t opid) {
+    ReplayContext *context = tap->context;
+    if (context->invoked[opid]) {
+        gk_latency_record(opid, context->timestamp + 1 - context->invoked[opid]);
+        context->invoked[opid] = 0;
+    }
+}
+
+void gk_replay_default_options(GKReplayOptions *options) {
+    if (options) {
+        options->speed = 0;
+        options->repeat = 1;
+        options->toDevice = false;
+        options->from = 0;
+        options->to = 0;
+        options->maxFrameDataSize = GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE;
+        options->latency = false;
+    }
+}
+
+bool gk_replay_run(struct gk_capture_reader *reader, const struct GKMethodTable *mtab, const void *any,
+                   const GKReplayOptions *options, GKReplayStats *stats) {
+    GKReplayOptions defaults;
+    if (!options) {
+        gk_replay_default_options(&defaults);
+        options = &defaults;
+    }
+    GKReplayStats ignored;
+    if (!stats) {
+        stats = &ignored;
+    }
+    *stats = (GKReplayStats) { 0 };
+    if (!reader || !mtab) {
+        return false;
+    }
+
+    size_t maxFrameDataSize = options->maxFrameDataSize ? options->maxFrameDataSize : GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE;
+    size_t memorySize = sd_get_required_memory_size(maxFrameDataSize);
+    bool latency = options->latency && !options->toDevice;
+    // With the latency, a second device decodes the host frames for their opid.
+    struct slip_dev_t *sd = memorySize ? malloc(memorySize) : NULL;
+    struct slip_dev_t *hostSd = memorySize && latency ? malloc(memorySize) : NULL;
+    if (!sd || sd_init_device(sd, maxFrameDataSize) != SDS_OK ||
+        (latency && (!hostSd || sd_init_device(hostSd, maxFrameDataSize) != SDS_OK))) {
+        free(sd);
+        free(hostSd);
+        return false;
+    }
+
+    GKCaptureDirection direction = options->toDevice ? GK_CAPTURE_TO_DEVICE : GK_CAPTURE_FROM_DEVICE;
+    ReplayContext context = { .mtab = mtab, .any = any, .stats = stats };
+    if (latency) {
+        context.tap = (GKLatencyTap) { mtab, any, onReplyDecoded, &context };
+    }
+    uint32_t passes = options->repeat ? options->repeat : 1;
+    uint64_t started = monotonicNanos();
+
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        uint64_t passStarted = monotonicNanos();
+        if (gk_capture_seek(reader, options->from) != GK_CAPTURE_OK) {
+            break;
+        }
+        memset(context.invoked, 0, sizeof(context.invoked));
+        GKCaptureRecord record;
+        while (gk_capture_next(reader, &record) == GK_CAPTURE_OK) {
+            if (options->to && record.timestamp > options->to) {
+                break;
+            }
+            if (record.direction != direction) {
+                if (latency && record.direction == GK_CAPTURE_TO_DEVICE) {
+                    context.timestamp = record.timestamp;
+                    sd_decode_frame(hostSd, record.data, record.length, onHostFrameDecoded, &context);
+                }
+                continue;
+            }
+            if (options->speed > 0) {
+                sleepUntil(passStarted + (uint64_t) ((double) (record.timestamp - options->from) * 1000.0 / options->speed));
+            }
+            stats->records++;
+            stats->bytes += record.length;
+            context.timestamp = record.timestamp;
+            GK_TRACE_SCOPE(GK_TRACE_SLIP_DECODE);
+            sd_decode_frame(sd, record.data, record.length, onFrameDecoded, &context);
+        }
+    }
+
+    stats->elapsed = monotonicNanos() - started;
+    sd_deinit_device(sd);
+    free(sd);
+    if (hostSd) {
+        sd_deinit_device(hostSd);
+        free(hostSd);
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+//
+// GKReplay.h
+// Feed a GKCapture file back through sd_decode_frame() and disassembleMethod().
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKREPLAY_H
+#define GIMKIT_GKREPLAY_H
+
+#include <stdint.h> // for uint64_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#include "GKCapture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** See GKMethods.h */
+struct GKMethodTable;
+
+/**
+ * Default size of the biggest decoded frame, see #sd_get_required_memory_size().
+ */
+#define GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE 512
+
+typedef struct GKReplayOptions {
+    /**
+     * Pace of the replay relative to the capture timestamps: 1 replays at wire speed, 2 twice as fast,
+     * 0 as fast as possible.
+     */
+    double speed;
+    /**
+     * Number of passes over the capture, 0 is treated as 1.
+     */
+    uint32_t repeat;
+    /**
+     * Replay the host to device traffic instead of the device to host one.
+     */
+    bool toDevice;
+    /**
+     * Start of the replayed window, in microseconds since the start of the capture.
+     */
+    uint64_t from;
+    /**
+     * End of the replayed window, 0 to replay up to the end.
+     */
+    uint64_t to;
+    /**
+     * See #GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE, 0 to use the default.
+     */
+    size_t maxFrameDataSize;
+    /**
+     * Record the round trip of every reply into the GKLatency histograms, on the capture clock: from
+     * the host to device record that ended the last invocation of the same method to the reply
+     * record. The host frames are decoded for their opid, see #gk_replay_frame_opid(); a reply with
+     * no invocation pending is not recorded. Device to host replays only.
+     */
+    bool latency;
+} GKReplayOptions;
+
+typedef struct GKReplayStats {
+    /** Capture records fed to the SLIP decoder */
+    uint64_t records;
+    uint64_t bytes;
+    /** Frames decoded successfully and handed to disassembleMethod() */
+    uint64_t frames;
+    /** Frames rejected by the SLIP decoder (SDS_BAD_FRAME, SDS_TOO_LARGE) */
+    uint64_t badFrames;
+    /** Wall clock time spent replaying, in nanoseconds */
+    uint64_t elapsed;
+} GKReplayStats;
+
+/***
+ * Fill 'options' with the defaults: as fast as possible, one pass, device to host traffic, whole capture.
+ */
+void gk_replay_default_options(GKReplayOptions *options);
+
+/***
+ * Replay the traffic of one direction of a capture.
+ * <p/>
+ * Every record payload is fed to one slip device as it was received from the characteristic; every
+ * decoded frame is passed to #disassembleMethod() with 'mtab' and 'any', on the calling thread. The
+ * SLIP decoding and method dispatch are traced with GKTrace when tracing is enabled.
+ *
+ * @param reader An open capture. It is rewound first, and left at the end of the replayed window.
+ * @param mtab The method table receiving the decoded methods.
+ * @param any Opaque pointer handed to every method table callback.
+ * @param options Replay options, NULL for #gk_replay_default_options().
+ * @param stats Receives the replay figures, may be NULL.
+ * @return false if the slip device can't be set up.
+ */
+bool gk_replay_run(struct gk_capture_reader *reader, const struct GKMethodTable *mtab, const void *any,
+                   const GKReplayOptions *options, GKReplayStats *stats);
+
+/***
+ * The opid of a decoded method frame.
+ * <p/>
+ * Its offset in the frame is found once, from frames the core assembles.
+ *
+ * @return false if the frame is too short, or the offset can't be told.
+ */
+bool gk_replay_frame_opid(const uint8_t *frame, size_t length, uint8_t *opid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKREPLAY_H
@@ -0,0 +1,127 @@
+//
+// GKSlipDevice.hpp
+// Header only RAII wrapper of a slip device, with the frame handling inlined into the callbacks.
+//
+#ifndef GIMKIT_GKSLIPDEVICE_HPP
+#define GIMKIT_GKSLIPDEVICE_HPP
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#include "GKCore.hpp"
+
+namespace gimkit {
+
+/**
+ * A slip device owning its memory, sized by #sd_get_required_memory_size().
+ * <p/>
+ * The callbacks are any callable: they are invoked through a thunk instantiated for their type, so
+ * the compiler sees through the function pointer handed to the core and can inline them, unlike a
+ * hand written sd_decode_cb reading its state back from 'any'. They are called synchronously, during
+ * #decode() / #encode(), on the calling thread.
+ */
+class SlipDevice {
+public:
+    /** See #GK_REPLAY_DEFAULT_MAX_FRAME_DATA_SIZE */
+    static constexpr size_t kDefaultMaxFrameDataSize = 512;
+
+    /**
+     * @throws std::bad_alloc if the memory can't be allocated, std::runtime_error if the core rejects
+     * 'maxFrameDataSize'.
+     */
+    explicit SlipDevice(size_t maxFrameDataSize = kDefaultMaxFrameDataSize) : maxFrameDataSize_(maxFrameDataSize) {
+        size_t size = sd_get_required_memory_size(maxFrameDataSize);
+        if (!size) {
+            throw std::runtime_error("invalid slip device frame size");
+        }
+        memory_.reset(new std::max_align_t[(size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+        if (sd_init_device(device(), maxFrameDataSize) != SDS_OK) {
+            throw std::runtime_error("slip device initialization failed");
+        }
+    }
+
+    ~SlipDevice() {
+        if (memory_) {
+            sd_deinit_device(device());
+        }
+    }
+
+    SlipDevice(SlipDevice &&) noexcept = default;
+    SlipDevice &operator=(SlipDevice &&other) noexcept {
+        if (this != &other) {
+            if (memory_) {
+                sd_deinit_device(device());
+            }
+            memory_ = std::move(other.memory_);
+            maxFrameDataSize_ = other.maxFrameDataSize_;
+        }
+        return *this;
+    }
+    SlipDevice(const SlipDevice &) = delete;
+    SlipDevice &operator=(const SlipDevice &) = delete;
+
+    struct slip_dev_t *device() const noexcept {
+        return reinterpret_cast<struct slip_dev_t *>(memory_.get());
+    }
+
+    size_t maxFrameDataSize() const noexcept { return maxFrameDataSize_; }
+
+    /**
+     * Feed a piece of SLIP encoded data, see #sd_decode_frame().
+     *
+     * @param onFrame Called for every frame completed by 'chunk', either as onFrame(span<const uint8_t>)
+     * for the well formed frames only, or as onFrame(span<const uint8_t>, slip_dev_status_t) for all of
+     * them.
+     */
+    template <typename OnFrame>
+    slip_dev_status_t decode(span<const uint8_t> chunk, OnFrame &&onFrame) {
+        using Callable = std::remove_reference_t<OnFrame>;
+        return sd_decode_frame(device(), chunk.data(), chunk.size(), &thunk<Callable>, std::addressof(onFrame));
+    }
+
+    /**
+     * Encode one frame, see #sd_encode_frame(). 'onFrame' is called as for #decode().
+     */
+    template <typename OnFrame>
+    slip_dev_status_t encode(span<const uint8_t> frame, OnFrame &&onFrame) {
+        using Callable = std::remove_reference_t<OnFrame>;
+        return sd_encode_frame(device(), frame.data(), frame.size(), &thunk<Callable>, std::addressof(onFrame));
+    }
+
+    /**
+     * The largest encoding of 'size' bytes: every byte escaped, plus the delimiters.
+     */
+    static constexpr size_t maxEncodedSize(size_t size) noexcept { return size * 2 + 2; }
+
+    /**
+     * Encode one frame into 'out', see #sd_encode_frame_to_buffer().
+     * @return the encoded size, 0 if 'out' is too small.
+     */
+    static size_t encodeTo(span<const uint8_t> frame, span<uint8_t> out) noexcept {
+        return sd_encode_frame_to_buffer(frame.data(), frame.size(), out.data(), out.size());
+    }
+
+private:
+    template <typename Callable>
+    static void thunk(const struct slip_dev_t *, const uint8_t *buf, size_t length, slip_dev_status_t status,
+                      const void *any) {
+        auto &callable = *static_cast<Callable *>(const_cast<void *>(any));
+        span<const uint8_t> frame(buf, length);
+        if constexpr (std::is_invocable_v<Callable &, span<const uint8_t>, slip_dev_status_t>) {
+            callable(frame, status);
+        } else {
+            if (status == SDS_OK) {
+                callable(frame);
+            }
+        }
+    }
+
+    std::unique_ptr<std::max_align_t[]> memory_;
+    size_t maxFrameDataSize_;
+};
+
+} // namespace gimkit
+
+#endif //GIMKIT_GKSLIPDEVICE_HPP
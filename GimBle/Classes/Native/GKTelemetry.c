@@ -0,0 +1,276 @@
+//
+// GKTelemetry.c
+// Telemetry samples of every device type in one shape, and a lock-free queue to hand them over.
+//
+
+#include "GKTelemetry.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slipdev.h"
+#include "GKMethods.h"
+#include "GKTrace.h"
+
+// Flag bits of the payloads that have one, in the order of their fields, see GKMethods.h.
+#define STRENGTH_TENSION     (1u << 0)
+#define STRENGTH_SPEED       (1u << 1)
+#define STRENGTH_POWER       (1u << 2)
+#define STRENGTH_POSITION    (1u << 3)
+#define STRENGTH_TEMPERATURE (1u << 5)
+
+#define ROWERM_TORQUE_RT     (1u << 3)
+#define ROWERM_FORCE         (1u << 4)
+#define ROWERM_DRAWSTRING    (1u << 6)
+#define ROWERM_STROKE_RATE   (1u << 9)
+#define ROWERM_SHIP_SPEED    (1u << 10)
+#define ROWERM_POWER         (1u << 11)
+
+#define XBIKE_CADENCE        (1u << 0)
+#define XBIKE_POWER          (1u << 1)
+#define XBIKE_TORQUE         (1u << 2)
+#define XBIKE_HEART_RATE     (1u << 3)
+#define XBIKE_DISTANCE       (1u << 4)
+#define XBIKE_CALORIE        (1u << 5)
+
+typedef struct Slot {
+    /** The push index the slot is free for, or that push index + 1 once the sample is written */
+    _Atomic size_t sequence;
+    GKTelemetrySample sample;
+} Slot;
+
+struct gk_telemetry_queue {
+    // The producer and the consumer indexes live on their own cache lines.
+    _Alignas(64) _Atomic size_t head;
+    _Alignas(64) _Atomic size_t tail;
+    _Alignas(64) _Atomic uint64_t dropped;
+    _Atomic bool closed;
+    size_t mask;
+    Slot *slots;
+};
+
+void gk_telemetry_from_gimkit(const GimkitData *data, GKTelemetrySample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    sample->present = GK_TELEMETRY_CADENCE | GK_TELEMETRY_POWER | GK_TELEMETRY_SPEED | GK_TELEMETRY_DISTANCE
+                      | GK_TELEMETRY_CALORIES | GK_TELEMETRY_TEMPERATURE | GK_TELEMETRY_TORQUE;
+    sample->cadence = data->cadence;
+    sample->power = data->power / 10.0f;
+    sample->speed = data->speed / 3600.0f;
+    sample->distance = (float) data->distance;
+    sample->calories = data->calorie / 1000.0f;
+    sample->temperature = data->temperature / 10.0f;
+    sample->torque = data->torque / 2.0f;
+    if (data->bpm != 0) {
+        sample->present |= GK_TELEMETRY_HEART_RATE;
+        sample->heartRate = data->bpm;
+    }
+}
+
+void gk_telemetry_from_strength(const StrengthData *data, GKTelemetrySample *sample) {
+    // Signed on the wire, the direction of the cable is not recorded.
+    gk_telemetry_from_strength_values(data->flag, data->tension, (int16_t) data->speed / 1000.0f, data->power / 10.0f,
+                                      data->position / 1000.0f, data->mcTemperature / 10.0f, sample);
+}
+
+void gk_telemetry_from_strength_values(uint32_t flag, float tension, float speed, float power, float position,
+                                       float mcTemperature, GKTelemetrySample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    if (flag & STRENGTH_TENSION) {
+        sample->present |= GK_TELEMETRY_TENSION;
+        sample->tension = tension;
+    }
+    if (flag & STRENGTH_SPEED) {
+        sample->present |= GK_TELEMETRY_SPEED;
+        sample->speed = fabsf(speed);
+    }
+    if (flag & STRENGTH_POWER) {
+        sample->present |= GK_TELEMETRY_POWER;
+        sample->power = power;
+    }
+    if (flag & STRENGTH_POSITION) {
+        sample->present |= GK_TELEMETRY_POSITION;
+        sample->position = position;
+    }
+    if (flag & STRENGTH_TEMPERATURE) {
+        sample->present |= GK_TELEMETRY_MOTOR_TEMPERATURE;
+        sample->motorTemperature = mcTemperature;
+    }
+}
+
+void gk_telemetry_from_rowerm(const RowermData *data, GKTelemetrySample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    if (data->flag & ROWERM_TORQUE_RT) {
+        sample->present |= GK_TELEMETRY_TORQUE;
+        sample->torque = data->torqueRT / 2.0f;
+    }
+    if (data->flag & ROWERM_FORCE) {
+        sample->present |= GK_TELEMETRY_FORCE;
+        sample->force = data->force / 10.0f;
+    }
+    if (data->flag & ROWERM_DRAWSTRING) {
+        sample->present |= GK_TELEMETRY_DRAWSTRING_DISTANCE;
+        sample->drawstringDistance = data->drawstringDistance / 100.0f;
+    }
+    if (data->flag & ROWERM_STROKE_RATE) {
+        sample->present |= GK_TELEMETRY_CADENCE;
+        sample->cadence = data->strokeRate;
+    }
+    if (data->flag & ROWERM_SHIP_SPEED) {
+        sample->present |= GK_TELEMETRY_SPEED;
+        sample->speed = data->shipSpeed / 10.0f;
+    }
+    if (data->flag & ROWERM_POWER) {
+        sample->present |= GK_TELEMETRY_POWER;
+        sample->power = data->power / 10.0f;
+    }
+}
+
+void gk_telemetry_from_xbike(const XbikeData *data, GKTelemetrySample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    if (data->flag & XBIKE_CADENCE) {
+        sample->present |= GK_TELEMETRY_CADENCE;
+        sample->cadence = data->cadence;
+    }
+    if (data->flag & XBIKE_POWER) {
+        sample->present |= GK_TELEMETRY_POWER;
+        sample->power = data->power / 10.0f;
+    }
+    if (data->flag & XBIKE_TORQUE) {
+        sample->present |= GK_TELEMETRY_TORQUE;
+        sample->torque = data->torque / 10.0f;
+    }
+    if (data->flag & XBIKE_HEART_RATE) {
+        sample->present |= GK_TELEMETRY_HEART_RATE;
+        sample->heartRate = data->heartRate;
+    }
+    if (data->flag & XBIKE_DISTANCE) {
+        sample->present |= GK_TELEMETRY_DISTANCE;
+        sample->distance = (float) data->totalDistance;
+    }
+    if (data->flag & XBIKE_CALORIE) {
+        sample->present |= GK_TELEMETRY_CALORIES;
+        sample->calories = data->totalCalorie / 1000.0f;
+    }
+}
+
+GKTelemetryQueue *gk_telemetry_queue_create(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    GKTelemetryQueue *queue = NULL;
+    if (posix_memalign((void **) &queue, 64, sizeof(GKTelemetryQueue)) != 0) {
+        return NULL;
+    }
+    queue->slots = malloc(size * sizeof(Slot));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    queue->mask = size - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->closed, false);
+    return queue;
+}
+
+void gk_telemetry_queue_destroy(GKTelemetryQueue *queue) {
+    if (queue) {
+        free(queue->slots);
+        free(queue);
+    }
+}
+
+void gk_telemetry_queue_close(GKTelemetryQueue *queue) {
+    atomic_store_explicit(&queue->closed, true, memory_order_relaxed);
+}
+
+size_t gk_telemetry_queue_push(GKTelemetryQueue *queue, const GKTelemetrySample *sample) {
+    if (atomic_load_explicit(&queue->closed, memory_order_relaxed)) {
+        return 0;
+    }
+    // Claim the slot at 'tail' by moving 'tail' past it, then publish the sample through the
+    // sequence of the slot: the producers never wait for each other.
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &queue->slots[tail & queue->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == tail) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &tail, tail + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if ((ptrdiff_t) (sequence - tail) < 0) {
+            // Not popped yet since the previous lap: full.
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return 0;
+        } else {
+            tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    slot->sample = *sample;
+    slot->sample.timeNs = gk_trace_now_ns();
+    atomic_store_explicit(&slot->sequence, tail + 1, memory_order_release);
+    // The consumer may already have popped it, and the samples of other producers after it.
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head <= tail ? tail + 1 - head : 1;
+}
+
+size_t gk_telemetry_queue_pop(GKTelemetryQueue *queue, GKTelemetrySample *samples, size_t max) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t count = 0;
+    // Up to the first slot claimed but not written yet.
+    while (count < max) {
+        Slot *slot = &queue->slots[(head + count) & queue->mask];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + count + 1) {
+            break;
+        }
+        samples[count] = slot->sample;
+        atomic_store_explicit(&slot->sequence, head + count + queue->mask + 1, memory_order_release);
+        count++;
+    }
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+    return count;
+}
+
+size_t gk_telemetry_queue_count(const GKTelemetryQueue *queue) {
+    GKTelemetryQueue *mutableQueue = (GKTelemetryQueue *) queue;
+    size_t tail = atomic_load_explicit(&mutableQueue->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&mutableQueue->head, memory_order_acquire);
+    return tail - head;
+}
+
+uint64_t gk_telemetry_queue_dropped(const GKTelemetryQueue *queue) {
+    return atomic_load_explicit(&((GKTelemetryQueue *) queue)->dropped, memory_order_relaxed);
+}
+
+void gk_telemetry_queue_push_gimkit(const void *any, const GimkitData *data) {
+    GKTelemetrySample sample;
+    gk_telemetry_from_gimkit(data, &sample);
+    gk_telemetry_queue_push((GKTelemetryQueue *) any, &sample);
+}
+
+void gk_telemetry_queue_push_strength(const void *any, const StrengthData *data) {
+    GKTelemetrySample sample;
+    gk_telemetry_from_strength(data, &sample);
+    gk_telemetry_queue_push((GKTelemetryQueue *) any, &sample);
+}
+
+void gk_telemetry_queue_push_rowerm(const void *any, const RowermData *data) {
+    GKTelemetrySample sample;
+    gk_telemetry_from_rowerm(data, &sample);
+    gk_telemetry_queue_push((GKTelemetryQueue *) any, &sample);
+}
+
+void gk_telemetry_queue_push_xbike(const void *any, const XbikeData *data) {
+    GKTelemetrySample sample;
+    gk_telemetry_from_xbike(data, &sample);
+    gk_telemetry_queue_push((GKTelemetryQueue *) any, &sample);
+}
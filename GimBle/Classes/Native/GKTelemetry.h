@@ -0,0 +1,165 @@
+//
+// GKTelemetry.h
+// Telemetry samples of every device type in one shape, and a lock-free queue to hand them over.
+//
+// The notify payloads of the core (GimkitData, StrengthData, RowermData, XbikeData) are converted to
+// a GKTelemetrySample in SI units, with a bit per field it holds. A GKTelemetryQueue is a bounded
+// multiple producer, single consumer ring of samples: the threads receiving the telemetry push with
+// a compare and swap and no lock or allocation, a background thread pops them in batches.
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKTELEMETRY_H
+#define GIMKIT_GKTELEMETRY_H
+
+#include <stdint.h> // for uint64_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct GimkitData;
+struct StrengthData;
+struct RowermData;
+struct XbikeData;
+
+/**
+ * Bits of GKTelemetrySample.present.
+ */
+typedef enum GKTelemetryField {
+    GK_TELEMETRY_CADENCE             = 1u << 0,
+    GK_TELEMETRY_POWER               = 1u << 1,
+    GK_TELEMETRY_SPEED               = 1u << 2,
+    GK_TELEMETRY_DISTANCE            = 1u << 3,
+    GK_TELEMETRY_CALORIES            = 1u << 4,
+    GK_TELEMETRY_HEART_RATE          = 1u << 5,
+    GK_TELEMETRY_TEMPERATURE         = 1u << 6,
+    GK_TELEMETRY_TORQUE              = 1u << 7,
+    GK_TELEMETRY_TENSION             = 1u << 8,
+    GK_TELEMETRY_POSITION            = 1u << 9,
+    GK_TELEMETRY_FORCE               = 1u << 10,
+    GK_TELEMETRY_DRAWSTRING_DISTANCE = 1u << 11,
+    GK_TELEMETRY_MOTOR_TEMPERATURE   = 1u << 12,
+    /** Not a value: the end of a lap at timeNs */
+    GK_TELEMETRY_LAP                 = 1u << 15
+} GKTelemetryField;
+
+typedef struct GKTelemetrySample {
+    /** #gk_trace_now_ns() when the sample was pushed, set by the queue */
+    uint64_t timeNs;
+    /** GKTelemetryField bits of the valid fields */
+    uint32_t present;
+    /** rpm, strokes per minute for a rower */
+    float cadence;
+    /** W */
+    float power;
+    /** m/s */
+    float speed;
+    /** m, accumulated */
+    float distance;
+    /** kcal, accumulated */
+    float calories;
+    /** °C */
+    float temperature;
+    /** N·m */
+    float torque;
+    /** N */
+    float tension;
+    /** m */
+    float position;
+    /** kg */
+    float force;
+    /** m */
+    float drawstringDistance;
+    /** °C */
+    float motorTemperature;
+    /** bpm */
+    uint8_t heartRate;
+} GKTelemetrySample;
+
+/***
+ * Convert the notify payloads of the core, see GKMethods.h for their units.
+ */
+void gk_telemetry_from_gimkit(const struct GimkitData *data, GKTelemetrySample *sample);
+
+void gk_telemetry_from_strength(const struct StrengthData *data, GKTelemetrySample *sample);
+
+/***
+ * The values of a StrengthData already scaled to SI units, kept as its 'flag' bits say: N, m/s (of
+ * either sign), W, m and °C.
+ */
+void gk_telemetry_from_strength_values(uint32_t flag, float tension, float speed, float power, float position,
+                                       float mcTemperature, GKTelemetrySample *sample);
+
+void gk_telemetry_from_rowerm(const struct RowermData *data, GKTelemetrySample *sample);
+
+void gk_telemetry_from_xbike(const struct XbikeData *data, GKTelemetrySample *sample);
+
+typedef struct gk_telemetry_queue GKTelemetryQueue;
+
+/***
+ * Create a queue of 'capacity' samples, rounded up to a power of two.
+ *
+ * @return The queue, or NULL if out of memory.
+ */
+GKTelemetryQueue *gk_telemetry_queue_create(size_t capacity);
+
+/***
+ * Destroy the queue. Closing it doesn't make a late push safe: unset the notify callbacks it is the
+ * context of, see #gk_telemetry_queue_push_gimkit(), before destroying it.
+ */
+void gk_telemetry_queue_destroy(GKTelemetryQueue *queue);
+
+/***
+ * Close the queue: the pushes after it are ignored and not counted as dropped, the queued samples can
+ * still be popped.
+ */
+void gk_telemetry_queue_close(GKTelemetryQueue *queue);
+
+/***
+ * Push a sample, stamped with the current time. Any number of threads may push at once.
+ *
+ * @return The number of queued samples with this one, or 0 if the queue was full and the sample was
+ *         dropped, or closed.
+ */
+size_t gk_telemetry_queue_push(GKTelemetryQueue *queue, const GKTelemetrySample *sample);
+
+/***
+ * Pop up to 'max' samples, oldest first. Only one thread may pop at a time.
+ *
+ * @return The number of samples copied to 'samples'.
+ */
+size_t gk_telemetry_queue_pop(GKTelemetryQueue *queue, GKTelemetrySample *samples, size_t max);
+
+/***
+ * Number of queued samples, as seen by the calling thread.
+ */
+size_t gk_telemetry_queue_count(const GKTelemetryQueue *queue);
+
+/***
+ * Number of samples dropped because the queue was full.
+ */
+uint64_t gk_telemetry_queue_dropped(const GKTelemetryQueue *queue);
+
+/***
+ * Push entry points with the signature of the GKMethodTable notify callbacks: set one of them as the
+ * callback and the queue as the 'any' context, and the payloads go straight from the method decoder
+ * into the queue.
+ */
+void gk_telemetry_queue_push_gimkit(const void *any, const struct GimkitData *data);
+
+void gk_telemetry_queue_push_strength(const void *any, const struct StrengthData *data);
+
+void gk_telemetry_queue_push_rowerm(const void *any, const struct RowermData *data);
+
+void gk_telemetry_queue_push_xbike(const void *any, const struct XbikeData *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GIMKIT_GKTELEMETRY_H
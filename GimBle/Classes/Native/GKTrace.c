@@ -0,0 +1,278 @@
+//
+// GKTrace.c
+// Lightweight scoped trace events, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+
+#if !defined(__APPLE__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for pthread_getname_np
+#endif
+
+#include "GKTrace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if !defined(__APPLE__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef enum {
+    PHASE_COMPLETE = 'X',
+    PHASE_INSTANT = 'i'
+} TracePhase;
+
+typedef struct TraceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+    uint8_t phase;
+} TraceEvent;
+
+/**
+ * Ring buffer owned by one thread. It's written by its owner only, and read by the exporter. Buffers are
+ * never freed: when the owner exits the buffer is released and the next new thread reuses it.
+ * <p/>
+ * #gk_trace_clear() doesn't touch the buffers, it starts a new epoch: the owner moves 'base' up to its
+ * head when it records its first event of the new epoch, and the exporter skips the buffers whose
+ * owner hasn't yet.
+ */
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    atomic_bool inUse;
+    uint64_t tid;
+    char threadName[64];
+    /** Number of events written so far, the slot of the next event is head & (capacity - 1) */
+    _Atomic uint64_t head;
+    /** The head when the owner entered 'epoch': the events before it were cleared */
+    _Atomic uint64_t base;
+    _Atomic uint64_t epoch;
+    size_t capacity;
+    TraceEvent *events;
+} TraceBuffer;
+
+static atomic_bool sEnabled = false;
+static _Atomic size_t sCapacity = GK_TRACE_DEFAULT_CAPACITY;
+static _Atomic(TraceBuffer *) sBuffers = NULL;
+static _Atomic uint64_t sEpoch = 0;
+static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sKey;
+static _Thread_local TraceBuffer *tBuffer = NULL;
+
+static void releaseBuffer(void *buffer) {
+    atomic_store_explicit(&((TraceBuffer *) buffer)->inUse, false, memory_order_release);
+}
+
+static void createKey(void) {
+    pthread_key_create(&sKey, releaseBuffer);
+}
+
+static uint64_t currentThreadId(void) {
+#if defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return tid;
+#else
+    return (uint64_t) syscall(SYS_gettid);
+#endif
+}
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) power <<= 1;
+    return power;
+}
+
+static TraceBuffer *claimBuffer(void) {
+    size_t capacity = atomic_load_explicit(&sCapacity, memory_order_relaxed);
+    TraceBuffer *buffer = atomic_load_explicit(&sBuffers, memory_order_acquire);
+    for (; buffer; buffer = buffer->next) {
+        bool expected = false;
+        if (buffer->capacity == capacity
+            && atomic_compare_exchange_strong_explicit(&buffer->inUse, &expected, true,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+            atomic_store_explicit(&buffer->head, 0, memory_order_relaxed);
+            atomic_store_explicit(&buffer->base, 0, memory_order_relaxed);
+            atomic_store_explicit(&buffer->epoch, atomic_load_explicit(&sEpoch, memory_order_relaxed),
+                                  memory_order_release);
+            return buffer;
+        }
+    }
+
+    buffer = calloc(1, sizeof(TraceBuffer));
+    TraceEvent *events = buffer ? calloc(capacity, sizeof(TraceEvent)) : NULL;
+    if (!events) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->events = events;
+    buffer->capacity = capacity;
+    atomic_init(&buffer->inUse, true);
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->base, 0);
+    atomic_init(&buffer->epoch, atomic_load_explicit(&sEpoch, memory_order_relaxed));
+
+    TraceBuffer *first = atomic_load_explicit(&sBuffers, memory_order_relaxed);
+    do {
+        buffer->next = first;
+    } while (!atomic_compare_exchange_weak_explicit(&sBuffers, &first, buffer,
+                                                    memory_order_release, memory_order_relaxed));
+    return buffer;
+}
+
+static TraceBuffer *threadBuffer(void) {
+    if (tBuffer) {
+        return tBuffer;
+    }
+    pthread_once(&sKeyOnce, createKey);
+    TraceBuffer *buffer = claimBuffer();
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->tid = currentThreadId();
+    buffer->threadName[0] = '\0';
+    pthread_getname_np(pthread_self(), buffer->threadName, sizeof(buffer->threadName));
+    pthread_setspecific(sKey, buffer);
+    tBuffer = buffer;
+    return buffer;
+}
+
+static void record(const char *name, uint8_t phase, uint64_t start, uint64_t duration) {
+    TraceBuffer *buffer = threadBuffer();
+    if (!buffer) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    uint64_t epoch = atomic_load_explicit(&sEpoch, memory_order_relaxed);
+    if (atomic_load_explicit(&buffer->epoch, memory_order_relaxed) != epoch) {
+        atomic_store_explicit(&buffer->base, head, memory_order_relaxed);
+        atomic_store_explicit(&buffer->epoch, epoch, memory_order_release);
+    }
+    TraceEvent *event = &buffer->events[head & (buffer->capacity - 1)];
+    event->name = name;
+    event->start = start;
+    event->duration = duration;
+    event->phase = phase;
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+void gk_trace_set_enabled(bool enabled) {
+    atomic_store_explicit(&sEnabled, enabled, memory_order_relaxed);
+}
+
+bool gk_trace_is_enabled(void) {
+    return atomic_load_explicit(&sEnabled, memory_order_relaxed);
+}
+
+void gk_trace_set_buffer_capacity(size_t events) {
+    atomic_store_explicit(&sCapacity, roundUpToPowerOfTwo(events ? events : 1), memory_order_relaxed);
+}
+
+uint64_t gk_trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+uint64_t gk_trace_begin(void) {
+    return gk_trace_is_enabled() ? gk_trace_now_ns() : 0;
+}
+
+void gk_trace_end(const char *name, uint64_t begin) {
+    if (!begin || !gk_trace_is_enabled()) {
+        return;
+    }
+    uint64_t now = gk_trace_now_ns();
+    record(name, PHASE_COMPLETE, begin, now > begin ? now - begin : 0);
+}
+
+void gk_trace_instant(const char *name) {
+    if (gk_trace_is_enabled()) {
+        record(name, PHASE_INSTANT, gk_trace_now_ns(), 0);
+    }
+}
+
+void gk_trace_clear(void) {
+    atomic_fetch_add_explicit(&sEpoch, 1, memory_order_relaxed);
+}
+
+static void writeJsonString(FILE *file, const char *string) {
+    fputc('"', file);
+    for (const char *c = string ? string : ""; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void writeEvent(FILE *file, bool *first, const TraceEvent *event, uint64_t tid) {
+    fputs(*first ? "\n" : ",\n", file);
+    *first = false;
+    fputs("{\"name\":", file);
+    writeJsonString(file, event->name);
+    fprintf(file, ",\"cat\":\"gimkit\",\"ph\":\"%c\",\"ts\":%.3f", event->phase, event->start / 1000.0);
+    if (event->phase == PHASE_COMPLETE) {
+        fprintf(file, ",\"dur\":%.3f", event->duration / 1000.0);
+    } else {
+        fputs(",\"s\":\"t\"", file);
+    }
+    fprintf(file, ",\"pid\":1,\"tid\":%llu}", (unsigned long long) tid);
+}
+
+long gk_trace_export_chrome_json(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    long written = 0;
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    uint64_t epoch = atomic_load_explicit(&sEpoch, memory_order_relaxed);
+    TraceBuffer *buffer = atomic_load_explicit(&sBuffers, memory_order_acquire);
+    for (; buffer; buffer = buffer->next) {
+        if (atomic_load_explicit(&buffer->epoch, memory_order_acquire) != epoch) {
+            continue;
+        }
+        uint64_t base = atomic_load_explicit(&buffer->base, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        if (head <= base) {
+            continue;
+        }
+        uint64_t tail = head - base > buffer->capacity ? head - buffer->capacity : base;
+
+        if (buffer->threadName[0]) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":",
+                    first ? "\n" : ",\n", (unsigned long long) buffer->tid);
+            writeJsonString(file, buffer->threadName);
+            fputs("}}", file);
+            first = false;
+        }
+
+        for (uint64_t i = tail; i < head; i++) {
+            TraceEvent event = buffer->events[i & (buffer->capacity - 1)];
+            // the owner may have wrapped around while we were reading this slot
+            uint64_t now = atomic_load_explicit(&buffer->head, memory_order_acquire);
+            if (i + buffer->capacity <= now) {
+                continue;
+            }
+            writeEvent(file, &first, &event, buffer->tid);
+            written++;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    if (fclose(file) != 0) {
+        return -1;
+    }
+    return written;
+}
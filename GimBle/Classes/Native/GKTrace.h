@@ -0,0 +1,120 @@
+//
+// GKTrace.h
+// Lightweight scoped trace events, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+#if !defined __cplusplus && (!defined __STDC_VERSION__ || __STDC_VERSION__ < 199901L)
+#error "Please use a C99 compliant toolchain."
+#endif
+
+#ifndef GIMKIT_GKTRACE_H
+#define GIMKIT_GKTRACE_H
+
+#include <stdint.h> // for uint64_t, etc
+#include <stddef.h> // for size_t
+#include <stdbool.h> // for bool, true, false
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Names of the stage boundaries along the telemetry path. Any other string literal can be used, the
+ * name pointer is stored as is and must stay valid until the trace is exported.
+ */
+#define GK_TRACE_TRANSPORT      "transport"
+#define GK_TRACE_SLIP_DECODE    "sd_decode_frame"
+#define GK_TRACE_DISASSEMBLE    "disassembleMethod"
+#define GK_TRACE_BRIDGE         "GimKitMethodDecodedListener"
+#define GK_TRACE_OBSERVER       "GimKitDeviceObserver"
+
+/**
+ * Default number of events kept per thread, the oldest events are overwritten first. At 32 bytes per
+ * event this is 256KB per tracing thread, enough for 30 seconds of 50Hz telemetry through every stage.
+ */
+#define GK_TRACE_DEFAULT_CAPACITY 8192
+
+/***
+ * Enable or disable tracing at runtime. Tracing is disabled by default, in which case every record
+ * call returns after a single relaxed atomic load.
+ */
+void gk_trace_set_enabled(bool enabled);
+
+bool gk_trace_is_enabled(void);
+
+/***
+ * Set the number of events of the ring buffers allocated from now on. It is rounded up to a power of
+ * two. Buffers that already exist keep their capacity.
+ */
+void gk_trace_set_buffer_capacity(size_t events);
+
+/***
+ * Monotonic clock used by the trace events, in nanoseconds.
+ */
+uint64_t gk_trace_now_ns(void);
+
+/***
+ * Open a scope. Pass the returned value to #gk_trace_end().
+ *
+ * @return The start timestamp, or 0 if tracing is disabled.
+ */
+uint64_t gk_trace_begin(void);
+
+/***
+ * Close a scope opened by #gk_trace_begin() and record it as a complete event of the calling thread.
+ * Nothing is recorded if the scope was opened while tracing was disabled.
+ *
+ * @param name Static string naming the scope, e.g. #GK_TRACE_SLIP_DECODE.
+ * @param begin The value returned from #gk_trace_begin().
+ */
+void gk_trace_end(const char *name, uint64_t begin);
+
+/***
+ * Record an instant event of the calling thread.
+ */
+void gk_trace_instant(const char *name);
+
+/***
+ * Drop every recorded event, of every thread.
+ * <p/>
+ * Safe to call while other threads are tracing: the events they record from now on are kept.
+ */
+void gk_trace_clear(void);
+
+/***
+ * Write the recorded events of every thread as Chrome trace JSON.
+ * <p/>
+ * It is safe to export while other threads are still tracing; events overwritten during the export
+ * are left out, as is the oldest event of a full buffer, the next one its owner overwrites. Disable
+ * tracing first to get a consistent snapshot.
+ *
+ * @param path Destination file, it is overwritten.
+ * @return Number of events written, or -1 if the file can't be written.
+ */
+long gk_trace_export_chrome_json(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+typedef struct GKTraceScope {
+    const char *name;
+    uint64_t begin;
+} GKTraceScope;
+
+static inline void gk_trace_scope_end(GKTraceScope *scope) {
+    gk_trace_end(scope->name, scope->begin);
+}
+
+#define GK_TRACE_CONCAT_(a, b) a##b
+#define GK_TRACE_CONCAT(a, b) GK_TRACE_CONCAT_(a, b)
+
+/**
+ * Trace the rest of the enclosing block as one complete event, e.g. GK_TRACE_SCOPE(GK_TRACE_DISASSEMBLE);
+ */
+#define GK_TRACE_SCOPE(name) \
+    GKTraceScope GK_TRACE_CONCAT(gkTraceScope, __LINE__) __attribute__((cleanup(gk_trace_scope_end), unused)) = \
+        { (name), gk_trace_begin() }
+#endif
+
+#endif //GIMKIT_GKTRACE_H